@@ -26,6 +26,7 @@
 #include "DAInternal.h"
 #include "DAServer.h"
 #include "DASession.h"
+#include "DiskArbitrationPrivate.h"
 
 #include <paths.h>
 #include <mach/mach.h>
@@ -45,11 +46,12 @@ struct __DADisk
 
 typedef struct __DADisk __DADisk;
 
-static CFStringRef __DADiskCopyDescription( CFTypeRef object );
-static CFStringRef __DADiskCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
-static void        __DADiskDeallocate( CFTypeRef object );
-static Boolean     __DADiskEqual( CFTypeRef object1, CFTypeRef object2 );
-static CFHashCode  __DADiskHash( CFTypeRef object );
+static CFStringRef     __DADiskCopyDescription( CFTypeRef object );
+static CFDictionaryRef __DADiskCopyDescriptionCache( DADiskRef disk );
+static CFStringRef     __DADiskCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
+static void            __DADiskDeallocate( CFTypeRef object );
+static Boolean         __DADiskEqual( CFTypeRef object1, CFTypeRef object2 );
+static CFHashCode      __DADiskHash( CFTypeRef object );
 
 static const CFRuntimeClass __DADiskClass =
 {
@@ -66,9 +68,70 @@ static const CFRuntimeClass __DADiskClass =
 
 static CFTypeID __kDADiskTypeID = _kCFRuntimeNotATypeID;
 
-__private_extern__ mach_port_t _DASessionGetID( DASessionRef session );
+__private_extern__ void _DADiskSetDescription( DADiskRef disk, CFDictionaryRef description );
+
+__private_extern__ CFMutableDictionaryRef _DASessionGetDescriptionList( DASessionRef session );
+__private_extern__ CFMutableSetRef        _DASessionGetDescriptionTrust( DASessionRef session );
+__private_extern__ CFMutableDictionaryRef _DASessionGetDiskList( DASessionRef session );
+__private_extern__ mach_port_t            _DASessionGetID( DASessionRef session );
+__private_extern__ mach_port_t            _DASessionGetQueryID( DASessionRef session );
+__private_extern__ Boolean                _DASessionIsCurrent( DASessionRef session );
+__private_extern__ void                   _DASessionLockDescriptionList( DASessionRef session );
+__private_extern__ void                   _DASessionLockDiskList( DASessionRef session );
+__private_extern__ void                   _DASessionPerform( DASessionRef session, dispatch_block_t request, dispatch_block_t completion );
+__private_extern__ void                   _DASessionUnlockDescriptionList( DASessionRef session );
+__private_extern__ void                   _DASessionUnlockDiskList( DASessionRef session );
+__private_extern__ Boolean                _DASessionWatchDescriptionList( DASessionRef session );
 
 extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
+extern CFTypeRef  _CFTryRetain( CFTypeRef object );
+
+static CFDictionaryRef __DADiskCopyDescriptionCache( DADiskRef disk )
+{
+    /*
+     * Answer the description from our copy, provided the copy is trusted and no event that may
+     * change it is pending delivery.
+     */
+
+    CFMutableDictionaryRef description = NULL;
+
+    if ( _DASessionIsCurrent( disk->_session ) )
+    {
+        CFDataRef data;
+
+        data = CFDataCreate( kCFAllocatorDefault, ( void * ) disk->_id, strlen( disk->_id ) + 1 );
+
+        if ( data )
+        {
+            _DASessionLockDescriptionList( disk->_session );
+
+            if ( CFSetContainsValue( _DASessionGetDescriptionTrust( disk->_session ), data ) )
+            {
+                CFDictionaryRef current;
+
+                current = CFDictionaryGetValue( _DASessionGetDescriptionList( disk->_session ), data );
+
+                if ( current )
+                {
+                    description = CFDictionaryCreateMutableCopy( CFGetAllocator( disk ), 0, current );
+
+                    if ( description )
+                    {
+                        CFDictionaryRemoveValue( description, _kDADiskGenerationKey );
+
+                        CFDictionaryRemoveValue( description, _kDADiskIDKey );
+                    }
+                }
+            }
+
+            _DASessionUnlockDescriptionList( disk->_session );
+
+            CFRelease( data );
+        }
+    }
+
+    return description;
+}
 
 static CFStringRef __DADiskCopyDescription( CFTypeRef object )
 {
@@ -107,6 +170,26 @@ static void __DADiskDeallocate( CFTypeRef object )
 {
     DADiskRef disk = ( DADiskRef ) object;
 
+    if ( disk->_session )
+    {
+        CFMutableDictionaryRef diskList;
+
+        /*
+         * Withdraw the disk object from the session, unless another has taken its place already.
+         */
+
+        diskList = _DASessionGetDiskList( disk->_session );
+
+        _DASessionLockDiskList( disk->_session );
+
+        if ( CFDictionaryGetValue( diskList, disk->_id ) == disk )
+        {
+            CFDictionaryRemoveValue( diskList, disk->_id );
+        }
+
+        _DASessionUnlockDiskList( disk->_session );
+    }
+
     if ( disk->_description   )  CFRelease( disk->_description );
     if ( disk->_device        )  free( disk->_device );
     if ( disk->_id            )  free( disk->_id );
@@ -134,21 +217,56 @@ __private_extern__ DADiskRef _DADiskCreate( CFAllocatorRef allocator, DASessionR
 
     if ( session )
     {
-        disk = __DADiskCreate( allocator, session, id );
+        CFMutableDictionaryRef diskList;
+
+        /*
+         * Hand out the disk object the session holds for the disk, if any, so that a disk is
+         * represented by one object per session.  The session references its disk objects
+         * weakly; an object on its way to deallocation is displaced by a new one.
+         */
+
+        diskList = _DASessionGetDiskList( session );
+
+        _DASessionLockDiskList( session );
+
+        disk = ( void * ) CFDictionaryGetValue( diskList, id );
 
         if ( disk )
         {
-            if ( strncmp( id, _PATH_DEV, strlen( _PATH_DEV ) ) == 0 )
+            if ( CFGetAllocator( disk ) == ( allocator ? allocator : CFAllocatorGetDefault( ) ) )
+            {
+                disk = ( void * ) _CFTryRetain( disk );
+            }
+            else
+            {
+                disk = NULL;
+            }
+        }
+
+        if ( disk == NULL )
+        {
+            disk = __DADiskCreate( allocator, session, id );
+
+            if ( disk )
             {
-                disk->_device = strdup( id + strlen( _PATH_DEV ) );
+                if ( strncmp( id, _PATH_DEV, strlen( _PATH_DEV ) ) == 0 )
+                {
+                    disk->_device = strdup( id + strlen( _PATH_DEV ) );
+                }
+
+                CFDictionaryRemoveValue( diskList, disk->_id );
+
+                CFDictionaryAddValue( diskList, disk->_id, disk );
             }
         }
+
+        _DASessionUnlockDiskList( session );
     }
 
     return disk;
 }
 
-DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization )
+static DADiskRef __DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization, Boolean appeared )
 {
     DADiskRef disk = NULL;
 
@@ -176,9 +294,158 @@ DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef
 
                     if ( disk )
                     {
-                        CFDictionaryRemoveValue( description, _kDADiskIDKey );
+                        CFNumberRef            base;
+                        CFMutableDictionaryRef current = NULL;
+                        CFMutableDictionaryRef descriptionList;
+
+                        descriptionList = _DASessionGetDescriptionList( session );
+
+                        _DASessionLockDescriptionList( session );
+
+                        base = CFDictionaryGetValue( description, _kDADiskGenerationBaseKey );
+
+                        if ( base )
+                        {
+                            /*
+                             * The serialization is a delta against the generation we last received.  We
+                             * apply it to our copy of the description when our copy is at least as new as
+                             * the base, since the keys changed in between are all part of the delta, and
+                             * fetch the description in full otherwise.  A copy that is newer still, such
+                             * as after the daemon merged queued events, is left as is.
+                             */
+
+                            current = ( void * ) CFDictionaryGetValue( descriptionList, data );
+
+                            if ( current )
+                            {
+                                SInt64 generation;
+
+                                generation = ___CFDictionaryGetIntegerValue( current, _kDADiskGenerationKey );
+
+                                if ( generation >= ___CFNumberGetIntegerValue( base ) )
+                                {
+                                    CFArrayRef keys;
+
+                                    keys = NULL;
+
+                                    if ( generation < ___CFDictionaryGetIntegerValue( description, _kDADiskGenerationKey ) )
+                                    {
+                                        keys = CFDictionaryGetValue( description, _kDADiskGenerationDeltaKey );
+
+                                        CFDictionarySetValue( current, _kDADiskGenerationKey, CFDictionaryGetValue( description, _kDADiskGenerationKey ) );
+                                    }
+
+                                    if ( keys )
+                                    {
+                                        CFIndex count;
+                                        CFIndex index;
+
+                                        count = CFArrayGetCount( keys );
+
+                                        for ( index = 0; index < count; index++ )
+                                        {
+                                            CFTypeRef key;
+                                            CFTypeRef value;
+
+                                            key = CFArrayGetValueAtIndex( keys, index );
+
+                                            value = CFDictionaryGetValue( description, key );
+
+                                            if ( value )
+                                            {
+                                                CFDictionarySetValue( current, key, value );
+                                            }
+                                            else
+                                            {
+                                                CFDictionaryRemoveValue( current, key );
+                                            }
+                                        }
+                                    }
+
+                                    CFRetain( current );
+                                }
+                                else
+                                {
+                                    current = NULL;
+                                }
+                            }
+
+                            if ( current == NULL )
+                            {
+                                vm_address_t           _description;
+                                mach_msg_type_number_t _descriptionSize;
+                                kern_return_t          status;
+
+                                status = _DAServerDiskCopyDescription( _DASessionGetID( session ), ( void * ) id, &_description, &_descriptionSize );
 
-                        disk->_description = CFRetain( description );
+                                if ( status == KERN_SUCCESS )
+                                {
+                                    current = _DAUnserializeDiskDescriptionWithBytes( CFGetAllocator( session ), _description, _descriptionSize );
+
+                                    vm_deallocate( mach_task_self( ), _description, _descriptionSize );
+                                }
+
+                                if ( current )
+                                {
+                                    CFDictionarySetValue( descriptionList, data, current );
+                                }
+                                else
+                                {
+                                    CFDictionaryRemoveValue( descriptionList, data );
+
+                                    CFSetRemoveValue( _DASessionGetDescriptionTrust( session ), data );
+                                }
+                            }
+                        }
+                        else
+                        {
+                            /*
+                             * The serialization is the description in full.  We keep our copy should
+                             * it be newer, as a copy fetched from the server ahead of this event is,
+                             * unless the disk just appeared, in which case our copy may be that of an
+                             * earlier disk with the same identifier.
+                             */
+
+                            if ( appeared )
+                            {
+                                CFDictionaryRemoveValue( descriptionList, data );
+
+                                CFSetRemoveValue( _DASessionGetDescriptionTrust( session ), data );
+                            }
+
+                            current = ( void * ) CFDictionaryGetValue( descriptionList, data );
+
+                            if ( current == NULL || ___CFDictionaryGetIntegerValue( current, _kDADiskGenerationKey ) <= ___CFDictionaryGetIntegerValue( description, _kDADiskGenerationKey ) )
+                            {
+                                CFDictionarySetValue( descriptionList, data, description );
+
+                                current = description;
+                            }
+
+                            CFRetain( current );
+                        }
+
+                        _DASessionUnlockDescriptionList( session );
+
+                        if ( current )
+                        {
+                            CFMutableDictionaryRef copy;
+
+                            copy = CFDictionaryCreateMutableCopy( CFGetAllocator( disk ), 0, current );
+
+                            if ( copy )
+                            {
+                                CFDictionaryRemoveValue( copy, _kDADiskGenerationKey );
+
+                                CFDictionaryRemoveValue( copy, _kDADiskIDKey );
+
+                                _DADiskSetDescription( disk, copy );
+
+                                CFRelease( copy );
+                            }
+
+                            CFRelease( current );
+                        }
                     }
                 }
             }
@@ -190,6 +457,16 @@ DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef
     return disk;
 }
 
+__private_extern__ DADiskRef _DADiskCreateFromAppearance( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization )
+{
+    return __DADiskCreateFromSerialization( allocator, session, serialization, TRUE );
+}
+
+DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization )
+{
+    return __DADiskCreateFromSerialization( allocator, session, serialization, FALSE );
+}
+
 __private_extern__ char * _DADiskGetID( DADiskRef disk )
 {
     return disk->_id;
@@ -212,19 +489,29 @@ __private_extern__ void _DADiskInitialize( void )
 
 __private_extern__ void _DADiskSetDescription( DADiskRef disk, CFDictionaryRef description )
 {
-    if ( disk->_description )
-    {
-        CFRelease( disk->_description );
+    CFDictionaryRef previous;
 
-        disk->_description = NULL;
-    }
+    /*
+     * The disk object may be shared with other threads, since it is interned by the session.
+     */
 
     if ( description )
     {
         CFRetain( description );
+    }
+
+    _DASessionLockDiskList( disk->_session );
 
-        disk->_description = description;
-    }    
+    previous = disk->_description;
+
+    disk->_description = description;
+
+    _DASessionUnlockDiskList( disk->_session );
+
+    if ( previous )
+    {
+        CFRelease( previous );
+    }
 }
 
 CFDictionaryRef DADiskCopyDescription( DADiskRef disk )
@@ -235,27 +522,88 @@ CFDictionaryRef DADiskCopyDescription( DADiskRef disk )
 
     if ( disk )
     {
+        _DASessionLockDiskList( disk->_session );
+
         if ( disk->_description )
         {
             CFRetain( disk->_description );
 
             description = disk->_description;
         }
-        else
-        {
-            vm_address_t           _description;
-            mach_msg_type_number_t _descriptionSize;
-            kern_return_t          status;
 
-            status = _DAServerDiskCopyDescription( _DADiskGetSessionID( disk ), _DADiskGetID( disk ), &_description, &_descriptionSize );
+        _DASessionUnlockDiskList( disk->_session );
 
-            if ( status == KERN_SUCCESS )
+        if ( description == NULL )
+        {
+            description = __DADiskCopyDescriptionCache( disk );
+
+            if ( description == NULL )
             {
-                description = _DAUnserializeDiskDescriptionWithBytes( CFGetAllocator( disk ), _description, _descriptionSize );
+                vm_address_t           _description;
+                mach_msg_type_number_t _descriptionSize;
+                kern_return_t          status;
+                Boolean                watch;
+
+                /*
+                 * Watch for changes ahead of the fetch, so that no change made after the fetch
+                 * goes unseen by our copy.  A description we are to keep must be fetched behind
+                 * the watch, on the session port.  Otherwise we ask the server's query thread,
+                 * which answers from the last published serialization without waiting on the
+                 * server's main thread.
+                 */
+
+                watch = _DASessionWatchDescriptionList( disk->_session );
 
-                CFDictionaryRemoveValue( ( void * ) description, _kDADiskIDKey );
+                status = _DAServerDiskCopyDescription( watch ? _DADiskGetSessionID( disk ) : _DASessionGetQueryID( disk->_session ), _DADiskGetID( disk ), &_description, &_descriptionSize );
 
-                vm_deallocate( mach_task_self( ), _description, _descriptionSize );
+                if ( status == KERN_SUCCESS )
+                {
+                    description = _DAUnserializeDiskDescriptionWithBytes( CFGetAllocator( disk ), _description, _descriptionSize );
+
+                    vm_deallocate( mach_task_self( ), _description, _descriptionSize );
+                }
+
+                if ( description )
+                {
+                    if ( watch )
+                    {
+                        CFDataRef data;
+
+                        data = CFDictionaryGetValue( description, _kDADiskIDKey );
+
+                        if ( data )
+                        {
+                            CFMutableDictionaryRef current;
+                            CFMutableDictionaryRef descriptionList;
+
+                            descriptionList = _DASessionGetDescriptionList( disk->_session );
+
+                            _DASessionLockDescriptionList( disk->_session );
+
+                            current = ( void * ) CFDictionaryGetValue( descriptionList, data );
+
+                            if ( current == NULL || ___CFDictionaryGetIntegerValue( current, _kDADiskGenerationKey ) <= ___CFDictionaryGetIntegerValue( description, _kDADiskGenerationKey ) )
+                            {
+                                current = CFDictionaryCreateMutableCopy( CFGetAllocator( disk ), 0, description );
+
+                                if ( current )
+                                {
+                                    CFDictionarySetValue( descriptionList, data, current );
+
+                                    CFRelease( current );
+                                }
+                            }
+
+                            CFSetAddValue( _DASessionGetDescriptionTrust( disk->_session ), data );
+
+                            _DASessionUnlockDescriptionList( disk->_session );
+                        }
+                    }
+
+                    CFDictionaryRemoveValue( ( void * ) description, _kDADiskGenerationKey );
+
+                    CFDictionaryRemoveValue( ( void * ) description, _kDADiskIDKey );
+                }
             }
         }
     }
@@ -263,6 +611,28 @@ CFDictionaryRef DADiskCopyDescription( DADiskRef disk )
     return description;
 }
 
+void DADiskCopyDescriptionWithCallback( DADiskRef disk, DADiskCopyDescriptionCallback callback, void * context )
+{
+    if ( disk )
+    {
+        __block CFDictionaryRef description = NULL;
+
+        CFRetain( disk );
+
+        _DASessionPerform( disk->_session, ^
+        {
+            description = DADiskCopyDescription( disk );
+        }, ^
+        {
+            ( callback )( disk, description, context );
+
+            if ( description )  CFRelease( description );
+
+            CFRelease( disk );
+        } );
+    }
+}
+
 io_service_t DADiskCopyIOMedia( DADiskRef disk )
 {
     io_service_t media;
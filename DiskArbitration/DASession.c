@@ -26,32 +26,59 @@
 #include "DADisk.h"
 #include "DAInternal.h"
 #include "DAServer.h"
+#include "DiskArbitrationPrivate.h"
 
+#include <Block.h>
 #include <bootstrap_priv.h>
 #include <crt_externs.h>
 #include <libgen.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <dispatch/dispatch.h>
+#include <libkern/OSAtomic.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 #include <mach-o/dyld.h>
 #include <servers/bootstrap.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreFoundation/CFRuntime.h>
 #include <Security/Authorization.h>
 
-struct __DASession
+struct __DASessionCompletion
 {
-    CFRuntimeBase      _base;
+    dispatch_block_t               _block;
+    struct __DASessionCompletion * _next;
+};
 
-    AuthorizationRef   _authorization;
-    CFMachPortRef      _client;
-    char *             _name;
-    pid_t              _pid;
-    mach_port_t        _server;
-    CFRunLoopSourceRef _source;
-    dispatch_source_t  _source2;
-    UInt32             _sourceCount;
+typedef struct __DASessionCompletion __DASessionCompletion;
+
+struct __DASession
+{
+    CFRuntimeBase           _base;
+
+    AuthorizationRef        _authorization;
+    CFMachPortRef           _client;
+    __DASessionCompletion * _completionList;
+    pthread_mutex_t         _completionLock;
+    mach_port_t             _completionPort;
+    CFMutableDictionaryRef  _descriptionList;
+    pthread_mutex_t         _descriptionLock;
+    CFMutableSetRef         _descriptionTrust;
+    Boolean                 _descriptionWatch;
+    CFMutableDictionaryRef  _diskList;
+    pthread_mutex_t         _diskLock;
+    DACallbackLatency       _latency;
+    DALatencyCallback       _latencyCallback;
+    void *                  _latencyContext;
+    char *                  _name;
+    pid_t                   _pid;
+    mach_port_t             _query;
+    _DACallbackRing *       _ring;
+    mach_port_t             _server;
+    CFRunLoopSourceRef      _source;
+    dispatch_source_t       _source2;
+    UInt32                  _sourceCount;
+    CFMutableBagRef         _withdrawList;
 };
 
 typedef struct __DASession __DASession;
@@ -61,6 +88,17 @@ static CFStringRef __DASessionCopyFormattingDescription( CFTypeRef object, CFDic
 static void        __DASessionDeallocate( CFTypeRef object );
 static Boolean     __DASessionEqual( CFTypeRef object1, CFTypeRef object2 );
 static CFHashCode  __DASessionHash( CFTypeRef object );
+static void        __DASessionCallback( DASessionRef session, CFDictionaryRef callback );
+static void        __DASessionCallbackQueue( DASessionRef session, vm_address_t queue, vm_size_t queueSize );
+static void        __DASessionCallbackRing( DASessionRef session );
+static void        __DASessionCompletionPost( mach_port_t port );
+static void        __DASessionCompletionQueue( DASessionRef session );
+static void        __DASessionCompletionSetPort( DASessionRef session, mach_port_t port );
+static CFDataRef   __DASessionCreateWithdrawKey( void * address, void * context );
+static void        __DASessionDescriptionChangedCallback( DADiskRef disk, CFArrayRef keys, void * context );
+static void        __DASessionDisappearedCallback( DADiskRef disk, void * context );
+static Boolean     __DASessionDiskListKeyEqual( const void * value1, const void * value2 );
+static CFHashCode  __DASessionDiskListKeyHash( const void * value );
 
 static const CFRuntimeClass __DASessionClass =
 {
@@ -77,10 +115,24 @@ static const CFRuntimeClass __DASessionClass =
 
 static CFTypeID __kDASessionTypeID = _kCFRuntimeNotATypeID;
 
+static const CFDictionaryKeyCallBacks __kDASessionDiskListKeyCallBacks =
+{
+    0,
+    NULL,
+    NULL,
+    NULL,
+    __DASessionDiskListKeyEqual,
+    __DASessionDiskListKeyHash
+};
+
 static pthread_mutex_t __gDASessionSetAuthorizationLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __gDASessionWithdrawLock         = PTHREAD_MUTEX_INITIALIZER;
 
 const CFStringRef kDAApprovalRunLoopMode = CFSTR( "kDAApprovalRunLoopMode" );
 
+__private_extern__ char * _DADiskGetID( DADiskRef disk );
+__private_extern__ void   _DADiskSetDescription( DADiskRef disk, CFDictionaryRef description );
+
 __private_extern__ void _DADispatchCallback( DASessionRef    session,
                                              void *          address,
                                              void *          context,
@@ -90,6 +142,16 @@ __private_extern__ void _DADispatchCallback( DASessionRef    session,
 
 __private_extern__ void _DAInitialize( void );
 
+__private_extern__ void _DARegisterCallback( DASessionRef    session,
+                                             void *          address,
+                                             void *          context,
+                                             _DACallbackKind kind,
+                                             CFIndex         order,
+                                             CFDictionaryRef match,
+                                             CFArrayRef      watch );
+
+extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
+
 static CFStringRef __DASessionCopyDescription( CFTypeRef object )
 {
     DASessionRef session = ( DASessionRef ) object;
@@ -124,14 +186,36 @@ static DASessionRef __DASessionCreate( CFAllocatorRef allocator )
 
     if ( session )
     {
-        session->_authorization = NULL;
-        session->_client        = NULL;
-        session->_name          = NULL;
-        session->_pid           = 0;
-        session->_server        = MACH_PORT_NULL;
-        session->_source        = NULL;
-        session->_source2       = NULL;
-        session->_sourceCount   = 0;
+        session->_authorization    = NULL;
+        session->_client           = NULL;
+        session->_completionList   = NULL;
+        session->_completionPort   = MACH_PORT_NULL;
+        session->_descriptionList  = CFDictionaryCreateMutable( allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+        session->_descriptionTrust = CFSetCreateMutable( allocator, 0, &kCFTypeSetCallBacks );
+        session->_descriptionWatch = FALSE;
+        session->_diskList         = CFDictionaryCreateMutable( allocator, 0, &__kDASessionDiskListKeyCallBacks, NULL );
+        session->_latencyCallback  = NULL;
+        session->_latencyContext   = NULL;
+        session->_name             = NULL;
+        session->_pid              = 0;
+        session->_query            = MACH_PORT_NULL;
+        session->_ring             = NULL;
+        session->_server           = MACH_PORT_NULL;
+        session->_source           = NULL;
+        session->_source2          = NULL;
+        session->_sourceCount      = 0;
+        session->_withdrawList     = CFBagCreateMutable( allocator, 0, &kCFTypeBagCallBacks );
+
+        bzero( &session->_latency, sizeof( session->_latency ) );
+
+        pthread_mutex_init( &session->_completionLock,  NULL );
+        pthread_mutex_init( &session->_descriptionLock, NULL );
+        pthread_mutex_init( &session->_diskLock,        NULL );
+
+        assert( session->_descriptionList  );
+        assert( session->_descriptionTrust );
+        assert( session->_diskList         );
+        assert( session->_withdrawList     );
     }
 
     return session;
@@ -145,9 +229,32 @@ static void __DASessionDeallocate( CFTypeRef object )
     assert( session->_source  == NULL );
     assert( session->_source2 == NULL );
 
-    if ( session->_authorization )  AuthorizationFree( session->_authorization, kAuthorizationFlagDefaults );
-    if ( session->_name          )  free( session->_name );
-    if ( session->_server        )  mach_port_deallocate( mach_task_self( ), session->_server );
+    while ( session->_completionList )
+    {
+        __DASessionCompletion * completion;
+
+        completion = session->_completionList;
+
+        session->_completionList = completion->_next;
+
+        Block_release( completion->_block );
+
+        free( completion );
+    }
+
+    if ( session->_authorization    )  AuthorizationFree( session->_authorization, kAuthorizationFlagDefaults );
+    if ( session->_descriptionList  )  CFRelease( session->_descriptionList );
+    if ( session->_descriptionTrust )  CFRelease( session->_descriptionTrust );
+    if ( session->_diskList         )  CFRelease( session->_diskList );
+    if ( session->_name             )  free( session->_name );
+    if ( session->_query            )  mach_port_deallocate( mach_task_self( ), session->_query );
+    if ( session->_ring             )  vm_deallocate( mach_task_self( ), ( vm_address_t ) session->_ring, round_page( sizeof( _DACallbackRing ) ) );
+    if ( session->_server           )  mach_port_deallocate( mach_task_self( ), session->_server );
+    if ( session->_withdrawList     )  CFRelease( session->_withdrawList );
+
+    pthread_mutex_destroy( &session->_completionLock  );
+    pthread_mutex_destroy( &session->_descriptionLock );
+    pthread_mutex_destroy( &session->_diskLock        );
 }
 
 static Boolean __DASessionEqual( CFTypeRef object1, CFTypeRef object2 )
@@ -165,6 +272,301 @@ static CFHashCode __DASessionHash( CFTypeRef object )
     return ( CFHashCode ) session->_server;
 }
 
+static void __DASessionCallback( DASessionRef session, CFDictionaryRef callback )
+{
+    void *          address;
+    void *          context;
+    _DACallbackKind kind;
+
+    CFTypeRef argument0;
+    CFTypeRef argument1;
+
+    address = ( void * ) ( uintptr_t ) ___CFDictionaryGetIntegerValue( callback, _kDACallbackAddressKey );
+    context = ( void * ) ( uintptr_t ) ___CFDictionaryGetIntegerValue( callback, _kDACallbackContextKey );
+    kind    = ___CFDictionaryGetIntegerValue( callback, _kDACallbackKindKey );
+
+    argument0 = CFDictionaryGetValue( callback, _kDACallbackArgument0Key );
+    argument1 = CFDictionaryGetValue( callback, _kDACallbackArgument1Key );
+
+    if ( session->_ring )
+    {
+        Boolean   withdrawn = FALSE;
+        CFDataRef withdraw;
+
+        /*
+         * Skip the callbacks that reached the callback ring for a registration we have since
+         * withdrawn, up until the server acknowledges the withdrawal.
+         */
+
+        withdraw = __DASessionCreateWithdrawKey( address, context );
+
+        if ( withdraw )
+        {
+            pthread_mutex_lock( &__gDASessionWithdrawLock );
+
+            if ( CFBagContainsValue( session->_withdrawList, withdraw ) )
+            {
+                if ( kind == _kDAUnregisterCallback )
+                {
+                    CFBagRemoveValue( session->_withdrawList, withdraw );
+                }
+
+                withdrawn = TRUE;
+            }
+
+            pthread_mutex_unlock( &__gDASessionWithdrawLock );
+
+            CFRelease( withdraw );
+        }
+
+        if ( withdrawn )
+        {
+            return;
+        }
+    }
+
+    if ( kind != _kDAUnregisterCallback )
+    {
+        if ( session->_latencyCallback )
+        {
+            if ( CFDictionaryGetValue( callback, _kDACallbackLatencyKey ) )
+            {
+                DACallbackLatency latency;
+
+                latency = session->_latency;
+
+                latency.queued     = ___CFDictionaryGetIntegerValue( callback, _kDACallbackLatencyKey );
+                latency.dispatched = mach_absolute_time( );
+
+                ( session->_latencyCallback )( &latency, session->_latencyContext );
+            }
+        }
+
+        _DADispatchCallback( session, address, context, kind, argument0, argument1 );
+    }
+}
+
+static void __DASessionCallbackQueue( DASessionRef session, vm_address_t queue, vm_size_t queueSize )
+{
+    CFArrayRef callbacks;
+
+    session->_latency.unserializing = mach_absolute_time( );
+
+    callbacks = _DAUnserializeWithBytes( CFGetAllocator( session ), queue, queueSize );
+
+    session->_latency.unserialized = mach_absolute_time( );
+
+    if ( callbacks )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( callbacks );
+
+        for ( index = 0; index < count; index++ )
+        {
+            CFDictionaryRef callback;
+                
+            callback = CFArrayGetValueAtIndex( callbacks, index );
+
+            if ( callback )
+            {
+                __DASessionCallback( session, callback );
+            }
+        }
+
+        CFRelease( callbacks );
+    }
+}
+
+static void __DASessionCallbackRing( DASessionRef session )
+{
+    /*
+     * Drain the callback ring shared with the server.  We look at the head again once we have
+     * published the tail, since the server only wakes us when it finds the ring drained.
+     */
+
+    _DACallbackRing * ring;
+    UInt32            tail;
+
+    ring = session->_ring;
+
+    tail = ring->_tail;
+
+    for ( ; ; )
+    {
+        UInt32 head;
+
+        head = ring->_head;
+
+        OSMemoryBarrier( );
+
+        while ( tail != head )
+        {
+            UInt32 length;
+
+            if ( head - tail < sizeof( length ) || head - tail > _kDACallbackRingSize )
+            {
+                tail = head;
+
+                break;
+            }
+
+            _DACallbackRingRead( ring, tail, &length, sizeof( length ) );
+
+            if ( length > head - tail - sizeof( length ) )
+            {
+                tail = head;
+
+                break;
+            }
+
+            if ( length )
+            {
+                UInt8 * bytes;
+
+                bytes = malloc( length );
+
+                if ( bytes )
+                {
+                    CFDictionaryRef callback;
+
+                    _DACallbackRingRead( ring, tail + sizeof( length ), bytes, length );
+
+                    session->_latency.unserializing = mach_absolute_time( );
+
+                    callback = _DAUnserializeWithBytes( CFGetAllocator( session ), ( vm_address_t ) bytes, length );
+
+                    session->_latency.unserialized = mach_absolute_time( );
+
+                    free( bytes );
+
+                    if ( callback )
+                    {
+                        __DASessionCallback( session, callback );
+
+                        CFRelease( callback );
+                    }
+                }
+            }
+
+            tail += ( sizeof( length ) + length + 3 ) & ~3;
+        }
+
+        ring->_tail = tail;
+
+        OSMemoryBarrier( );
+
+        if ( ring->_head == tail )
+        {
+            break;
+        }
+    }
+}
+
+static void __DASessionCompletionPost( mach_port_t port )
+{
+    mach_msg_header_t message;
+
+    /*
+     * Wake the session's client port.  The port holds no more than one message; should one be
+     * queued already, the pending completions are handled along with it.
+     */
+
+    message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_MAKE_SEND, 0 );
+    message.msgh_id          = _kDAClientMessageComplete;
+    message.msgh_local_port  = MACH_PORT_NULL;
+    message.msgh_remote_port = port;
+    message.msgh_reserved    = 0;
+    message.msgh_size        = sizeof( message );
+
+    mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+}
+
+static void __DASessionCompletionQueue( DASessionRef session )
+{
+    __DASessionCompletion * completion;
+
+    /*
+     * Run the completions of the requests made off the session's run loop, in the order in which
+     * the requests finished.
+     */
+
+    pthread_mutex_lock( &session->_completionLock );
+
+    completion = session->_completionList;
+
+    session->_completionList = NULL;
+
+    pthread_mutex_unlock( &session->_completionLock );
+
+    while ( completion )
+    {
+        __DASessionCompletion * next;
+
+        next = completion->_next;
+
+        ( completion->_block )( );
+
+        Block_release( completion->_block );
+
+        free( completion );
+
+        completion = next;
+    }
+}
+
+static void __DASessionCompletionSetPort( DASessionRef session, mach_port_t port )
+{
+    pthread_mutex_lock( &session->_completionLock );
+
+    session->_completionPort = port;
+
+    if ( session->_completionPort )
+    {
+        if ( session->_completionList )
+        {
+            __DASessionCompletionPost( session->_completionPort );
+        }
+    }
+
+    pthread_mutex_unlock( &session->_completionLock );
+}
+
+static CFDataRef __DASessionCreateWithdrawKey( void * address, void * context )
+{
+    uintptr_t key[2];
+
+    key[0] = ( uintptr_t ) address;
+    key[1] = ( uintptr_t ) context;
+
+    return CFDataCreate( kCFAllocatorDefault, ( void * ) key, sizeof( key ) );
+}
+
+static void __DASessionDescriptionChangedCallback( DADiskRef disk, CFArrayRef keys, void * context )
+{
+    /*
+     * Our copies of disk descriptions are brought up to date before the callback is dispatched.
+     */
+}
+
+static void __DASessionDisappearedCallback( DADiskRef disk, void * context )
+{
+    /*
+     * Our copy of the disk description is forgotten when the callback is dispatched.
+     */
+}
+
+static Boolean __DASessionDiskListKeyEqual( const void * value1, const void * value2 )
+{
+    return ( strcmp( value1, value2 ) == 0 );
+}
+
+static CFHashCode __DASessionDiskListKeyHash( const void * value )
+{
+    return CFHashBytes( ( void * ) value, strlen( value ) );
+}
+
 __private_extern__ void _DASessionCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info )
 {
     vm_address_t           _queue;
@@ -172,47 +574,73 @@ __private_extern__ void _DASessionCallback( CFMachPortRef port, void * message,
     DASessionRef           session = info;
     kern_return_t          status;
 
-    status = _DAServerSessionCopyCallbackQueue( session->_server, &_queue, &_queueSize );
+    __DASessionCompletionQueue( session );
 
-    if ( status == KERN_SUCCESS )
+    if ( message )
+    {
+        _DAClientMessage * _message = message;
+
+        if ( _message->_header.msgh_id == _kDAClientMessageComplete )
+        {
+            return;
+        }
+    }
+
+    session->_latency.woken    = mach_absolute_time( );
+    session->_latency.fetched  = 0;
+    session->_latency.received = 0;
+
+    if ( session->_ring )
     {
-        CFArrayRef queue;
+        __DASessionCallbackRing( session );
 
-        queue = _DAUnserializeWithBytes( CFGetAllocator( session ), _queue, _queueSize );
+        /*
+         * Fetch the callback queue only if the server had to fall back to it.
+         */
 
-        if ( queue )
+        if ( session->_ring->_queued == FALSE )
         {
-            CFIndex count;
-            CFIndex index;
+            return;
+        }
+    }
 
-            count = CFArrayGetCount( queue );
+    if ( message )
+    {
+        _DAClientMessage * _message = message;
 
-            for ( index = 0; index < count; index++ )
-            {
-                CFDictionaryRef callback;
-                
-                callback = CFArrayGetValueAtIndex( queue, index );
+        if ( _message->_header.msgh_id == _kDAClientMessageQueue )
+        {
+            /*
+             * The server sent the callback queue within the message itself.
+             */
 
-                if ( callback )
+            if ( ( _message->_header.msgh_bits & MACH_MSGH_BITS_COMPLEX ) && _message->_header.msgh_size >= sizeof( _DAClientMessage ) )
+            {
+                if ( _message->_body.msgh_descriptor_count == 1 && _message->_queue.type == MACH_MSG_OOL_DESCRIPTOR )
                 {
-                    void * address;
-                    void * context;
+                    __DASessionCallbackQueue( session, ( vm_address_t ) _message->_queue.address, _message->_queue.size );
 
-                    CFTypeRef argument0;
-                    CFTypeRef argument1;
+                    vm_deallocate( mach_task_self( ), ( vm_address_t ) _message->_queue.address, _message->_queue.size );
 
-                    address = ( void * ) ( uintptr_t ) ___CFDictionaryGetIntegerValue( callback, _kDACallbackAddressKey );
-                    context = ( void * ) ( uintptr_t ) ___CFDictionaryGetIntegerValue( callback, _kDACallbackContextKey );
-
-                    argument0 = CFDictionaryGetValue( callback, _kDACallbackArgument0Key );
-                    argument1 = CFDictionaryGetValue( callback, _kDACallbackArgument1Key );
-                    
-                    _DADispatchCallback( session, address, context, ___CFDictionaryGetIntegerValue( callback, _kDACallbackKindKey ), argument0, argument1 );
+                    return;
                 }
             }
 
-            CFRelease( queue );
+            mach_msg_destroy( &_message->_header );
+
+            return;
         }
+    }
+
+    session->_latency.fetched = mach_absolute_time( );
+
+    status = _DAServerSessionCopyCallbackQueue( session->_server, &_queue, &_queueSize );
+
+    session->_latency.received = mach_absolute_time( );
+
+    if ( status == KERN_SUCCESS )
+    {
+        __DASessionCallbackQueue( session, _queue, _queueSize );
 
         vm_deallocate( mach_task_self( ), _queue, _queueSize );
     }
@@ -284,6 +712,21 @@ __private_extern__ mach_port_t _DASessionGetClientPort( DASessionRef session )
 
 #endif /* !__LP64__ */
 
+__private_extern__ CFMutableDictionaryRef _DASessionGetDescriptionList( DASessionRef session )
+{
+    return session->_descriptionList;
+}
+
+__private_extern__ CFMutableSetRef _DASessionGetDescriptionTrust( DASessionRef session )
+{
+    return session->_descriptionTrust;
+}
+
+__private_extern__ CFMutableDictionaryRef _DASessionGetDiskList( DASessionRef session )
+{
+    return session->_diskList;
+}
+
 __private_extern__ mach_port_t _DASessionGetID( DASessionRef session )
 {
     return session->_server;
@@ -294,7 +737,135 @@ __private_extern__ void _DASessionInitialize( void )
     __kDASessionTypeID = _CFRuntimeRegisterClass( &__DASessionClass );
 }
 
-__private_extern__ void _DASessionScheduleWithRunLoop( DASessionRef session )
+__private_extern__ mach_port_t _DASessionGetQueryID( DASessionRef session )
+{
+    mach_port_t query;
+
+    /*
+     * Obtain the port on which the server answers read-only queries away from its main thread,
+     * or fall back to the session port should there be none.
+     */
+
+    pthread_mutex_lock( &session->_descriptionLock );
+
+    if ( session->_query == MACH_PORT_NULL )
+    {
+        if ( _DAServerSessionCopyQueryPort( session->_server, &query ) == KERN_SUCCESS )
+        {
+            session->_query = query;
+        }
+    }
+
+    query = session->_query ? session->_query : session->_server;
+
+    pthread_mutex_unlock( &session->_descriptionLock );
+
+    return query;
+}
+
+__private_extern__ Boolean _DASessionIsCurrent( DASessionRef session )
+{
+    /*
+     * Determine whether the session has handled every callback sent to it, in which case our
+     * copies of the disk descriptions are as current as the callbacks have made them.
+     */
+
+    mach_port_t client = MACH_PORT_NULL;
+
+    if ( session->_client )
+    {
+        client = CFMachPortGetPort( session->_client );
+    }
+    else if ( session->_source2 )
+    {
+        client = ( mach_port_t ) dispatch_source_get_handle( session->_source2 );
+    }
+
+    if ( client )
+    {
+        mach_port_status_t     status;
+        mach_msg_type_number_t statusCount;
+
+        if ( session->_ring )
+        {
+            if ( session->_ring->_head != session->_ring->_tail || session->_ring->_queued )
+            {
+                return FALSE;
+            }
+        }
+
+        statusCount = MACH_PORT_RECEIVE_STATUS_COUNT;
+
+        if ( mach_port_get_attributes( mach_task_self( ), client, MACH_PORT_RECEIVE_STATUS, ( mach_port_info_t ) &status, &statusCount ) == KERN_SUCCESS )
+        {
+            return status.mps_msgcount ? FALSE : TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+__private_extern__ void _DASessionLockDescriptionList( DASessionRef session )
+{
+    pthread_mutex_lock( &session->_descriptionLock );
+}
+
+__private_extern__ void _DASessionLockDiskList( DASessionRef session )
+{
+    pthread_mutex_lock( &session->_diskLock );
+}
+
+__private_extern__ void _DASessionPerform( DASessionRef session, dispatch_block_t request, dispatch_block_t completion )
+{
+    /*
+     * Perform the request away from the caller, then complete it on the session's run loop or
+     * dispatch queue.  Any number of requests may be outstanding at a time.
+     */
+
+    CFRetain( session );
+
+    dispatch_async( dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 ), ^
+    {
+        __DASessionCompletion * entry;
+
+        ( request )( );
+
+        entry = malloc( sizeof( __DASessionCompletion ) );
+
+        if ( entry )
+        {
+            __DASessionCompletion ** next;
+
+            entry->_block = Block_copy( completion );
+            entry->_next  = NULL;
+
+            pthread_mutex_lock( &session->_completionLock );
+
+            next = &session->_completionList;
+
+            while ( *next )
+            {
+                next = &( *next )->_next;
+            }
+
+            *next = entry;
+
+            if ( session->_completionList == entry )
+            {
+                if ( session->_completionPort )
+                {
+                    __DASessionCompletionPost( session->_completionPort );
+                }
+            }
+
+            pthread_mutex_unlock( &session->_completionLock );
+        }
+
+        CFRelease( session );
+    } );
+}
+
+__private_extern__ void _DASessionScheduleWithRunLoop( DASessionRef session, _DAClientPortOptions options )
 {
     session->_sourceCount++;
 
@@ -353,7 +924,14 @@ __private_extern__ void _DASessionScheduleWithRunLoop( DASessionRef session )
                         session->_client = client;
                         session->_source = source;
 
-                        _DAServerSessionSetClientPort( session->_server, CFMachPortGetPort( client ) );
+                        if ( session->_latencyCallback )
+                        {
+                            options |= _kDAClientPortOptionLatency;
+                        }
+
+                        _DAServerSessionSetClientPortWithOptions( session->_server, CFMachPortGetPort( client ), options );
+
+                        __DASessionCompletionSetPort( session, CFMachPortGetPort( client ) );
 
                         return;
                     }
@@ -369,6 +947,16 @@ __private_extern__ void _DASessionScheduleWithRunLoop( DASessionRef session )
     }
 }
 
+__private_extern__ void _DASessionUnlockDescriptionList( DASessionRef session )
+{
+    pthread_mutex_unlock( &session->_descriptionLock );
+}
+
+__private_extern__ void _DASessionUnlockDiskList( DASessionRef session )
+{
+    pthread_mutex_unlock( &session->_diskLock );
+}
+
 __private_extern__ void _DASessionUnscheduleFromRunLoop( DASessionRef session )
 {
     if ( session->_sourceCount == 1 )
@@ -386,6 +974,8 @@ __private_extern__ void _DASessionUnscheduleFromRunLoop( DASessionRef session )
         {
             mach_port_t clientPort;
 
+            __DASessionCompletionSetPort( session, MACH_PORT_NULL );
+
             clientPort = CFMachPortGetPort( session->_client );
 
             CFMachPortInvalidate( session->_client );
@@ -404,6 +994,63 @@ __private_extern__ void _DASessionUnscheduleFromRunLoop( DASessionRef session )
     }
 }
 
+__private_extern__ Boolean _DASessionWatchDescriptionList( DASessionRef session )
+{
+    /*
+     * Have the server send us every description change and every disappearance once the session
+     * is scheduled, so that our copies of the disk descriptions are kept current.  A copy taken
+     * from the server thereafter can be trusted, since the server handles our requests in order.
+     */
+
+    Boolean watch;
+
+    pthread_mutex_lock( &session->_descriptionLock );
+
+    if ( session->_descriptionWatch == FALSE )
+    {
+        if ( session->_client || session->_source2 )
+        {
+            _DARegisterCallback( session, __DASessionDescriptionChangedCallback, NULL, _kDADiskDescriptionChangedCallback, 0, NULL, NULL );
+
+            _DARegisterCallback( session, __DASessionDisappearedCallback, NULL, _kDADiskDisappearedCallback, 0, NULL, NULL );
+
+            session->_descriptionWatch = TRUE;
+        }
+    }
+
+    watch = session->_descriptionWatch;
+
+    pthread_mutex_unlock( &session->_descriptionLock );
+
+    return watch;
+}
+
+__private_extern__ void _DASessionWithdrawCallback( DASessionRef session, void * address, void * context )
+{
+    /*
+     * Note a registration we are about to withdraw, since the callbacks that reached the callback
+     * ring for it can no longer be taken back by the server.
+     */
+
+    if ( session->_ring )
+    {
+        CFDataRef withdraw;
+
+        withdraw = __DASessionCreateWithdrawKey( address, context );
+
+        if ( withdraw )
+        {
+            pthread_mutex_lock( &__gDASessionWithdrawLock );
+
+            CFBagAddValue( session->_withdrawList, withdraw );
+
+            pthread_mutex_unlock( &__gDASessionWithdrawLock );
+
+            CFRelease( withdraw );
+        }
+    }
+}
+
 DAApprovalSessionRef DAApprovalSessionCreate( CFAllocatorRef allocator )
 {
     return DASessionCreate( allocator );
@@ -428,6 +1075,129 @@ void DAApprovalSessionUnscheduleFromRunLoop( DAApprovalSessionRef session, CFRun
     DASessionUnscheduleFromRunLoop( session, runLoop, runLoopMode );
 }
 
+CFDictionaryRef DASessionCopyDiskSnapshot( DASessionRef session, CFDictionaryRef match )
+{
+    CFMutableDictionaryRef snapshot = NULL;
+
+    if ( session )
+    {
+        CFDataRef              _match = NULL;
+        vm_address_t           _disks;
+        mach_msg_type_number_t _disksSize;
+        kern_return_t          status;
+        Boolean                watch;
+
+        if ( match )  _match = _DASerializeDiskDescription( kCFAllocatorDefault, match );
+
+        /*
+         * Watch for changes ahead of the fetch, as for DADiskCopyDescription(), so that the
+         * descriptions we obtain can answer later queries locally.
+         */
+
+        watch = _DASessionWatchDescriptionList( session );
+
+        status = _DAServerSessionCopyDiskList( session->_server,
+                                               ( vm_address_t           ) ( _match ? CFDataGetBytePtr( _match ) : 0 ),
+                                               ( mach_msg_type_number_t ) ( _match ? CFDataGetLength(  _match ) : 0 ),
+                                               &_disks,
+                                               &_disksSize );
+
+        if ( status == KERN_SUCCESS )
+        {
+            CFArrayRef disks;
+
+            disks = _DAUnserializeWithBytes( CFGetAllocator( session ), _disks, _disksSize );
+
+            if ( disks )
+            {
+                snapshot = CFDictionaryCreateMutable( CFGetAllocator( session ), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                if ( snapshot )
+                {
+                    CFIndex count;
+                    CFIndex index;
+
+                    count = CFArrayGetCount( disks );
+
+                    for ( index = 0; index < count; index++ )
+                    {
+                        DADiskRef disk;
+
+                        disk = _DADiskCreateFromSerialization( CFGetAllocator( session ), session, CFArrayGetValueAtIndex( disks, index ) );
+
+                        if ( disk )
+                        {
+                            CFDictionaryRef description;
+
+                            description = DADiskCopyDescription( disk );
+
+                            _DADiskSetDescription( disk, NULL );
+
+                            if ( description )
+                            {
+                                CFDictionarySetValue( snapshot, disk, description );
+
+                                if ( watch )
+                                {
+                                    CFDataRef data;
+
+                                    data = CFDataCreate( kCFAllocatorDefault, ( void * ) _DADiskGetID( disk ), strlen( _DADiskGetID( disk ) ) + 1 );
+
+                                    if ( data )
+                                    {
+                                        pthread_mutex_lock( &session->_descriptionLock );
+
+                                        CFSetAddValue( session->_descriptionTrust, data );
+
+                                        pthread_mutex_unlock( &session->_descriptionLock );
+
+                                        CFRelease( data );
+                                    }
+                                }
+
+                                CFRelease( description );
+                            }
+
+                            CFRelease( disk );
+                        }
+                    }
+                }
+
+                CFRelease( disks );
+            }
+
+            vm_deallocate( mach_task_self( ), _disks, _disksSize );
+        }
+
+        if ( _match )  CFRelease( _match );
+    }
+
+    return snapshot;
+}
+
+CFDictionaryRef DASessionCopyStatistics( DASessionRef session )
+{
+    CFDictionaryRef statistics = NULL;
+
+    if ( session )
+    {
+        vm_address_t           _statistics;
+        mach_msg_type_number_t _statisticsSize;
+        kern_return_t          status;
+
+        status = _DAServerSessionCopyStatistics( session->_server, &_statistics, &_statisticsSize );
+
+        if ( status == KERN_SUCCESS )
+        {
+            statistics = _DAUnserializeWithBytes( CFGetAllocator( session ), _statistics, _statisticsSize );
+
+            vm_deallocate( mach_task_self( ), _statistics, _statisticsSize );
+        }
+    }
+
+    return statistics;
+}
+
 DASessionRef DASessionCreate( CFAllocatorRef allocator )
 {
     DASessionRef session;
@@ -484,10 +1254,47 @@ DASessionRef DASessionCreate( CFAllocatorRef allocator )
 
                 if ( status == KERN_SUCCESS )
                 {
+                    mach_port_t ring;
+
                     session->_name   = strdup( basename( ( char * ) _dyld_get_image_name( 0 ) ) );
                     session->_pid    = getpid( );
                     session->_server = server;
 
+                    /*
+                     * Map the callback ring shared with the server, if there is one.  We fall
+                     * back to fetching the callback queue otherwise.
+                     */
+
+                    status = _DAServerSessionCopyCallbackRing( server, &ring );
+
+                    if ( status == KERN_SUCCESS )
+                    {
+                        vm_address_t address;
+
+                        address = 0;
+
+                        status = vm_map( mach_task_self( ),
+                                         &address,
+                                         round_page( sizeof( _DACallbackRing ) ),
+                                         0,
+                                         VM_FLAGS_ANYWHERE,
+                                         ring,
+                                         0,
+                                         FALSE,
+                                         VM_PROT_READ | VM_PROT_WRITE,
+                                         VM_PROT_READ | VM_PROT_WRITE,
+                                         VM_INHERIT_NONE );
+
+                        if ( status == KERN_SUCCESS )
+                        {
+                            session->_ring = ( void * ) address;
+
+                            session->_ring->_mapped = TRUE;
+                        }
+
+                        mach_port_deallocate( mach_task_self( ), ring );
+                    }
+
 ///w:start
 if ( strcmp( session->_name, "SystemUIServer" ) == 0 )
 {
@@ -514,7 +1321,7 @@ void DASessionScheduleWithRunLoop( DASessionRef session, CFRunLoopRef runLoop, C
 {
     if ( session )
     {
-        _DASessionScheduleWithRunLoop( session );
+        _DASessionScheduleWithRunLoop( session, _kDAClientPortOptionMessage );
 
         if ( session->_source )
         {
@@ -529,6 +1336,8 @@ void DASessionSetDispatchQueue( DASessionRef session, dispatch_queue_t queue )
     {
         if ( session->_source2 )
         {
+            __DASessionCompletionSetPort( session, MACH_PORT_NULL );
+
             dispatch_source_cancel( session->_source2 );
 
             dispatch_release( session->_source2 );
@@ -538,8 +1347,9 @@ void DASessionSetDispatchQueue( DASessionRef session, dispatch_queue_t queue )
 
         if ( queue )
         {
-            mach_port_t   client;
-            kern_return_t status;
+            mach_port_t          client;
+            _DAClientPortOptions options;
+            kern_return_t        status;
 
             /*
              * Create the session's client port.
@@ -588,16 +1398,38 @@ void DASessionSetDispatchQueue( DASessionRef session, dispatch_queue_t queue )
 
                         dispatch_source_set_event_handler( session->_source2, ^
                         {
-                            mach_msg_empty_rcv_t message;
-
-                            mach_msg( ( void * ) &message, MACH_RCV_MSG | MACH_RCV_TIMEOUT, 0, sizeof( message ), client, 0, MACH_PORT_NULL );
-
-                            _DASessionCallback( NULL, NULL, 0, session );
+                            struct
+                            {
+                                _DAClientMessage   _message;
+                                mach_msg_trailer_t _trailer;
+                            } message;
+
+                            kern_return_t status;
+
+                            status = mach_msg( ( void * ) &message, MACH_RCV_MSG | MACH_RCV_TIMEOUT, 0, sizeof( message ), client, 0, MACH_PORT_NULL );
+
+                            if ( status == MACH_MSG_SUCCESS )
+                            {
+                                _DASessionCallback( NULL, &message, message._message._header.msgh_size, session );
+                            }
+                            else
+                            {
+                                _DASessionCallback( NULL, NULL, 0, session );
+                            }
                         } );
 
                         dispatch_resume( session->_source2 );
 
-                        _DAServerSessionSetClientPort( session->_server, client );
+                        options = _kDAClientPortOptionMessage;
+
+                        if ( session->_latencyCallback )
+                        {
+                            options |= _kDAClientPortOptionLatency;
+                        }
+
+                        _DAServerSessionSetClientPortWithOptions( session->_server, client, options );
+
+                        __DASessionCompletionSetPort( session, client );
 
                         return;
                     }
@@ -609,6 +1441,26 @@ void DASessionSetDispatchQueue( DASessionRef session, dispatch_queue_t queue )
     }
 }
 
+void DASessionSetLatencyCallback( DASessionRef session, DALatencyCallback callback, void * context )
+{
+    if ( session )
+    {
+        session->_latencyCallback = callback;
+        session->_latencyContext  = context;
+    }
+}
+
+void DASessionSetResponseTimeout( DASessionRef session, CFTimeInterval timeout )
+{
+    if ( session )
+    {
+        if ( timeout >= 0 )
+        {
+            _DAServerSessionSetResponseTimeout( session->_server, ( timeout < INT32_MAX / 1000 ) ? ( int32_t ) ( timeout * 1000 ) : INT32_MAX );
+        }
+    }
+}
+
 void DASessionUnscheduleFromRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode )
 {
     if ( session )
@@ -40,14 +40,21 @@ CFDictionaryRef kDADiskDescriptionMatchVolumeUnrecognized = NULL;
 CFArrayRef kDADiskDescriptionWatchVolumeName = NULL;
 CFArrayRef kDADiskDescriptionWatchVolumePath = NULL;
 
+__private_extern__ DADiskRef   _DADiskCreateFromAppearance( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization );
 __private_extern__ char *      _DADiskGetID( DADiskRef disk );
 __private_extern__ mach_port_t _DADiskGetSessionID( DADiskRef disk );
 __private_extern__ void        _DADiskInitialize( void );
 __private_extern__ void        _DADiskSetDescription( DADiskRef disk, CFDictionaryRef description );
 
-__private_extern__ AuthorizationRef _DASessionGetAuthorization( DASessionRef session );
-__private_extern__ mach_port_t      _DASessionGetID( DASessionRef session );
-__private_extern__ void             _DASessionInitialize( void );
+__private_extern__ AuthorizationRef       _DASessionGetAuthorization( DASessionRef session );
+__private_extern__ CFMutableDictionaryRef _DASessionGetDescriptionList( DASessionRef session );
+__private_extern__ CFMutableSetRef        _DASessionGetDescriptionTrust( DASessionRef session );
+__private_extern__ mach_port_t            _DASessionGetID( DASessionRef session );
+__private_extern__ void                   _DASessionInitialize( void );
+__private_extern__ void                   _DASessionLockDescriptionList( DASessionRef session );
+__private_extern__ void                   _DASessionPerform( DASessionRef session, dispatch_block_t request, dispatch_block_t completion );
+__private_extern__ void                   _DASessionUnlockDescriptionList( DASessionRef session );
+__private_extern__ void                   _DASessionWithdrawCallback( DASessionRef session, void * address, void * context );
 
 static void __DAInitialize( void )
 {
@@ -328,7 +335,14 @@ __private_extern__ void _DADispatchCallback( DASessionRef    session,
     
     if ( argument0 )
     {
-        disk = _DADiskCreateFromSerialization( CFGetAllocator( session ), session, argument0 );
+        if ( kind == _kDADiskAppearedCallback )
+        {
+            disk = _DADiskCreateFromAppearance( CFGetAllocator( session ), session, argument0 );
+        }
+        else
+        {
+            disk = _DADiskCreateFromSerialization( CFGetAllocator( session ), session, argument0 );
+        }
     }
 
     switch ( kind )
@@ -363,6 +377,30 @@ __private_extern__ void _DADispatchCallback( DASessionRef    session,
         {
             ( ( DADiskDisappearedCallback ) address )( disk, context );
 
+            if ( disk )
+            {
+                CFDataRef data;
+
+                /*
+                 * Forget our copy of the description, against which subsequent deltas would apply.
+                 */
+
+                data = CFDataCreate( kCFAllocatorDefault, ( void * ) _DADiskGetID( disk ), strlen( _DADiskGetID( disk ) ) + 1 );
+
+                if ( data )
+                {
+                    _DASessionLockDescriptionList( session );
+
+                    CFDictionaryRemoveValue( _DASessionGetDescriptionList( session ), data );
+
+                    CFSetRemoveValue( _DASessionGetDescriptionTrust( session ), data );
+
+                    _DASessionUnlockDescriptionList( session );
+
+                    CFRelease( data );
+                }
+            }
+
             break;
         }
         case _kDADiskEjectCallback:
@@ -425,6 +463,23 @@ __private_extern__ void _DADispatchCallback( DASessionRef    session,
         {
             ( ( DAIdleCallback ) address )( context );
 
+            break;
+        }
+        case _kDAQueueOverflowCallback:
+        {
+            /*
+             * The server dropped description changes meant for us, so forget our copies of the
+             * descriptions, against which they would have applied.  They are fetched anew.
+             */
+
+            _DASessionLockDescriptionList( session );
+
+            CFDictionaryRemoveAllValues( _DASessionGetDescriptionList( session ) );
+
+            CFSetRemoveAllValues( _DASessionGetDescriptionTrust( session ) );
+
+            _DASessionUnlockDescriptionList( session );
+
             break;
         }
     }
@@ -498,6 +553,8 @@ __private_extern__ void _DAUnregisterCallback( DASessionRef session, void * addr
 {
     if ( session )
     {
+        _DASessionWithdrawCallback( session, address, context );
+
         _DAServerSessionUnregisterCallback( _DASessionGetID( session ), ( uintptr_t ) address, ( uintptr_t ) context );
     }
 }
@@ -586,6 +643,26 @@ DADiskOptions DADiskGetOptions( DADiskRef disk )
     return options;
 }
 
+void DADiskGetOptionsWithCallback( DADiskRef disk, DADiskGetOptionsCallback callback, void * context )
+{
+    if ( disk )
+    {
+        __block DADiskOptions options = kDADiskOptionDefault;
+
+        CFRetain( disk );
+
+        _DASessionPerform( _DADiskGetSession( disk ), ^
+        {
+            options = DADiskGetOptions( disk );
+        }, ^
+        {
+            ( callback )( disk, options, context );
+
+            CFRelease( disk );
+        } );
+    }
+}
+
 Boolean DADiskIsClaimed( DADiskRef disk )
 {
     boolean_t claimed;
@@ -600,6 +677,26 @@ Boolean DADiskIsClaimed( DADiskRef disk )
     return claimed;
 }
 
+void DADiskIsClaimedWithCallback( DADiskRef disk, DADiskIsClaimedCallback callback, void * context )
+{
+    if ( disk )
+    {
+        __block Boolean claimed = FALSE;
+
+        CFRetain( disk );
+
+        _DASessionPerform( _DADiskGetSession( disk ), ^
+        {
+            claimed = DADiskIsClaimed( disk );
+        }, ^
+        {
+            ( callback )( disk, claimed, context );
+
+            CFRelease( disk );
+        } );
+    }
+}
+
 void DADiskMount( DADiskRef disk, CFURLRef path, DADiskMountOptions options, DADiskMountCallback callback, void * context )
 {
     DADiskMountWithArguments( disk, path, options, callback, context, NULL );
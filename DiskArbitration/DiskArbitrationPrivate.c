@@ -38,23 +38,32 @@
 #include <IOKit/storage/IOBDMedia.h>
 #include <IOKit/storage/IOCDMedia.h>
 #include <IOKit/storage/IODVDMedia.h>
+
+#define __kDiskArbCallbackListCount ( kDA_DISK_APPEARED_COMPLETE + 1 )
+
 ///w:start
 static kern_return_t          __gDiskArbStatus                      = KERN_SUCCESS;
 static Boolean                __gDiskArbStatusLock                  = FALSE;
 ///w:stop
 
 static int                    __gDiskArbAck                         = 0;
-static CFMutableDictionaryRef __gDiskArbCallbackList                = NULL;
 static CFMutableSetRef        __gDiskArbEjectList                   = NULL;
 static int                    __gDiskArbHandlesUnrecognized         = 0;
 static int                    __gDiskArbHandlesUnrecognizedPriority = 0;
 static int                    __gDiskArbHandlesUnrecognizedTypes    = 0;
+static struct statfs *        __gDiskArbMountList                   = NULL;
+static CFMutableDictionaryRef __gDiskArbMountListDiskIndex          = NULL;
+static CFMutableDictionaryRef __gDiskArbMountListNameIndex          = NULL;
+static Boolean                __gDiskArbMountListValid              = FALSE;
+static Boolean                __gDiskArbMountListWatch              = FALSE;
 static int                    __gDiskArbNotificationComplete        = 0;
 static CFMutableArrayRef      __gDiskArbRegisterList                = NULL;
 static CFMutableSetRef        __gDiskArbReservationList             = NULL;
 static DASessionRef           __gDiskArbSession                     = NULL;
 static CFMutableSetRef        __gDiskArbUnmountList                 = NULL;
 
+static CFMutableArrayRef __gDiskArbCallbackList[ __kDiskArbCallbackListCount ] = { NULL };
+
 #endif /* !__LP64__ */
 
 __private_extern__ DAReturn _DAAuthorize( DASessionRef session, _DAAuthorizeOptions options, DADiskRef disk, const char * right );
@@ -70,361 +79,293 @@ __private_extern__ void _DARegisterCallback( DASessionRef    session,
                                              CFDictionaryRef match,
                                              CFArrayRef      watch );
 
+__private_extern__ void _DASessionPerform( DASessionRef session, dispatch_block_t request, dispatch_block_t completion );
+
 #ifndef __LP64__
 
 __private_extern__ void             _DASessionCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info );
 __private_extern__ AuthorizationRef _DASessionGetAuthorization( DASessionRef session );
 __private_extern__ mach_port_t      _DASessionGetClientPort( DASessionRef session );
-__private_extern__ void             _DASessionScheduleWithRunLoop( DASessionRef session );
+__private_extern__ void             _DASessionScheduleWithRunLoop( DASessionRef session, _DAClientPortOptions options );
 
-static unsigned __DiskArbCopyDiskDescriptionAppearanceTime( DADiskRef disk )
+extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
+
+static unsigned __DiskArbCopyDiskDescriptionAppearanceTime( CFDictionaryRef description )
 {
     double time = 0;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFNumberRef number;
 
-        description = DADiskCopyDescription( disk );
+        number = CFDictionaryGetValue( description, kDADiskDescriptionAppearanceTimeKey );
 
-        if ( description )
+        if ( number )
         {
-            CFNumberRef number;
-
-            number = CFDictionaryGetValue( description, kDADiskDescriptionAppearanceTimeKey );
-
-            if ( number )
-            {
-                CFNumberGetValue( number, kCFNumberDoubleType, &time );
-            }
-
-            CFRelease( description );
+            CFNumberGetValue( number, kCFNumberDoubleType, &time );
         }
     }
 
     return time;
 }
 
-static char * __DiskArbCopyDiskDescriptionDeviceTreePath( DADiskRef disk )
+static char * __DiskArbCopyDiskDescriptionDeviceTreePath( CFDictionaryRef description )
 {
     char * path = NULL;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFStringRef string;
 
-        description = DADiskCopyDescription( disk );
+        string = CFDictionaryGetValue( description, kDADiskDescriptionMediaPathKey );
 
-        if ( description )
+        if ( string )
         {
-            CFStringRef string;
+            char * buffer;
 
-            string = CFDictionaryGetValue( description, kDADiskDescriptionMediaPathKey );
+            buffer = ___CFStringCopyCString( string );
 
-            if ( string )
+            if ( buffer )
             {
-                char * buffer;
-
-                buffer = ___CFStringCopyCString( string );
-
-                if ( buffer )
+                if ( strncmp( buffer, kIODeviceTreePlane ":", strlen( kIODeviceTreePlane ":" ) ) == 0 )
                 {
-                    if ( strncmp( buffer, kIODeviceTreePlane ":", strlen( kIODeviceTreePlane ":" ) ) == 0 )
-                    {
-                        path = strdup( buffer + strlen( kIODeviceTreePlane ":" ) );
-                    }
-
-                    free( buffer );
+                    path = strdup( buffer + strlen( kIODeviceTreePlane ":" ) );
                 }
-            }
 
-            CFRelease( description );
+                free( buffer );
+            }
         }
     }
     
     return path ? path : strdup( "" );
 }
 
-static unsigned __DiskArbCopyDiskDescriptionFlags( DADiskRef disk )
+static unsigned __DiskArbCopyDiskDescriptionFlags( DADiskRef disk, CFDictionaryRef description )
 {
     unsigned flags = 0;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFTypeRef object;
 
-        description = DADiskCopyDescription( disk );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionDeviceInternalKey );
 
-        if ( description )
+        if ( object )
         {
-            CFTypeRef object;
-
-            object = CFDictionaryGetValue( description, kDADiskDescriptionDeviceInternalKey );
-
-            if ( object )
+            if ( object == kCFBooleanTrue )
             {
-                if ( object == kCFBooleanTrue )
-                {
-                    flags |= kDiskArbDiskAppearedInternal;
-                }
+                flags |= kDiskArbDiskAppearedInternal;
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionMediaEjectableKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionMediaEjectableKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( object == kCFBooleanTrue )
             {
-                if ( object == kCFBooleanTrue )
+                flags |= kDiskArbDiskAppearedEjectableMask;
+
+                object = CFDictionaryGetValue( description, kDADiskDescriptionMediaKindKey );
+
+                if ( object )
                 {
-                    flags |= kDiskArbDiskAppearedEjectableMask;
+                    DADiskRef whole;
 
-                    object = CFDictionaryGetValue( description, kDADiskDescriptionMediaKindKey );
+                    whole = DADiskCopyWholeDisk( disk );
 
-                    if ( object )
+                    if ( whole )
                     {
-                        DADiskRef whole;
+                        io_service_t media;
 
-                        whole = DADiskCopyWholeDisk( disk );
+                        media = DADiskCopyIOMedia( whole );
 
-                        if ( whole )
+                        if ( media )
                         {
-                            io_service_t media;
-
-                            media = DADiskCopyIOMedia( whole );
-
-                            if ( media )
+                            if ( IOObjectConformsTo( media, kIOBDMediaClass ) )
                             {
-                                if ( IOObjectConformsTo( media, kIOBDMediaClass ) )
-                                {
-                                    flags |= kDiskArbDiskAppearedBDROMMask;
-                                }
-
-                                if ( IOObjectConformsTo( media, kIOCDMediaClass ) )
-                                {
-                                    flags |= kDiskArbDiskAppearedCDROMMask;
-                                }
+                                flags |= kDiskArbDiskAppearedBDROMMask;
+                            }
 
-                                if ( IOObjectConformsTo( media, kIODVDMediaClass ) )
-                                {
-                                    flags |= kDiskArbDiskAppearedDVDROMMask;
-                                }
+                            if ( IOObjectConformsTo( media, kIOCDMediaClass ) )
+                            {
+                                flags |= kDiskArbDiskAppearedCDROMMask;
+                            }
 
-                                IOObjectRelease( media );
+                            if ( IOObjectConformsTo( media, kIODVDMediaClass ) )
+                            {
+                                flags |= kDiskArbDiskAppearedDVDROMMask;
                             }
 
-                            CFRelease( whole );
+                            IOObjectRelease( media );
                         }
+
+                        CFRelease( whole );
                     }
                 }
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionMediaLeafKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionMediaLeafKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( object == kCFBooleanFalse )
             {
-                if ( object == kCFBooleanFalse )
-                {
-                    flags |= kDiskArbDiskAppearedNonLeafDiskMask;
-                }
+                flags |= kDiskArbDiskAppearedNonLeafDiskMask;
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionMediaSizeKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionMediaSizeKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( ___CFNumberGetIntegerValue( object ) == 0 )
             {
-                if ( ___CFNumberGetIntegerValue( object ) == 0 )
-                {
-                    flags |= kDiskArbDiskAppearedNoSizeMask;
-                }
+                flags |= kDiskArbDiskAppearedNoSizeMask;
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionMediaWholeKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionMediaWholeKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( object == kCFBooleanTrue )
             {
-                if ( object == kCFBooleanTrue )
-                {
-                    flags |= kDiskArbDiskAppearedWholeDiskMask;
-                }
+                flags |= kDiskArbDiskAppearedWholeDiskMask;
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionMediaWritableKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionMediaWritableKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( object == kCFBooleanFalse )
             {
-                if ( object == kCFBooleanFalse )
-                {
-                    flags |= kDiskArbDiskAppearedLockedMask;
-                }
+                flags |= kDiskArbDiskAppearedLockedMask;
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionVolumeMountableKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionVolumeMountableKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( object == kCFBooleanFalse )
             {
-                if ( object == kCFBooleanFalse )
-                {
-                    flags |= kDiskArbDiskAppearedUnrecognizableFormat;
-                }
+                flags |= kDiskArbDiskAppearedUnrecognizableFormat;
             }
+        }
 
-            object = CFDictionaryGetValue( description, kDADiskDescriptionVolumeNetworkKey );
+        object = CFDictionaryGetValue( description, kDADiskDescriptionVolumeNetworkKey );
 
-            if ( object )
+        if ( object )
+        {
+            if ( object == kCFBooleanTrue )
             {
-                if ( object == kCFBooleanTrue )
-                {
-                    flags |= kDiskArbDiskAppearedNetworkDiskMask;
-                }
+                flags |= kDiskArbDiskAppearedNetworkDiskMask;
             }
-
-            CFRelease( description );
         }
     }
 
     return flags;
 }
 
-static char * __DiskArbCopyDiskDescriptionMediaContent( DADiskRef disk )
+static char * __DiskArbCopyDiskDescriptionMediaContent( CFDictionaryRef description )
 {
     char * content = NULL;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFStringRef string;
 
-        description = DADiskCopyDescription( disk );
+        string = CFDictionaryGetValue( description, kDADiskDescriptionMediaContentKey );
 
-        if ( description )
+        if ( string )
         {
-            CFStringRef string;
-
-            string = CFDictionaryGetValue( description, kDADiskDescriptionMediaContentKey );
-
-            if ( string )
-            {
-                content = ___CFStringCopyCString( string );
-            }
-
-            CFRelease( description );
+            content = ___CFStringCopyCString( string );
         }
     }
 
     return content ? content : strdup( "" );
 }
 
-static unsigned __DiskArbCopyDiskDescriptionSequenceNumber( DADiskRef disk )
+static unsigned __DiskArbCopyDiskDescriptionSequenceNumber( CFDictionaryRef description )
 {
     unsigned sequence = -1;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFURLRef url;
 
-        description = DADiskCopyDescription( disk );
+        url = CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey );
 
-        if ( description )
+        if ( url )
         {
-            CFURLRef url;
+            CFNumberRef number;
 
-            url = CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey );
+            number = CFDictionaryGetValue( description, kDADiskDescriptionMediaBSDMinorKey );
 
-            if ( url )
+            if ( number )
             {
-                CFNumberRef number;
-
-                number = CFDictionaryGetValue( description, kDADiskDescriptionMediaBSDMinorKey );
-
-                if ( number )
-                {
-                    CFNumberGetValue( number, kCFNumberIntType, &sequence );
-                }
+                CFNumberGetValue( number, kCFNumberIntType, &sequence );
             }
-
-            CFRelease( description );
         }
     }
 
     return sequence;
 }
 
-static char * __DiskArbCopyDiskDescriptionVolumeKind( DADiskRef disk )
+static char * __DiskArbCopyDiskDescriptionVolumeKind( CFDictionaryRef description )
 {
     char * kind = NULL;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFStringRef string;
 
-        description = DADiskCopyDescription( disk );
+        string = CFDictionaryGetValue( description, kDADiskDescriptionVolumeKindKey );
 
-        if ( description )
+        if ( string )
         {
-            CFStringRef string;
-
-            string = CFDictionaryGetValue( description, kDADiskDescriptionVolumeKindKey );
-
-            if ( string )
-            {
-                kind = ___CFStringCopyCString( string );
-            }
-
-            CFRelease( description );
+            kind = ___CFStringCopyCString( string );
         }
     }
 
     return kind ? kind : strdup( "" );
 }
 
-static char * __DiskArbCopyDiskDescriptionVolumeName( DADiskRef disk )
+static char * __DiskArbCopyDiskDescriptionVolumeName( CFDictionaryRef description )
 {
     char * name = NULL;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFStringRef string;
 
-        description = DADiskCopyDescription( disk );
+        string = CFDictionaryGetValue( description, kDADiskDescriptionVolumeNameKey );
 
-        if ( description )
+        if ( string )
         {
-            CFStringRef string;
-
-            string = CFDictionaryGetValue( description, kDADiskDescriptionVolumeNameKey );
-
-            if ( string )
-            {
-                name = ___CFStringCopyCString( string );
-            }
-
-            CFRelease( description );
+            name = ___CFStringCopyCString( string );
         }
     }
 
     return name ? name : strdup( "" );
 }
 
-static char * __DiskArbCopyDiskDescriptionVolumePath( DADiskRef disk )
+static char * __DiskArbCopyDiskDescriptionVolumePath( CFDictionaryRef description )
 {
     char * path = NULL;
 
-    if ( disk )
+    if ( description )
     {
-        CFDictionaryRef description;
+        CFURLRef url;
 
-        description = DADiskCopyDescription( disk );
+        url = CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey );
 
-        if ( description )
+        if ( url )
         {
-            CFURLRef url;
-
-            url = CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey );
-
-            if ( url )
-            {
-                path = ___CFURLCopyFileSystemRepresentation( url );
-            }
-
-            CFRelease( description );
+            path = ___CFURLCopyFileSystemRepresentation( url );
         }
     }
 
@@ -435,18 +376,9 @@ static CFArrayRef __DiskArbGetCallbackHandler( int type )
 {
     CFArrayRef callbacks = NULL;
 
-    if ( __gDiskArbCallbackList )
+    if ( type > 0 && type < __kDiskArbCallbackListCount )
     {
-        CFNumberRef key;
-
-        key = CFNumberCreate( kCFAllocatorDefault, kCFNumberIntType, &type );
-
-        if ( key )
-        {
-            callbacks = CFDictionaryGetValue( __gDiskArbCallbackList, key );
-
-            CFRelease( key );
-        }
+        callbacks = __gDiskArbCallbackList[ type ];
     }
 
     return callbacks;
@@ -466,41 +398,116 @@ static char * __DiskArbGetDiskID( DADiskRef _disk )
     return disk;
 }
 
-static struct statfs * __DiskArbGetFileSystemStatus( char * disk )
+static Boolean __DiskArbMountListKeyEqual( const void * value1, const void * value2 )
+{
+    return ( strcmp( value1, value2 ) == 0 );
+}
+
+static CFHashCode __DiskArbMountListKeyHash( const void * value )
 {
+    return CFHashBytes( ( void * ) value, strlen( value ) );
+}
+
+static void __DiskArbMountListRefresh( void )
+{
+    /*
+     * Take a snapshot of the mount table, indexed by device and by mount point.  The snapshot is
+     * kept for as long as our disk description changed callbacks vouch for it, which is only the
+     * case once they are registered.
+     */
+
     struct statfs * mountList;
     int             mountListCount;
     int             mountListIndex;
 
+    if ( __gDiskArbMountListValid )
+    {
+        return;
+    }
+
+    if ( __gDiskArbMountListDiskIndex == NULL )
+    {
+        CFDictionaryKeyCallBacks callbacks = { 0 };
+
+        callbacks.equal = __DiskArbMountListKeyEqual;
+        callbacks.hash  = __DiskArbMountListKeyHash;
+
+        __gDiskArbMountListDiskIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &callbacks, NULL );
+        __gDiskArbMountListNameIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &callbacks, NULL );
+    }
+
+    if ( __gDiskArbMountListDiskIndex )  CFDictionaryRemoveAllValues( __gDiskArbMountListDiskIndex );
+    if ( __gDiskArbMountListNameIndex )  CFDictionaryRemoveAllValues( __gDiskArbMountListNameIndex );
+
+    if ( __gDiskArbMountList )
+    {
+        free( __gDiskArbMountList );
+
+        __gDiskArbMountList = NULL;
+    }
+
     mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
 
-    for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
+    if ( mountListCount > 0 )
     {
-        if ( strncmp( disk, "disk", strlen( "disk" ) ) )
-        {
-            if ( strcmp( mountList[mountListIndex].f_mntfromname, disk ) == 0 )
-            {
-                break;
-            }
+        __gDiskArbMountList = malloc( mountListCount * sizeof( struct statfs ) );
 
-            if ( strcmp( mountList[mountListIndex].f_mntonname, disk ) == 0 )
-            {
-                break;
-            }
-        }
-        else
+        if ( __gDiskArbMountList )
         {
-            if ( strncmp( mountList[mountListIndex].f_mntfromname, _PATH_DEV, strlen( _PATH_DEV ) ) == 0 )
+            memcpy( __gDiskArbMountList, mountList, mountListCount * sizeof( struct statfs ) );
+
+            for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
             {
-                if ( strcmp( mountList[mountListIndex].f_mntfromname + strlen( _PATH_DEV ), disk ) == 0 )
+                struct statfs * fs;
+
+                fs = __gDiskArbMountList + mountListIndex;
+
+                /*
+                 * The first entry of a name wins, as it would in a scan of the mount table.
+                 */
+
+                if ( __gDiskArbMountListNameIndex )
+                {
+                    CFDictionaryAddValue( __gDiskArbMountListNameIndex, fs->f_mntfromname, fs );
+                    CFDictionaryAddValue( __gDiskArbMountListNameIndex, fs->f_mntonname,   fs );
+                }
+
+                if ( __gDiskArbMountListDiskIndex )
                 {
-                    break;
+                    if ( strncmp( fs->f_mntfromname, _PATH_DEV, strlen( _PATH_DEV ) ) == 0 )
+                    {
+                        CFDictionaryAddValue( __gDiskArbMountListDiskIndex, fs->f_mntfromname + strlen( _PATH_DEV ), fs );
+                    }
                 }
             }
         }
     }
 
-    return ( mountListIndex < mountListCount ) ? ( mountList + mountListIndex ) : ( NULL );
+    __gDiskArbMountListValid = __gDiskArbMountListWatch;
+}
+
+static struct statfs * __DiskArbGetFileSystemStatus( char * disk )
+{
+    struct statfs * fs = NULL;
+
+    __DiskArbMountListRefresh( );
+
+    if ( strncmp( disk, "disk", strlen( "disk" ) ) )
+    {
+        if ( __gDiskArbMountListNameIndex )
+        {
+            fs = ( void * ) CFDictionaryGetValue( __gDiskArbMountListNameIndex, disk );
+        }
+    }
+    else
+    {
+        if ( __gDiskArbMountListDiskIndex )
+        {
+            fs = ( void * ) CFDictionaryGetValue( __gDiskArbMountListDiskIndex, disk );
+        }
+    }
+
+    return fs;
 }
 
 static void __DiskArbCallback_CallFailedNotification( char * disk, int type, int status )
@@ -660,6 +667,7 @@ static void __DiskArbDiskAppearedCallback( DADiskRef disk, void * context )
 {
     CFArrayRef      callbacks   = NULL;
     char *          content     = NULL;
+    CFDictionaryRef description = NULL;
     char *          filesystem  = NULL;
     unsigned        flags       = 0;
     char *          mountpoint  = NULL;
@@ -668,14 +676,23 @@ static void __DiskArbDiskAppearedCallback( DADiskRef disk, void * context )
     unsigned        sequence    = -1;
     double          time        = 0;
 
-    content    = __DiskArbCopyDiskDescriptionMediaContent( disk );
-    filesystem = __DiskArbCopyDiskDescriptionVolumeKind( disk );
-    flags      = __DiskArbCopyDiskDescriptionFlags( disk );
-    mountpoint = __DiskArbCopyDiskDescriptionVolumePath( disk );
-    name       = __DiskArbCopyDiskDescriptionVolumeName( disk );
-    path       = __DiskArbCopyDiskDescriptionDeviceTreePath( disk );
-    sequence   = __DiskArbCopyDiskDescriptionSequenceNumber( disk );
-    time       = __DiskArbCopyDiskDescriptionAppearanceTime( disk );
+    /*
+     * Fetch the description once and share it across the field accessors.  The description
+     * changed callback hands us the description it already holds through the context.
+     */
+
+    description = context ? CFRetain( context ) : DADiskCopyDescription( disk );
+
+    content    = __DiskArbCopyDiskDescriptionMediaContent( description );
+    filesystem = __DiskArbCopyDiskDescriptionVolumeKind( description );
+    flags      = __DiskArbCopyDiskDescriptionFlags( disk, description );
+    mountpoint = __DiskArbCopyDiskDescriptionVolumePath( description );
+    name       = __DiskArbCopyDiskDescriptionVolumeName( description );
+    path       = __DiskArbCopyDiskDescriptionDeviceTreePath( description );
+    sequence   = __DiskArbCopyDiskDescriptionSequenceNumber( description );
+    time       = __DiskArbCopyDiskDescriptionAppearanceTime( description );
+
+    if ( description )  CFRelease( description );
 
     callbacks = __DiskArbGetCallbackHandler( kDA_DISK_APPEARED );
 
@@ -861,6 +878,11 @@ static void __DiskArbDiskDescriptionChangedCallback( DADiskRef disk, CFArrayRef
 {
     CFDictionaryRef description;
 
+    if ( ___CFArrayContainsValue( keys, kDADiskDescriptionVolumePathKey ) )
+    {
+        __gDiskArbMountListValid = FALSE;
+    }
+
     description = DADiskCopyDescription( disk );
 
     if ( description )
@@ -872,8 +894,8 @@ static void __DiskArbDiskDescriptionChangedCallback( DADiskRef disk, CFArrayRef
                 char * name;
                 char * path;
 
-                name = __DiskArbCopyDiskDescriptionVolumeName( disk );
-                path = __DiskArbCopyDiskDescriptionVolumePath( disk );
+                name = __DiskArbCopyDiskDescriptionVolumeName( description );
+                path = __DiskArbCopyDiskDescriptionVolumePath( description );
 
                 __DiskArbCallback_DiskChangedNotification( __DiskArbGetDiskID( disk ), path, name, 0, kDiskArbRenameSuccessful );
 
@@ -885,7 +907,7 @@ static void __DiskArbDiskDescriptionChangedCallback( DADiskRef disk, CFArrayRef
         {
             if ( CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey ) )
             {
-                __DiskArbDiskAppearedCallback( disk, NULL );
+                __DiskArbDiskAppearedCallback( disk, ( void * ) description );
             }
             else
             {
@@ -903,6 +925,8 @@ static void __DiskArbDiskDisappearedCallback( DADiskRef disk, void * context )
 {
     CFDictionaryRef description;
 
+    __gDiskArbMountListValid = FALSE;
+
     CFSetRemoveValue( __gDiskArbUnmountList, disk );
 
     CFSetRemoveValue( __gDiskArbEjectList, disk );
@@ -1124,6 +1148,8 @@ static DADissenterRef __DiskArbDiskEjectApprovalCallback( DADiskRef disk, void *
 
 static void __DiskArbDiskMountCallback( DADiskRef disk, DADissenterRef dissenter, void * context )
 {
+    __gDiskArbMountListValid = FALSE;
+
     if ( dissenter )
     {
 ///w:start
@@ -1154,22 +1180,28 @@ static void __DiskArbDiskMountCallback( DADiskRef disk, DADissenterRef dissenter
 
 static DADissenterRef __DiskArbDiskMountApprovalCallback( DADiskRef disk, void * context )
 {
-    CFArrayRef     callbacks  = NULL;
-    char *         content    = NULL;
-    DADissenterRef dissenter  = NULL;
-    char *         filesystem = NULL;
-    unsigned       flags      = 0;
-    char *         name       = NULL;
-    char *         path       = NULL;
-    int            removable  = FALSE;
-    int            whole      = FALSE;
-    int            writable   = FALSE;
-
-    content    = __DiskArbCopyDiskDescriptionMediaContent( disk );
-    filesystem = __DiskArbCopyDiskDescriptionVolumeKind( disk );
-    flags      = __DiskArbCopyDiskDescriptionFlags( disk );
-    name       = __DiskArbCopyDiskDescriptionVolumeName( disk );
-    path       = __DiskArbCopyDiskDescriptionDeviceTreePath( disk );
+    CFArrayRef      callbacks   = NULL;
+    char *          content     = NULL;
+    CFDictionaryRef description = NULL;
+    DADissenterRef  dissenter   = NULL;
+    char *          filesystem  = NULL;
+    unsigned        flags       = 0;
+    char *          name        = NULL;
+    char *          path        = NULL;
+    int             removable   = FALSE;
+    int             whole       = FALSE;
+    int             writable    = FALSE;
+
+    description = DADiskCopyDescription( disk );
+
+    content    = __DiskArbCopyDiskDescriptionMediaContent( description );
+    filesystem = __DiskArbCopyDiskDescriptionVolumeKind( description );
+    flags      = __DiskArbCopyDiskDescriptionFlags( disk, description );
+    name       = __DiskArbCopyDiskDescriptionVolumeName( description );
+    path       = __DiskArbCopyDiskDescriptionDeviceTreePath( description );
+
+    if ( description )  CFRelease( description );
+
     removable  = ( flags & kDiskArbDiskAppearedEjectableMask ) ? TRUE : FALSE;
     whole      = ( flags & kDiskArbDiskAppearedWholeDiskMask ) ? TRUE : FALSE;
     writable   = ( flags & kDiskArbDiskAppearedLockedMask ) ? FALSE : TRUE; 
@@ -1275,7 +1307,7 @@ static void __DiskArbDiskPeekCallback( DADiskRef disk, void * context )
 
     if ( description )
     {
-        flags      = __DiskArbCopyDiskDescriptionFlags( disk );
+        flags      = __DiskArbCopyDiskDescriptionFlags( disk, description );
         kind       = CFDictionaryGetValue( description, kDADiskDescriptionMediaKindKey );
         removable  = ( flags & kDiskArbDiskAppearedEjectableMask ) ? TRUE : FALSE;
         size       = ___CFDictionaryGetIntegerValue( description, kDADiskDescriptionMediaSizeKey );
@@ -1371,6 +1403,8 @@ static void __DiskArbDiskRenameCallback( DADiskRef disk, DADissenterRef dissente
 
 static void __DiskArbDiskUnmountCallback( DADiskRef disk, DADissenterRef dissenter, void * context )
 {
+    __gDiskArbMountListValid = FALSE;
+
     if ( dissenter )
     {
         DAReturn status;
@@ -1576,12 +1610,8 @@ static void __DiskArbIdleCallback( void * context )
 
 void DiskArbAddCallbackHandler( int type, void * callback, int overwrite )
 {
-    if ( __gDiskArbCallbackList == NULL )
+    if ( __gDiskArbRegisterList == NULL )
     {
-        __gDiskArbCallbackList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
-
-        assert( __gDiskArbCallbackList );
-
         __gDiskArbEjectList = CFSetCreateMutable( kCFAllocatorDefault, 0, &kCFTypeSetCallBacks );
 
         assert( __gDiskArbEjectList );
@@ -1601,25 +1631,31 @@ void DiskArbAddCallbackHandler( int type, void * callback, int overwrite )
 
     if ( callback )
     {
-        CFNumberRef key;
-
-        key = CFNumberCreate( kCFAllocatorDefault, kCFNumberIntType, &type );
-
-        if ( key )
+        if ( type > 0 && type < __kDiskArbCallbackListCount )
         {
             CFMutableArrayRef callbacks;
 
-            callbacks = ( void * ) CFDictionaryGetValue( __gDiskArbCallbackList, key );
+            callbacks = __gDiskArbCallbackList[ type ];
 
-            if ( callbacks )
+            if ( callbacks == NULL )
             {
-                CFRetain( callbacks );
-            }
-            else
-            {
-                callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, NULL );
+                CFNumberRef key;
+
+                key = CFNumberCreate( kCFAllocatorDefault, kCFNumberIntType, &type );
+
+                if ( key )
+                {
+                    callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, NULL );
+
+                    if ( callbacks )
+                    {
+                        __gDiskArbCallbackList[ type ] = callbacks;
+
+                        CFArrayAppendValue( __gDiskArbRegisterList, key );
+                    }
 
-                CFArrayAppendValue( __gDiskArbRegisterList, key );
+                    CFRelease( key );
+                }
             }
 
             if ( callbacks )
@@ -1630,13 +1666,7 @@ void DiskArbAddCallbackHandler( int type, void * callback, int overwrite )
                 }            
 
                 CFArrayAppendValue( callbacks, callback );
-
-                CFDictionarySetValue( __gDiskArbCallbackList, key, callbacks );
-
-                CFRelease( callbacks );
             }
-
-            CFRelease( key );
         }
     }
 }
@@ -1822,7 +1852,12 @@ kern_return_t DiskArbInit( void )
 
         if ( __gDiskArbSession )
         {
-            _DASessionScheduleWithRunLoop( __gDiskArbSession );
+            /*
+             * Legacy clients may receive on the client port with buffers of their own, so they
+             * take the bare wakeup only.
+             */
+
+            _DASessionScheduleWithRunLoop( __gDiskArbSession, _kDAClientPortOptionDefault );
         }
     }
 
@@ -2009,24 +2044,15 @@ kern_return_t DiskArbReleaseClientReservationForDevice( char * disk )
 
 void DiskArbRemoveCallbackHandler( int type, void * callback )
 {
-    if ( __gDiskArbCallbackList )
+    if ( type > 0 && type < __kDiskArbCallbackListCount )
     {
-        CFNumberRef key;
+        CFMutableArrayRef callbacks;
 
-        key = CFNumberCreate( kCFAllocatorDefault, kCFNumberIntType, &type );
+        callbacks = __gDiskArbCallbackList[ type ];
 
-        if ( key )
+        if ( callbacks )
         {
-            CFMutableArrayRef callbacks;
-
-            callbacks = ( void * ) CFDictionaryGetValue( __gDiskArbCallbackList, key );
-
-            if ( callbacks )
-            {
-                ___CFArrayRemoveValue( callbacks, callback );
-            }
-
-            CFRelease( key );
+            ___CFArrayRemoveValue( callbacks, callback );
         }
     }
 }
@@ -2393,6 +2419,8 @@ void DiskArbUpdateClientFlags( void )
                                 
                                 DARegisterDiskAppearedCallback( __gDiskArbSession, NULL, __DiskArbDiskAppearedCallback, NULL );
 
+                                __gDiskArbMountListWatch = TRUE;
+
                                 registered = TRUE;
                             }
 
@@ -2502,6 +2530,26 @@ DAReturn _DADiskSetAdoption( DADiskRef disk, Boolean adoption )
     return status;
 }
 
+void _DADiskSetAdoptionWithCallback( DADiskRef disk, Boolean adoption, DADiskSetAdoptionCallback callback, void * context )
+{
+    if ( disk )
+    {
+        __block DAReturn status = kDAReturnError;
+
+        CFRetain( disk );
+
+        _DASessionPerform( _DADiskGetSession( disk ), ^
+        {
+            status = _DADiskSetAdoption( disk, adoption );
+        }, ^
+        {
+            ( callback )( disk, status, context );
+
+            CFRelease( disk );
+        } );
+    }
+}
+
 DAReturn _DADiskSetEncoding( DADiskRef disk, UInt32 encoding )
 {
     DAReturn status;
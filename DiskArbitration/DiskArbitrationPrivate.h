@@ -287,16 +287,89 @@ extern const CFStringRef kDADiskDescriptionMediaMatchKey;
 
 #ifndef __DISKARBITRATIOND__
 
+typedef void ( *DADiskCopyDescriptionCallback )( DADiskRef disk, CFDictionaryRef description, void * context );
+
+typedef void ( *DADiskGetOptionsCallback )( DADiskRef disk, DADiskOptions options, void * context );
+
+typedef void ( *DADiskIsClaimedCallback )( DADiskRef disk, Boolean claimed, void * context );
+
+typedef void ( *DADiskSetAdoptionCallback )( DADiskRef disk, DAReturn status, void * context );
+
+/*
+ * The WithCallback variants below do not wait on the server.  The callback is called on the
+ * session's run loop or dispatch queue once the request completes, which requires the session
+ * to be scheduled.  Several requests may be outstanding at a time.
+ */
+
+extern void DADiskCopyDescriptionWithCallback( DADiskRef disk, DADiskCopyDescriptionCallback callback, void * context );
+
+extern void DADiskGetOptionsWithCallback( DADiskRef disk, DADiskGetOptionsCallback callback, void * context );
+
+extern void DADiskIsClaimedWithCallback( DADiskRef disk, DADiskIsClaimedCallback callback, void * context );
+
 extern DADiskRef _DADiskCreateFromSerialization( CFAllocatorRef allocator, DASessionRef session, CFDataRef serialization );
 
 extern DASessionRef _DADiskGetSession( DADiskRef disk );
 
 extern DAReturn _DADiskSetAdoption( DADiskRef disk, Boolean adoption );
 
+extern void _DADiskSetAdoptionWithCallback( DADiskRef disk, Boolean adoption, DADiskSetAdoptionCallback callback, void * context );
+
 extern DAReturn _DADiskSetEncoding( DADiskRef disk, UInt32 encoding );
 
 extern pid_t DADissenterGetProcessID( DADissenterRef dissenter );
 
+/*
+ * Returns the disks that have appeared, each mapped to its description, in a single request.
+ * Pass a match dictionary, as for DARegisterDiskAppearedCallback(), to limit the disks returned.
+ */
+
+extern CFDictionaryRef DASessionCopyDiskSnapshot( DASessionRef session, CFDictionaryRef match );
+
+/*
+ * Returns the daemon's internal statistics: the sizes of its disk, request, response and session
+ * lists, the depth of each session's callback queue, the commands and jobs in flight, the probe
+ * cache hit counts and the stage and request latency histograms.  Meant for monitoring.
+ */
+
+extern CFDictionaryRef DASessionCopyStatistics( DASessionRef session );
+
+/*
+ * The times, in mach_absolute_time() units, at which a callback passed each step on its way from
+ * the daemon's callback queue to its dispatch.  The fetch times are 0 for a callback that reached
+ * the client through the callback ring or within the wake-up message itself.  The daemon's share
+ * of serialization time is reported in the QueueTime statistic of DASessionCopyStatistics().
+ */
+
+typedef struct
+{
+    UInt64 queued;        /* the daemon queued the callback               */
+    UInt64 woken;         /* the client took the wake-up message          */
+    UInt64 fetched;       /* the client sent its copy-queue request       */
+    UInt64 received;      /* the client received the reply to it          */
+    UInt64 unserializing; /* the client began to unserialize the callback */
+    UInt64 unserialized;  /* the client unserialized the callback         */
+    UInt64 dispatched;    /* the client handed the callback to its target */
+} DACallbackLatency;
+
+typedef void ( *DALatencyCallback )( const DACallbackLatency * latency, void * context );
+
+/*
+ * Reports the latency of each callback the session dispatches, just ahead of its dispatch.  The
+ * daemon stamps callbacks only for the sessions that ask for it as they are scheduled, so set the
+ * callback before scheduling the session.  Meant for benchmarking.
+ */
+
+extern void DASessionSetLatencyCallback( DASessionRef session, DALatencyCallback callback, void * context );
+
+/*
+ * Commits the session to respond to its approval and peek callbacks within the specified time,
+ * which may only shorten the daemon's own limit.  A session that fails to respond in time is
+ * treated as not responding, as it would be at the daemon's limit.  Pass 0 to restore the limit.
+ */
+
+extern void DASessionSetResponseTimeout( DASessionRef session, CFTimeInterval timeout );
+
 typedef void ( *DAIdleCallback )( void * context );
 
 extern void DARegisterIdleCallback( DASessionRef session, DAIdleCallback callback, void * context );
@@ -34,6 +34,7 @@ extern "C" {
 extern void DADialogInitialize( void );
 extern void DADialogShowDeviceRemoval( DADiskRef disk );
 extern void DADialogShowDeviceUnreadable( DADiskRef disk );
+extern void DADialogShowDeviceUnreadableList( CFArrayRef disks );
 extern void DADialogShowDeviceUnrepairable( DADiskRef disk );
 
 #ifdef __cplusplus
@@ -42,6 +42,7 @@ static const CFStringRef __kDADialogTextDeviceUnreadableEject      = CFSTR( "Eje
 static const CFStringRef __kDADialogTextDeviceUnreadableHeader     = CFSTR( "The disk you inserted was not readable by this computer." );
 static const CFStringRef __kDADialogTextDeviceUnreadableIgnore     = CFSTR( "Ignore" );
 static const CFStringRef __kDADialogTextDeviceUnreadableInitialize = CFSTR( "Initialize..." );
+static const CFStringRef __kDADialogTextDeviceUnreadableListHeader = CFSTR( "The disks you inserted were not readable by this computer." );
 
 static const CFStringRef __kDADialogTextDeviceUnrepairable             = CFSTR( "You can still open or copy files on the disk, but you can't save changes to files on the disk. Back up the disk and reformat it as soon as you can." );
 static const CFStringRef __kDADialogTextDeviceUnrepairableHeaderPrefix = CFSTR( "OS X can't repair the disk \"" );
@@ -97,102 +98,143 @@ void DADialogShowDeviceRemoval( DADiskRef disk )
 
 void DADialogShowDeviceUnreadable( DADiskRef disk )
 {
-    CFDictionaryRef description;
+    CFArrayRef disks;
 
-    description = DADiskCopyDescription( disk );
+    disks = CFArrayCreate( kCFAllocatorDefault, ( const void ** ) &disk, 1, &kCFTypeArrayCallBacks );
 
-    if ( description )
+    if ( disks )
+    {
+        DADialogShowDeviceUnreadableList( disks );
+
+        CFRelease( disks );
+    }
+}
+
+void DADialogShowDeviceUnreadableList( CFArrayRef disks )
+{
+    /*
+     * Show one dialog for all the specified disks.  Its responses apply to each of them.
+     */
+
+    CFMutableDictionaryRef dictionary;
+
+    dictionary = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( dictionary )
     {
-        CFMutableDictionaryRef dictionary;
+        CFURLRef path;
 
-        dictionary = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+        path = CFURLCreateWithFileSystemPath( kCFAllocatorDefault, ( CFStringRef ) __kDADialogLocalizedStringBundlePath, kCFURLPOSIXPathStyle, TRUE );
 
-        if ( dictionary )
+        if ( path )
         {
-            CFURLRef path;
+            CFIndex               count;
+            CFIndex               index;
+            CFUserNotificationRef notification;
+
+            count = CFArrayGetCount( disks );
+
+            if ( count > 1 )
+            {
+                CFDictionarySetValue( dictionary, kCFUserNotificationAlertHeaderKey, __kDADialogTextDeviceUnreadableListHeader );
+            }
+            else
+            {
+                CFDictionarySetValue( dictionary, kCFUserNotificationAlertHeaderKey, __kDADialogTextDeviceUnreadableHeader );
+            }
 
-            path = CFURLCreateWithFileSystemPath( kCFAllocatorDefault, ( CFStringRef ) __kDADialogLocalizedStringBundlePath, kCFURLPOSIXPathStyle, TRUE );
+            CFDictionarySetValue( dictionary, kCFUserNotificationDefaultButtonTitleKey, __kDADialogTextDeviceUnreadableEject  );
+            CFDictionarySetValue( dictionary, kCFUserNotificationLocalizationURLKey,    path                                  );
+            CFDictionarySetValue( dictionary, kCFUserNotificationOtherButtonTitleKey,   __kDADialogTextDeviceUnreadableIgnore );
 
-            if ( path )
+            for ( index = 0; index < count; index++ )
             {
-                CFUserNotificationRef notification;
+                CFDictionaryRef description;
 
-                CFDictionarySetValue( dictionary, kCFUserNotificationAlertHeaderKey,        __kDADialogTextDeviceUnreadableHeader );
-                CFDictionarySetValue( dictionary, kCFUserNotificationDefaultButtonTitleKey, __kDADialogTextDeviceUnreadableEject  );
-                CFDictionarySetValue( dictionary, kCFUserNotificationLocalizationURLKey,    path                                  );
-                CFDictionarySetValue( dictionary, kCFUserNotificationOtherButtonTitleKey,   __kDADialogTextDeviceUnreadableIgnore );
+                description = DADiskCopyDescription( ( void * ) CFArrayGetValueAtIndex( disks, index ) );
 
-                if ( CFDictionaryGetValue( description, kDADiskDescriptionMediaWritableKey ) == kCFBooleanTrue )
+                if ( description )
                 {
-                    CFDictionarySetValue( dictionary, kCFUserNotificationAlternateButtonTitleKey, __kDADialogTextDeviceUnreadableInitialize );
+                    if ( CFDictionaryGetValue( description, kDADiskDescriptionMediaWritableKey ) == kCFBooleanTrue )
+                    {
+                        CFDictionarySetValue( dictionary, kCFUserNotificationAlternateButtonTitleKey, __kDADialogTextDeviceUnreadableInitialize );
+                    }
+
+                    CFRelease( description );
                 }
+            }
 
-                notification = CFUserNotificationCreate( kCFAllocatorDefault, 0, kCFUserNotificationCautionAlertLevel, NULL, dictionary );
+            notification = CFUserNotificationCreate( kCFAllocatorDefault, 0, kCFUserNotificationCautionAlertLevel, NULL, dictionary );
 
-                if ( notification )
+            if ( notification )
+            {
+                vproc_transaction_t transaction;
+                
+                transaction = vproc_transaction_begin( NULL );
+                
+                if ( transaction )
                 {
-                    vproc_transaction_t transaction;
-                    
-                    transaction = vproc_transaction_begin( NULL );
-                    
-                    if ( transaction )
-                    {
-                        CFRetain( disk );
+                    CFRetain( disks );
 
-                        CFRetain( notification );
+                    CFRetain( notification );
 
-                        dispatch_async( dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 ), ^
-                        {
-                            CFOptionFlags response;
+                    dispatch_async( dispatch_get_global_queue( DISPATCH_QUEUE_PRIORITY_DEFAULT, 0 ), ^
+                    {
+                        CFOptionFlags response;
 
-                            response = 0;
+                        response = 0;
 
-                            CFUserNotificationReceiveResponse( notification, 0, &response );
+                        CFUserNotificationReceiveResponse( notification, 0, &response );
 
-                            switch ( ( response & 0x3 ) )
+                        switch ( ( response & 0x3 ) )
+                        {
+                            case kCFUserNotificationAlternateResponse:
                             {
-                                case kCFUserNotificationAlternateResponse:
+                                CFURLRef path;
+
+                                path = CFURLCreateWithFileSystemPath( kCFAllocatorDefault, CFSTR( "/Applications/Utilities/Disk Utility.app" ), kCFURLPOSIXPathStyle, FALSE );
+
+                                if ( path )
                                 {
-                                    CFURLRef path;
+                                    LSOpenCFURLRef( path, NULL );
 
-                                    path = CFURLCreateWithFileSystemPath( kCFAllocatorDefault, CFSTR( "/Applications/Utilities/Disk Utility.app" ), kCFURLPOSIXPathStyle, FALSE );
+                                    CFRelease( path );
+                                }
 
-                                    if ( path )
-                                    {
-                                        LSOpenCFURLRef( path, NULL );
+                                break;
+                            }
+                            case kCFUserNotificationCancelResponse:
+                            case kCFUserNotificationDefaultResponse:
+                            {
+                                CFIndex count;
+                                CFIndex index;
 
-                                        CFRelease( path );
-                                    }
+                                count = CFArrayGetCount( disks );
 
-                                    break;
-                                }
-                                case kCFUserNotificationCancelResponse:
-                                case kCFUserNotificationDefaultResponse:
+                                for ( index = 0; index < count; index++ )
                                 {
-                                    DADiskEject( disk, kDADiskEjectOptionDefault, NULL, NULL );
-
-                                    break;
+                                    DADiskEject( ( void * ) CFArrayGetValueAtIndex( disks, index ), kDADiskEjectOptionDefault, NULL, NULL );
                                 }
-                            }
 
-                            vproc_transaction_end( NULL, transaction );
+                                break;
+                            }
+                        }
 
-                            CFRelease( notification );
+                        vproc_transaction_end( NULL, transaction );
 
-                            CFRelease( disk );
-                        } );
-                    }
+                        CFRelease( notification );
 
-                    CFRelease( notification );
+                        CFRelease( disks );
+                    } );
                 }
 
-                CFRelease( path );
+                CFRelease( notification );
             }
 
-            CFRelease( dictionary );
+            CFRelease( path );
         }
 
-        CFRelease( description );
+        CFRelease( dictionary );
     }
 }
 
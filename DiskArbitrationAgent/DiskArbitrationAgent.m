@@ -43,6 +43,27 @@ static void __DAAgentConnectionCallback( xpc_object_t object )
     }
 }
 
+static DADiskRef __DAAgentCreateDisk( DASessionRef session, xpc_object_t object )
+{
+    DADiskRef disk = NULL;
+
+    if ( xpc_get_type( object ) == XPC_TYPE_DATA )
+    {
+        CFDataRef serialization;
+
+        serialization = CFDataCreateWithBytesNoCopy( kCFAllocatorDefault, xpc_data_get_bytes_ptr( object ), xpc_data_get_length( object ), kCFAllocatorNull );
+
+        if ( serialization )
+        {
+            disk = _DADiskCreateFromSerialization( kCFAllocatorDefault, session, serialization );
+
+            CFRelease( serialization );
+        }
+    }
+
+    return disk;
+}
+
 static void __DAAgentMessageCallback( xpc_object_t object )
 {
     xpc_type_t type;
@@ -51,65 +72,104 @@ static void __DAAgentMessageCallback( xpc_object_t object )
 
     if ( type == XPC_TYPE_DICTIONARY )
     {
-        const void * _disk;
-        size_t       _diskSize;
+        CFMutableArrayRef disks;
 
-        _disk = xpc_dictionary_get_data( object, _kDAAgentDiskKey, &_diskSize );
+        /*
+         * The message carries a single disk, or a list of disks for the same action.
+         */
 
-        if ( _disk )
+        disks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( disks )
         {
-            CFDataRef serialization;
+            DASessionRef session;
 
-            serialization = CFDataCreateWithBytesNoCopy( kCFAllocatorDefault, _disk, _diskSize, kCFAllocatorNull );
+            session = DASessionCreate( kCFAllocatorDefault );
 
-            if ( serialization )
+            if ( session )
             {
-                DASessionRef session;
+                xpc_object_t _disk;
+                xpc_object_t _diskList;
 
-                session = DASessionCreate( kCFAllocatorDefault );
+                _disk     = xpc_dictionary_get_value( object, _kDAAgentDiskKey     );
+                _diskList = xpc_dictionary_get_value( object, _kDAAgentDiskListKey );
 
-                if ( session )
+                if ( _disk )
                 {
                     DADiskRef disk;
 
-                    disk = _DADiskCreateFromSerialization( kCFAllocatorDefault, session, serialization );
+                    disk = __DAAgentCreateDisk( session, _disk );
 
                     if ( disk )
                     {
-                        _DAAgentAction _action;
+                        CFArrayAppendValue( disks, disk );
 
-                        _action = xpc_dictionary_get_uint64( object, _kDAAgentActionKey );
+                        CFRelease( disk );
+                    }
+                }
 
-                        switch ( _action )
+                if ( _diskList && xpc_get_type( _diskList ) == XPC_TYPE_ARRAY )
+                {
+                    xpc_array_apply( _diskList, ^( size_t index, xpc_object_t value )
+                    {
+                        DADiskRef disk;
+
+                        disk = __DAAgentCreateDisk( session, value );
+
+                        if ( disk )
                         {
-                            case _kDAAgentActionShowDeviceRemoval:
-                            {
-                                DADialogShowDeviceRemoval( disk );
+                            CFArrayAppendValue( disks, disk );
 
-                                break;
-                            }
-                            case _kDAAgentActionShowDeviceUnreadable:
-                            {
-                                DADialogShowDeviceUnreadable( disk );
+                            CFRelease( disk );
+                        }
 
-                                break;
-                            }
-                            case _kDAAgentActionShowDeviceUnrepairable:
-                            {
-                                DADialogShowDeviceUnrepairable( disk );
+                        return ( bool ) true;
+                    } );
+                }
+
+                if ( CFArrayGetCount( disks ) )
+                {
+                    _DAAgentAction _action;
+                    CFIndex        count;
+                    CFIndex        index;
 
-                                break;
+                    _action = xpc_dictionary_get_uint64( object, _kDAAgentActionKey );
+
+                    count = CFArrayGetCount( disks );
+
+                    switch ( _action )
+                    {
+                        case _kDAAgentActionShowDeviceRemoval:
+                        {
+                            for ( index = 0; index < count; index++ )
+                            {
+                                DADialogShowDeviceRemoval( ( void * ) CFArrayGetValueAtIndex( disks, index ) );
                             }
+
+                            break;
                         }
+                        case _kDAAgentActionShowDeviceUnreadable:
+                        {
+                            DADialogShowDeviceUnreadableList( disks );
 
-                        CFRelease( disk );
-                    }
+                            break;
+                        }
+                        case _kDAAgentActionShowDeviceUnrepairable:
+                        {
+                            for ( index = 0; index < count; index++ )
+                            {
+                                DADialogShowDeviceUnrepairable( ( void * ) CFArrayGetValueAtIndex( disks, index ) );
+                            }
 
-                    CFRelease( session );
+                            break;
+                        }
+                    }
                 }
 
-                CFRelease( serialization );
+                CFRelease( session );
             }
+
+            CFRelease( disks );
         }
     }
 }
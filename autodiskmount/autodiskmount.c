@@ -67,6 +67,7 @@ typedef struct {
     boolean_t	debug;
     DiskPtr	Disks;
     unsigned	NumDisks;
+    int		Jobs;
 } GlobalStruct;
 
 GlobalStruct g;
@@ -86,6 +87,23 @@ struct DiskVolume
 
 typedef struct DiskVolume DiskVolume, *DiskVolumePtr;
 
+/*
+ * The resource, repair path and repair arguments of each filesystem bundle,
+ * looked up once from plistDict rather than each time they are needed.
+ */
+struct FileSystemInfo
+{
+    char *		name;		/* bundle name, e.g. "hfs.fs" */
+    char *		resourcePath;
+    char *		repairPath;
+    char *		repairArgs;
+};
+
+typedef struct FileSystemInfo FileSystemInfo, *FileSystemInfoPtr;
+
+FileSystemInfoPtr fsInfoList = NULL;
+int fsInfoCount = 0;
+
 struct DiskVolumes
 {
     CFMutableArrayRef list;
@@ -275,8 +293,8 @@ cacheFileSystemMatchingArray()
 	}
 }
 
-char           *
-resourcePathForFSName(char *fs)
+static char    *
+copyResourcePathForFSName(char *fs)
 {
 	char            bundlePath[MAXPATHLEN];
 	CFBundleRef     bundle;
@@ -284,7 +302,7 @@ resourcePathForFSName(char *fs)
 	CFURLRef        resourceUrl;
 	CFStringRef     resourceString;
 	char           *path;
-	char           *resourcePath = malloc(MAXPATHLEN);
+	char           *resourcePath = calloc(1, MAXPATHLEN);
 	CFStringRef     str;
 
 	sprintf(bundlePath, "%s/%s", FS_DIR_LOCATION, fs);
@@ -294,6 +312,10 @@ resourcePathForFSName(char *fs)
 	bundleUrl = CFURLCreateWithFileSystemPath(NULL, str, kCFURLPOSIXPathStyle, 1);
 	CFRelease(str);
 	bundle = CFBundleCreate(NULL, bundleUrl);
+	CFRelease(bundleUrl);
+	if (!bundle) {
+		return resourcePath;
+	}
 	resourceUrl = CFBundleCopyResourcesDirectoryURL(bundle);
 	resourceString = CFURLCopyPath(resourceUrl);
 
@@ -301,7 +323,6 @@ resourcePathForFSName(char *fs)
 
 	sprintf(resourcePath, "%s/%s", bundlePath, path);
 
-	CFRelease(bundleUrl);
 	CFRelease(bundle);
 	CFRelease(resourceUrl);
 	CFRelease(resourceString);
@@ -310,8 +331,8 @@ resourcePathForFSName(char *fs)
 	return resourcePath;
 }
 
-char           *
-repairPathForFileSystem(char *fsname)
+static char    *
+copyRepairPathForFileSystem(char *fsname)
 {
 	CFDictionaryRef fsDict;
 	CFDictionaryRef personalities;
@@ -319,7 +340,7 @@ repairPathForFileSystem(char *fsname)
 	CFStringRef     fsckPath1;
 	char            fs[128];
 	char           *fsckPath;
-	char           *finalPath = malloc(MAXPATHLEN);
+	char           *finalPath = calloc(1, MAXPATHLEN);
 	CFStringRef     str;
 
 	if (strlen(fsname) == 0) {
@@ -348,7 +369,7 @@ repairPathForFileSystem(char *fsname)
 	fsckPath1 = (CFStringRef) CFDictionaryGetValue(personality, CFSTR(kFSRepairExecutableKey));
 
 	if (fsckPath1) {
-		char           *resourcePath = resourcePathForFSName(fs);
+		char           *resourcePath = copyResourcePathForFSName(fs);
 		fsckPath = daCreateCStringFromCFString(fsckPath1);
 
 		sprintf(finalPath, "%s%s", resourcePath, fsckPath);
@@ -360,8 +381,8 @@ repairPathForFileSystem(char *fsname)
 
 }
 
-char           *
-repairArgsForFileSystem(char *fsname)
+static char    *
+copyRepairArgsForFileSystem(char *fsname)
 {
 	CFDictionaryRef fsDict;
 	CFDictionaryRef personalities;
@@ -372,7 +393,7 @@ repairArgsForFileSystem(char *fsname)
 	CFStringRef     str;
 
 	if (strlen(fsname) == 0) {
-		repairArgs = malloc(MAXPATHLEN);
+		repairArgs = calloc(1, MAXPATHLEN);
 		return repairArgs;
 	}
 	sprintf(fs, "%s%s", fsname, FS_DIR_SUFFIX);
@@ -381,7 +402,7 @@ repairArgsForFileSystem(char *fsname)
 	CFRelease(str);
 
 	if (!fsDict) {
-		repairArgs = malloc(MAXPATHLEN);
+		repairArgs = calloc(1, MAXPATHLEN);
 		return repairArgs;
 	}
 	personalities = (CFDictionaryRef) CFDictionaryGetValue(fsDict, CFSTR(kFSPersonalitiesKey));
@@ -401,7 +422,7 @@ repairArgsForFileSystem(char *fsname)
 	if (repairArgs1) {
 		repairArgs = daCreateCStringFromCFString(repairArgs1);
 	} else {
-		repairArgs = malloc(MAXPATHLEN);
+		repairArgs = calloc(1, MAXPATHLEN);
 	}
 
 
@@ -409,6 +430,105 @@ repairArgsForFileSystem(char *fsname)
 
 }
 
+void 
+cacheFileSystemInfo()
+{
+	/*
+	 * Build the lookup table from the bundle dictionaries, which must
+	 * already be cached.
+	 */
+
+	if (!fsInfoList && plistDict) {
+		int             count = CFDictionaryGetCount(plistDict);
+		CFStringRef    *keys = (CFStringRef *)malloc(sizeof(CFStringRef) * count);
+		int             n;
+
+		fsInfoList = (FileSystemInfoPtr)calloc(count, sizeof(FileSystemInfo));
+		if (!keys || !fsInfoList) {
+			free(keys);
+			free(fsInfoList);
+			fsInfoList = NULL;
+			return;
+		}
+		CFDictionaryGetKeysAndValues(plistDict, (const void **) keys, NULL);
+
+		for (n = 0; n < count; n++) {
+			FileSystemInfoPtr info = &fsInfoList[n];
+			char           *fsname;
+
+			info->name = daCreateCStringFromCFString(keys[n]);
+			fsname = strdup(info->name);
+			*strrchr(fsname, '.') = '\0';
+
+			info->resourcePath = copyResourcePathForFSName(info->name);
+			info->repairPath = copyRepairPathForFileSystem(fsname);
+			info->repairArgs = copyRepairArgsForFileSystem(fsname);
+
+			dwarning(("%s: repair '%s' '%s'\n", info->name, info->repairPath, info->repairArgs));
+			free(fsname);
+		}
+		fsInfoCount = count;
+		free(keys);
+	}
+}
+
+static FileSystemInfoPtr
+lookupFileSystemInfo(const char *fs)
+{
+	int             n;
+
+	for (n = 0; n < fsInfoCount; n++) {
+		if (strcmp(fsInfoList[n].name, fs) == 0) {
+			return (&fsInfoList[n]);
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * The results of resourcePathForFSName, repairPathForFileSystem and
+ * repairArgsForFileSystem should be released with free()
+ */
+
+char           *
+resourcePathForFSName(char *fs)
+{
+	FileSystemInfoPtr info = lookupFileSystemInfo(fs);
+
+	if (info) {
+		return strdup(info->resourcePath);
+	}
+	return copyResourcePathForFSName(fs);
+}
+
+char           *
+repairPathForFileSystem(char *fsname)
+{
+	char            fs[128];
+	FileSystemInfoPtr info;
+
+	snprintf(fs, sizeof(fs), "%s%s", fsname, FS_DIR_SUFFIX);
+	info = lookupFileSystemInfo(fs);
+	if (info) {
+		return strdup(info->repairPath);
+	}
+	return copyRepairPathForFileSystem(fsname);
+}
+
+char           *
+repairArgsForFileSystem(char *fsname)
+{
+	char            fs[128];
+	FileSystemInfoPtr info;
+
+	snprintf(fs, sizeof(fs), "%s%s", fsname, FS_DIR_SUFFIX);
+	info = lookupFileSystemInfo(fs);
+	if (info) {
+		return strdup(info->repairArgs);
+	}
+	return copyRepairArgsForFileSystem(fsname);
+}
+
 #define PIPEFULL	(4 * 1024)
 static char *
 read_output(int fd)
@@ -552,6 +672,40 @@ do_exec(const char * dir, const char * argv[], int * result,
 	return (got_result);
 }
 
+/*
+ * start_exec: like do_exec, without output, but returns the pid of the child
+ * rather than waiting for it, or -1 if it could not be started
+ */
+static pid_t
+start_exec(const char * argv[])
+{
+	pid_t		pid = -1;
+
+	if (g.debug) {
+		const char * * scan;
+		printf("start_exec(");
+		for (scan = argv; *scan; scan++) {
+			printf("%s%s", (scan != argv) ? " " : "", *scan);
+		}
+		printf(")\n");
+	}
+	if (access(argv[0], F_OK) == 0) {
+		pid = fork();
+		if (pid == 0) {
+			/* CHILD PROCESS */
+			cleanUpAfterFork(NULL);
+			execve(argv[0], (char * const *)argv, 0);
+			exit(-127);
+		}
+		else if (pid < 0) {
+			pwarning(("start_exec: fork() failed, %s",
+					strerror(errno)));
+			pid = -1;
+		}
+	}
+	return (pid);
+}
+
 DiskPtr NewDisk(	char * ioBSDName,
                                         io_object_t	service,
 					unsigned flags,
@@ -1353,6 +1507,174 @@ string_to_argv(char * str, char * * argv, int n)
 	return (count);
 }
 
+/*
+ * fsck_unit: the whole disk holding the given volume, e.g. 0 for disk0s8,
+ * or -1 if it cannot be told from the name
+ */
+static int
+fsck_unit(DiskVolumePtr vol)
+{
+	int		unit;
+
+	if (vol->disk_dev_name == NULL
+	    || sscanf(vol->disk_dev_name, "disk%d", &unit) != 1) {
+		return (-1);
+	}
+	return (unit);
+}
+
+#define MAX_JOBS	16
+#define NUM_ARGV	6
+
+struct FsckJob
+{
+    pid_t		pid;
+    int			unit;
+    char *		fsckCmd;
+    DiskVolumePtr	vol;
+};
+
+/*
+ * fsck_vols_parallel: run the fsck of up to <jobs> dirty volumes at once.
+ * Volumes on the same whole disk are checked one after the other, as running
+ * them side by side would only make the disk seek between them.  The outcome
+ * for each volume is the same as in the serial loop of fsck_vols.
+ */
+static boolean_t
+fsck_vols_parallel(DiskVolumesPtr vols, int jobs)
+{
+	boolean_t       result = TRUE;	/* mandatory initialization */
+	struct FsckJob	running[MAX_JOBS];
+	int		nrunning = 0;
+	int		count = DiskVolumes_count(vols);
+	boolean_t *	started;
+	int		i;
+
+	if (jobs > MAX_JOBS) {
+		jobs = MAX_JOBS;
+	}
+	started = (boolean_t *)calloc(count ? count : 1, sizeof(boolean_t));
+	if (started == NULL) {
+		return FALSE;
+	}
+
+	for (;;) {
+		int		j;
+		int		ret;
+		int		statusp;
+		pid_t		pid;
+		boolean_t	got_result;
+		struct FsckJob	job;
+
+		/* start what we can: a free slot and a whole disk not already busy */
+		for (i = 0; i < count && nrunning < jobs; i++) {
+			DiskVolumePtr   vol = (DiskVolumePtr) DiskVolumes_objectAtIndex(vols, i);
+			int 		unit;
+			boolean_t	busy = FALSE;
+
+			if (started[i] || !vol || !(vol->writable && vol->dirty)) {
+				continue;
+			}
+			unit = fsck_unit(vol);
+			for (j = 0; j < nrunning && unit != -1; j++) {
+				if (running[j].unit == unit) {
+					busy = TRUE;
+				}
+			}
+			if (busy) {
+				continue;
+			}
+			started[i] = TRUE;
+
+			{
+				const char * 	argv[NUM_ARGV] = {
+					NULL, /* fsck */
+					NULL, /* -y */
+					NULL, /* /dev/rdisk0s8 */
+					NULL, /* termination */
+					NULL, /* 2 extra args in case someone wants to pass */
+					NULL  /* extra args beyond -y */
+				};
+				int 		argc;
+				char           *fsckCmd = repairPathForFileSystem(vol->fs_type);
+				char           *rprCmd = repairArgsForFileSystem(vol->fs_type);
+				char 		devpath[64];
+
+				snprintf(devpath, sizeof(devpath), "/dev/r%s", vol->disk_dev_name);
+				argv[0] = fsckCmd;
+				argc = string_to_argv(rprCmd, (char * *)argv + 1, NUM_ARGV - 3);
+				argv[1 + argc] = devpath;
+
+				pid = start_exec(argv);
+				free(rprCmd);
+
+				if (pid == -1) {
+					/* failed to get a result, assume the volume is clean */
+					dwarning(("*** vol dirty? ***\n"));
+					vol->dirty = FALSE;
+					free(fsckCmd);
+					continue;
+				}
+				running[nrunning].pid = pid;
+				running[nrunning].unit = unit;
+				running[nrunning].fsckCmd = fsckCmd;
+				running[nrunning].vol = vol;
+				nrunning++;
+			}
+		}
+
+		if (nrunning == 0) {
+			break;
+		}
+
+		/* wait for any one of them to finish */
+		dwarning(("wait4(pid=-1,&statusp,0,NULL)...\n"));
+		pid = wait4(-1, &statusp, 0, NULL);
+		dwarning(("wait4(pid=-1,&statusp,0,NULL) => %d\n", pid));
+
+		if (pid == -1 && errno == EINTR) {
+			continue;
+		}
+		for (j = 0; j < nrunning; j++) {
+			if (pid == -1 || running[j].pid == pid) {
+				break;
+			}
+		}
+		if (j == nrunning) {
+			continue;
+		}
+		job = running[j];
+		running[j] = running[--nrunning];
+
+		got_result = (pid > 0 && WIFEXITED(statusp));
+		ret = got_result ? (int)(char)(WEXITSTATUS(statusp)) : 0;
+
+		if (got_result == FALSE) {
+			/* failed to get a result, assume the volume is clean */
+			dwarning(("*** vol dirty? ***\n"));
+			job.vol->dirty = FALSE;
+		}
+		else if (ret == 0) {
+			/* Mark the volume as clean so that it will be mounted */
+			job.vol->dirty = FALSE;
+		}
+		else {
+			dwarning(("'%s' failed: %d\n", job.fsckCmd, ret));
+		}
+
+		/*
+		 * Result will be TRUE iff each fsck command
+		 * is successful
+		 */
+		result = result && (ret == 0);
+
+		free(job.fsckCmd);
+	}
+
+	free(started);
+	return result;
+}
+
 /*
  * We only want to trigger the quotacheck command
  * on a volume when we fsck it and mark it clean.
@@ -1364,6 +1686,10 @@ fsck_vols(DiskVolumesPtr vols)
 	boolean_t       result = TRUE;	/* mandatory initialization */
 	int             i;
 
+	if (g.Jobs > 1) {
+		return fsck_vols_parallel(vols, g.Jobs);
+	}
+
 	for (i = 0; i < DiskVolumes_count(vols); i++) {
 
 		DiskVolumePtr   vol = (DiskVolumePtr) DiskVolumes_objectAtIndex(vols, i);
@@ -1372,7 +1698,6 @@ fsck_vols(DiskVolumesPtr vols)
 		}
 
 		if (vol->writable && vol->dirty) {
-#define NUM_ARGV	6
 			const char * 	argv[NUM_ARGV] = {
 				NULL, /* fsck */
 				NULL, /* -y */
@@ -1464,6 +1789,7 @@ findDiskInit()
         GetDisksFromRegistry(ioIterator, 1, 0);
         IOObjectRelease(ioIterator);
         cacheFileSystemDictionaries();
+        cacheFileSystemInfo();
         cacheFileSystemMatchingArray();
 	return (0);
 }
@@ -1484,6 +1810,7 @@ main(int argc, char * argv[])
 	
 	g.verbose = FALSE;
 	g.debug = FALSE;
+	g.Jobs = 1;
 	
 	/* Initialize <progname> */
 	
@@ -1496,7 +1823,7 @@ main(int argc, char * argv[])
 	}
 	
 	/* Parse command-line arguments */
-	while ((ch = getopt(argc, argv, "avdFV:")) != -1)	{
+	while ((ch = getopt(argc, argv, "avdFj:V:")) != -1)	{
 		switch (ch) {
 		case 'a':
 			all = TRUE;
@@ -1510,6 +1837,10 @@ main(int argc, char * argv[])
 		case 'F':
 			find = TRUE;
 			break;
+		case 'j':
+			/* run up to this many fscks at once */
+			g.Jobs = atoi(optarg);
+			break;
 		case 'V':
 			volume_name = optarg;
 			break;
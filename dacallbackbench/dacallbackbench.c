@@ -0,0 +1,648 @@
+/*
+ * Copyright (c) 1998-2014 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Measure the round trip of a description changed callback, from the moment the daemon queues it
+ * to the moment the framework dispatches it.  We open a number of sessions, half scheduled on the
+ * main run loop and half on a dispatch queue, register a mix of description changed callbacks in
+ * each, then rename a scratch volume in a burst and collect the times the framework reports for
+ * each callback.  The volume is renamed back to its original name at the end of the burst.
+ *
+ * usage: dacallbackbench [-c callbacks] [-n renames] [-s sessions] disk
+ */
+
+#include <dispatch/dispatch.h>
+#include <libkern/OSAtomic.h>
+#include <mach/mach_time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <DiskArbitration/DiskArbitrationPrivate.h>
+
+#define __kDABenchQuietInterval 1.0
+
+enum
+{
+    __kDABenchPhaseWakeup,
+    __kDABenchPhaseFetch,
+    __kDABenchPhaseUnserialize,
+    __kDABenchPhaseDispatch,
+    __kDABenchPhaseTotal,
+    __kDABenchPhaseCount
+};
+
+static const char * __kDABenchPhaseName[__kDABenchPhaseCount] =
+{
+    "queue and wake-up",
+    "copy-queue request",
+    "unserialization",
+    "dispatch wait",
+    "total"
+};
+
+struct __DABenchSession
+{
+    Boolean             _dispatch;
+    DACallbackLatency * _sampleList;
+    CFIndex             _sampleCount;
+    CFIndex             _sampleLimit;
+    DASessionRef        _session;
+};
+
+typedef struct __DABenchSession __DABenchSession;
+
+static CFIndex                   __gDABenchCallbackCount = 4;
+static volatile int32_t          __gDABenchChangeCount   = 0;
+static int32_t                   __gDABenchChangeLast    = -1;
+static DADiskRef                 __gDABenchDisk          = NULL;
+static CFStringRef               __gDABenchName          = NULL;
+static CFIndex                   __gDABenchRenameCount   = 0;
+static CFIndex                   __gDABenchRenameLimit   = 100;
+static __DABenchSession *        __gDABenchSessionList   = NULL;
+static CFIndex                   __gDABenchSessionCount  = 4;
+static mach_timebase_info_data_t __gDABenchTimebase;
+
+static int __DABenchCompare( const void * value1, const void * value2 )
+{
+    UInt64 time1 = *( const UInt64 * ) value1;
+    UInt64 time2 = *( const UInt64 * ) value2;
+
+    return ( time1 < time2 ) ? -1 : ( time1 > time2 ) ? 1 : 0;
+}
+
+static SInt64 __DABenchCopyQueueTime( DASessionRef session )
+{
+    /*
+     * Sum the time the daemon spent serializing the callback queues of our sessions, in ms.
+     */
+
+    CFDictionaryRef statistics;
+    SInt64          time = 0;
+
+    statistics = DASessionCopyStatistics( session );
+
+    if ( statistics )
+    {
+        CFArrayRef sessions;
+
+        sessions = CFDictionaryGetValue( statistics, CFSTR( "Sessions" ) );
+
+        if ( sessions )
+        {
+            CFStringRef name;
+
+            name = CFStringCreateWithCString( kCFAllocatorDefault, getprogname( ), kCFStringEncodingUTF8 );
+
+            if ( name )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = CFArrayGetCount( sessions );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    CFDictionaryRef entry;
+                    CFTypeRef       value;
+
+                    entry = CFArrayGetValueAtIndex( sessions, index );
+
+                    value = CFDictionaryGetValue( entry, CFSTR( "Name" ) );
+
+                    if ( value && CFEqual( value, name ) )
+                    {
+                        value = CFDictionaryGetValue( entry, CFSTR( "QueueTime" ) );
+
+                        if ( value )
+                        {
+                            SInt64 entryTime = 0;
+
+                            CFNumberGetValue( value, kCFNumberSInt64Type, &entryTime );
+
+                            time += entryTime;
+                        }
+                    }
+                }
+
+                CFRelease( name );
+            }
+        }
+
+        CFRelease( statistics );
+    }
+
+    return time;
+}
+
+static void __DABenchDescriptionChangedCallback( DADiskRef disk, CFArrayRef keys, void * context )
+{
+    OSAtomicIncrement32( &__gDABenchChangeCount );
+}
+
+static void __DABenchLatencyCallback( const DACallbackLatency * latency, void * context )
+{
+    __DABenchSession * session = context;
+
+    if ( session->_sampleCount == session->_sampleLimit )
+    {
+        DACallbackLatency * list;
+        CFIndex             limit;
+
+        limit = session->_sampleLimit ? session->_sampleLimit * 2 : 1024;
+
+        list = realloc( session->_sampleList, limit * sizeof( DACallbackLatency ) );
+
+        if ( list == NULL )
+        {
+            return;
+        }
+
+        session->_sampleList  = list;
+        session->_sampleLimit = limit;
+    }
+
+    session->_sampleList[session->_sampleCount] = *latency;
+
+    session->_sampleCount++;
+}
+
+static void __DABenchQuietCallback( CFRunLoopTimerRef timer, void * info )
+{
+    /*
+     * Stop once the burst is done and no callback has come in for a full interval.
+     */
+
+    int32_t count;
+
+    count = __gDABenchChangeCount;
+
+    if ( count == __gDABenchChangeLast )
+    {
+        CFRunLoopStop( CFRunLoopGetMain( ) );
+    }
+
+    __gDABenchChangeLast = count;
+}
+
+static void __DABenchRenameCallback( DADiskRef disk, DADissenterRef dissenter, void * context )
+{
+    if ( dissenter )
+    {
+        fprintf( stderr, "dacallbackbench: unable to rename the volume (status code 0x%08X).\n", DADissenterGetStatus( dissenter ) );
+
+        exit( EX_SOFTWARE );
+    }
+
+    __gDABenchRenameCount++;
+
+    if ( __gDABenchRenameCount == __gDABenchRenameLimit )
+    {
+        CFRunLoopTimerRef timer;
+
+        timer = CFRunLoopTimerCreate( kCFAllocatorDefault, 0, __kDABenchQuietInterval, 0, 0, __DABenchQuietCallback, NULL );
+
+        if ( timer )
+        {
+            CFRunLoopAddTimer( CFRunLoopGetMain( ), timer, kCFRunLoopDefaultMode );
+
+            CFRelease( timer );
+        }
+    }
+}
+
+static void __DABenchRegister( DASessionRef session, CFIndex index, void * context )
+{
+    /*
+     * Register the specified callback of the mix: one matches every disk and watches every key,
+     * two match the scratch volume and watch a single key each, and one never matches it.
+     */
+
+    CFMutableDictionaryRef match = NULL;
+    CFMutableArrayRef      watch = NULL;
+
+    switch ( index % 4 )
+    {
+        case 1:
+        {
+            match = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+            watch = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( match )  CFDictionarySetValue( match, kDADiskDescriptionVolumeMountableKey, kCFBooleanTrue );
+            if ( watch )  CFArrayAppendValue( watch, kDADiskDescriptionVolumeNameKey );
+
+            break;
+        }
+        case 2:
+        {
+            match = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+            watch = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( match )  CFDictionarySetValue( match, kDADiskDescriptionMediaWholeKey, kCFBooleanFalse );
+            if ( watch )  CFArrayAppendValue( watch, kDADiskDescriptionVolumePathKey );
+
+            break;
+        }
+        case 3:
+        {
+            match = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( match )  CFDictionarySetValue( match, kDADiskDescriptionVolumeNetworkKey, kCFBooleanTrue );
+
+            break;
+        }
+    }
+
+    DARegisterDiskDescriptionChangedCallback( session, match, watch, __DABenchDescriptionChangedCallback, context );
+
+    if ( match )  CFRelease( match );
+    if ( watch )  CFRelease( watch );
+}
+
+static void __DABenchReport( Boolean dispatch )
+{
+    /*
+     * Print the phases of the round trip for the sessions scheduled in the specified way.  Each
+     * phase is measured between neighbouring times, such that time spent on earlier callbacks of
+     * the same wake-up counts against the dispatch wait rather than against unserialization.
+     */
+
+    CFIndex  count = 0;
+    CFIndex  fetches = 0;
+    CFIndex  index;
+    UInt32   phase;
+    UInt64 * times[__kDABenchPhaseCount];
+    CFIndex  timesCount[__kDABenchPhaseCount];
+
+    for ( index = 0; index < __gDABenchSessionCount; index++ )
+    {
+        if ( __gDABenchSessionList[index]._dispatch == dispatch )
+        {
+            count += __gDABenchSessionList[index]._sampleCount;
+        }
+    }
+
+    printf( "%s: %ld callbacks\n", dispatch ? "dispatch queue" : "run loop", ( long ) count );
+
+    if ( count == 0 )
+    {
+        return;
+    }
+
+    for ( phase = 0; phase < __kDABenchPhaseCount; phase++ )
+    {
+        times[phase]      = malloc( count * sizeof( UInt64 ) );
+        timesCount[phase] = 0;
+
+        if ( times[phase] == NULL )
+        {
+            exit( EX_OSERR );
+        }
+    }
+
+    for ( index = 0; index < __gDABenchSessionCount; index++ )
+    {
+        __DABenchSession * session;
+        CFIndex            subindex;
+
+        session = __gDABenchSessionList + index;
+
+        if ( session->_dispatch != dispatch )
+        {
+            continue;
+        }
+
+        for ( subindex = 0; subindex < session->_sampleCount; subindex++ )
+        {
+            DACallbackLatency * sample;
+
+            sample = session->_sampleList + subindex;
+
+#define __DABenchSpan( a, b ) ( ( ( b ) > ( a ) ) ? ( ( b ) - ( a ) ) : 0 )
+
+            times[__kDABenchPhaseWakeup][timesCount[__kDABenchPhaseWakeup]++] = __DABenchSpan( sample->queued, sample->woken );
+
+            if ( sample->fetched )
+            {
+                times[__kDABenchPhaseFetch][timesCount[__kDABenchPhaseFetch]++] = __DABenchSpan( sample->fetched, sample->received );
+
+                fetches++;
+            }
+
+            times[__kDABenchPhaseUnserialize][timesCount[__kDABenchPhaseUnserialize]++] = __DABenchSpan( sample->unserializing, sample->unserialized );
+            times[__kDABenchPhaseDispatch   ][timesCount[__kDABenchPhaseDispatch   ]++] = __DABenchSpan( sample->unserialized,  sample->dispatched   );
+            times[__kDABenchPhaseTotal      ][timesCount[__kDABenchPhaseTotal      ]++] = __DABenchSpan( sample->queued,        sample->dispatched   );
+
+#undef __DABenchSpan
+        }
+    }
+
+    printf( "  %ld fetched with a copy-queue request, %ld through the ring or the wake-up message\n", ( long ) fetches, ( long ) ( count - fetches ) );
+
+    printf( "  %-20s %10s %10s %10s %10s\n", "phase (us)", "mean", "p50", "p99", "max" );
+
+    for ( phase = 0; phase < __kDABenchPhaseCount; phase++ )
+    {
+        CFIndex subcount;
+        CFIndex subindex;
+        double  sum = 0;
+
+        subcount = timesCount[phase];
+
+        if ( subcount )
+        {
+            double scale;
+
+            qsort( times[phase], subcount, sizeof( UInt64 ), __DABenchCompare );
+
+            for ( subindex = 0; subindex < subcount; subindex++ )
+            {
+                sum += times[phase][subindex];
+            }
+
+            scale = ( double ) __gDABenchTimebase.numer / __gDABenchTimebase.denom / 1000;
+
+            printf( "  %-20s %10.1f %10.1f %10.1f %10.1f\n",
+                    __kDABenchPhaseName[phase],
+                    sum / subcount * scale,
+                    times[phase][subcount / 2] * scale,
+                    times[phase][( subcount * 99 ) / 100] * scale,
+                    times[phase][subcount - 1] * scale );
+        }
+
+        free( times[phase] );
+    }
+}
+
+static void __DABenchUsage( void )
+{
+    fprintf( stderr, "usage: dacallbackbench [-c callbacks] [-n renames] [-s sessions] disk\n" );
+
+    exit( EX_USAGE );
+}
+
+int main( int argc, char * argv[] )
+{
+    DASessionRef     control;
+    CFDictionaryRef  description;
+    CFIndex          index;
+    int              option;
+    dispatch_queue_t queue;
+    SInt64           time;
+
+    while ( ( option = getopt( argc, argv, "c:n:s:" ) ) != -1 )
+    {
+        switch ( option )
+        {
+            case 'c':
+            {
+                __gDABenchCallbackCount = strtol( optarg, NULL, 10 );
+
+                break;
+            }
+            case 'n':
+            {
+                __gDABenchRenameLimit = strtol( optarg, NULL, 10 );
+
+                break;
+            }
+            case 's':
+            {
+                __gDABenchSessionCount = strtol( optarg, NULL, 10 );
+
+                break;
+            }
+            default:
+            {
+                __DABenchUsage( );
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if ( argc != 1 || __gDABenchCallbackCount < 1 || __gDABenchRenameLimit < 2 || __gDABenchSessionCount < 1 )
+    {
+        __DABenchUsage( );
+    }
+
+    mach_timebase_info( &__gDABenchTimebase );
+
+    /*
+     * Look up the scratch volume and its name through a session of its own, which renames it.
+     */
+
+    control = DASessionCreate( kCFAllocatorDefault );
+
+    if ( control == NULL )
+    {
+        exit( EX_UNAVAILABLE );
+    }
+
+    DASessionScheduleWithRunLoop( control, CFRunLoopGetMain( ), kCFRunLoopDefaultMode );
+
+    __gDABenchDisk = DADiskCreateFromBSDName( kCFAllocatorDefault, control, argv[0] );
+
+    if ( __gDABenchDisk == NULL )
+    {
+        __DABenchUsage( );
+    }
+
+    description = DADiskCopyDescription( __gDABenchDisk );
+
+    if ( description )
+    {
+        __gDABenchName = CFDictionaryGetValue( description, kDADiskDescriptionVolumeNameKey );
+
+        if ( __gDABenchName )
+        {
+            CFRetain( __gDABenchName );
+        }
+
+        CFRelease( description );
+    }
+
+    if ( __gDABenchName == NULL )
+    {
+        fprintf( stderr, "dacallbackbench: %s has no volume to rename.\n", argv[0] );
+
+        exit( EX_DATAERR );
+    }
+
+    /*
+     * Open the sessions under measure.  The latency callback is set ahead of the scheduling, as
+     * the daemon stamps the callbacks only of the sessions that ask for it when they schedule.
+     */
+
+    __gDABenchSessionList = calloc( __gDABenchSessionCount, sizeof( __DABenchSession ) );
+
+    if ( __gDABenchSessionList == NULL )
+    {
+        exit( EX_OSERR );
+    }
+
+    queue = dispatch_queue_create( "com.apple.dacallbackbench", NULL );
+
+    for ( index = 0; index < __gDABenchSessionCount; index++ )
+    {
+        __DABenchSession * session;
+        CFIndex            subindex;
+
+        session = __gDABenchSessionList + index;
+
+        session->_dispatch = ( index % 2 ) ? TRUE : FALSE;
+        session->_session  = DASessionCreate( kCFAllocatorDefault );
+
+        if ( session->_session == NULL )
+        {
+            exit( EX_UNAVAILABLE );
+        }
+
+        DASessionSetLatencyCallback( session->_session, __DABenchLatencyCallback, session );
+
+        for ( subindex = 0; subindex < __gDABenchCallbackCount; subindex++ )
+        {
+            __DABenchRegister( session->_session, subindex, session );
+        }
+
+        if ( session->_dispatch )
+        {
+            DASessionSetDispatchQueue( session->_session, queue );
+        }
+        else
+        {
+            DASessionScheduleWithRunLoop( session->_session, CFRunLoopGetMain( ), kCFRunLoopDefaultMode );
+        }
+    }
+
+    /*
+     * Let the registrations settle, then drive the burst.  Every rename but the last alternates
+     * between two names; the last restores the original one.
+     */
+
+    CFRunLoopRunInMode( kCFRunLoopDefaultMode, __kDABenchQuietInterval, FALSE );
+
+    for ( index = 0; index < __gDABenchSessionCount; index++ )
+    {
+        __DABenchSession * session;
+
+        session = __gDABenchSessionList + index;
+
+        if ( session->_dispatch )
+        {
+            dispatch_sync( queue, ^{ session->_sampleCount = 0; } );
+        }
+        else
+        {
+            session->_sampleCount = 0;
+        }
+    }
+
+    time = __DABenchCopyQueueTime( control );
+
+    for ( index = 0; index < __gDABenchRenameLimit; index++ )
+    {
+        CFStringRef name;
+
+        if ( index + 1 == __gDABenchRenameLimit )
+        {
+            name = CFRetain( __gDABenchName );
+        }
+        else
+        {
+            name = CFStringCreateWithFormat( kCFAllocatorDefault, NULL, CFSTR( "%@ %ld" ), __gDABenchName, ( long ) ( index % 2 ) );
+        }
+
+        if ( name )
+        {
+            DADiskRename( __gDABenchDisk, name, kDADiskRenameOptionDefault, __DABenchRenameCallback, NULL );
+
+            CFRelease( name );
+        }
+    }
+
+    CFRunLoopRun( );
+
+    /*
+     * Bring the dispatch queue sessions to a stop before reading their samples.
+     */
+
+    for ( index = 0; index < __gDABenchSessionCount; index++ )
+    {
+        __DABenchSession * session;
+
+        session = __gDABenchSessionList + index;
+
+        if ( session->_dispatch )
+        {
+            DASessionSetDispatchQueue( session->_session, NULL );
+        }
+        else
+        {
+            DASessionUnscheduleFromRunLoop( session->_session, CFRunLoopGetMain( ), kCFRunLoopDefaultMode );
+        }
+    }
+
+    dispatch_sync( queue, ^{ } );
+
+    time = __DABenchCopyQueueTime( control ) - time;
+
+    printf( "%ld sessions, %ld callbacks each, %ld renames, %d description changes\n",
+            ( long ) __gDABenchSessionCount,
+            ( long ) __gDABenchCallbackCount,
+            ( long ) __gDABenchRenameLimit,
+            __gDABenchChangeCount );
+
+    __DABenchReport( FALSE );
+    __DABenchReport( TRUE  );
+
+    /*
+     * The daemon serializes a callback either as it queues it, for the ring, or as it sends the
+     * queue, so its share is reported apart from the phases above, which include it.
+     */
+
+    printf( "daemon serialization: %lld ms in all\n", ( long long ) time );
+
+    for ( index = 0; index < __gDABenchSessionCount; index++ )
+    {
+        CFRelease( __gDABenchSessionList[index]._session );
+
+        free( __gDABenchSessionList[index]._sampleList );
+    }
+
+    free( __gDABenchSessionList );
+
+    dispatch_release( queue );
+
+    CFRelease( __gDABenchName );
+    CFRelease( __gDABenchDisk );
+
+    DASessionUnscheduleFromRunLoop( control, CFRunLoopGetMain( ), kCFRunLoopDefaultMode );
+
+    CFRelease( control );
+
+    exit( EX_OK );
+}
@@ -0,0 +1,612 @@
+/*
+ * Copyright (c) 1998-2014 Apple Inc. All rights reserved.
+ *
+ * @APPLE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this
+ * file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Measure how fast the daemon takes disks through its stages.  We build a number of disk images,
+ * each with a partition layout and file system of its own, attach them all at once and time the
+ * arrival of each disk from the start of the burst, as the appeared callback and the mount mark
+ * it.  The daemon's processor time per disk and its memory footprint are taken from its resource
+ * usage.  Slow helpers are modelled with a peek callback and a mount approval callback that hold
+ * each disk for the specified time, one disk after another, as a serial helper would.
+ *
+ * The images are disk images in memory of the kernel's own, so the media are fake, but the daemon
+ * sees them as any other media and runs its probe, repair and mount commands on them in full.
+ *
+ * usage: dastagebench [-n disks] [-s megabytes] [-i layout:filesystem ...] [-p ms] [-m ms]
+ *
+ * This must be run as root, for the resource usage of the daemon.
+ */
+
+#include <dispatch/dispatch.h>
+#include <libproc.h>
+#include <mach/mach_time.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <DiskArbitration/DiskArbitration.h>
+
+#define __kDABenchDeviceModel "Disk Image"
+#define __kDABenchTimeout     120.0
+
+extern char ** environ;
+
+struct __DABenchImage
+{
+    char * _filesystem;
+    char * _layout;
+};
+
+typedef struct __DABenchImage __DABenchImage;
+
+static CFIndex                   __gDABenchAppearedCount = 0;
+static UInt64 *                  __gDABenchAppearedList  = NULL;
+static UInt64                    __gDABenchBurst         = 0;
+static CFIndex                   __gDABenchDiskCount     = 8;
+static CFIndex                   __gDABenchEventCount    = 0;
+static __DABenchImage *          __gDABenchImageList     = NULL;
+static CFIndex                   __gDABenchImageCount    = 0;
+static useconds_t                __gDABenchMountLatency  = 0;
+static CFIndex                   __gDABenchMountedCount  = 0;
+static UInt64 *                  __gDABenchMountedList   = NULL;
+static useconds_t                __gDABenchPeekLatency   = 0;
+static CFMutableArrayRef         __gDABenchWholeList     = NULL;
+static CFIndex                   __gDABenchSize          = 64;
+static mach_timebase_info_data_t __gDABenchTimebase;
+
+static Boolean __DABenchIsImage( DADiskRef disk, CFDictionaryRef description )
+{
+    CFStringRef model;
+
+    model = CFDictionaryGetValue( description, kDADiskDescriptionDeviceModelKey );
+
+    if ( model )
+    {
+        if ( CFStringCompare( model, CFSTR( __kDABenchDeviceModel ), 0 ) == kCFCompareEqualTo )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static int __DABenchCompare( const void * value1, const void * value2 )
+{
+    UInt64 time1 = *( const UInt64 * ) value1;
+    UInt64 time2 = *( const UInt64 * ) value2;
+
+    return ( time1 < time2 ) ? -1 : ( time1 > time2 ) ? 1 : 0;
+}
+
+static pid_t __DABenchCopyDaemonID( void )
+{
+    /*
+     * Find the daemon among the running processes.
+     */
+
+    pid_t   daemon = 0;
+    int     count;
+    pid_t * list;
+
+    count = proc_listpids( PROC_ALL_PIDS, 0, NULL, 0 );
+
+    if ( count > 0 )
+    {
+        list = malloc( count );
+
+        if ( list )
+        {
+            int index;
+
+            count = proc_listpids( PROC_ALL_PIDS, 0, list, count ) / sizeof( pid_t );
+
+            for ( index = 0; index < count; index++ )
+            {
+                char name[MAXCOMLEN + 1];
+
+                if ( list[index] == 0 )
+                {
+                    continue;
+                }
+
+                if ( proc_name( list[index], name, sizeof( name ) ) > 0 )
+                {
+                    if ( strcmp( name, "diskarbitrationd" ) == 0 )
+                    {
+                        daemon = list[index];
+
+                        break;
+                    }
+                }
+            }
+
+            free( list );
+        }
+    }
+
+    return daemon;
+}
+
+static pid_t __DABenchSpawn( char * argv[] )
+{
+    pid_t pid;
+
+    if ( posix_spawnp( &pid, argv[0], NULL, NULL, argv, environ ) )
+    {
+        return 0;
+    }
+
+    return pid;
+}
+
+static int __DABenchRun( char * argv[] )
+{
+    pid_t pid;
+    int   status;
+
+    pid = __DABenchSpawn( argv );
+
+    if ( pid == 0 )
+    {
+        return -1;
+    }
+
+    if ( waitpid( pid, &status, 0 ) == -1 )
+    {
+        return -1;
+    }
+
+    return WIFEXITED( status ) ? WEXITSTATUS( status ) : -1;
+}
+
+static void __DABenchAppearedCallback( DADiskRef disk, void * context )
+{
+    /*
+     * Time the arrival of each disk of our images.  We hold on to the whole disks to detach them
+     * once we are done.
+     */
+
+    CFDictionaryRef description;
+
+    if ( __gDABenchBurst == 0 )
+    {
+        return;
+    }
+
+    description = DADiskCopyDescription( disk );
+
+    if ( description )
+    {
+        if ( __DABenchIsImage( disk, description ) )
+        {
+            __gDABenchEventCount++;
+
+            if ( CFDictionaryGetValue( description, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue )
+            {
+                CFStringRef name;
+
+                name = CFDictionaryGetValue( description, kDADiskDescriptionMediaBSDNameKey );
+
+                if ( name )
+                {
+                    CFArrayAppendValue( __gDABenchWholeList, name );
+                }
+            }
+
+            if ( CFDictionaryGetValue( description, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanTrue )
+            {
+                if ( __gDABenchAppearedCount < __gDABenchDiskCount )
+                {
+                    __gDABenchAppearedList[__gDABenchAppearedCount] = mach_absolute_time( ) - __gDABenchBurst;
+
+                    __gDABenchAppearedCount++;
+                }
+            }
+        }
+
+        CFRelease( description );
+    }
+}
+
+static void __DABenchDescriptionChangedCallback( DADiskRef disk, CFArrayRef keys, void * context )
+{
+    CFDictionaryRef description;
+
+    if ( __gDABenchBurst == 0 )
+    {
+        return;
+    }
+
+    description = DADiskCopyDescription( disk );
+
+    if ( description )
+    {
+        if ( __DABenchIsImage( disk, description ) )
+        {
+            if ( CFDictionaryGetValue( description, kDADiskDescriptionVolumePathKey ) )
+            {
+                if ( __gDABenchMountedCount < __gDABenchDiskCount )
+                {
+                    __gDABenchMountedList[__gDABenchMountedCount] = mach_absolute_time( ) - __gDABenchBurst;
+
+                    __gDABenchMountedCount++;
+
+                    if ( __gDABenchMountedCount == __gDABenchDiskCount )
+                    {
+                        CFRunLoopStop( CFRunLoopGetMain( ) );
+                    }
+                }
+            }
+        }
+
+        CFRelease( description );
+    }
+}
+
+static DADissenterRef __DABenchMountApprovalCallback( DADiskRef disk, void * context )
+{
+    usleep( __gDABenchMountLatency );
+
+    return NULL;
+}
+
+static void __DABenchPeekCallback( DADiskRef disk, void * context )
+{
+    usleep( __gDABenchPeekLatency );
+}
+
+static void __DABenchReport( const char * title, UInt64 * list, CFIndex count )
+{
+    double  scale;
+    double  sum = 0;
+    CFIndex index;
+
+    if ( count == 0 )
+    {
+        printf( "  %-10s %10s\n", title, "none" );
+
+        return;
+    }
+
+    qsort( list, count, sizeof( UInt64 ), __DABenchCompare );
+
+    for ( index = 0; index < count; index++ )
+    {
+        sum += list[index];
+    }
+
+    scale = ( double ) __gDABenchTimebase.numer / __gDABenchTimebase.denom / 1000000;
+
+    printf( "  %-10s %10.1f %10.1f %10.1f %10.1f\n",
+            title,
+            sum / count * scale,
+            list[count / 2] * scale,
+            list[( count * 99 ) / 100] * scale,
+            list[count - 1] * scale );
+}
+
+static void __DABenchUsage( void )
+{
+    fprintf( stderr, "usage: dastagebench [-n disks] [-s megabytes] [-i layout:filesystem ...] [-p ms] [-m ms]\n" );
+
+    exit( EX_USAGE );
+}
+
+int main( int argc, char * argv[] )
+{
+    pid_t                     daemon;
+    char                      directory[] = "/tmp/dastagebench.XXXXXX";
+    double                    elapsed;
+    CFIndex                   index;
+    int                       option;
+    pid_t *                   pidList;
+    double                    scale;
+    DASessionRef              session;
+    struct rusage_info_v4     usage1;
+    struct rusage_info_v4     usage2;
+
+    while ( ( option = getopt( argc, argv, "i:m:n:p:s:" ) ) != -1 )
+    {
+        switch ( option )
+        {
+            case 'i':
+            {
+                __DABenchImage * list;
+                char *           separator;
+
+                separator = strchr( optarg, ':' );
+
+                if ( separator == NULL )
+                {
+                    __DABenchUsage( );
+                }
+
+                list = realloc( __gDABenchImageList, ( __gDABenchImageCount + 1 ) * sizeof( __DABenchImage ) );
+
+                if ( list == NULL )
+                {
+                    exit( EX_OSERR );
+                }
+
+                *separator = 0;
+
+                list[__gDABenchImageCount]._layout     = optarg;
+                list[__gDABenchImageCount]._filesystem = separator + 1;
+
+                __gDABenchImageList = list;
+
+                __gDABenchImageCount++;
+
+                break;
+            }
+            case 'm':
+            {
+                __gDABenchMountLatency = strtol( optarg, NULL, 10 ) * 1000;
+
+                break;
+            }
+            case 'n':
+            {
+                __gDABenchDiskCount = strtol( optarg, NULL, 10 );
+
+                break;
+            }
+            case 'p':
+            {
+                __gDABenchPeekLatency = strtol( optarg, NULL, 10 ) * 1000;
+
+                break;
+            }
+            case 's':
+            {
+                __gDABenchSize = strtol( optarg, NULL, 10 );
+
+                break;
+            }
+            default:
+            {
+                __DABenchUsage( );
+            }
+        }
+    }
+
+    if ( optind != argc || __gDABenchDiskCount < 1 || __gDABenchSize < 1 )
+    {
+        __DABenchUsage( );
+    }
+
+    if ( geteuid( ) )
+    {
+        fprintf( stderr, "dastagebench: permission denied.\n" );
+
+        exit( EX_NOPERM );
+    }
+
+    if ( __gDABenchImageCount == 0 )
+    {
+        static __DABenchImage image = { "JHFS+", "GPTSPUD" };
+
+        __gDABenchImageList  = &image;
+        __gDABenchImageCount = 1;
+    }
+
+    mach_timebase_info( &__gDABenchTimebase );
+
+    daemon = __DABenchCopyDaemonID( );
+
+    if ( daemon == 0 )
+    {
+        fprintf( stderr, "dastagebench: diskarbitrationd is not running.\n" );
+
+        exit( EX_UNAVAILABLE );
+    }
+
+    __gDABenchAppearedList = calloc( __gDABenchDiskCount, sizeof( UInt64 ) );
+    __gDABenchMountedList  = calloc( __gDABenchDiskCount, sizeof( UInt64 ) );
+    __gDABenchWholeList    = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+    pidList = calloc( __gDABenchDiskCount, sizeof( pid_t ) );
+
+    if ( __gDABenchAppearedList == NULL || __gDABenchMountedList == NULL || __gDABenchWholeList == NULL || pidList == NULL )
+    {
+        exit( EX_OSERR );
+    }
+
+    /*
+     * Build the images ahead of the burst, cycling through the layouts and file systems we were
+     * given.
+     */
+
+    if ( mkdtemp( directory ) == NULL )
+    {
+        exit( EX_CANTCREAT );
+    }
+
+    for ( index = 0; index < __gDABenchDiskCount; index++ )
+    {
+        __DABenchImage * image;
+        char             name[64];
+        char             path[MAXPATHLEN];
+        char             size[32];
+
+        image = __gDABenchImageList + ( index % __gDABenchImageCount );
+
+        snprintf( name, sizeof( name ), "DABench%ld", ( long ) index );
+        snprintf( path, sizeof( path ), "%s/%ld.dmg", directory, ( long ) index );
+        snprintf( size, sizeof( size ), "%ldm", ( long ) __gDABenchSize );
+
+        char * arguments[] = { "hdiutil", "create", "-quiet", "-size", size, "-layout", image->_layout, "-fs", image->_filesystem, "-volname", name, path, NULL };
+
+        if ( __DABenchRun( arguments ) )
+        {
+            fprintf( stderr, "dastagebench: unable to create %s with layout %s and file system %s.\n", path, image->_layout, image->_filesystem );
+
+            exit( EX_SOFTWARE );
+        }
+    }
+
+    /*
+     * Watch the disks arrive.
+     */
+
+    session = DASessionCreate( kCFAllocatorDefault );
+
+    if ( session == NULL )
+    {
+        exit( EX_UNAVAILABLE );
+    }
+
+    DARegisterDiskAppearedCallback( session, NULL, __DABenchAppearedCallback, NULL );
+
+    DARegisterDiskDescriptionChangedCallback( session, NULL, kDADiskDescriptionWatchVolumePath, __DABenchDescriptionChangedCallback, NULL );
+
+    if ( __gDABenchMountLatency )
+    {
+        DARegisterDiskMountApprovalCallback( session, NULL, __DABenchMountApprovalCallback, NULL );
+    }
+
+    if ( __gDABenchPeekLatency )
+    {
+        DARegisterDiskPeekCallback( session, NULL, 0, __DABenchPeekCallback, NULL );
+    }
+
+    DASessionScheduleWithRunLoop( session, CFRunLoopGetMain( ), kCFRunLoopDefaultMode );
+
+    CFRunLoopRunInMode( kCFRunLoopDefaultMode, 1.0, FALSE );
+
+    /*
+     * Attach the images in a burst.
+     */
+
+    if ( proc_pid_rusage( daemon, RUSAGE_INFO_V4, ( rusage_info_t * ) &usage1 ) )
+    {
+        exit( EX_NOPERM );
+    }
+
+    __gDABenchBurst = mach_absolute_time( );
+
+    for ( index = 0; index < __gDABenchDiskCount; index++ )
+    {
+        char path[MAXPATHLEN];
+
+        snprintf( path, sizeof( path ), "%s/%ld.dmg", directory, ( long ) index );
+
+        char * arguments[] = { "hdiutil", "attach", "-quiet", "-nobrowse", "-noverify", "-noautofsck", path, NULL };
+
+        pidList[index] = __DABenchSpawn( arguments );
+    }
+
+    CFRunLoopRunInMode( kCFRunLoopDefaultMode, __kDABenchTimeout, FALSE );
+
+    elapsed = ( mach_absolute_time( ) - __gDABenchBurst ) * ( double ) __gDABenchTimebase.numer / __gDABenchTimebase.denom / 1000000000;
+
+    proc_pid_rusage( daemon, RUSAGE_INFO_V4, ( rusage_info_t * ) &usage2 );
+
+    for ( index = 0; index < __gDABenchDiskCount; index++ )
+    {
+        if ( pidList[index] )
+        {
+            waitpid( pidList[index], NULL, 0 );
+        }
+    }
+
+    /*
+     * Report.  The processor time of the daemon is taken over every disk of our images, whole
+     * disks and partitions alike, as each passes through the stages.
+     */
+
+    scale = ( double ) __gDABenchTimebase.numer / __gDABenchTimebase.denom / 1000000;
+
+    printf( "%ld disks of %ld MB, %ld appeared and %ld mounted in %.3f s, %.1f disks/s\n",
+            ( long ) __gDABenchDiskCount,
+            ( long ) __gDABenchSize,
+            ( long ) __gDABenchAppearedCount,
+            ( long ) __gDABenchMountedCount,
+            elapsed,
+            __gDABenchMountedCount / elapsed );
+
+    printf( "  %-10s %10s %10s %10s %10s\n", "time (ms)", "mean", "p50", "p99", "max" );
+
+    __DABenchReport( "appeared", __gDABenchAppearedList, __gDABenchAppearedCount );
+    __DABenchReport( "mounted",  __gDABenchMountedList,  __gDABenchMountedCount  );
+
+    if ( __gDABenchEventCount )
+    {
+        double time;
+
+        time = ( usage2.ri_user_time + usage2.ri_system_time - usage1.ri_user_time - usage1.ri_system_time ) * scale;
+
+        printf( "daemon: %.1f ms of processor time, %.2f ms per disk over %ld disks\n", time, time / __gDABenchEventCount, ( long ) __gDABenchEventCount );
+    }
+
+    printf( "daemon: footprint %.1f MB, up %.1f MB, peak %.1f MB\n",
+            usage2.ri_phys_footprint / 1048576.0,
+            ( ( SInt64 ) usage2.ri_phys_footprint - ( SInt64 ) usage1.ri_phys_footprint ) / 1048576.0,
+            usage2.ri_lifetime_max_phys_footprint / 1048576.0 );
+
+    /*
+     * Detach the images and clean up.
+     */
+
+    DASessionUnscheduleFromRunLoop( session, CFRunLoopGetMain( ), kCFRunLoopDefaultMode );
+
+    CFRelease( session );
+
+    for ( index = 0; index < CFArrayGetCount( __gDABenchWholeList ); index++ )
+    {
+        char name[MAXPATHLEN];
+
+        if ( CFStringGetCString( CFArrayGetValueAtIndex( __gDABenchWholeList, index ), name, sizeof( name ), kCFStringEncodingUTF8 ) )
+        {
+            char * arguments[] = { "hdiutil", "detach", "-quiet", "-force", name, NULL };
+
+            __DABenchRun( arguments );
+        }
+    }
+
+    for ( index = 0; index < __gDABenchDiskCount; index++ )
+    {
+        char path[MAXPATHLEN];
+
+        snprintf( path, sizeof( path ), "%s/%ld.dmg", directory, ( long ) index );
+
+        unlink( path );
+    }
+
+    rmdir( directory );
+
+    CFRelease( __gDABenchWholeList );
+
+    free( __gDABenchAppearedList );
+    free( __gDABenchMountedList );
+    free( pidList );
+
+    exit( EX_OK );
+}
@@ -23,5 +23,6 @@
 
 #include "DAAgent.h"
 
-__private_extern__ const char * _kDAAgentActionKey = "DAAgentAction";
-__private_extern__ const char * _kDAAgentDiskKey   = "DAAgentDisk";
+__private_extern__ const char * _kDAAgentActionKey   = "DAAgentAction";
+__private_extern__ const char * _kDAAgentDiskKey     = "DAAgentDisk";
+__private_extern__ const char * _kDAAgentDiskListKey = "DAAgentDiskList";
@@ -44,6 +44,7 @@ typedef UInt32 _DAAgentAction;
 
 const char * _kDAAgentActionKey;
 const char * _kDAAgentDiskKey;
+const char * _kDAAgentDiskListKey;
 
 #ifdef __cplusplus
 }
@@ -27,6 +27,7 @@
 
 #include <fcntl.h>
 #include <paths.h>
+#include <pthread.h>
 #include <sysexits.h>
 #include <vproc.h>
 #include <sys/attr.h>
@@ -182,6 +183,167 @@ __private_extern__ void ___vproc_transaction_end( void )
     }
 }
 
+#define ___kCFAllocatorPoolClassCount  16
+#define ___kCFAllocatorPoolClassMemory 0x00008000
+#define ___kCFAllocatorPoolClassSize   16
+
+struct ___CFAllocatorPoolBlock
+{
+    struct ___CFAllocatorPoolBlock * next;
+    size_t                           size;
+};
+
+typedef struct ___CFAllocatorPoolBlock ___CFAllocatorPoolBlock;
+
+struct ___CFAllocatorPool
+{
+    CFIndex                   capacity;
+    CFIndex                   count[___kCFAllocatorPoolClassCount];
+    ___CFAllocatorPoolBlock * free[___kCFAllocatorPoolClassCount];
+    pthread_mutex_t           lock;
+};
+
+typedef struct ___CFAllocatorPool ___CFAllocatorPool;
+
+static void * ___CFAllocatorPoolAllocate( CFIndex size, CFOptionFlags hint, void * info )
+{
+    /*
+     * Hand out a block from the free list of its size class, if any.  Each block is preceded by
+     * a header that records its usable size, which is rounded up to the size class.
+     */
+
+    ___CFAllocatorPoolBlock * block;
+    ___CFAllocatorPool *      pool = info;
+    CFIndex                   class;
+
+    if ( size < 1 )  return NULL;
+
+    class = ( size - 1 ) / ___kCFAllocatorPoolClassSize;
+
+    block = NULL;
+
+    if ( class < ___kCFAllocatorPoolClassCount )
+    {
+        pthread_mutex_lock( &pool->lock );
+
+        block = pool->free[class];
+
+        if ( block )
+        {
+            pool->free[class] = block->next;
+
+            pool->count[class]--;
+        }
+
+        pthread_mutex_unlock( &pool->lock );
+
+        size = ( class + 1 ) * ___kCFAllocatorPoolClassSize;
+    }
+
+    if ( block == NULL )
+    {
+        block = malloc( sizeof( ___CFAllocatorPoolBlock ) + size );
+
+        if ( block == NULL )  return NULL;
+
+        block->size = size;
+    }
+
+    block->next = NULL;
+
+    return block + 1;
+}
+
+static void ___CFAllocatorPoolDeallocate( void * pointer, void * info )
+{
+    /*
+     * Return a block to the free list of its size class, unless the free list is full.  The free
+     * list is full at capacity blocks, or once its blocks take up the memory allowed each class,
+     * so that a burst of allocations does not leave the pool holding onto its peak for good.
+     */
+
+    ___CFAllocatorPoolBlock * block = ( ___CFAllocatorPoolBlock * ) pointer - 1;
+    ___CFAllocatorPool *      pool  = info;
+    CFIndex                   class;
+
+    class = ( block->size - 1 ) / ___kCFAllocatorPoolClassSize;
+
+    if ( class < ___kCFAllocatorPoolClassCount )
+    {
+        pthread_mutex_lock( &pool->lock );
+
+        if ( pool->count[class] < pool->capacity && ( pool->count[class] + 1 ) * ( sizeof( ___CFAllocatorPoolBlock ) + block->size ) <= ___kCFAllocatorPoolClassMemory )
+        {
+            block->next = pool->free[class];
+
+            pool->free[class] = block;
+
+            pool->count[class]++;
+
+            block = NULL;
+        }
+
+        pthread_mutex_unlock( &pool->lock );
+    }
+
+    if ( block )
+    {
+        free( block );
+    }
+}
+
+static void * ___CFAllocatorPoolReallocate( void * pointer, CFIndex size, CFOptionFlags hint, void * info )
+{
+    ___CFAllocatorPoolBlock * block = ( ___CFAllocatorPoolBlock * ) pointer - 1;
+    void *                    reallocation;
+
+    if ( size <= ( CFIndex ) block->size )  return pointer;
+
+    reallocation = ___CFAllocatorPoolAllocate( size, hint, info );
+
+    if ( reallocation )
+    {
+        memcpy( reallocation, pointer, block->size );
+
+        ___CFAllocatorPoolDeallocate( pointer, info );
+    }
+
+    return reallocation;
+}
+
+__private_extern__ CFAllocatorRef ___CFAllocatorCreatePool( CFIndex capacity )
+{
+    /*
+     * Create an allocator that recycles the small blocks it is given back, keeping up to capacity
+     * free blocks, and no more than 32 KB of them, per size class.  It suits objects that are
+     * created and destroyed at a high rate, and it is meant to live for the duration of the
+     * process.
+     */
+
+    CFAllocatorContext   context;
+    ___CFAllocatorPool * pool;
+
+    pool = calloc( 1, sizeof( ___CFAllocatorPool ) );
+
+    if ( pool == NULL )  return NULL;
+
+    pool->capacity = capacity;
+
+    pthread_mutex_init( &pool->lock, NULL );
+
+    context.version         = 0;
+    context.info            = pool;
+    context.retain          = NULL;
+    context.release         = NULL;
+    context.copyDescription = NULL;
+    context.allocate        = ___CFAllocatorPoolAllocate;
+    context.reallocate      = ___CFAllocatorPoolReallocate;
+    context.deallocate      = ___CFAllocatorPoolDeallocate;
+    context.preferredSize   = NULL;
+
+    return CFAllocatorCreate( kCFAllocatorDefault, &context );
+}
+
 __private_extern__ const void * ___CFArrayGetValue( CFArrayRef array, const void * value )
 {
     /*
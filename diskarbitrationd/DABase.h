@@ -49,6 +49,7 @@ __private_extern__ int             ___isautofs( const char * path );
 __private_extern__ int             ___mkdir( const char * path, mode_t mode );
 __private_extern__ void            ___vproc_transaction_begin( void );
 __private_extern__ void            ___vproc_transaction_end( void );
+__private_extern__ CFAllocatorRef  ___CFAllocatorCreatePool( CFIndex capacity );
 __private_extern__ const void *    ___CFArrayGetValue( CFArrayRef array, const void * value );
 __private_extern__ void            ___CFArrayIntersect( CFMutableArrayRef array1, CFArrayRef array2 );
 __private_extern__ CFStringRef     ___CFBundleCopyLocalizedStringInDirectory( CFURLRef bundleURL, CFStringRef key, CFStringRef value, CFStringRef table );
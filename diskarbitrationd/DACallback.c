@@ -23,6 +23,33 @@
 
 #include "DACallback.h"
 
+#include "DABase.h"
+
+static CFAllocatorRef __gDACallbackAllocator = NULL;
+
+static CFAllocatorRef __DACallbackGetAllocator( CFAllocatorRef allocator )
+{
+    /*
+     * Callbacks are copied for every interested session and are discarded as soon as they are
+     * delivered or answered, so default allocations are recycled through a pool.
+     */
+
+    if ( allocator == kCFAllocatorDefault )
+    {
+        if ( __gDACallbackAllocator == NULL )
+        {
+            __gDACallbackAllocator = ___CFAllocatorCreatePool( 1024 );
+        }
+
+        if ( __gDACallbackAllocator )
+        {
+            allocator = __gDACallbackAllocator;
+        }
+    }
+
+    return allocator;
+}
+
 DACallbackRef DACallbackCreate( CFAllocatorRef   allocator,
                                 DASessionRef     session,
                                 mach_vm_offset_t address,
@@ -34,7 +61,7 @@ DACallbackRef DACallbackCreate( CFAllocatorRef   allocator,
 {
     CFMutableDictionaryRef callback;
 
-    callback = CFDictionaryCreateMutable( allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+    callback = CFDictionaryCreateMutable( __DACallbackGetAllocator( allocator ), 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
     if ( callback )
     {
@@ -54,7 +81,44 @@ DACallbackRef DACallbackCreate( CFAllocatorRef   allocator,
 
 DACallbackRef DACallbackCreateCopy( CFAllocatorRef allocator, DACallbackRef callback )
 {
-    return ( void * ) CFDictionaryCreateMutableCopy( allocator, 0, ( void * ) callback );
+    return ( void * ) CFDictionaryCreateMutableCopy( __DACallbackGetAllocator( allocator ), 0, ( void * ) callback );
+}
+
+DACallbackRef DACallbackCreateEvent( CFAllocatorRef allocator, DACallbackRef callback, CFTypeRef argument0, CFTypeRef argument1 )
+{
+    /*
+     * Create a callback queue entry for the specified callback registration.  The entry holds
+     * no more than what the client is sent, but for the disk, which the caller sets as before
+     * with DACallbackSetDisk() and which is stripped when the queue is copied out.  The arguments,
+     * such as the disk serialization, are referenced rather than copied, such that one event is
+     * shared by all of its subscribers.
+     */
+
+    CFMutableDictionaryRef event;
+
+    event = CFDictionaryCreateMutable( __DACallbackGetAllocator( allocator ), 5, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( event )
+    {
+        CFTypeRef value;
+
+        value = CFDictionaryGetValue( ( void * ) callback, _kDACallbackAddressKey );
+        if ( value )  CFDictionarySetValue( event, _kDACallbackAddressKey, value );
+
+        value = CFDictionaryGetValue( ( void * ) callback, _kDACallbackContextKey );
+        if ( value )  CFDictionarySetValue( event, _kDACallbackContextKey, value );
+
+        value = CFDictionaryGetValue( ( void * ) callback, _kDACallbackKindKey );
+        if ( value )  CFDictionarySetValue( event, _kDACallbackKindKey, value );
+
+        value = CFDictionaryGetValue( ( void * ) callback, _kDACallbackLatencyKey );
+        if ( value )  CFDictionarySetValue( event, _kDACallbackLatencyKey, value );
+
+        if ( argument0 )  CFDictionarySetValue( event, _kDACallbackArgument0Key, argument0 );
+        if ( argument1 )  CFDictionarySetValue( event, _kDACallbackArgument1Key, argument1 );
+    }
+
+    return ( void * ) event;
 }
 
 mach_vm_offset_t DACallbackGetAddress( DACallbackRef callback )
@@ -44,6 +44,7 @@ extern DACallbackRef DACallbackCreate( CFAllocatorRef   allocator,
                                        CFArrayRef       watch );
 
 extern DACallbackRef    DACallbackCreateCopy( CFAllocatorRef allocator, DACallbackRef callback );
+extern DACallbackRef    DACallbackCreateEvent( CFAllocatorRef allocator, DACallbackRef callback, CFTypeRef argument0, CFTypeRef argument1 );
 extern mach_vm_offset_t DACallbackGetAddress( DACallbackRef callback );
 extern CFTypeRef        DACallbackGetArgument0( DACallbackRef callback );
 extern CFTypeRef        DACallbackGetArgument1( DACallbackRef callback );
@@ -25,15 +25,24 @@
 
 #include "DABase.h"
 #include "DAInternal.h"
+#include "DALog.h"
 
+#include <crt_externs.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <paths.h>
 #include <pthread.h>
+#include <spawn.h>
 #include <sysexits.h>
+#include <signal.h>
 #include <unistd.h>
-#include <mach/mach.h>
+#include <libkern/OSAtomic.h>
+#include <sys/event.h>
 #include <sys/wait.h>
 
+extern int posix_spawnattr_set_gid_np( const posix_spawnattr_t * attr, gid_t gid ) __attribute__( ( weak_import ) );
+extern int posix_spawnattr_set_uid_np( const posix_spawnattr_t * attr, uid_t uid ) __attribute__( ( weak_import ) );
+
 enum
 {
     __kDACommandRunLoopSourceJobKindExecute = 0x00000001
@@ -43,8 +52,7 @@ typedef UInt32 __DACommandRunLoopSourceJobKind;
 
 struct __DACommandRunLoopSourceJob
 {
-    __DACommandRunLoopSourceJobKind      kind;
-    struct __DACommandRunLoopSourceJob * next;
+    __DACommandRunLoopSourceJobKind kind;
 
     union
     {
@@ -52,6 +60,11 @@ struct __DACommandRunLoopSourceJob
         {
             pid_t                    pid;
             int                      pipe;
+            CFMutableDataRef         output;
+            DACommandOutputCallback  outputCallback;
+            CFMutableDataRef         outputLine;
+            int                      status;
+            CFTimeInterval           timeout;
             DACommandExecuteCallback callback;
             void *                   callbackContext;
         } execute;
@@ -60,128 +73,209 @@ struct __DACommandRunLoopSourceJob
 
 typedef struct __DACommandRunLoopSourceJob __DACommandRunLoopSourceJob;
 
-static __DACommandRunLoopSourceJob * __gDACommandRunLoopSourceJobs = NULL;
-static pthread_mutex_t	             __gDACommandRunLoopSourceLock = PTHREAD_MUTEX_INITIALIZER;
-static CFMachPortRef                 __gDACommandRunLoopSourcePort = NULL;
+/*
+ * Each running command is watched with its own EVFILT_PROC event on our kqueue.  The event carries
+ * the job, such that a child's exit is matched to its job without a list scan or a lock.  A command
+ * with a deadline is also watched with an EVFILT_TIMER event.  On expiry the command is asked to
+ * terminate with SIGTERM, then killed with SIGKILL once __kDACommandTimeoutGrace has passed.
+ */
+
+static const CFTimeInterval __kDACommandTimeoutGrace = 5;
+
+static CFFileDescriptorRef    __gDACommandRunLoopSourceDescriptor = NULL;
+static volatile int32_t       __gDACommandRunLoopSourceJobsCount  = 0;
+static pthread_mutex_t        __gDACommandRunLoopSourceLock       = PTHREAD_MUTEX_INITIALIZER;
+static int                    __gDACommandRunLoopSourceQueue      = -1;
+
+/*
+ * Commands that name a queue, typically the device they operate on, are scheduled.  No more than
+ * __kDACommandScheduleLimit scheduled commands run at once, of which no more than
+ * __kDACommandScheduleLimitBackground are background commands, such that long repairs leave room
+ * for probes and mounts.  A waiting command is chosen by its priority first, by the number of
+ * commands running against its queue next, and by its age last, such that one busy device cannot
+ * starve the others.  The scheduler runs on the main thread.
+ */
+
+struct __DACommandScheduleJob
+{
+    char **                         argv;
+    DACommandExecuteCallback        callback;
+    void *                          callbackContext;
+    Boolean                         canceled;
+    __DACommandRunLoopSourceJob *   command;
+    struct __DACommandScheduleJob * next;
+    UInt32                          options;
+    DACommandOutputCallback         outputCallback;
+    CFStringRef                     queue;
+    CFTimeInterval                  timeout;
+    gid_t                           userGID;
+    uid_t                           userUID;
+};
 
-static void __DACommandExecute( char * const *           argv,
-                                UInt32                   options,
-                                uid_t                    userUID,
-                                gid_t                    userGID,
-                                DACommandExecuteCallback callback,
-                                void *                   callbackContext )
+typedef struct __DACommandScheduleJob __DACommandScheduleJob;
+
+static const CFIndex __kDACommandScheduleLimit           = 8;
+static const CFIndex __kDACommandScheduleLimitBackground = 4;
+
+static CFMutableBagRef          __gDACommandScheduleBag             = NULL;
+static CFIndex                  __gDACommandScheduleCount           = 0;
+static CFIndex                  __gDACommandScheduleCountBackground = 0;
+static __DACommandScheduleJob * __gDACommandScheduleJobs           = NULL;
+static __DACommandScheduleJob * __gDACommandScheduleJobsActive     = NULL;
+static __DACommandScheduleJob * __gDACommandScheduleJobsTail       = NULL;
+
+static void  __DACommandRunLoopSourceAddJob( __DACommandRunLoopSourceJob * job );
+static void  __DACommandRunLoopSourceCancelJob( __DACommandRunLoopSourceJob * job, int status, int sig );
+static void  __DACommandRunLoopSourceRead( __DACommandRunLoopSourceJob * job );
+static void  __DACommandScheduleCallback( int status, CFDataRef output, void * context );
+static void  __DACommandScheduleDispatch( void );
+static void  __DACommandScheduleOutputCallback( CFDataRef line, void * context );
+static pid_t __DACommandSpawn( char * const * argv, int outputPipe, uid_t userUID, gid_t userGID );
+
+static void __DACommandExecute( char * const *                 argv,
+                                UInt32                         options,
+                                CFTimeInterval                 timeout,
+                                uid_t                          userUID,
+                                gid_t                          userGID,
+                                DACommandExecuteCallback       callback,
+                                DACommandOutputCallback        outputCallback,
+                                void *                         callbackContext,
+                                __DACommandRunLoopSourceJob ** command )
 {
     /*
-     * Execute a command as the specified user.  The argument list must be NULL terminated.
+     * Execute a command as the specified user.  The argument list must be NULL terminated.  The
+     * running job is returned through command, if specified, ahead of any callback.
      */
 
-    pid_t           executablePID = 0;
-    int             outputPipe[2] = { -1, -1 };
-    int             status        = EX_OK;
+    pid_t                         executablePID = 0;
+    __DACommandRunLoopSourceJob * job           = NULL;
+    int                           outputPipe[2] = { -1, -1 };
+    int                           status        = EX_OK;
 
     /*
      * State our assumptions.
      */
 
-    assert( __gDACommandRunLoopSourcePort );
+    assert( __gDACommandRunLoopSourceQueue != -1 );
+
+    /*
+     * Create the job up front.  A child we cannot watch is a child we cannot reap.
+     */
+
+    job = malloc( sizeof( __DACommandRunLoopSourceJob ) );
+    if ( job == NULL )  { status = EX_OSERR; goto __DACommandExecuteErr; }
+
+    job->execute.output     = NULL;
+    job->execute.outputLine = NULL;
 
     /*
      * Create a pipe in order to capture the executable output.
      */
 
-    if ( ( options & kDACommandExecuteOptionCaptureOutput ) )
+    if ( ( options & kDACommandExecuteOptionCaptureOutput ) || outputCallback )
     {
         status = pipe( outputPipe );
         if ( status )  { status = EX_NOINPUT; goto __DACommandExecuteErr; }
     }
 
     /*
-     * Fork in order to run the executable.
+     * Spawn, or fork, in order to run the executable.
      */
 
-    pthread_mutex_lock( &__gDACommandRunLoopSourceLock );
-
-    executablePID = fork( );
+    executablePID = __DACommandSpawn( argv, outputPipe[1], userUID, userGID );
 
     if ( executablePID == 0 )
     {
-        int fd;
+        executablePID = fork( );
 
-        /*
-         * Prepare the post-fork execution environment.
-         */
+        if ( executablePID == 0 )
+        {
+            int fd;
 
-        setgid( userGID );
-        setuid( userUID );
+            /*
+             * Prepare the post-fork execution environment.
+             */
 
-        for ( fd = getdtablesize() - 1; fd > -1; fd-- )
-        {
-            if ( fd != outputPipe[1] )
+            setgid( userGID );
+            setuid( userUID );
+
+            for ( fd = getdtablesize() - 1; fd > -1; fd-- )
             {
-                close( fd );
+                if ( fd != outputPipe[1] )
+                {
+                    close( fd );
+                }
             }
-        }
-
-        fd = open( _PATH_DEVNULL, O_RDWR, 0 );
 
-        if ( fd != -1 )
-        {
-            dup2( fd, STDIN_FILENO );
-            dup2( fd, STDOUT_FILENO );
-            dup2( fd, STDERR_FILENO );
+            fd = open( _PATH_DEVNULL, O_RDWR, 0 );
 
-            if ( fd > 2 )
+            if ( fd != -1 )
             {
-                close( fd );
+                dup2( fd, STDIN_FILENO );
+                dup2( fd, STDOUT_FILENO );
+                dup2( fd, STDERR_FILENO );
+
+                if ( fd > 2 )
+                {
+                    close( fd );
+                }
             }
-        }
 
-        if ( outputPipe[1] != -1 )
-        {
-            dup2( outputPipe[1], STDOUT_FILENO );
+            if ( outputPipe[1] != -1 )
+            {
+                dup2( outputPipe[1], STDOUT_FILENO );
 
-            close( outputPipe[1] );
-        }
+                close( outputPipe[1] );
+            }
 
-        /*
-         * Run the executable.
-         */
+            /*
+             * Run the executable.
+             */
 
-        execv( argv[0], argv );
+            execv( argv[0], argv );
 
-        _exit( EX_OSERR );
+            _exit( EX_OSERR );
+        }
     }
 
-    if ( executablePID != -1 )
-    {
-        /*
-         * Register this callback job on our queue.
-         */
+    if ( executablePID == -1 )  { status = EX_OSERR; goto __DACommandExecuteErr; }
 
-        if ( callback )
-        {
-            __DACommandRunLoopSourceJob * job;
+    DATraceStart( kDATraceCommand, executablePID, 0, 0 );
 
-            job = malloc( sizeof( __DACommandRunLoopSourceJob ) );
+    /*
+     * Watch for the child's exit.  The job now belongs to our queue.
+     */
 
-            if ( job )
-            {
-                job->kind = __kDACommandRunLoopSourceJobKindExecute;
-                job->next = __gDACommandRunLoopSourceJobs;
+    job->kind = __kDACommandRunLoopSourceJobKindExecute;
 
-                job->execute.pid             = executablePID;
-                job->execute.pipe            = ( outputPipe[0] != -1 ) ? dup( outputPipe[0] ) : -1;
-                job->execute.callback        = callback;
-                job->execute.callbackContext = callbackContext;
+    job->execute.pid             = executablePID;
+    job->execute.pipe            = ( outputPipe[0] != -1 ) ? dup( outputPipe[0] ) : -1;
+    job->execute.outputCallback  = outputCallback;
+    job->execute.status          = 0;
+    job->execute.timeout         = timeout;
+    job->execute.callback        = callback;
+    job->execute.callbackContext = callbackContext;
 
-                __gDACommandRunLoopSourceJobs = job;
-            }
+    if ( job->execute.pipe != -1 )
+    {
+        fcntl( job->execute.pipe, F_SETFL, O_NONBLOCK );
+
+        if ( ( options & kDACommandExecuteOptionCaptureOutput ) )
+        {
+            job->execute.output = CFDataCreateMutable( kCFAllocatorDefault, 0 );
+        }
+
+        if ( outputCallback )
+        {
+            job->execute.outputLine = CFDataCreateMutable( kCFAllocatorDefault, 0 );
         }
     }
 
-    pthread_mutex_unlock( &__gDACommandRunLoopSourceLock );
+    __DACommandRunLoopSourceAddJob( job );
 
-    if ( executablePID == -1 )  { status = EX_OSERR; goto __DACommandExecuteErr; }
+    if ( command )  *command = job;
+
+    job = NULL;
 
     /*
      * Release our resources.
@@ -189,6 +283,13 @@ static void __DACommandExecute( char * const *           argv,
 
 __DACommandExecuteErr:
 
+    if ( job )  free( job );
+
+    if ( status )
+    {
+        if ( command )  *command = NULL;
+    }
+
     if ( outputPipe[0] != -1 )  close( outputPipe[0] );
     if ( outputPipe[1] != -1 )  close( outputPipe[1] );
 
@@ -205,313 +306,824 @@ __DACommandExecuteErr:
     }
 }
 
-static void __DACommandRunLoopSourceCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info )
+static void __DACommandExecuteWithArguments( CFURLRef                 executable,
+                                             DACommandExecuteOptions  options,
+                                             CFStringRef              queue,
+                                             CFTimeInterval           timeout,
+                                             uid_t                    userUID,
+                                             gid_t                    userGID,
+                                             DACommandExecuteCallback callback,
+                                             DACommandOutputCallback  outputCallback,
+                                             void *                   callbackContext,
+                                             va_list                  arguments )
 {
     /*
-     * Process a DACommand CFRunLoopSource fire.  __DACommandSignal() triggers the fire when
-     * a child exits or stops.  We locate the appropriate callback candidate in our job list
-     * and issue the callback.
+     * Execute a command as the specified user.  The argument list maps to argv[1] and up.  All
+     * arguments in the argument list shall be of type CFTypeRef, which are converted to string
+     * form via CFCopyDescription().  The argument list must be NULL terminated.  The command is
+     * scheduled against the specified queue, if any.  The command is terminated should it run for
+     * longer than the specified timeout, if any.
      */
 
-    pid_t pid;
-    int   status;
+    int         argc      = 0;
+    char **     argv      = NULL;
+    CFTypeRef   argument  = NULL;
+    va_list     argumentsCopy;
+    int         status    = EX_OK;
 
     /*
-     * Scan through exited or stopped children.
+     * Construct the list of arguments -- compute argc.
      */
 
-    while ( ( pid = waitpid( -1, &status, WNOHANG ) ) > 0 )
-    {
-        __DACommandRunLoopSourceJob * job     = NULL;
-        __DACommandRunLoopSourceJob * jobLast = NULL;
+    va_copy( argumentsCopy, arguments );
 
-        pthread_mutex_lock( &__gDACommandRunLoopSourceLock );
+    for ( argc = 1; va_arg( argumentsCopy, CFTypeRef ); argc++ )  {  }
 
-        /*
-         * Scan through job list.
-         */
+    va_end( argumentsCopy );
 
-        for ( job = __gDACommandRunLoopSourceJobs; job; jobLast = job, job = job->next )
-        {
-            assert( job->kind == __kDACommandRunLoopSourceJobKindExecute );
+    /*
+     * Construct the list of arguments -- allocate argv.
+     */
 
-            if ( job->execute.pid == pid )
-            {
-                /*
-                 * Process the job's callback.
-                 */
+    argv = malloc( ( argc + 1 ) * sizeof( char * ) );
+    if ( argv == NULL )  { status = EX_SOFTWARE; goto DACommandExecuteErr; }
 
-                CFMutableDataRef output = NULL;
+    memset( argv, 0, ( argc + 1 ) * sizeof( char * ) );
 
-                if ( jobLast )
-                {
-                    jobLast->next = job->next;
-                }
-                else
-                {
-                    __gDACommandRunLoopSourceJobs = job->next;
-                }
+    /*
+     * Construct the list of arguments -- fill out argv[0].
+     */
 
-                pthread_mutex_unlock( &__gDACommandRunLoopSourceLock );
+    argv[0] = ___CFURLCopyFileSystemRepresentation( executable );
+    if ( argv[0] == NULL )  { status = EX_DATAERR; goto DACommandExecuteErr; }
 
-                /*
-                 * Capture the executable's output, or the last remains of it, from the pipe.
-                 */
+    /*
+     * Construct the list of arguments -- fill out argv[1] through argv[argc].
+     */
 
-                if ( job->execute.pipe != -1 )
-                {
-                    output = CFDataCreateMutable( kCFAllocatorDefault, 0 );
+    for ( argc = 1; ( argument = va_arg( arguments, CFTypeRef ) ); argc++ )
+    {
+        CFStringRef string;
 
-                    if ( output )
-                    {
-                        UInt8 * buffer;
-                        
-                        buffer = malloc( PIPE_BUF );
+        string = CFStringCreateWithFormat( kCFAllocatorDefault, 0, CFSTR( "%@" ), argument );
 
-                        if ( buffer )
-                        {
-                            int count;
+        if ( string )
+        {
+            argv[argc] = ___CFStringCopyCString( string );
 
-                            while ( ( count = read( job->execute.pipe, buffer, PIPE_BUF ) ) > 0 )
-                            {
-                                CFDataAppendBytes( output, buffer, count );
-                            }
+            CFRelease( string );
+        }
 
-                            free( buffer );
-                        }
-                    }
+        if ( argv[argc] == NULL )  break;
+    }
 
-                    close( job->execute.pipe );
-                }
+    if ( argument )  { status = EX_SOFTWARE; goto DACommandExecuteErr; }
 
-                /*
-                 * Issue the callback.
-                 */
+    /*
+     * Run the executable.
+     */
 
-                status = WIFEXITED( status ) ? ( ( char ) WEXITSTATUS( status ) ) : status;
+    if ( queue )
+    {
+        __DACommandScheduleJob * job;
 
-                ( job->execute.callback )( status, output, job->execute.callbackContext );
+        job = malloc( sizeof( __DACommandScheduleJob ) );
+        if ( job == NULL )  { status = EX_SOFTWARE; goto DACommandExecuteErr; }
 
-                /*
-                 * Release our resources.
-                 */
+        if ( __gDACommandScheduleBag == NULL )
+        {
+            __gDACommandScheduleBag = CFBagCreateMutable( kCFAllocatorDefault, 0, &kCFTypeBagCallBacks );
 
-                if ( output )
-                {
-                    CFRelease( output );
-                }
+            assert( __gDACommandScheduleBag );
+        }
 
-                free( job );
+        job->argv            = argv;
+        job->callback        = callback;
+        job->callbackContext = callbackContext;
+        job->canceled        = FALSE;
+        job->command         = NULL;
+        job->next            = NULL;
+        job->options         = options;
+        job->outputCallback  = outputCallback;
+        job->queue           = CFRetain( queue );
+        job->timeout         = timeout;
+        job->userGID         = userGID;
+        job->userUID         = userUID;
+
+        if ( __gDACommandScheduleJobsTail )
+        {
+            __gDACommandScheduleJobsTail->next = job;
+        }
+        else
+        {
+            __gDACommandScheduleJobs = job;
+        }
 
-                pthread_mutex_lock( &__gDACommandRunLoopSourceLock );
+        __gDACommandScheduleJobsTail = job;
 
-                break;
-            }
+        /*
+         * The argument list now belongs to the job.
+         */
+
+        argv = NULL;
+
+        __DACommandScheduleDispatch( );
+    }
+    else
+    {
+        __DACommandExecute( argv, options, timeout, userUID, userGID, callback, outputCallback, callbackContext, NULL );
+    }
+
+    /*
+     * Release our resources.
+     */
+
+DACommandExecuteErr:
+
+    if ( argv )
+    {
+        for ( argc = 0; argv[argc]; argc++ )
+        {
+            free( argv[argc] );
         }
 
-        pthread_mutex_unlock( &__gDACommandRunLoopSourceLock );
+        free( argv );
+    }
+
+    /*
+     * Complete the call in case we had a local failure.
+     */
+
+    if ( status )
+    {
+        if ( callback )
+        {
+            ( callback )( status, NULL, callbackContext );
+        }
     }
 }
 
-static void __DACommandSignal( int sig )
+static void __DACommandRunLoopSourceAddJob( __DACommandRunLoopSourceJob * job )
 {
     /*
-     * Process a SIGCHLD signal.  mach_msg() is safe from a signal handler.
+     * Watch a child for its exit, and its output pipe for data.  Should the child have exited
+     * before we got to watch it, we post the job to our kqueue ourselves, so that it completes
+     * through the same path.
      */
 
-    mach_msg_header_t message;
-    kern_return_t     status;
+    struct kevent event;
+    int           status;
+
+    OSAtomicIncrement32( &__gDACommandRunLoopSourceJobsCount );
+
+    if ( job->execute.pipe != -1 )
+    {
+        EV_SET( &event, job->execute.pipe, EVFILT_READ, EV_ADD, 0, 0, job );
+
+        kevent( __gDACommandRunLoopSourceQueue, &event, 1, NULL, 0, NULL );
+    }
+
+    if ( job->execute.timeout > 0 )
+    {
+        EV_SET( &event, ( uintptr_t ) job, EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0, ( intptr_t ) ( job->execute.timeout * 1000 ), job );
+
+        kevent( __gDACommandRunLoopSourceQueue, &event, 1, NULL, 0, NULL );
+    }
 
-    message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
-    message.msgh_id          = 0;
-    message.msgh_local_port  = MACH_PORT_NULL;
-    message.msgh_remote_port = CFMachPortGetPort( __gDACommandRunLoopSourcePort );
-    message.msgh_reserved    = 0;
-    message.msgh_size        = sizeof( message );
+    EV_SET( &event, job->execute.pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, job );
 
-    status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+    status = kevent( __gDACommandRunLoopSourceQueue, &event, 1, NULL, 0, NULL );
 
-    if ( status == MACH_SEND_TIMED_OUT )
+    if ( status == -1 )
     {
-        mach_msg_destroy( &message );
+        EV_SET( &event, ( uintptr_t ) job, EVFILT_USER, EV_ADD | EV_ONESHOT, NOTE_TRIGGER, 0, job );
+
+        kevent( __gDACommandRunLoopSourceQueue, &event, 1, NULL, 0, NULL );
     }
 }
 
-CFRunLoopSourceRef DACommandCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
+static void __DACommandRunLoopSourceCancelJob( __DACommandRunLoopSourceJob * job, int status, int sig )
 {
     /*
-     * Create a CFRunLoopSource for DACommand callbacks.
+     * Signal a running child, which is to complete with the specified status.  The child is not
+     * reaped until its exit event is processed, so its pid cannot have been reused.
      */
 
-    CFRunLoopSourceRef source = NULL;
+    if ( job->execute.status == 0 )
+    {
+        job->execute.status = status;
+    }
 
-    pthread_mutex_lock( &__gDACommandRunLoopSourceLock );
+    kill( job->execute.pid, sig );
+}
 
+static void __DACommandRunLoopSourceCallback( CFFileDescriptorRef descriptor, CFOptionFlags callBackTypes, void * info )
+{
     /*
-     * Initialize our minimal state.
+     * Process a DACommand CFRunLoopSource fire.  Our kqueue becomes readable when a child writes
+     * output or exits.  Each event carries its job.  We drain the output as it arrives, and once
+     * the child exits, we reap it and issue the callback.
      */
 
-    if ( __gDACommandRunLoopSourcePort == NULL )
+    struct kevent   event;
+    struct timespec timeout = { 0, 0 };
+
+    while ( kevent( __gDACommandRunLoopSourceQueue, NULL, 0, &event, 1, &timeout ) > 0 )
     {
-        /*
-         * Create the global CFMachPort.  It will be used to post jobs to the run loop.
-         */
+        __DACommandRunLoopSourceJob * job;
+        pid_t                         pid;
+        int                           status = 0;
+
+        job = ( void * ) event.udata;
 
-        __gDACommandRunLoopSourcePort = CFMachPortCreate( kCFAllocatorDefault, __DACommandRunLoopSourceCallback, NULL, NULL );
+        assert( job->kind == __kDACommandRunLoopSourceJobKindExecute );
 
-        if ( __gDACommandRunLoopSourcePort )
+        if ( event.filter == EVFILT_READ )
+        {
+            if ( job->execute.pipe != -1 )
+            {
+                __DACommandRunLoopSourceRead( job );
+            }
+
+            continue;
+        }
+
+        if ( event.filter == EVFILT_TIMER )
         {
             /*
-             * Set up the global CFMachPort.  It requires no more than one queue element.
+             * Terminate the child, as it missed its deadline.  Kill it should it not comply.
              */
 
-            mach_port_limits_t limits = { 0 };
+            if ( job->execute.status == 0 )
+            {
+                DALogError( "command %d timed out after %.0f seconds.", job->execute.pid, job->execute.timeout );
+
+                __DACommandRunLoopSourceCancelJob( job, ETIMEDOUT, SIGTERM );
+
+                EV_SET( &event, ( uintptr_t ) job, EVFILT_TIMER, EV_ADD | EV_ONESHOT, 0, ( intptr_t ) ( __kDACommandTimeoutGrace * 1000 ), job );
 
-            limits.mpl_qlimit = 1;
+                kevent( __gDACommandRunLoopSourceQueue, &event, 1, NULL, 0, NULL );
+            }
+            else
+            {
+                __DACommandRunLoopSourceCancelJob( job, ETIMEDOUT, SIGKILL );
+            }
 
-            mach_port_set_attributes( mach_task_self( ),
-                                      CFMachPortGetPort( __gDACommandRunLoopSourcePort ),
-                                      MACH_PORT_LIMITS_INFO,
-                                      ( mach_port_info_t ) &limits,
-                                      MACH_PORT_LIMITS_INFO_COUNT );
+            continue;
         }
 
-        if ( __gDACommandRunLoopSourcePort )
+        /*
+         * Disarm the deadline, which must not outlive the job.
+         */
+
+        if ( job->execute.timeout > 0 )
         {
-            /*
-             * Set up the global signal handler to catch child status changes from BSD.
-             */
+            EV_SET( &event, ( uintptr_t ) job, EVFILT_TIMER, EV_DELETE, 0, 0, NULL );
+
+            kevent( __gDACommandRunLoopSourceQueue, &event, 1, NULL, 0, NULL );
+        }
+
+        /*
+         * Reap the child.  It has exited, so the wait is short.
+         */
+
+        while ( ( pid = waitpid( job->execute.pid, &status, 0 ) ) == -1 && errno == EINTR )  {  }
+
+        DATraceEnd( kDATraceCommand, job->execute.pid, status, 0 );
+
+        OSAtomicDecrement32( &__gDACommandRunLoopSourceJobsCount );
+
+        /*
+         * Capture the last remains of the executable's output from the pipe.  Closing the pipe
+         * removes its event, which must not outlive the job.
+         */
+
+        if ( job->execute.pipe != -1 )
+        {
+            fcntl( job->execute.pipe, F_SETFL, 0 );
+
+            while ( job->execute.pipe != -1 )
+            {
+                __DACommandRunLoopSourceRead( job );
+            }
+        }
+
+        /*
+         * Issue the callback.
+         */
+
+        if ( pid == -1 )
+        {
+            status = EX_OSERR;
+        }
+        else if ( job->execute.status )
+        {
+            status = job->execute.status;
+        }
+        else
+        {
+            status = WIFEXITED( status ) ? ( ( char ) WEXITSTATUS( status ) ) : status;
+        }
+
+        if ( job->execute.callback )
+        {
+            ( job->execute.callback )( status, job->execute.output, job->execute.callbackContext );
+        }
+
+        /*
+         * Release our resources.
+         */
+
+        if ( job->execute.output )
+        {
+            CFRelease( job->execute.output );
+        }
+
+        if ( job->execute.outputLine )
+        {
+            CFRelease( job->execute.outputLine );
+        }
+
+        free( job );
+    }
+
+    CFFileDescriptorEnableCallBacks( descriptor, kCFFileDescriptorReadCallBack );
+}
+
+static void __DACommandRunLoopSourceRead( __DACommandRunLoopSourceJob * job )
+{
+    /*
+     * Drain the output the child has written so far.  Each complete line is passed on to the
+     * output callback as it arrives, without its newline.  The pipe is closed at end of file.
+     */
 
-            sig_t sig;
+    UInt8   buffer[PIPE_BUF];
+    ssize_t count;
 
-            sig = signal( SIGCHLD, __DACommandSignal );
+    while ( ( count = read( job->execute.pipe, buffer, sizeof( buffer ) ) ) > 0 )
+    {
+        if ( job->execute.output )
+        {
+            CFDataAppendBytes( job->execute.output, buffer, count );
+        }
+
+        if ( job->execute.outputLine )
+        {
+            const UInt8 * bytes;
+            CFIndex       index;
+            CFIndex       length;
+            CFIndex       start;
+
+            CFDataAppendBytes( job->execute.outputLine, buffer, count );
 
-            if ( sig == SIG_ERR )
+            bytes  = CFDataGetBytePtr( job->execute.outputLine );
+            length = CFDataGetLength( job->execute.outputLine );
+
+            for ( index = 0, start = 0; index < length; index++ )
             {
-                CFRelease( __gDACommandRunLoopSourcePort );
+                if ( bytes[index] == '\n' )
+                {
+                    CFDataRef line;
 
-                __gDACommandRunLoopSourcePort = NULL;
+                    line = CFDataCreate( kCFAllocatorDefault, bytes + start, index - start );
+
+                    if ( line )
+                    {
+                        ( job->execute.outputCallback )( line, job->execute.callbackContext );
+
+                        CFRelease( line );
+                    }
+
+                    start = index + 1;
+                }
             }
+
+            CFDataDeleteBytes( job->execute.outputLine, CFRangeMake( 0, start ) );
         }
     }
 
+    if ( count == -1 )
+    {
+        if ( errno == EAGAIN || errno == EINTR )  return;
+    }
+
     /*
-     * Obtain the CFRunLoopSource for our CFMachPort.
+     * Pass on the last line, should the output not end with a newline.
      */
 
-    if ( __gDACommandRunLoopSourcePort )
+    if ( job->execute.outputLine )
     {
-        source = CFMachPortCreateRunLoopSource( allocator, __gDACommandRunLoopSourcePort, order );
+        if ( CFDataGetLength( job->execute.outputLine ) )
+        {
+            ( job->execute.outputCallback )( job->execute.outputLine, job->execute.callbackContext );
+
+            CFDataSetLength( job->execute.outputLine, 0 );
+        }
     }
 
-    pthread_mutex_unlock( &__gDACommandRunLoopSourceLock );
+    close( job->execute.pipe );
 
-    return source;
+    job->execute.pipe = -1;
 }
 
-void DACommandExecute( CFURLRef                 executable,
-                       DACommandExecuteOptions  options,
-                       uid_t                    userUID,
-                       gid_t                    userGID,
-                       DACommandExecuteCallback callback,
-                       void *                   callbackContext,
-                       ... )
+static void __DACommandScheduleCallback( int status, CFDataRef output, void * context )
 {
     /*
-     * Execute a command as the specified user.  The argument list maps to argv[1] and up.  All
-     * arguments in the argument list shall be of type CFTypeRef, which are converted to string
-     * form via CFCopyDescription().  The argument list must be NULL terminated.
+     * Process a scheduled command's completion.
      */
 
-    int         argc      = 0;
-    char **     argv      = NULL;
-    CFTypeRef   argument  = NULL;
-    va_list     arguments;
-    int         status    = EX_OK;
+    __DACommandScheduleJob * job     = context;
+    __DACommandScheduleJob * jobLast = NULL;
+    __DACommandScheduleJob * jobNext;
 
-    /*
-     * Construct the list of arguments -- compute argc.
-     */
+    for ( jobNext = __gDACommandScheduleJobsActive; jobNext; jobLast = jobNext, jobNext = jobNext->next )
+    {
+        if ( jobNext == job )
+        {
+            if ( jobLast )
+            {
+                jobLast->next = job->next;
+            }
+            else
+            {
+                __gDACommandScheduleJobsActive = job->next;
+            }
 
-    va_start( arguments, callbackContext );
+            break;
+        }
+    }
 
-    for ( argc = 1; va_arg( arguments, CFTypeRef ); argc++ )  {  }
+    __gDACommandScheduleCount--;
 
-    va_end( arguments );
+    if ( ( job->options & kDACommandExecuteOptionBackground ) )
+    {
+        __gDACommandScheduleCountBackground--;
+    }
+
+    CFBagRemoveValue( __gDACommandScheduleBag, job->queue );
+
+    if ( job->callback )
+    {
+        ( job->callback )( status, output, job->callbackContext );
+    }
 
+    CFRelease( job->queue );
+
+    free( job );
+
+    __DACommandScheduleDispatch( );
+}
+
+static void __DACommandScheduleDispatch( void )
+{
     /*
-     * Construct the list of arguments -- allocate argv.
+     * Run waiting commands for as long as there is room.
      */
 
-    argv = malloc( ( argc + 1 ) * sizeof( char * ) );
-    if ( argv == NULL )  { status = EX_SOFTWARE; goto DACommandExecuteErr; }
+    while ( __gDACommandScheduleJobs && __gDACommandScheduleCount < __kDACommandScheduleLimit )
+    {
+        char **                  argv;
+        CFIndex                  index;
+        __DACommandScheduleJob * job;
+        __DACommandScheduleJob * jobLast;
+        __DACommandScheduleJob * jobBest     = NULL;
+        __DACommandScheduleJob * jobBestLast = NULL;
+        CFIndex                  jobBestLoad = 0;
 
-    memset( argv, 0, ( argc + 1 ) * sizeof( char * ) );
+        /*
+         * Choose the next command.
+         */
+
+        for ( job = __gDACommandScheduleJobs, jobLast = NULL; job; jobLast = job, job = job->next )
+        {
+            CFIndex load;
+
+            if ( job->canceled )
+            {
+                jobBest     = job;
+                jobBestLast = jobLast;
+
+                break;
+            }
+
+            if ( ( job->options & kDACommandExecuteOptionBackground ) )
+            {
+                if ( __gDACommandScheduleCountBackground >= __kDACommandScheduleLimitBackground )  continue;
+            }
+
+            load = CFBagGetCountOfValue( __gDACommandScheduleBag, job->queue );
+
+            if ( jobBest )
+            {
+                if ( ( job->options & kDACommandExecuteOptionBackground ) > ( jobBest->options & kDACommandExecuteOptionBackground ) )  continue;
+
+                if ( ( job->options & kDACommandExecuteOptionBackground ) == ( jobBest->options & kDACommandExecuteOptionBackground ) )
+                {
+                    if ( load >= jobBestLoad )  continue;
+                }
+            }
+
+            jobBest     = job;
+            jobBestLast = jobLast;
+            jobBestLoad = load;
+        }
+
+        /*
+         * Leave the background commands waiting once they have taken their share.
+         */
+
+        if ( jobBest == NULL )  break;
+
+        if ( jobBestLast )
+        {
+            jobBestLast->next = jobBest->next;
+        }
+        else
+        {
+            __gDACommandScheduleJobs = jobBest->next;
+        }
+
+        if ( __gDACommandScheduleJobsTail == jobBest )
+        {
+            __gDACommandScheduleJobsTail = jobBestLast;
+        }
+
+        /*
+         * Run the command.  The job may complete before we return, in case of a local failure or
+         * of a cancellation.
+         */
+
+        argv = jobBest->argv;
+
+        __gDACommandScheduleCount++;
+
+        if ( ( jobBest->options & kDACommandExecuteOptionBackground ) )
+        {
+            __gDACommandScheduleCountBackground++;
+        }
+
+        CFBagAddValue( __gDACommandScheduleBag, jobBest->queue );
+
+        jobBest->next = __gDACommandScheduleJobsActive;
+
+        __gDACommandScheduleJobsActive = jobBest;
 
+        if ( jobBest->canceled )
+        {
+            __DACommandScheduleCallback( ECANCELED, NULL, jobBest );
+        }
+        else
+        {
+            __DACommandExecute( argv,
+                                jobBest->options,
+                                jobBest->timeout,
+                                jobBest->userUID,
+                                jobBest->userGID,
+                                __DACommandScheduleCallback,
+                                jobBest->outputCallback ? __DACommandScheduleOutputCallback : NULL,
+                                jobBest,
+                                &jobBest->command );
+        }
+
+        for ( index = 0; argv[index]; index++ )
+        {
+            free( argv[index] );
+        }
+
+        free( argv );
+    }
+}
+
+static void __DACommandScheduleOutputCallback( CFDataRef line, void * context )
+{
     /*
-     * Construct the list of arguments -- fill out argv[0].
+     * Process a scheduled command's line of output.
      */
 
-    argv[0] = ___CFURLCopyFileSystemRepresentation( executable );
-    if ( argv[0] == NULL )  { status = EX_DATAERR; goto DACommandExecuteErr; }
+    __DACommandScheduleJob * job = context;
+
+    ( job->outputCallback )( line, job->callbackContext );
+}
 
+static pid_t __DACommandSpawn( char * const * argv, int outputPipe, uid_t userUID, gid_t userGID )
+{
     /*
-     * Construct the list of arguments -- fill out argv[1] through argv[argc].
+     * Spawn a command as the specified user, without duplicating our address space and port
+     * space as fork() would.  Every descriptor but the standard ones is closed on execution.
+     * We return 0 if posix_spawn() cannot switch to the specified user on this system, or if it
+     * fails, in which case the caller shall fork instead.  A failure to execute is thus reported
+     * as the EX_OSERR exit status of the child, as it always was.
      */
 
-    va_start( arguments, callbackContext );
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t          attributes;
+    pid_t                      pid;
+    int                        status;
 
-    for ( argc = 1; ( argument = va_arg( arguments, CFTypeRef ) ); argc++ )
+    if ( userUID != geteuid( ) || userGID != getegid( ) )
     {
-        CFStringRef string;
+        if ( posix_spawnattr_set_uid_np == NULL )  return 0;
+        if ( posix_spawnattr_set_gid_np == NULL )  return 0;
+    }
 
-        string = CFStringCreateWithFormat( kCFAllocatorDefault, 0, CFSTR( "%@" ), argument );
+    status = posix_spawnattr_init( &attributes );
+    if ( status )  return 0;
 
-        if ( string )
-        {
-            argv[argc] = ___CFStringCopyCString( string );
+    status = posix_spawn_file_actions_init( &actions );
+    if ( status )  { posix_spawnattr_destroy( &attributes ); return 0; }
 
-            CFRelease( string );
-        }
+    /*
+     * Prepare the execution environment.
+     */
 
-        if ( argv[argc] == NULL )  break;
+    status |= posix_spawnattr_setflags( &attributes, POSIX_SPAWN_CLOEXEC_DEFAULT );
+
+    if ( userUID != geteuid( ) || userGID != getegid( ) )
+    {
+        status |= posix_spawnattr_set_gid_np( &attributes, userGID );
+        status |= posix_spawnattr_set_uid_np( &attributes, userUID );
     }
 
-    va_end( arguments );
+    status |= posix_spawn_file_actions_addopen( &actions, STDIN_FILENO, _PATH_DEVNULL, O_RDWR, 0 );
+    status |= posix_spawn_file_actions_adddup2( &actions, STDIN_FILENO, STDOUT_FILENO );
+    status |= posix_spawn_file_actions_adddup2( &actions, STDIN_FILENO, STDERR_FILENO );
 
-    if ( argument )  { status = EX_SOFTWARE; goto DACommandExecuteErr; }
+    if ( outputPipe != -1 )
+    {
+        status |= posix_spawn_file_actions_adddup2( &actions, outputPipe, STDOUT_FILENO );
+    }
 
     /*
      * Run the executable.
      */
 
-    __DACommandExecute( argv, options, userUID, userGID, callback, callbackContext );
+    if ( status )
+    {
+        pid = 0;
+    }
+    else
+    {
+        status = posix_spawn( &pid, argv[0], &actions, &attributes, argv, *_NSGetEnviron( ) );
+
+        if ( status )  pid = 0;
+    }
+
+    posix_spawn_file_actions_destroy( &actions );
+    posix_spawnattr_destroy( &attributes );
 
+    return pid;
+}
+
+void DACommandCancel( CFStringRef queue )
+{
     /*
-     * Release our resources.
+     * Cancel the commands scheduled against the specified queue.  A running command is killed,
+     * and a waiting one is never run.  Either completes with ECANCELED from the run loop.
      */
 
-DACommandExecuteErr:
+    __DACommandScheduleJob * job;
 
-    if ( argv )
+    for ( job = __gDACommandScheduleJobs; job; job = job->next )
     {
-        for ( argc = 0; argv[argc]; argc++ )
+        if ( CFEqual( job->queue, queue ) )
         {
-            free( argv[argc] );
+            job->canceled = TRUE;
         }
+    }
 
-        free( argv );
+    for ( job = __gDACommandScheduleJobsActive; job; job = job->next )
+    {
+        if ( CFEqual( job->queue, queue ) )
+        {
+            if ( job->command )
+            {
+                __DACommandRunLoopSourceCancelJob( job->command, ECANCELED, SIGKILL );
+            }
+        }
     }
+}
 
+CFRunLoopSourceRef DACommandCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
+{
     /*
-     * Complete the call in case we had a local failure.
+     * Create a CFRunLoopSource for DACommand callbacks.
      */
 
-    if ( status )
+    CFRunLoopSourceRef source = NULL;
+
+    pthread_mutex_lock( &__gDACommandRunLoopSourceLock );
+
+    /*
+     * Initialize our minimal state.
+     */
+
+    if ( __gDACommandRunLoopSourceDescriptor == NULL )
     {
-        if ( callback )
+        /*
+         * Create the global kqueue.  It will be used to post child exits to the run loop.
+         */
+
+        __gDACommandRunLoopSourceQueue = kqueue( );
+
+        if ( __gDACommandRunLoopSourceQueue != -1 )
         {
-            ( callback )( status, NULL, callbackContext );
+            __gDACommandRunLoopSourceDescriptor = CFFileDescriptorCreate( kCFAllocatorDefault,
+                                                                          __gDACommandRunLoopSourceQueue,
+                                                                          TRUE,
+                                                                          __DACommandRunLoopSourceCallback,
+                                                                          NULL );
+
+            if ( __gDACommandRunLoopSourceDescriptor )
+            {
+                CFFileDescriptorEnableCallBacks( __gDACommandRunLoopSourceDescriptor, kCFFileDescriptorReadCallBack );
+            }
+            else
+            {
+                close( __gDACommandRunLoopSourceQueue );
+
+                __gDACommandRunLoopSourceQueue = -1;
+            }
         }
     }
+
+    /*
+     * Obtain the CFRunLoopSource for our CFFileDescriptor.
+     */
+
+    if ( __gDACommandRunLoopSourceDescriptor )
+    {
+        source = CFFileDescriptorCreateRunLoopSource( allocator, __gDACommandRunLoopSourceDescriptor, order );
+    }
+
+    pthread_mutex_unlock( &__gDACommandRunLoopSourceLock );
+
+    return source;
+}
+
+void DACommandExecute( CFURLRef                 executable,
+                       DACommandExecuteOptions  options,
+                       CFStringRef              queue,
+                       CFTimeInterval           timeout,
+                       uid_t                    userUID,
+                       gid_t                    userGID,
+                       DACommandExecuteCallback callback,
+                       void *                   callbackContext,
+                       ... )
+{
+    /*
+     * Execute a command as the specified user.  The argument list must be NULL terminated.
+     */
+
+    va_list arguments;
+
+    va_start( arguments, callbackContext );
+
+    __DACommandExecuteWithArguments( executable, options, queue, timeout, userUID, userGID, callback, NULL, callbackContext, arguments );
+
+    va_end( arguments );
+}
+
+void DACommandExecuteWithOutputCallback( CFURLRef                 executable,
+                                         DACommandExecuteOptions  options,
+                                         CFStringRef              queue,
+                                         CFTimeInterval           timeout,
+                                         uid_t                    userUID,
+                                         gid_t                    userGID,
+                                         DACommandExecuteCallback callback,
+                                         DACommandOutputCallback  outputCallback,
+                                         void *                   callbackContext,
+                                         ... )
+{
+    /*
+     * Execute a command as the specified user.  Each line of the command's output is passed on to
+     * the output callback as soon as it arrives, ahead of the completion callback.  The argument
+     * list must be NULL terminated.
+     */
+
+    va_list arguments;
+
+    va_start( arguments, callbackContext );
+
+    __DACommandExecuteWithArguments( executable, options, queue, timeout, userUID, userGID, callback, outputCallback, callbackContext, arguments );
+
+    va_end( arguments );
+}
+
+CFIndex DACommandGetCount( void )
+{
+    /*
+     * Obtain the number of commands in flight, whether running or waiting on the scheduler.
+     */
+
+    CFIndex                  count = 0;
+    __DACommandScheduleJob * jobWait;
+
+    count = __gDACommandRunLoopSourceJobsCount;
+
+    for ( jobWait = __gDACommandScheduleJobs; jobWait; jobWait = jobWait->next )
+    {
+        count++;
+    }
+
+    return count;
 }
@@ -34,23 +34,43 @@ extern "C" {
 enum
 {
     kDACommandExecuteOptionDefault       = 0x00000000,
-    kDACommandExecuteOptionCaptureOutput = 0x00000001
+    kDACommandExecuteOptionCaptureOutput = 0x00000001,
+    kDACommandExecuteOptionBackground    = 0x00000002
 };
 
 typedef UInt32 DACommandExecuteOptions;
 
 typedef void ( *DACommandExecuteCallback )( int status, CFDataRef output, void * context );
 
+typedef void ( *DACommandOutputCallback )( CFDataRef line, void * context );
+
+extern void DACommandCancel( CFStringRef queue );
+
 extern CFRunLoopSourceRef DACommandCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order );
 
 extern void DACommandExecute( CFURLRef                 executable,
                               DACommandExecuteOptions  options,
+                              CFStringRef              queue,
+                              CFTimeInterval           timeout,
                               uid_t                    userUID,
                               gid_t                    userGID,
                               DACommandExecuteCallback callback,
                               void *                   callbackContext,
                               ... );
 
+extern void DACommandExecuteWithOutputCallback( CFURLRef                 executable,
+                                                DACommandExecuteOptions  options,
+                                                CFStringRef              queue,
+                                                CFTimeInterval           timeout,
+                                                uid_t                    userUID,
+                                                gid_t                    userGID,
+                                                DACommandExecuteCallback callback,
+                                                DACommandOutputCallback  outputCallback,
+                                                void *                   callbackContext,
+                                                ... );
+
+extern CFIndex DACommandGetCount( void );
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
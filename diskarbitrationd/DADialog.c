@@ -28,13 +28,30 @@
 
 #include <xpc/private.h>
 
-static void __DADialogShow( DADiskRef disk, _DAAgentAction action )
-{
-    xpc_object_t message;
+/*
+ * Messages for the agent are held back for a moment, such that the disks of one event, say a hub
+ * of unreadable devices being plugged in, reach it in one message per action.  The connection is
+ * kept across messages, for as long as the console user stays the same.
+ */
 
-    message = xpc_dictionary_create( NULL, NULL, 0 );
+static const CFTimeInterval __kDADialogListDelay = 0.5;
+
+static xpc_connection_t  __gDADialogConnection    = NULL;
+static uid_t             __gDADialogConnectionUID = 0;
+static xpc_object_t      __gDADialogList[ _kDAAgentActionShowDeviceUnrepairable + 1 ] = { NULL };
+static CFRunLoopTimerRef __gDADialogListTimer     = NULL;
+
+static xpc_connection_t __DADialogGetConnection( void )
+{
+    if ( __gDADialogConnection )
+    {
+        if ( __gDADialogConnectionUID != gDAConsoleUserUID )
+        {
+            DADialogInvalidate( );
+        }
+    }
 
-    if ( message )
+    if ( __gDADialogConnection == NULL )
     {
         xpc_connection_t connection;
 
@@ -42,26 +59,174 @@ static void __DADialogShow( DADiskRef disk, _DAAgentAction action )
 
         if ( connection )
         {
-            CFDataRef serialization;
+            /*
+             * The connection is dropped once it is no longer valid.  It is not dropped when it is
+             * interrupted, as the next message relaunches the agent.
+             */
+
+            xpc_connection_set_target_queue( connection, dispatch_get_main_queue( ) );
+
+            xpc_connection_set_event_handler( connection, ^( xpc_object_t object )
+            {
+                if ( object == XPC_ERROR_CONNECTION_INVALID )
+                {
+                    if ( __gDADialogConnection == connection )
+                    {
+                        xpc_release( __gDADialogConnection );
+
+                        __gDADialogConnection = NULL;
+                    }
+                }
+            } );
+
+            xpc_connection_set_target_uid( connection, gDAConsoleUserUID );
+
+            xpc_connection_resume( connection );
+
+            __gDADialogConnection    = connection;
+            __gDADialogConnectionUID = gDAConsoleUserUID;
+        }
+    }
+
+    return __gDADialogConnection;
+}
+
+static void __DADialogListTimerCallback( CFRunLoopTimerRef timer, void * info )
+{
+    _DAAgentAction action;
+
+    for ( action = _kDAAgentActionShowDeviceRemoval; action <= _kDAAgentActionShowDeviceUnrepairable; action++ )
+    {
+        xpc_object_t list;
+
+        list = __gDADialogList[action];
+
+        if ( list )
+        {
+            xpc_object_t message;
 
-            serialization = DADiskGetSerialization( disk );
+            __gDADialogList[action] = NULL;
 
-            xpc_dictionary_set_uint64( message, _kDAAgentActionKey, action );
+            message = xpc_dictionary_create( NULL, NULL, 0 );
 
-            xpc_dictionary_set_data( message, _kDAAgentDiskKey, CFDataGetBytePtr( serialization ), CFDataGetLength( serialization ) );
+            if ( message )
+            {
+                xpc_connection_t connection;
 
-            xpc_connection_set_event_handler( connection, ^( xpc_object_t object ) { } );
+                connection = __DADialogGetConnection( );
 
-            xpc_connection_set_target_uid( connection, gDAConsoleUserUID );
+                if ( connection )
+                {
+                    xpc_dictionary_set_uint64( message, _kDAAgentActionKey, action );
 
-            xpc_connection_resume( connection );
+                    /*
+                     * A single disk is sent as before, for the sake of an agent that knows no lists.
+                     */
+
+                    if ( xpc_array_get_count( list ) == 1 )
+                    {
+                        xpc_dictionary_set_value( message, _kDAAgentDiskKey, xpc_array_get_value( list, 0 ) );
+                    }
+                    else
+                    {
+                        xpc_dictionary_set_value( message, _kDAAgentDiskListKey, list );
+                    }
+
+                    xpc_connection_send_message( connection, message );
+                }
+
+                xpc_release( message );
+            }
 
-            xpc_connection_send_message( connection, message );
+            xpc_release( list );
+        }
+    }
+}
+
+static void __DADialogShow( DADiskRef disk, _DAAgentAction action )
+{
+    CFDataRef serialization;
+
+    serialization = DADiskGetSerialization( disk );
+
+    if ( serialization )
+    {
+        xpc_object_t   data;
+        _DAAgentAction index;
+        Boolean        pending;
+
+        pending = FALSE;
+
+        for ( index = _kDAAgentActionShowDeviceRemoval; index <= _kDAAgentActionShowDeviceUnrepairable; index++ )
+        {
+            if ( __gDADialogList[index] )
+            {
+                pending = TRUE;
+            }
+        }
+
+        if ( __gDADialogList[action] == NULL )
+        {
+            __gDADialogList[action] = xpc_array_create( NULL, 0 );
+        }
 
-            xpc_release( connection );
+        data = xpc_data_create( CFDataGetBytePtr( serialization ), CFDataGetLength( serialization ) );
+
+        if ( data )
+        {
+            if ( __gDADialogList[action] )
+            {
+                xpc_array_append_value( __gDADialogList[action], data );
+            }
+
+            xpc_release( data );
+        }
+
+        /*
+         * The delay runs from the first disk held back, such that a steady stream of disks does not
+         * hold back the message for good.
+         */
+
+        if ( pending == FALSE )
+        {
+            CFAbsoluteTime clock;
+
+            clock = CFAbsoluteTimeGetCurrent( ) + __kDADialogListDelay;
+
+            if ( __gDADialogListTimer )
+            {
+                CFRunLoopTimerSetNextFireDate( __gDADialogListTimer, clock );
+            }
+            else
+            {
+                __gDADialogListTimer = CFRunLoopTimerCreate( kCFAllocatorDefault, clock, kCFAbsoluteTimeIntervalSince1904, 0, 0, __DADialogListTimerCallback, NULL );
+
+                if ( __gDADialogListTimer )
+                {
+                    CFRunLoopAddTimer( CFRunLoopGetCurrent( ), __gDADialogListTimer, kCFRunLoopDefaultMode );
+                }
+                else
+                {
+                    __DADialogListTimerCallback( NULL, NULL );
+                }
+            }
         }
+    }
+}
+
+void DADialogInvalidate( void )
+{
+    if ( __gDADialogConnection )
+    {
+        xpc_connection_t connection;
+
+        connection = __gDADialogConnection;
+
+        __gDADialogConnection = NULL;
+
+        xpc_connection_cancel( connection );
 
-        xpc_release( message );
+        xpc_release( connection );
     }
 }
 
@@ -32,6 +32,7 @@
 extern "C" {
 #endif /* __cplusplus */
 
+extern void DADialogInvalidate( void );
 extern void DADialogShowDeviceRemoval( DADiskRef disk );
 extern void DADialogShowDeviceUnreadable( DADiskRef disk );
 extern void DADialogShowDeviceUnrepairable( DADiskRef disk );
@@ -26,9 +26,12 @@
 #include "DABase.h"
 #include "DAInternal.h"
 #include "DALog.h"
+#include "DAStage.h"
+#include "DASupport.h"
 
 #include <grp.h>
 #include <paths.h>
+#include <pthread.h>
 #include <pwd.h>
 #include <CoreFoundation/CFRuntime.h>
 #include <DiskArbitration/DiskArbitrationPrivate.h>
@@ -40,6 +43,42 @@
 #include <IOKit/storage/IODVDMedia.h>
 #include <IOKit/storage/IOStorageDeviceCharacteristics.h>
 
+#define __kDADiskDeviceEjectUponLogoutKey CFSTR( "DAEjectUponLogout" )
+#define __kDADiskHistoryLimit             16
+#define __kDADiskStateStagedCount         6
+#define __kDADiskStateStagedMask          ( kDADiskStateStagedProbe     | \
+                                            kDADiskStateStagedPeek      | \
+                                            kDADiskStateStagedAppear    | \
+                                            kDADiskStateStagedApprove   | \
+                                            kDADiskStateStagedAuthorize | \
+                                            kDADiskStateStagedMount     )
+
+/*
+ * The well-known description keys that the staging, mounting and queueing loops look at keep a
+ * fixed slot, which mirrors the value held by the description dictionary.
+ */
+
+enum
+{
+    __kDADiskSlotDeviceInternal,
+    __kDADiskSlotMediaContent,
+    __kDADiskSlotMediaEjectable,
+    __kDADiskSlotMediaLeaf,
+    __kDADiskSlotMediaRemovable,
+    __kDADiskSlotMediaSize,
+    __kDADiskSlotMediaType,
+    __kDADiskSlotMediaUUID,
+    __kDADiskSlotMediaWhole,
+    __kDADiskSlotMediaWritable,
+    __kDADiskSlotVolumeKind,
+    __kDADiskSlotVolumeMountable,
+    __kDADiskSlotVolumeName,
+    __kDADiskSlotVolumeNetwork,
+    __kDADiskSlotVolumePath,
+    __kDADiskSlotVolumeUUID,
+    __kDADiskSlotCount
+};
+
 struct __DADisk
 {
     CFRuntimeBase          _base;
@@ -49,6 +88,7 @@ struct __DADisk
     DACallbackRef          _claim;
     CFTypeRef              _context;
     CFTypeRef              _contextRe;
+    CFMutableDictionaryRef _deliveries;
     CFMutableDictionaryRef _description;
     CFURLRef               _device;
     char *                 _deviceLink[2];
@@ -56,12 +96,16 @@ struct __DADisk
     char *                 _devicePath[2];
     SInt32                 _deviceUnit;
     DAFileSystemRef        _filesystem;
+    UInt32                 _generation;
+    CFStringRef            _history[__kDADiskHistoryLimit];
     char *                 _id;
     io_service_t           _media;
     mode_t                 _mode;
     DADiskOptions          _options;
     io_object_t            _propertyNotification;
     CFDataRef              _serialization;
+    CFTypeRef              _slots[__kDADiskSlotCount];
+    CFAbsoluteTime         _stageTime;
     DADiskState            _state;
     gid_t                  _userGID;
     uid_t                  _userUID;
@@ -74,6 +118,7 @@ static CFStringRef __DADiskCopyFormattingDescription( CFTypeRef object, CFDictio
 static void        __DADiskDeallocate( CFTypeRef object );
 static Boolean     __DADiskEqual( CFTypeRef object1, CFTypeRef object2 );
 static CFHashCode  __DADiskHash( CFTypeRef object );
+static void        __DADiskSetSnapshotDirty( DADiskRef disk, Boolean dirty );
 
 static const CFRuntimeClass __DADiskClass =
 {
@@ -90,6 +135,29 @@ static const CFRuntimeClass __DADiskClass =
 
 static CFTypeID __kDADiskTypeID = _kCFRuntimeNotATypeID;
 
+static CFMutableDictionaryRef __gDADiskDeviceCache       = NULL;
+static UInt32                 __gDADiskGeneration        = 0;
+static CFMutableSetRef        __gDADiskSnapshotDirtyList = NULL;
+static CFMutableDictionaryRef __gDADiskSnapshotList      = NULL;
+static pthread_mutex_t        __gDADiskSnapshotLock      = PTHREAD_MUTEX_INITIALIZER;
+
+static CFStringRef            __gDADiskSlotKeys[__kDADiskSlotCount];
+static CFMutableDictionaryRef __gDADiskSlotList = NULL;
+
+/*
+ * The stages, in the order of their latency phases.
+ */
+
+static const DADiskState __kDADiskStateStagedList[__kDADiskStateStagedCount] =
+{
+    kDADiskStateStagedProbe,
+    kDADiskStateStagedPeek,
+    kDADiskStateStagedAppear,
+    kDADiskStateStagedApprove,
+    kDADiskStateStagedAuthorize,
+    kDADiskStateStagedMount
+};
+
 extern CFHashCode CFHashBytes( UInt8 * bytes, CFIndex length );
 
 static CFStringRef __DADiskCopyDescription( CFTypeRef object )
@@ -115,6 +183,7 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, const char * id )
     if ( disk )
     {
         CFDataRef data;
+        UInt32    index;
 
         disk->_busy                 = 0;
         disk->_busyNotification     = IO_OBJECT_NULL;
@@ -122,6 +191,7 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, const char * id )
         disk->_claim                = NULL;
         disk->_context              = NULL;
         disk->_contextRe            = NULL;
+        disk->_deliveries           = NULL;
         disk->_description          = CFDictionaryCreateMutable( allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
         disk->_device               = NULL;
         disk->_deviceLink[0]        = NULL;
@@ -131,12 +201,14 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, const char * id )
         disk->_devicePath[1]        = NULL;
         disk->_deviceUnit           = -1;
         disk->_filesystem           = NULL;
+        disk->_generation           = ++__gDADiskGeneration;
         disk->_id                   = strdup( id );
         disk->_media                = IO_OBJECT_NULL;
         disk->_mode                 = 0750;
         disk->_options              = 0;
         disk->_propertyNotification = IO_OBJECT_NULL;
         disk->_serialization        = NULL;
+        disk->_stageTime            = CFAbsoluteTimeGetCurrent( );
         disk->_state                = 0;
         disk->_userGID              = ___GID_WHEEL;
         disk->_userUID              = ___UID_ROOT;
@@ -144,6 +216,24 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, const char * id )
         assert( disk->_description );
         assert( disk->_id          );
 
+        for ( index = 0; index < __kDADiskHistoryLimit; index++ )
+        {
+            disk->_history[index] = NULL;
+        }
+
+        for ( index = 0; index < __kDADiskSlotCount; index++ )
+        {
+            disk->_slots[index] = NULL;
+        }
+
+        /*
+         * Identifiers are reused as media comes and goes, so generations are drawn from a counter
+         * that every disk object advances, such that a new disk object outranks any earlier disk
+         * object with the same identifier.
+         */
+
+        ___CFDictionarySetIntegerValue( disk->_description, _kDADiskGenerationKey, disk->_generation );
+
         data = CFDataCreate( allocator, ( void * ) id, strlen( id ) + 1 );
 
         if ( data )
@@ -152,20 +242,274 @@ static DADiskRef __DADiskCreate( CFAllocatorRef allocator, const char * id )
 
             CFRelease( data );
         }
+
+        __DADiskSetSnapshotDirty( disk, TRUE );
     }
 
     return disk;
 }
 
+static CFDictionaryRef __DADiskCreateDeviceDescription( CFAllocatorRef allocator, io_service_t device )
+{
+    /*
+     * Create the portion of the disk description that is shared by all media objects on the device.
+     */
+
+    io_service_t           bus         = IO_OBJECT_NULL;
+    CFMutableDictionaryRef description = NULL;
+    io_name_t              name;
+    CFMutableDictionaryRef properties  = NULL;
+    CFTypeRef              object;
+    ___io_path_t           path;
+    io_iterator_t          services;
+    kern_return_t          status;
+    CFDictionaryRef        sub;
+
+    description = CFDictionaryCreateMutable( allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+    if ( description == NULL )  goto __DADiskCreateDeviceDescriptionErr;
+
+    /*
+     * Obtain the device properties.
+     */
+
+    status = IORegistryEntryCreateCFProperties( device, &properties, allocator, 0 );
+    if ( status != KERN_SUCCESS )  goto __DADiskCreateDeviceDescriptionErr;
+
+    /*
+     * Obtain the device protocol subproperties.
+     */
+
+    sub = CFDictionaryGetValue( properties, CFSTR( kIOPropertyProtocolCharacteristicsKey ) );
+
+    if ( sub )
+    {
+        /*
+         * Create the disk description -- device internal?
+         */
+
+        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyPhysicalInterconnectLocationKey ) );
+
+        if ( object )
+        {
+            if ( CFStringCompare( object, CFSTR( kIOPropertyInternalKey ), 0 ) == 0 )
+            {
+                object = kCFBooleanTrue;
+
+                CFDictionarySetValue( description, kDADiskDescriptionDeviceInternalKey, object );
+            }
+            else if ( CFStringCompare( object, CFSTR( kIOPropertyExternalKey ), 0 ) == 0 )
+            {
+                object = kCFBooleanFalse;
+
+                CFDictionarySetValue( description, kDADiskDescriptionDeviceInternalKey, object );
+            }
+        }
+
+        /*
+         * Create the disk description -- device protocol.
+         */
+
+        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyPhysicalInterconnectTypeKey ) );
+
+        if ( object )
+        {
+            CFDictionarySetValue( description, kDADiskDescriptionDeviceProtocolKey, object );
+        }
+    }
+
+    /*
+     * Obtain the device model subproperties.
+     */
+
+    sub = CFDictionaryGetValue( properties, CFSTR( kIOPropertyDeviceCharacteristicsKey ) );
+
+    if ( sub )
+    {
+        /*
+         * Create the disk description -- device model.
+         */
+
+        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyProductNameKey ) );
+
+        if ( object )
+        {
+            CFDictionarySetValue( description, kDADiskDescriptionDeviceModelKey, object );
+        }
+
+        /*
+         * Create the disk description -- device revision.
+         */
+
+        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyProductRevisionLevelKey ) );
+
+        if ( object )
+        {
+            CFDictionarySetValue( description, kDADiskDescriptionDeviceRevisionKey, object );
+        }
+
+        /*
+         * Create the disk description -- device vendor.
+         */
+
+        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyVendorNameKey ) );
+
+        if ( object )
+        {
+            CFDictionarySetValue( description, kDADiskDescriptionDeviceVendorKey, object );
+        }
+    }
+
+    /*
+     * Create the disk description -- device path.
+     */
+
+    status = ___IORegistryEntryGetPath( device, kIOServicePlane, path );
+    if ( status != KERN_SUCCESS )  goto __DADiskCreateDeviceDescriptionErr;
+
+    object = CFStringCreateWithCString( allocator, path, kCFStringEncodingUTF8 );
+    if ( object == NULL )  goto __DADiskCreateDeviceDescriptionErr;
+
+    CFDictionarySetValue( description, kDADiskDescriptionDevicePathKey, object );
+    CFRelease( object );
+
+    /*
+     * Create the disk description -- device unit.
+     */
+
+    object = IORegistryEntrySearchCFProperty( device,
+                                              kIOServicePlane,
+                                              CFSTR( "IOUnit" ),
+                                              allocator,
+                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+
+    if ( object )
+    {
+        CFDictionarySetValue( description, kDADiskDescriptionDeviceUnitKey, object );
+        CFRelease( object );
+    }
+
+    /*
+     * Create the disk description -- device GUID (IEEE EUI-64).
+     */
+
+    object = IORegistryEntrySearchCFProperty( device,
+                                              kIOServicePlane,
+                                              CFSTR( "GUID" ),
+                                              allocator,
+                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+
+    if ( object )
+    {
+        UInt64 value;
+
+        CFNumberGetValue( object, kCFNumberSInt64Type, &value );
+        CFRelease( object );
+
+        value = OSSwapHostToBigInt64( value );
+
+        object = CFDataCreate( allocator, ( void * ) &value, sizeof( value ) );
+        if ( object == NULL )  goto __DADiskCreateDeviceDescriptionErr;
+
+        CFDictionarySetValue( description, kDADiskDescriptionDeviceGUIDKey, object );
+        CFRelease( object );
+    }
+
+    /*
+     * Obtain the bus object.
+     */
+
+    status = IORegistryEntryCreateIterator( device,
+                                            kIOServicePlane,
+                                            kIORegistryIterateParents | kIORegistryIterateRecursively,
+                                            &services );
+
+    while ( ( bus = IOIteratorNext( services ) ) )
+    {
+        if ( IORegistryEntryInPlane( bus, kIODeviceTreePlane ) )  break;
+
+        IOObjectRelease( bus );
+    }
+
+    IOObjectRelease( services );
+
+    if ( bus )
+    {
+        /*
+         * Create the disk description -- bus name.
+         */
+
+        status = IORegistryEntryGetNameInPlane( bus, kIODeviceTreePlane, name );
+        if ( status != KERN_SUCCESS )  goto __DADiskCreateDeviceDescriptionErr;
+
+        object = CFStringCreateWithCString( allocator, name, kCFStringEncodingUTF8 );
+        if ( object == NULL )  goto __DADiskCreateDeviceDescriptionErr;
+
+        CFDictionarySetValue( description, kDADiskDescriptionBusNameKey, object );
+        CFRelease( object );
+
+        /*
+         * Create the disk description -- bus path.
+         */
+
+        status = ___IORegistryEntryGetPath( bus, kIODeviceTreePlane, path );
+        if ( status != KERN_SUCCESS )  goto __DADiskCreateDeviceDescriptionErr;
+
+        object = CFStringCreateWithCString( allocator, path, kCFStringEncodingUTF8 );
+        if ( object == NULL )  goto __DADiskCreateDeviceDescriptionErr;
+
+        CFDictionarySetValue( description, kDADiskDescriptionBusPathKey, object );
+        CFRelease( object );
+
+        IOObjectRelease( bus );
+        bus = IO_OBJECT_NULL;
+    }
+
+    /*
+     * Create the device description -- eject upon logout?
+     */
+
+    object = IORegistryEntrySearchCFProperty( device,
+                                              kIOServicePlane,
+                                              CFSTR( "eject-upon-logout" ),
+                                              allocator,
+                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+
+    if ( object == kCFBooleanTrue )
+    {
+        CFDictionarySetValue( description, __kDADiskDeviceEjectUponLogoutKey, object );
+    }
+
+    if ( object )  CFRelease( object );
+
+    CFRelease( properties );
+
+    return description;
+
+__DADiskCreateDeviceDescriptionErr:
+
+    if ( bus         )  IOObjectRelease( bus );
+    if ( description )  CFRelease( description );
+    if ( properties  )  CFRelease( properties );
+
+    return NULL;
+}
+
 static void __DADiskDeallocate( CFTypeRef object )
 {
     DADiskRef disk = ( DADiskRef ) object;
+    UInt32    index;
+
+    for ( index = 0; index < __kDADiskHistoryLimit; index++ )
+    {
+        if ( disk->_history[index] )  CFRelease( disk->_history[index] );
+    }
 
     if ( disk->_busyNotification     )  IOObjectRelease( disk->_busyNotification );
     if ( disk->_bypath               )  CFRelease( disk->_bypath );
     if ( disk->_claim                )  CFRelease( disk->_claim );
     if ( disk->_context              )  CFRelease( disk->_context );
     if ( disk->_contextRe            )  CFRelease( disk->_contextRe );
+    if ( disk->_deliveries           )  CFRelease( disk->_deliveries );
     if ( disk->_description          )  CFRelease( disk->_description );
     if ( disk->_device               )  CFRelease( disk->_device );
     if ( disk->_deviceLink[0]        )  free( disk->_deviceLink[0] );
@@ -177,21 +521,92 @@ static void __DADiskDeallocate( CFTypeRef object )
     if ( disk->_media                )  IOObjectRelease( disk->_media );
     if ( disk->_propertyNotification )  IOObjectRelease( disk->_propertyNotification );
     if ( disk->_serialization        )  CFRelease( disk->_serialization );
+
+    __DADiskSetSnapshotDirty( disk, FALSE );
 }
 
 static Boolean __DADiskEqual( CFTypeRef object1, CFTypeRef object2 )
 {
-    DADiskRef disk1 = ( DADiskRef ) object1;
-    DADiskRef disk2 = ( DADiskRef ) object2;
+    DADiskRef disk1 = ( DADiskRef ) object1;
+    DADiskRef disk2 = ( DADiskRef ) object2;
+
+    return ( strcmp( disk1->_id, disk2->_id ) == 0 );
+}
+
+static CFHashCode __DADiskHash( CFTypeRef object )
+{
+    DADiskRef disk = ( DADiskRef ) object;
+
+    return CFHashBytes( ( void * ) disk->_id, MIN( strlen( disk->_id ), 16 ) );
+}
+
+static CFIndex __DADiskGetSlot( CFStringRef description )
+{
+    /*
+     * Obtain the slot of a well-known description key.  The keys are usually the exported constants,
+     * so they are recognized by address first.  An equal key at another address is looked up in the
+     * slot list, which holds each slot index plus one.
+     */
+
+    CFIndex index;
+
+    for ( index = 0; index < __kDADiskSlotCount; index++ )
+    {
+        if ( __gDADiskSlotKeys[index] == description )  return index;
+    }
+
+    return ( ( CFIndex ) CFDictionaryGetValue( __gDADiskSlotList, description ) ) - 1;
+}
+
+static void __DADiskMergeDescription( const void * key, const void * value, void * context )
+{
+    if ( CFEqual( key, __kDADiskDeviceEjectUponLogoutKey ) == FALSE )
+    {
+        CFDictionarySetValue( context, key, value );
+    }
+}
+
+static DADiskRef __DADiskSetSlots( DADiskRef disk )
+{
+    /*
+     * Mirror the description dictionary into the slots once a newly created disk is filled out.
+     */
 
-    return ( strcmp( disk1->_id, disk2->_id ) == 0 );
+    if ( disk )
+    {
+        CFIndex index;
+
+        for ( index = 0; index < __kDADiskSlotCount; index++ )
+        {
+            disk->_slots[index] = CFDictionaryGetValue( disk->_description, __gDADiskSlotKeys[index] );
+        }
+    }
+
+    return disk;
 }
 
-static CFHashCode __DADiskHash( CFTypeRef object )
+static void __DADiskSetSnapshotDirty( DADiskRef disk, Boolean dirty )
 {
-    DADiskRef disk = ( DADiskRef ) object;
+    /*
+     * Keep track of the disks whose published serialization is out of date.  The dirty list holds
+     * no reference, so a disk object leaves it no later than it is deallocated.
+     */
 
-    return CFHashBytes( ( void * ) disk->_id, MIN( strlen( disk->_id ), 16 ) );
+    if ( dirty )
+    {
+        if ( __gDADiskSnapshotDirtyList == NULL )
+        {
+            __gDADiskSnapshotDirtyList = CFSetCreateMutable( kCFAllocatorDefault, 0, NULL );
+
+            assert( __gDADiskSnapshotDirtyList );
+        }
+
+        CFSetAddValue( __gDADiskSnapshotDirtyList, disk );
+    }
+    else if ( __gDADiskSnapshotDirtyList )
+    {
+        CFSetRemoveValue( __gDADiskSnapshotDirtyList, disk );
+    }
 }
 
 static void __DADiskMatch( const void * key, const void * value, void * context )
@@ -227,7 +642,7 @@ static void __DADiskMatch( const void * key, const void * value, void * context
 
 CFComparisonResult DADiskCompareDescription( DADiskRef disk, CFStringRef description, CFTypeRef value )
 {
-    CFTypeRef object1 = CFDictionaryGetValue( disk->_description, description );
+    CFTypeRef object1 = DADiskGetDescription( disk, description );
     CFTypeRef object2 = value;
 
     if ( object1 == object2 )  return kCFCompareEqualTo;
@@ -237,21 +652,123 @@ CFComparisonResult DADiskCompareDescription( DADiskRef disk, CFStringRef descrip
     return CFEqual( object1, object2 ) ? kCFCompareEqualTo : kCFCompareLessThan;
 }
 
+CFDataRef DADiskCopySerialization( DADiskRef disk, DASessionRef session, Boolean delta )
+{
+    /*
+     * Obtain the serialization of the disk description for delivery to the specified session.
+     * If a delta is acceptable and the session last received a generation that is still within
+     * our history, we serialize only the keys that changed since, otherwise we serialize it all.
+     */
+
+    CFDataRef    serialization = NULL;
+    const void * value;
+
+    if ( delta )
+    {
+        if ( disk->_deliveries )
+        {
+            if ( CFDictionaryGetValueIfPresent( disk->_deliveries, session, &value ) )
+            {
+                UInt32 base;
+
+                base = ( UInt32 ) ( uintptr_t ) value;
+
+                if ( disk->_generation - base <= __kDADiskHistoryLimit )
+                {
+                    CFMutableDictionaryRef description;
+
+                    description = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                    if ( description )
+                    {
+                        CFMutableArrayRef keys;
+
+                        keys = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                        if ( keys )
+                        {
+                            UInt32 generation;
+
+                            for ( generation = base + 1; generation != disk->_generation + 1; generation++ )
+                            {
+                                CFStringRef key;
+
+                                key = disk->_history[generation % __kDADiskHistoryLimit];
+
+                                if ( ___CFArrayContainsValue( keys, key ) == FALSE )
+                                {
+                                    CFArrayAppendValue( keys, key );
+
+                                    value = CFDictionaryGetValue( disk->_description, key );
+
+                                    if ( value )
+                                    {
+                                        CFDictionarySetValue( description, key, value );
+                                    }
+                                }
+                            }
+
+                            CFDictionarySetValue( description, _kDADiskIDKey, CFDictionaryGetValue( disk->_description, _kDADiskIDKey ) );
+
+                            ___CFDictionarySetIntegerValue( description, _kDADiskGenerationKey, disk->_generation );
+
+                            ___CFDictionarySetIntegerValue( description, _kDADiskGenerationBaseKey, base );
+
+                            CFDictionarySetValue( description, _kDADiskGenerationDeltaKey, keys );
+
+                            serialization = _DASerializeDiskDescription( kCFAllocatorDefault, description );
+
+                            CFRelease( keys );
+                        }
+
+                        CFRelease( description );
+                    }
+                }
+            }
+        }
+    }
+
+    if ( serialization == NULL )
+    {
+        serialization = DADiskGetSerialization( disk );
+
+        if ( serialization )
+        {
+            CFRetain( serialization );
+        }
+    }
+
+    if ( serialization )
+    {
+        if ( disk->_deliveries == NULL )
+        {
+            disk->_deliveries = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+
+            assert( disk->_deliveries );
+        }
+
+        CFDictionarySetValue( disk->_deliveries, session, ( void * ) ( uintptr_t ) disk->_generation );
+    }
+
+    return serialization;
+}
+
 DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media )
 {
-    io_service_t           bus        = IO_OBJECT_NULL;
     uint32_t               busy;
-    io_service_t           device     = IO_OBJECT_NULL;
-    DADiskRef              disk       = NULL;
+    CFDictionaryRef        description = NULL;
+    io_service_t           device      = IO_OBJECT_NULL;
+    DADiskRef              disk        = NULL;
+    uint64_t               id;
+    CFNumberRef            key         = NULL;
     UInt32                 major;
     UInt32                 minor;
     io_name_t              name;
-    CFMutableDictionaryRef properties = NULL;
+    CFMutableDictionaryRef properties  = NULL;
     CFTypeRef              object;
     ___io_path_t           path;
     io_iterator_t          services;
     kern_return_t          status;
-    CFDictionaryRef        sub;
     double                 time;
 
     /*
@@ -438,310 +955,147 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
     object = CFDictionaryGetValue( properties, CFSTR( kIOMediaLeafKey ) );
     if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
 
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaLeafKey, object );
-
-    /*
-     * Create the disk description -- media name.
-     */
-
-    status = IORegistryEntryGetName( media, name );
-    if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
-
-    object = CFStringCreateWithCString( allocator, name, kCFStringEncodingUTF8 );
-    if ( object == NULL )  object = CFStringCreateWithCString( allocator, name, kCFStringEncodingMacRoman );
-    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaNameKey, object );
-    CFRelease( object );
-
-    /*
-     * Create the disk description -- media path.
-     */
-
-    status = ___IORegistryEntryGetPath( media, kIODeviceTreePlane, path );
-    if ( status != KERN_SUCCESS )  status = ___IORegistryEntryGetPath( media, kIOServicePlane, path );
-    if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
-
-    object = CFStringCreateWithCString( allocator, path, kCFStringEncodingUTF8 );
-    if ( object == NULL )  object = CFStringCreateWithCString( allocator, path, kCFStringEncodingMacRoman );
-    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaPathKey, object );
-    CFRelease( object );
-
-    /*
-     * Create the disk description -- media removable?
-     */
-
-    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaRemovableKey ) );
-    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaRemovableKey, object );
-
-    /*
-     * Create the disk description -- media size.
-     */
-
-    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaSizeKey ) );
-    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaSizeKey, object );
-
-    /*
-     * Create the disk description -- media UUID.
-     */
-
-    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaUUIDKey ) );
-
-    if ( object )
-    {
-        object = ___CFUUIDCreateFromString( allocator, object );
-        if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-        CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaUUIDKey, object );
-        CFRelease( object );
-    }
-
-    /*
-     * Create the disk description -- media whole?
-     */
-
-    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaWholeKey ) );
-    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaWholeKey, object );
-
-    /*
-     * Create the disk description -- media writable?
-     */
-
-    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaWritableKey ) );
-    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
-
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaWritableKey, object );
-
-    CFRelease( properties );
-    properties = NULL;
-
-    /*
-     * Obtain the device object.
-     */
-
-    status = IORegistryEntryCreateIterator( media,
-                                            kIOServicePlane,
-                                            kIORegistryIterateParents | kIORegistryIterateRecursively,
-                                            &services );
-
-    while ( ( device = IOIteratorNext( services ) ) )
-    {
-        if ( IOObjectConformsTo( device, kIOBlockStorageDeviceClass ) )  break;
-
-        IOObjectRelease( device );
-    }
-
-    IOObjectRelease( services );
-
-    if ( device == IO_OBJECT_NULL )  goto DADiskCreateFromIOMediaErr;
-
-    /*
-     * Obtain the device properties.
-     */
-
-    status = IORegistryEntryCreateCFProperties( device, &properties, allocator, 0 );
-    if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
-
-    /*
-     * Obtain the device protocol subproperties.
-     */
-
-    sub = CFDictionaryGetValue( properties, CFSTR( kIOPropertyProtocolCharacteristicsKey ) );
-
-    if ( sub )
-    {
-        /*
-         * Create the disk description -- device internal?
-         */
-
-        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyPhysicalInterconnectLocationKey ) );
-
-        if ( object )
-        {
-            if ( CFStringCompare( object, CFSTR( kIOPropertyInternalKey ), 0 ) == 0 )
-            {
-                object = kCFBooleanTrue;
-
-                CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceInternalKey, object );
-            }
-            else if ( CFStringCompare( object, CFSTR( kIOPropertyExternalKey ), 0 ) == 0 )
-            {
-                object = kCFBooleanFalse;
-
-                CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceInternalKey, object );
-            }
-        }
-
-        /*
-         * Create the disk description -- device protocol.
-         */
-
-        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyPhysicalInterconnectTypeKey ) );
-
-        if ( object )
-        {
-            CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceProtocolKey, object );
-        }
-    }
-
-    /*
-     * Obtain the device model subproperties.
-     */
-
-    sub = CFDictionaryGetValue( properties, CFSTR( kIOPropertyDeviceCharacteristicsKey ) );
-
-    if ( sub )
-    {
-        /*
-         * Create the disk description -- device model.
-         */
-
-        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyProductNameKey ) );
-
-        if ( object )
-        {
-            CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceModelKey, object );
-        }
-
-        /*
-         * Create the disk description -- device revision.
-         */
-
-        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyProductRevisionLevelKey ) );
-
-        if ( object )
-        {
-            CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceRevisionKey, object );
-        }
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaLeafKey, object );
 
-        /*
-         * Create the disk description -- device vendor.
-         */
+    /*
+     * Create the disk description -- media name.
+     */
 
-        object = CFDictionaryGetValue( sub, CFSTR( kIOPropertyVendorNameKey ) );
+    status = IORegistryEntryGetName( media, name );
+    if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
 
-        if ( object )
-        {
-            CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceVendorKey, object );
-        }
-    }
+    object = CFStringCreateWithCString( allocator, name, kCFStringEncodingUTF8 );
+    if ( object == NULL )  object = CFStringCreateWithCString( allocator, name, kCFStringEncodingMacRoman );
+    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
+
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaNameKey, object );
+    CFRelease( object );
 
     /*
-     * Create the disk description -- device path.
+     * Create the disk description -- media path.
      */
 
-    status = ___IORegistryEntryGetPath( device, kIOServicePlane, path );
+    status = ___IORegistryEntryGetPath( media, kIODeviceTreePlane, path );
+    if ( status != KERN_SUCCESS )  status = ___IORegistryEntryGetPath( media, kIOServicePlane, path );
     if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
 
     object = CFStringCreateWithCString( allocator, path, kCFStringEncodingUTF8 );
+    if ( object == NULL )  object = CFStringCreateWithCString( allocator, path, kCFStringEncodingMacRoman );
     if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
 
-    CFDictionarySetValue( disk->_description, kDADiskDescriptionDevicePathKey, object );
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaPathKey, object );
     CFRelease( object );
 
     /*
-     * Create the disk description -- device unit.
+     * Create the disk description -- media removable?
      */
 
-    object = IORegistryEntrySearchCFProperty( device,
-                                              kIOServicePlane,
-                                              CFSTR( "IOUnit" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaRemovableKey ) );
+    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
 
-    if ( object )
-    {
-        CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceUnitKey, object );
-        CFRelease( object );
-    }
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaRemovableKey, object );
 
     /*
-     * Create the disk description -- device GUID (IEEE EUI-64).
+     * Create the disk description -- media size.
      */
 
-    object = IORegistryEntrySearchCFProperty( device,
-                                              kIOServicePlane,
-                                              CFSTR( "GUID" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
+    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaSizeKey ) );
+    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
 
-    if ( object )
-    {
-        UInt64 value;
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaSizeKey, object );
 
-        CFNumberGetValue( object, kCFNumberSInt64Type, &value );
-        CFRelease( object );
+    /*
+     * Create the disk description -- media UUID.
+     */
 
-        value = OSSwapHostToBigInt64( value );
+    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaUUIDKey ) );
 
-        object = CFDataCreate( allocator, ( void * ) &value, sizeof( value ) );
+    if ( object )
+    {
+        object = ___CFUUIDCreateFromString( allocator, object );
         if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
 
-        CFDictionarySetValue( disk->_description, kDADiskDescriptionDeviceGUIDKey, object );
+        CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaUUIDKey, object );
         CFRelease( object );
     }
 
+    /*
+     * Create the disk description -- media whole?
+     */
+
+    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaWholeKey ) );
+    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
+
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaWholeKey, object );
+
+    /*
+     * Create the disk description -- media writable?
+     */
+
+    object = CFDictionaryGetValue( properties, CFSTR( kIOMediaWritableKey ) );
+    if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
+
+    CFDictionarySetValue( disk->_description, kDADiskDescriptionMediaWritableKey, object );
+
     CFRelease( properties );
     properties = NULL;
 
     /*
-     * Obtain the bus object.
+     * Obtain the device object.
      */
 
-    status = IORegistryEntryCreateIterator( device,
+    status = IORegistryEntryCreateIterator( media,
                                             kIOServicePlane,
                                             kIORegistryIterateParents | kIORegistryIterateRecursively,
                                             &services );
 
-    while ( ( bus = IOIteratorNext( services ) ) )
+    while ( ( device = IOIteratorNext( services ) ) )
     {
-        if ( IORegistryEntryInPlane( bus, kIODeviceTreePlane ) )  break;
+        if ( IOObjectConformsTo( device, kIOBlockStorageDeviceClass ) )  break;
 
-        IOObjectRelease( bus );
+        IOObjectRelease( device );
     }
 
     IOObjectRelease( services );
 
-    if ( bus )
-    {
-        /*
-         * Create the disk description -- bus name.
-         */
+    if ( device == IO_OBJECT_NULL )  goto DADiskCreateFromIOMediaErr;
 
-        status = IORegistryEntryGetNameInPlane( bus, kIODeviceTreePlane, name );
-        if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
+    /*
+     * Obtain the device description, which is shared by the sibling media objects on the device.
+     */
 
-        object = CFStringCreateWithCString( allocator, name, kCFStringEncodingUTF8 );
-        if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
+    status = IORegistryEntryGetRegistryEntryID( device, &id );
+    if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
 
-        CFDictionarySetValue( disk->_description, kDADiskDescriptionBusNameKey, object );
-        CFRelease( object );
+    key = CFNumberCreate( allocator, kCFNumberSInt64Type, &id );
+    if ( key == NULL )  goto DADiskCreateFromIOMediaErr;
 
-        /*
-         * Create the disk description -- bus path.
-         */
+    if ( __gDADiskDeviceCache == NULL )
+    {
+        __gDADiskDeviceCache = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
-        status = ___IORegistryEntryGetPath( bus, kIODeviceTreePlane, path );
-        if ( status != KERN_SUCCESS )  goto DADiskCreateFromIOMediaErr;
+        assert( __gDADiskDeviceCache );
+    }
 
-        object = CFStringCreateWithCString( allocator, path, kCFStringEncodingUTF8 );
-        if ( object == NULL )  goto DADiskCreateFromIOMediaErr;
+    description = CFDictionaryGetValue( __gDADiskDeviceCache, key );
 
-        CFDictionarySetValue( disk->_description, kDADiskDescriptionBusPathKey, object );
-        CFRelease( object );
+    if ( description )
+    {
+        CFRetain( description );
+    }
+    else
+    {
+        description = __DADiskCreateDeviceDescription( allocator, device );
+        if ( description == NULL )  goto DADiskCreateFromIOMediaErr;
 
-        IOObjectRelease( bus );
-        bus = IO_OBJECT_NULL;
+        CFDictionarySetValue( __gDADiskDeviceCache, key, description );
     }
 
+    CFRelease( key );
+    key = NULL;
+
+    CFDictionaryApplyFunction( description, __DADiskMergeDescription, disk->_description );
+
     /*
      * Create the disk description -- appearance time.
      */
@@ -792,19 +1146,11 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
      * Create the disk state -- eject upon logout?
      */
 
-    object = IORegistryEntrySearchCFProperty( device,
-                                              kIOServicePlane,
-                                              CFSTR( "eject-upon-logout" ),
-                                              allocator,
-                                              kIORegistryIterateParents | kIORegistryIterateRecursively );
-
-    if ( object == kCFBooleanTrue )
+    if ( CFDictionaryGetValue( description, __kDADiskDeviceEjectUponLogoutKey ) == kCFBooleanTrue )
     {
         disk->_options |= kDADiskOptionEjectUponLogout;
     }
 
-    if ( object )  CFRelease( object );
-
     /*
      * Create the disk state -- owner.
      */
@@ -909,9 +1255,11 @@ DADiskRef DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media
         CFRelease( object );
     }
 
+    CFRelease( description );
+
     IOObjectRelease( device );
 
-    return disk;
+    return __DADiskSetSlots( disk );
 
 DADiskCreateFromIOMediaErr:
 
@@ -920,10 +1268,11 @@ DADiskCreateFromIOMediaErr:
         DALogError( "unable to create disk, id = %s.", disk ? DADiskGetID( disk ) : NULL );
     }
 
-    if ( bus        )  IOObjectRelease( bus );
-    if ( device     )  IOObjectRelease( device );
-    if ( disk       )  CFRelease( disk );
-    if ( properties )  CFRelease( properties );
+    if ( description )  CFRelease( description );
+    if ( device      )  IOObjectRelease( device );
+    if ( disk        )  CFRelease( disk );
+    if ( key         )  CFRelease( key );
+    if ( properties  )  CFRelease( properties );
 
     return NULL;
 }
@@ -1017,7 +1366,41 @@ DADiskRef DADiskCreateFromVolumePath( CFAllocatorRef allocator, const struct sta
         }
     }
 
-    return disk;
+    return __DADiskSetSlots( disk );
+}
+
+CFDataRef DADiskCopySnapshot( const char * id )
+{
+    /*
+     * Copy the serialization last published for the specified disk.  This may be called from any
+     * thread.
+     */
+
+    CFDataRef serialization = NULL;
+    CFDataRef key;
+
+    key = CFDataCreate( kCFAllocatorDefault, ( void * ) id, strlen( id ) + 1 );
+
+    if ( key )
+    {
+        pthread_mutex_lock( &__gDADiskSnapshotLock );
+
+        if ( __gDADiskSnapshotList )
+        {
+            serialization = CFDictionaryGetValue( __gDADiskSnapshotList, key );
+
+            if ( serialization )
+            {
+                CFRetain( serialization );
+            }
+        }
+
+        pthread_mutex_unlock( &__gDADiskSnapshotLock );
+
+        CFRelease( key );
+    }
+
+    return serialization;
 }
 
 CFAbsoluteTime DADiskGetBusy( DADiskRef disk )
@@ -1072,7 +1455,16 @@ CFTypeRef DADiskGetContextRe( DADiskRef disk )
 
 CFTypeRef DADiskGetDescription( DADiskRef disk, CFStringRef description )
 {
-    return CFDictionaryGetValue( disk->_description, description );
+    CFIndex slot;
+
+    slot = __DADiskGetSlot( description );
+
+    if ( slot < 0 )
+    {
+        return CFDictionaryGetValue( disk->_description, description );
+    }
+
+    return disk->_slots[slot];
 }
 
 CFURLRef DADiskGetDevice( DADiskRef disk )
@@ -1129,6 +1521,30 @@ CFDataRef DADiskGetSerialization( DADiskRef disk )
     if ( disk->_serialization == NULL )
     {
         disk->_serialization = _DASerializeDiskDescription( CFGetAllocator( disk ), disk->_description );
+
+        /*
+         * Publish the serialization for the queries served off the main thread.  Any description
+         * a client has been sent is thus published no later than it was sent.
+         */
+
+        if ( disk->_serialization )
+        {
+            if ( DADiskGetState( disk, kDADiskStateZombie ) == FALSE )
+            {
+                pthread_mutex_lock( &__gDADiskSnapshotLock );
+
+                if ( __gDADiskSnapshotList == NULL )
+                {
+                    __gDADiskSnapshotList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                    assert( __gDADiskSnapshotList );
+                }
+
+                CFDictionarySetValue( __gDADiskSnapshotList, CFDictionaryGetValue( disk->_description, _kDADiskIDKey ), disk->_serialization );
+
+                pthread_mutex_unlock( &__gDADiskSnapshotLock );
+            }
+        }
     }
 
     return disk->_serialization;
@@ -1156,7 +1572,43 @@ uid_t DADiskGetUserUID( DADiskRef disk )
 
 void DADiskInitialize( void )
 {
+    CFIndex index;
+
     __kDADiskTypeID = _CFRuntimeRegisterClass( &__DADiskClass );
+
+    __gDADiskSlotKeys[__kDADiskSlotDeviceInternal]  = kDADiskDescriptionDeviceInternalKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaContent]    = kDADiskDescriptionMediaContentKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaEjectable]  = kDADiskDescriptionMediaEjectableKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaLeaf]       = kDADiskDescriptionMediaLeafKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaRemovable]  = kDADiskDescriptionMediaRemovableKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaSize]       = kDADiskDescriptionMediaSizeKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaType]       = kDADiskDescriptionMediaTypeKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaUUID]       = kDADiskDescriptionMediaUUIDKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaWhole]      = kDADiskDescriptionMediaWholeKey;
+    __gDADiskSlotKeys[__kDADiskSlotMediaWritable]   = kDADiskDescriptionMediaWritableKey;
+    __gDADiskSlotKeys[__kDADiskSlotVolumeKind]      = kDADiskDescriptionVolumeKindKey;
+    __gDADiskSlotKeys[__kDADiskSlotVolumeMountable] = kDADiskDescriptionVolumeMountableKey;
+    __gDADiskSlotKeys[__kDADiskSlotVolumeName]      = kDADiskDescriptionVolumeNameKey;
+    __gDADiskSlotKeys[__kDADiskSlotVolumeNetwork]   = kDADiskDescriptionVolumeNetworkKey;
+    __gDADiskSlotKeys[__kDADiskSlotVolumePath]      = kDADiskDescriptionVolumePathKey;
+    __gDADiskSlotKeys[__kDADiskSlotVolumeUUID]      = kDADiskDescriptionVolumeUUIDKey;
+
+    __gDADiskSlotList = CFDictionaryCreateMutable( kCFAllocatorDefault, __kDADiskSlotCount, &kCFTypeDictionaryKeyCallBacks, NULL );
+
+    assert( __gDADiskSlotList );
+
+    for ( index = 0; index < __kDADiskSlotCount; index++ )
+    {
+        CFDictionarySetValue( __gDADiskSlotList, __gDADiskSlotKeys[index], ( void * ) ( index + 1 ) );
+    }
+}
+
+void DADiskDeviceCacheRemoveAllEntries( void )
+{
+    if ( __gDADiskDeviceCache )
+    {
+        CFDictionaryRemoveAllValues( __gDADiskDeviceCache );
+    }
 }
 
 Boolean DADiskMatch( DADiskRef disk, CFDictionaryRef match )
@@ -1166,6 +1618,77 @@ Boolean DADiskMatch( DADiskRef disk, CFDictionaryRef match )
     return disk ? TRUE : FALSE;
 }
 
+void DADiskPublishSnapshots( void )
+{
+    /*
+     * Publish the serializations of the disks whose descriptions have changed since they were last
+     * published.  A disk object that has yet to enter the disk list is kept for a later pass.
+     */
+
+    if ( __gDADiskSnapshotDirtyList )
+    {
+        CFIndex count;
+
+        count = CFSetGetCount( __gDADiskSnapshotDirtyList );
+
+        if ( count )
+        {
+            DADiskRef * disks;
+
+            disks = malloc( count * sizeof( DADiskRef ) );
+
+            if ( disks )
+            {
+                CFIndex index;
+
+                CFSetGetValues( __gDADiskSnapshotDirtyList, ( const void ** ) disks );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    if ( DADiskListGetDisk( disks[index]->_id ) == disks[index] )
+                    {
+                        DADiskGetSerialization( disks[index] );
+
+                        CFSetRemoveValue( __gDADiskSnapshotDirtyList, disks[index] );
+                    }
+                    else if ( DADiskGetState( disks[index], kDADiskStateZombie ) )
+                    {
+                        CFSetRemoveValue( __gDADiskSnapshotDirtyList, disks[index] );
+                    }
+                }
+
+                free( disks );
+            }
+        }
+    }
+}
+
+void DADiskRemoveSession( DADiskRef disk, DASessionRef session )
+{
+    /*
+     * Forget the generation last delivered to the specified session.
+     */
+
+    if ( disk->_deliveries )
+    {
+        CFDictionaryRemoveValue( disk->_deliveries, session );
+    }
+}
+
+void DADiskRemoveSnapshot( DADiskRef disk )
+{
+    __DADiskSetSnapshotDirty( disk, FALSE );
+
+    pthread_mutex_lock( &__gDADiskSnapshotLock );
+
+    if ( __gDADiskSnapshotList )
+    {
+        CFDictionaryRemoveValue( __gDADiskSnapshotList, CFDictionaryGetValue( disk->_description, _kDADiskIDKey ) );
+    }
+
+    pthread_mutex_unlock( &__gDADiskSnapshotLock );
+}
+
 void DADiskSetBusy( DADiskRef disk, CFAbsoluteTime busy )
 {
     disk->_busy = busy;
@@ -1273,6 +1796,8 @@ void DADiskSetContextRe( DADiskRef disk, CFTypeRef context )
 
 void DADiskSetDescription( DADiskRef disk, CFStringRef description, CFTypeRef value )
 {
+    CFIndex slot;
+
     if ( value )
     {
         CFDictionarySetValue( disk->_description, description, value );
@@ -1282,12 +1807,34 @@ void DADiskSetDescription( DADiskRef disk, CFStringRef description, CFTypeRef va
         CFDictionaryRemoveValue( disk->_description, description );
     }
 
+    slot = __DADiskGetSlot( description );
+
+    if ( slot > -1 )
+    {
+        disk->_slots[slot] = value;
+    }
+
+    disk->_generation++;
+
+    __gDADiskGeneration++;
+
+    if ( disk->_history[disk->_generation % __kDADiskHistoryLimit] )
+    {
+        CFRelease( disk->_history[disk->_generation % __kDADiskHistoryLimit] );
+    }
+
+    disk->_history[disk->_generation % __kDADiskHistoryLimit] = CFRetain( description );
+
+    ___CFDictionarySetIntegerValue( disk->_description, _kDADiskGenerationKey, disk->_generation );
+
     if ( disk->_serialization )
     {
         CFRelease( disk->_serialization );
 
         disk->_serialization = NULL;
     }
+
+    __DADiskSetSnapshotDirty( disk, TRUE );
 }
 
 void DADiskSetFileSystem( DADiskRef disk, DAFileSystemRef filesystem )
@@ -1337,6 +1884,36 @@ void DADiskSetPropertyNotification( DADiskRef disk, io_object_t notification )
 
 void DADiskSetState( DADiskRef disk, DADiskState state, Boolean value )
 {
-    disk->_state &= ~state;
-    disk->_state |= value ? state : 0;
+    if ( ( disk->_state & state ) != ( value ? state : 0 ) )
+    {
+        disk->_state &= ~state;
+        disk->_state |= value ? state : 0;
+
+        /*
+         * Account for the time spent in the stage that is now complete, or restart the clock when
+         * the disk goes back through a stage.
+         */
+
+        if ( ( state & __kDADiskStateStagedMask ) )
+        {
+            if ( value )
+            {
+                DALatencyPhase phase;
+
+                for ( phase = 0; phase < __kDADiskStateStagedCount; phase++ )
+                {
+                    if ( __kDADiskStateStagedList[phase] == state )
+                    {
+                        DALatencyListAddSample( kDALatencyPhaseStageProbe + phase, disk, disk->_stageTime );
+
+                        break;
+                    }
+                }
+            }
+
+            disk->_stageTime = CFAbsoluteTimeGetCurrent( );
+        }
+
+        DAStageAddDisk( disk );
+    }
 }
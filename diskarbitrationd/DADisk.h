@@ -64,6 +64,9 @@ typedef UInt32 DADiskState;
 extern CFComparisonResult DADiskCompareDescription( DADiskRef disk, CFStringRef description, CFTypeRef value );
 extern DADiskRef          DADiskCreateFromIOMedia( CFAllocatorRef allocator, io_service_t media );
 extern DADiskRef          DADiskCreateFromVolumePath( CFAllocatorRef allocator, const struct statfs * fs );
+extern CFDataRef          DADiskCopySerialization( DADiskRef disk, DASessionRef session, Boolean delta );
+extern CFDataRef          DADiskCopySnapshot( const char * id );
+extern void               DADiskDeviceCacheRemoveAllEntries( void );
 extern CFAbsoluteTime     DADiskGetBusy( DADiskRef disk );
 extern io_object_t        DADiskGetBusyNotification( DADiskRef disk );
 extern CFURLRef           DADiskGetBypath( DADiskRef disk );
@@ -90,6 +93,9 @@ extern gid_t              DADiskGetUserGID( DADiskRef disk );
 extern uid_t              DADiskGetUserUID( DADiskRef disk );
 extern void               DADiskInitialize( void );
 extern Boolean            DADiskMatch( DADiskRef disk, CFDictionaryRef match );
+extern void               DADiskPublishSnapshots( void );
+extern void               DADiskRemoveSession( DADiskRef disk, DASessionRef session );
+extern void               DADiskRemoveSnapshot( DADiskRef disk );
 extern void               DADiskSetBusy( DADiskRef disk, CFAbsoluteTime busy );
 extern void               DADiskSetBusyNotification( DADiskRef disk, io_object_t notification );
 extern void               DADiskSetBypath( DADiskRef disk, CFURLRef bypath );
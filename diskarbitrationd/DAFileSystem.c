@@ -26,12 +26,20 @@
 #include "DABase.h"
 #include "DACommand.h"
 #include "DAInternal.h"
+#include "DAMain.h"
+#include "DASupport.h"
+#include "DAThread.h"
 
+#include <fcntl.h>
 #include <fsproperties.h>
 #include <paths.h>
 #include <unistd.h>
+#include <hfs/hfs_format.h>
+#include <libkern/OSByteOrder.h>
 #include <sys/attr.h>
 #include <sys/dirent.h>
+#include <sys/disk.h>
+#include <sys/ioctl.h>
 #include <sys/loadable_fs.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreFoundation/CFRuntime.h>
@@ -60,21 +68,38 @@ struct __DAFileSystemContext
 
 typedef struct __DAFileSystemContext __DAFileSystemContext;
 
+struct __DAFileSystemProbeContext;
+
+typedef int ( *__DAFileSystemProbeFunction )( int file, struct __DAFileSystemProbeContext * context );
+
 struct __DAFileSystemProbeContext
 {
-    DAFileSystemProbeCallback callback;
-    void *                    callbackContext;
-    CFStringRef               deviceName;
-    CFStringRef               devicePath;
-    CFURLRef                  probeCommand;
-    CFURLRef                  repairCommand;
-    CFBooleanRef              volumeClean;
-    CFStringRef               volumeName;
-    CFUUIDRef                 volumeUUID;
+    DAFileSystemProbeCallback   callback;
+    void *                      callbackContext;
+    CFUUIDRef                   cleanUUID;
+    CFStringRef                 deviceName;
+    CFStringRef                 devicePath;
+    CFStringRef                 probeArgument;
+    CFURLRef                    probeCommand;
+    __DAFileSystemProbeFunction probeFunction;
+    CFStringRef                 queue;
+    CFURLRef                    repairCommand;
+    CFTimeInterval              timeout;
+    CFBooleanRef                volumeClean;
+    CFStringRef                 volumeName;
+    CFUUIDRef                   volumeUUID;
 };
 
 typedef struct __DAFileSystemProbeContext __DAFileSystemProbeContext;
 
+struct __DAFileSystemProbeProvider
+{
+    CFStringRef                 kind;
+    __DAFileSystemProbeFunction function;
+};
+
+typedef struct __DAFileSystemProbeProvider __DAFileSystemProbeProvider;
+
 struct __DAFileSystemRenameBuffer
 {
     attrreference_t data;
@@ -83,11 +108,13 @@ struct __DAFileSystemRenameBuffer
 
 typedef struct __DAFileSystemRenameBuffer __DAFileSystemRenameBuffer;
 
-static CFStringRef __DAFileSystemCopyDescription( CFTypeRef object );
-static CFStringRef __DAFileSystemCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
-static void        __DAFileSystemDeallocate( CFTypeRef object );
-static Boolean     __DAFileSystemEqual( CFTypeRef object1, CFTypeRef object2 );
-static CFHashCode  __DAFileSystemHash( CFTypeRef object );
+static CFStringRef    __DAFileSystemCopyDescription( CFTypeRef object );
+static CFStringRef    __DAFileSystemCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
+static CFStringRef    __DAFileSystemCreateQueue( CFURLRef device );
+static void           __DAFileSystemDeallocate( CFTypeRef object );
+static Boolean        __DAFileSystemEqual( CFTypeRef object1, CFTypeRef object2 );
+static CFTimeInterval __DAFileSystemGetTimeout( CFStringRef key, CFTimeInterval timeout );
+static CFHashCode     __DAFileSystemHash( CFTypeRef object );
 
 static const CFRuntimeClass __DAFileSystemClass =
 {
@@ -115,9 +142,48 @@ const CFStringRef kDAFileSystemMountArgumentUpdate      = CFSTR( "update"   );
 
 const CFStringRef kDAFileSystemUnmountArgumentForce     = CFSTR( "force" );
 
-static void __DAFileSystemProbeCallbackStage1( int status, CFDataRef output, void * context );
-static void __DAFileSystemProbeCallbackStage2( int status, CFDataRef output, void * context );
-static void __DAFileSystemProbeCallbackStage3( int status, CFDataRef output, void * context );
+/*
+ * A file system bundle may declare a combined probe argument next to its probe executable.  The
+ * probe executable, run with that argument in place of "-p", prints a property list dictionary
+ * with the volume name, UUID and clean state, and exits with FSUR_RECOGNIZED.
+ */
+
+static const CFStringRef __kDAFileSystemProbeCombinedArgumentKey = CFSTR( "FSProbeCombinedArgument" );
+static const CFStringRef __kDAFileSystemProbeVolumeCleanKey      = CFSTR( "FSVolumeClean"           );
+static const CFStringRef __kDAFileSystemProbeVolumeNameKey       = CFSTR( "FSVolumeName"            );
+static const CFStringRef __kDAFileSystemProbeVolumeUUIDKey       = CFSTR( "FSVolumeUUID"            );
+
+/*
+ * The default deadlines for each command, in seconds, which the preferences may override.  Every
+ * command of a probe gets the probe deadline.  A repair may legitimately run for hours on a large
+ * volume, so it has no deadline by default.
+ */
+
+static const CFTimeInterval __kDAFileSystemMountTimeout  = 300;
+static const CFTimeInterval __kDAFileSystemProbeTimeout  = 120;
+static const CFTimeInterval __kDAFileSystemRepairTimeout = 0;
+
+static void    __DAFileSystemProbeCallbackCombined( int status, CFDataRef output, void * context );
+static void    __DAFileSystemProbeCallbackStage1( int status, CFDataRef output, void * context );
+static void    __DAFileSystemProbeCallbackStage2( int status, CFDataRef output, void * context );
+static void    __DAFileSystemProbeCallbackStage3( int status, CFDataRef output, void * context );
+static void    __DAFileSystemProbeExecute( __DAFileSystemProbeContext * context );
+static Boolean __DAFileSystemProbeIsClean( __DAFileSystemProbeContext * context );
+static void    __DAFileSystemProbeOutputStage1( CFDataRef line, void * context );
+static void    __DAFileSystemProbeOutputStage2( CFDataRef line, void * context );
+static int     __DAFileSystemProbeHFS( int file, __DAFileSystemProbeContext * context );
+static int     __DAFileSystemProbeRead( int file, UInt32 blockSize, UInt64 offset, void * buffer, size_t length );
+
+/*
+ * The in-process probe providers.  A provider reads the volume's on-disk structures from the raw
+ * device and produces the same result as the file system's probe, "get UUID" and "is clean"
+ * commands would.  A provider that does not recognize the volume defers to those commands.
+ */
+
+static const __DAFileSystemProbeProvider __kDAFileSystemProbeProviderList[] =
+{
+    { CFSTR( "hfs" ), __DAFileSystemProbeHFS }
+};
 
 static void __DAFileSystemCallback( int status, CFDataRef output, void * parameter )
 {
@@ -169,6 +235,42 @@ static DAFileSystemRef __DAFileSystemCreate( CFAllocatorRef allocator, CFURLRef
     return filesystem;
 }
 
+static CFStringRef __DAFileSystemCreateQueue( CFURLRef device )
+{
+    /*
+     * Create the command queue for the specified device, which is that of its BSD unit, so that
+     * commands are scheduled fairly across physical devices, and may be canceled together.
+     */
+
+    CFStringRef name;
+    CFStringRef queue = NULL;
+
+    name = CFURLCopyLastPathComponent( device );
+
+    if ( name )
+    {
+        char * path;
+
+        path = ___CFStringCopyCString( name );
+
+        if ( path )
+        {
+            int unit;
+
+            if ( sscanf( path, "disk%d", &unit ) == 1 || sscanf( path, "rdisk%d", &unit ) == 1 )
+            {
+                queue = CFStringCreateWithFormat( kCFAllocatorDefault, 0, CFSTR( "disk%d" ), unit );
+            }
+
+            free( path );
+        }
+
+        CFRelease( name );
+    }
+
+    return queue;
+}
+
 static void __DAFileSystemDeallocate( CFTypeRef object )
 {
     DAFileSystemRef filesystem = ( DAFileSystemRef ) object;
@@ -185,6 +287,25 @@ static Boolean __DAFileSystemEqual( CFTypeRef object1, CFTypeRef object2 )
     return CFEqual( filesystem1->_id, filesystem2->_id );
 }
 
+static CFTimeInterval __DAFileSystemGetTimeout( CFStringRef key, CFTimeInterval timeout )
+{
+    /*
+     * Obtain the deadline configured for the specified kind of command.  A deadline of 0 means
+     * that the command may run for as long as it takes.
+     */
+
+    CFNumberRef number;
+
+    number = CFDictionaryGetValue( gDAPreferenceList, key );
+
+    if ( number )
+    {
+        CFNumberGetValue( number, kCFNumberDoubleType, &timeout );
+    }
+
+    return timeout;
+}
+
 static CFHashCode __DAFileSystemHash( CFTypeRef object )
 {
     DAFileSystemRef filesystem = ( DAFileSystemRef ) object;
@@ -216,6 +337,9 @@ static void __DAFileSystemProbeCallback( int status, void * parameter, CFDataRef
     CFRelease( context->devicePath   );
     CFRelease( context->probeCommand );
 
+    if ( context->cleanUUID     )  CFRelease( context->cleanUUID     );
+    if ( context->probeArgument )  CFRelease( context->probeArgument );
+    if ( context->queue         )  CFRelease( context->queue         );
     if ( context->repairCommand )  CFRelease( context->repairCommand );
     if ( context->volumeClean   )  CFRelease( context->volumeClean   );
     if ( context->volumeName    )  CFRelease( context->volumeName    );
@@ -224,55 +348,145 @@ static void __DAFileSystemProbeCallback( int status, void * parameter, CFDataRef
     free( context );
 }
 
-static void __DAFileSystemProbeCallbackStage1( int status, CFDataRef output, void * parameter )
+static void __DAFileSystemProbeCallbackCombined( int status, CFDataRef output, void * parameter )
 {
     /*
-     * Process the probe command's completion.
+     * Process the combined probe command's completion.
      */
 
     __DAFileSystemProbeContext * context = parameter;
 
     if ( status == FSUR_RECOGNIZED )
     {
-        /*
-         * Obtain the volume name.
-         */
+        CFPropertyListRef result = NULL;
 
         if ( output )
         {
-            CFStringRef string;
+            result = CFPropertyListCreateWithData( kCFAllocatorDefault, output, kCFPropertyListImmutable, NULL, NULL );
+        }
+
+        if ( result && CFGetTypeID( result ) == CFDictionaryGetTypeID( ) )
+        {
+            CFTypeRef value;
+
+            /*
+             * Obtain the volume name.
+             */
 
-            string = CFStringCreateFromExternalRepresentation( kCFAllocatorDefault, output, kCFStringEncodingUTF8 );
+            value = CFDictionaryGetValue( result, __kDAFileSystemProbeVolumeNameKey );
 
-            if ( string )
+            if ( value && CFGetTypeID( value ) == CFStringGetTypeID( ) )
             {
-                if ( CFStringGetLength( string ) )
+                if ( CFStringGetLength( value ) )
                 {
-                    context->volumeName = CFStringCreateMutableCopy( kCFAllocatorDefault, 0, string );
-
-                    if ( context->volumeName )
-                    {
-                        CFStringTrim( ( CFMutableStringRef ) context->volumeName, CFSTR( "\n" ) );
-                    }
+                    context->volumeName = CFRetain( value );
                 }
+            }
+
+            /*
+             * Obtain the volume UUID.
+             */
+
+            value = CFDictionaryGetValue( result, __kDAFileSystemProbeVolumeUUIDKey );
+
+            if ( value && CFGetTypeID( value ) == CFStringGetTypeID( ) )
+            {
+                context->volumeUUID = ___CFUUIDCreateFromString( kCFAllocatorDefault, value );
+            }
+
+            /*
+             * Obtain the volume state.  We fall back to the "is clean" command if it was not reported,
+             * unless the volume is known to be clean.
+             */
+
+            value = CFDictionaryGetValue( result, __kDAFileSystemProbeVolumeCleanKey );
 
-                CFRelease( string );
+            if ( context->repairCommand == NULL )
+            {
+                __DAFileSystemProbeCallbackStage3( 0, NULL, context );
+            }
+            else if ( value && CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+            {
+                __DAFileSystemProbeCallbackStage3( ( value == kCFBooleanTrue ) ? 0 : 1, NULL, context );
+            }
+            else if ( __DAFileSystemProbeIsClean( context ) )
+            {
+                __DAFileSystemProbeCallbackStage3( 0, NULL, context );
+            }
+            else
+            {
+                DACommandExecute( context->repairCommand,
+                                  kDACommandExecuteOptionDefault,
+                                  context->queue,
+                                  context->timeout,
+                                  ___UID_ROOT,
+                                  ___GID_WHEEL,
+                                  __DAFileSystemProbeCallbackStage3,
+                                  context,
+                                  CFSTR( "-q" ),
+                                  context->devicePath,
+                                  NULL );
             }
         }
+        else
+        {
+            /*
+             * Fall back to the three-stage probe, as the combined output is not understood.
+             */
+
+            CFRelease( context->probeArgument );
+
+            context->probeArgument = NULL;
+
+            __DAFileSystemProbeExecute( context );
+        }
+
+        if ( result )
+        {
+            CFRelease( result );
+        }
+    }
+    else
+    {
+        __DAFileSystemProbeCallback( status, context, NULL );
+    }
+}
+
+static void __DAFileSystemProbeCallbackStage1( int status, CFDataRef output, void * parameter )
+{
+    /*
+     * Process the probe command's completion.
+     */
+
+    __DAFileSystemProbeContext * context = parameter;
+
+    if ( status == FSUR_RECOGNIZED )
+    {
+        /*
+         * Complete the volume name, which __DAFileSystemProbeOutputStage1() collected line by line.
+         */
+
+        if ( context->volumeName )
+        {
+            CFStringTrim( ( CFMutableStringRef ) context->volumeName, CFSTR( "\n" ) );
+        }
 
         /*
          * Execute the "get UUID" command.
          */
 
-        DACommandExecute( context->probeCommand,
-                          kDACommandExecuteOptionCaptureOutput,
-                          ___UID_ROOT,
-                          ___GID_WHEEL,
-                          __DAFileSystemProbeCallbackStage2,
-                          context,
-                          CFSTR( "-k" ),
-                          context->deviceName,
-                          NULL );
+        DACommandExecuteWithOutputCallback( context->probeCommand,
+                                            kDACommandExecuteOptionDefault,
+                                            context->queue,
+                                            context->timeout,
+                                            ___UID_ROOT,
+                                            ___GID_WHEEL,
+                                            __DAFileSystemProbeCallbackStage2,
+                                            __DAFileSystemProbeOutputStage2,
+                                            context,
+                                            CFSTR( "-k" ),
+                                            context->deviceName,
+                                            NULL );
     }
     else
     {
@@ -288,31 +502,30 @@ static void __DAFileSystemProbeCallbackStage2( int status, CFDataRef output, voi
 
     __DAFileSystemProbeContext * context = parameter;
 
-    if ( status == FSUR_IO_SUCCESS )
+    if ( status != FSUR_IO_SUCCESS )
     {
         /*
-         * Obtain the volume UUID.  The "get UUID" command returns a unique 64-bit number, which
-         * we must map into the official, structured 128-bit UUID format.  One would expect that
-         * the "get UUID" interface return the official UUID format, when it is revised later on,
-         * and we take that into account here.
+         * Discard the volume UUID, which __DAFileSystemProbeOutputStage2() may have obtained
+         * ahead of the failure.
          */
 
-        if ( output )
+        if ( context->volumeUUID )
         {
-            CFStringRef string;
-
-            string = CFStringCreateFromExternalRepresentation( kCFAllocatorDefault, output, kCFStringEncodingUTF8 );
-
-            if ( string )
-            {
-                context->volumeUUID = ___CFUUIDCreateFromString( kCFAllocatorDefault, string );
+            CFRelease( context->volumeUUID );
 
-                CFRelease( string );
-            }
+            context->volumeUUID = NULL;
         }
     }
 
-    if ( context->repairCommand )
+    if ( __DAFileSystemProbeIsClean( context ) )
+    {
+        /*
+         * Skip the "is clean" command, as the volume is known to be clean.
+         */
+
+        __DAFileSystemProbeCallbackStage3( 0, NULL, context );
+    }
+    else if ( context->repairCommand )
     {
         /*
          * Execute the "is clean" command.
@@ -320,6 +533,8 @@ static void __DAFileSystemProbeCallbackStage2( int status, CFDataRef output, voi
 
         DACommandExecute( context->repairCommand,
                           kDACommandExecuteOptionDefault,
+                          context->queue,
+                          context->timeout,
                           ___UID_ROOT,
                           ___GID_WHEEL,
                           __DAFileSystemProbeCallbackStage3,
@@ -351,6 +566,417 @@ static void __DAFileSystemProbeCallbackStage3( int status, CFDataRef output, voi
     __DAFileSystemProbeCallback( 0, context, NULL );
 }
 
+static void __DAFileSystemProbeExecute( __DAFileSystemProbeContext * context )
+{
+    /*
+     * Execute the probe command, in its combined form if the file system bundle supports it.
+     */
+
+    if ( context->probeArgument )
+    {
+        DACommandExecute( context->probeCommand,
+                          kDACommandExecuteOptionCaptureOutput,
+                          context->queue,
+                          context->timeout,
+                          ___UID_ROOT,
+                          ___GID_WHEEL,
+                          __DAFileSystemProbeCallbackCombined,
+                          context,
+                          context->probeArgument,
+                          context->deviceName,
+                          CFSTR( "removable" ),
+                          CFSTR( "readonly"  ),
+                          NULL );
+    }
+    else
+    {
+        DACommandExecuteWithOutputCallback( context->probeCommand,
+                                            kDACommandExecuteOptionDefault,
+                                            context->queue,
+                                            context->timeout,
+                                            ___UID_ROOT,
+                                            ___GID_WHEEL,
+                                            __DAFileSystemProbeCallbackStage1,
+                                            __DAFileSystemProbeOutputStage1,
+                                            context,
+                                            CFSTR( "-p" ),
+                                            context->deviceName,
+                                            CFSTR( "removable" ),
+                                            CFSTR( "readonly"  ),
+                                            NULL );
+    }
+}
+
+static Boolean __DAFileSystemProbeIsClean( __DAFileSystemProbeContext * context )
+{
+    /*
+     * Determine whether the probed volume is the one known to be clean, which spares the "is clean"
+     * command.  The caller vouches that the volume has not been written to since its last check.
+     */
+
+    if ( context->cleanUUID && context->volumeUUID )
+    {
+        if ( CFEqual( context->cleanUUID, context->volumeUUID ) )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void __DAFileSystemProbeOutputStage1( CFDataRef line, void * parameter )
+{
+    /*
+     * Process a line of the probe command's output, which holds the volume name.  The name is
+     * kept only once the command reports the volume as recognized.
+     */
+
+    __DAFileSystemProbeContext * context = parameter;
+    CFStringRef                  string;
+
+    string = CFStringCreateFromExternalRepresentation( kCFAllocatorDefault, line, kCFStringEncodingUTF8 );
+
+    if ( string )
+    {
+        if ( context->volumeName )
+        {
+            CFStringAppend( ( CFMutableStringRef ) context->volumeName, CFSTR( "\n" ) );
+            CFStringAppend( ( CFMutableStringRef ) context->volumeName, string );
+        }
+        else
+        {
+            context->volumeName = CFStringCreateMutableCopy( kCFAllocatorDefault, 0, string );
+        }
+
+        CFRelease( string );
+    }
+}
+
+static void __DAFileSystemProbeOutputStage2( CFDataRef line, void * parameter )
+{
+    /*
+     * Process a line of the "get UUID" command's output.  The "get UUID" command returns a unique
+     * 64-bit number, which we must map into the official, structured 128-bit UUID format.  One
+     * would expect that the "get UUID" interface return the official UUID format, when it is
+     * revised later on, and we take that into account here.
+     */
+
+    __DAFileSystemProbeContext * context = parameter;
+
+    if ( context->volumeUUID == NULL )
+    {
+        CFStringRef string;
+
+        string = CFStringCreateFromExternalRepresentation( kCFAllocatorDefault, line, kCFStringEncodingUTF8 );
+
+        if ( string )
+        {
+            context->volumeUUID = ___CFUUIDCreateFromString( kCFAllocatorDefault, string );
+
+            CFRelease( string );
+        }
+    }
+}
+
+static int __DAFileSystemProbeHFS( int file, __DAFileSystemProbeContext * context )
+{
+    /*
+     * Probe the specified HFS Plus volume.  The volume name is that of the root folder, which is
+     * the first record of the first leaf node of the catalog file.  A status of 0 indicates that
+     * the volume was recognized.
+     */
+
+    UInt32                attributes;
+    UInt32                blockSize;
+    UInt8                 buffer[sizeof( HFSPlusVolumeHeader )];
+    UInt16 *              characters = NULL;
+    HFSPlusVolumeHeader * header     = ( void * ) buffer;
+    UInt32                index;
+    HFSPlusCatalogKey *   key;
+    UInt32                length;
+    UInt8 *               node       = NULL;
+    UInt32                nodeCount;
+    UInt32                nodeNumber;
+    UInt16                nodeSize;
+    UInt16                recordOffset;
+    int                   status;
+    UInt8                 uuid[8];
+
+    /*
+     * Obtain the device block size.
+     */
+
+    status = ioctl( file, DKIOCGETBLOCKSIZE, &blockSize );
+    if ( status )  goto __DAFileSystemProbeHFSErr;
+
+    /*
+     * Read the volume header.  A wrapped or a standard HFS volume is left to the probe command.
+     */
+
+    status = __DAFileSystemProbeRead( file, blockSize, 1024, header, sizeof( HFSPlusVolumeHeader ) );
+    if ( status )  goto __DAFileSystemProbeHFSErr;
+
+    status = EINVAL;
+
+    if ( OSSwapBigToHostInt16( header->signature ) != kHFSPlusSigWord &&
+         OSSwapBigToHostInt16( header->signature ) != kHFSXSigWord )
+    {
+        goto __DAFileSystemProbeHFSErr;
+    }
+
+    if ( OSSwapBigToHostInt32( header->blockSize ) == 0 )  goto __DAFileSystemProbeHFSErr;
+
+    /*
+     * Read the catalog file's header node.  We only consult the catalog file's first extent.
+     */
+
+    node = malloc( sizeof( BTNodeDescriptor ) + sizeof( BTHeaderRec ) );
+    if ( node == NULL )  { status = ENOMEM; goto __DAFileSystemProbeHFSErr; }
+
+    status = __DAFileSystemProbeRead( file,
+                                      blockSize,
+                                      ( UInt64 ) OSSwapBigToHostInt32( header->catalogFile.extents[0].startBlock ) * OSSwapBigToHostInt32( header->blockSize ),
+                                      node,
+                                      sizeof( BTNodeDescriptor ) + sizeof( BTHeaderRec ) );
+    if ( status )  goto __DAFileSystemProbeHFSErr;
+
+    status = EINVAL;
+
+    if ( ( ( BTNodeDescriptor * ) node )->kind != kBTHeaderNode )  goto __DAFileSystemProbeHFSErr;
+
+    nodeNumber = OSSwapBigToHostInt32( ( ( BTHeaderRec * ) ( node + sizeof( BTNodeDescriptor ) ) )->firstLeafNode );
+    nodeSize   = OSSwapBigToHostInt16( ( ( BTHeaderRec * ) ( node + sizeof( BTNodeDescriptor ) ) )->nodeSize );
+
+    if ( nodeSize < 512 || ( nodeSize % 512 ) )  goto __DAFileSystemProbeHFSErr;
+
+    nodeCount = ( ( UInt64 ) OSSwapBigToHostInt32( header->catalogFile.extents[0].blockCount ) * OSSwapBigToHostInt32( header->blockSize ) ) / nodeSize;
+
+    if ( nodeNumber == 0 || nodeNumber >= nodeCount )  goto __DAFileSystemProbeHFSErr;
+
+    /*
+     * Read the catalog file's first leaf node.
+     */
+
+    free( node );
+
+    node = malloc( nodeSize );
+    if ( node == NULL )  { status = ENOMEM; goto __DAFileSystemProbeHFSErr; }
+
+    status = __DAFileSystemProbeRead( file,
+                                      blockSize,
+                                      ( UInt64 ) OSSwapBigToHostInt32( header->catalogFile.extents[0].startBlock ) * OSSwapBigToHostInt32( header->blockSize ) + ( UInt64 ) nodeNumber * nodeSize,
+                                      node,
+                                      nodeSize );
+    if ( status )  goto __DAFileSystemProbeHFSErr;
+
+    status = EINVAL;
+
+    if ( ( ( BTNodeDescriptor * ) node )->kind != kBTLeafNode )  goto __DAFileSystemProbeHFSErr;
+
+    if ( OSSwapBigToHostInt16( ( ( BTNodeDescriptor * ) node )->numRecords ) == 0 )  goto __DAFileSystemProbeHFSErr;
+
+    recordOffset = OSSwapBigToHostInt16( *( ( UInt16 * ) ( node + nodeSize - sizeof( UInt16 ) ) ) );
+
+    if ( recordOffset < sizeof( BTNodeDescriptor ) )  goto __DAFileSystemProbeHFSErr;
+
+    if ( recordOffset + offsetof( HFSPlusCatalogKey, nodeName.unicode ) > nodeSize - sizeof( UInt16 ) )  goto __DAFileSystemProbeHFSErr;
+
+    key = ( void * ) ( node + recordOffset );
+
+    if ( OSSwapBigToHostInt32( key->parentID ) != kHFSRootParentID )  goto __DAFileSystemProbeHFSErr;
+
+    length = OSSwapBigToHostInt16( key->nodeName.length );
+
+    if ( length > 255 )  goto __DAFileSystemProbeHFSErr;
+
+    if ( recordOffset + offsetof( HFSPlusCatalogKey, nodeName.unicode ) + length * sizeof( UInt16 ) > nodeSize - sizeof( UInt16 ) )  goto __DAFileSystemProbeHFSErr;
+
+    /*
+     * Obtain the volume name.  A slash in a catalog name is a colon in the file system's name.
+     */
+
+    if ( length )
+    {
+        characters = malloc( length * sizeof( UInt16 ) );
+        if ( characters == NULL )  { status = ENOMEM; goto __DAFileSystemProbeHFSErr; }
+
+        for ( index = 0; index < length; index++ )
+        {
+            characters[index] = OSSwapBigToHostInt16( key->nodeName.unicode[index] );
+
+            if ( characters[index] == '/' )
+            {
+                characters[index] = ':';
+            }
+        }
+
+        context->volumeName = CFStringCreateWithCharacters( kCFAllocatorDefault, characters, length );
+    }
+
+    /*
+     * Obtain the volume UUID.  The 64-bit volume identifier is mapped into the official 128-bit
+     * UUID format, as the "get UUID" command does.
+     */
+
+    memcpy( uuid, &header->finderInfo[6], sizeof( uuid ) );
+
+    for ( index = 0; index < sizeof( uuid ); index++ )
+    {
+        if ( uuid[index] )  break;
+    }
+
+    if ( index < sizeof( uuid ) )
+    {
+        CFDataRef data;
+
+        data = CFDataCreate( kCFAllocatorDefault, uuid, sizeof( uuid ) );
+
+        if ( data )
+        {
+            context->volumeUUID = ___CFUUIDCreateFromName( kCFAllocatorDefault, __kDAFileSystemUUIDSpaceSHA1, data );
+
+            CFRelease( data );
+        }
+    }
+
+    /*
+     * Obtain the volume state.  A journaled volume is clean unless it is marked inconsistent, or
+     * unless a prior repair was interrupted.
+     */
+
+    attributes = OSSwapBigToHostInt32( header->attributes );
+
+    if ( ( attributes & kHFSVolumeInconsistentMask ) )
+    {
+        context->volumeClean = CFRetain( kCFBooleanFalse );
+    }
+    else if ( OSSwapBigToHostInt32( header->lastMountedVersion ) == kFSKMountVersion )
+    {
+        context->volumeClean = CFRetain( kCFBooleanFalse );
+    }
+    else if ( ( attributes & ( kHFSVolumeJournaledMask | kHFSVolumeUnmountedMask ) ) )
+    {
+        context->volumeClean = CFRetain( kCFBooleanTrue );
+    }
+    else
+    {
+        context->volumeClean = CFRetain( kCFBooleanFalse );
+    }
+
+    status = 0;
+
+__DAFileSystemProbeHFSErr:
+
+    if ( characters )  free( characters );
+    if ( node       )  free( node );
+
+    return status;
+}
+
+static int __DAFileSystemProbeProvider( void * parameter )
+{
+    /*
+     * Run the in-process probe provider against the raw device.  This call is blocking and is
+     * made off of the main thread.
+     */
+
+    __DAFileSystemProbeContext * context = parameter;
+    int                          file    = -1;
+    char *                       path    = NULL;
+    int                          status  = 0;
+
+    path = ___CFStringCopyCString( context->devicePath );
+    if ( path == NULL )  { status = ENOMEM; goto __DAFileSystemProbeProviderErr; }
+
+    file = open( path, O_RDONLY );
+    if ( file == -1 )  { status = errno; goto __DAFileSystemProbeProviderErr; }
+
+    status = ( context->probeFunction )( file, context );
+
+__DAFileSystemProbeProviderErr:
+
+    if ( file != -1 )  close( file );
+    if ( path       )  free( path );
+
+    return status;
+}
+
+static void __DAFileSystemProbeProviderCallback( int status, void * parameter )
+{
+    /*
+     * Process the in-process probe provider's completion.
+     */
+
+    __DAFileSystemProbeContext * context = parameter;
+
+    if ( status )
+    {
+        /*
+         * Defer to the probe command.
+         */
+
+        if ( context->volumeClean )  CFRelease( context->volumeClean );
+        if ( context->volumeName  )  CFRelease( context->volumeName  );
+        if ( context->volumeUUID  )  CFRelease( context->volumeUUID  );
+
+        context->volumeClean = NULL;
+        context->volumeName  = NULL;
+        context->volumeUUID  = NULL;
+
+        __DAFileSystemProbeExecute( context );
+    }
+    else
+    {
+        /*
+         * The "is clean" command is not applicable without a repair command.
+         */
+
+        if ( context->repairCommand == NULL )
+        {
+            if ( context->volumeClean )  CFRelease( context->volumeClean );
+
+            context->volumeClean = CFRetain( kCFBooleanTrue );
+        }
+
+        __DAFileSystemProbeCallback( 0, context, NULL );
+    }
+}
+
+static int __DAFileSystemProbeRead( int file, UInt32 blockSize, UInt64 offset, void * buffer, size_t length )
+{
+    /*
+     * Read the specified range from the raw device, whose transfers must be aligned to the device
+     * block size.  A status of 0 indicates success.
+     */
+
+    UInt8 * data;
+    UInt64  dataOffset;
+    size_t  dataLength;
+    int     status = 0;
+
+    if ( blockSize == 0 )  return EINVAL;
+
+    dataOffset = offset - ( offset % blockSize );
+    dataLength = ( ( offset + length - dataOffset + blockSize - 1 ) / blockSize ) * blockSize;
+
+    data = malloc( dataLength );
+    if ( data == NULL )  return ENOMEM;
+
+    if ( pread( file, data, dataLength, dataOffset ) == ( ssize_t ) dataLength )
+    {
+        memcpy( buffer, data + ( offset - dataOffset ), length );
+    }
+    else
+    {
+        status = EIO;
+    }
+
+    free( data );
+
+    return status;
+}
+
 CFStringRef _DAFileSystemCopyName( DAFileSystemRef filesystem, CFURLRef mountpoint )
 {
     struct attr_name_t
@@ -414,6 +1040,25 @@ CFUUIDRef _DAFileSystemCreateUUIDFromString( CFAllocatorRef allocator, CFStringR
     return uuid;
 }
 
+void DAFileSystemCancel( CFURLRef device )
+{
+    /*
+     * Cancel the commands running or waiting against the specified device.  The commands are
+     * scheduled per BSD unit, so this cancels the commands of every slice on that unit.
+     */
+
+    CFStringRef queue;
+
+    queue = __DAFileSystemCreateQueue( device );
+
+    if ( queue )
+    {
+        DACommandCancel( queue );
+
+        CFRelease( queue );
+    }
+}
+
 DAFileSystemRef DAFileSystemCreate( CFAllocatorRef allocator, CFURLRef path )
 {
     DAFileSystemRef filesystem = NULL;
@@ -514,7 +1159,9 @@ void DAFileSystemMountWithArguments( DAFileSystemRef      filesystem,
     CFStringRef             devicePath     = NULL;
     CFStringRef             mountpointPath = NULL;
     CFMutableStringRef      options        = NULL;
+    CFStringRef             queue          = NULL;
     int                     status         = 0;
+    CFTimeInterval          timeout        = 0;
 
     /*
      * Prepare to mount the volume.
@@ -529,6 +1176,10 @@ void DAFileSystemMountWithArguments( DAFileSystemRef      filesystem,
     devicePath = CFURLCopyFileSystemPath( device, kCFURLPOSIXPathStyle );
     if ( devicePath == NULL )  { status = EINVAL; goto DAFileSystemMountErr; }
 
+    queue = __DAFileSystemCreateQueue( device );
+
+    timeout = __DAFileSystemGetTimeout( kDAPreferenceMountTimeoutKey, __kDAFileSystemMountTimeout );
+
     mountpointPath = CFURLCopyFileSystemPath( mountpoint, kCFURLPOSIXPathStyle );
     if ( mountpointPath == NULL )  { status = EINVAL; goto DAFileSystemMountErr; }
 
@@ -562,6 +1213,8 @@ void DAFileSystemMountWithArguments( DAFileSystemRef      filesystem,
     {
         DACommandExecute( command,
                           kDACommandExecuteOptionDefault,
+                          queue,
+                          timeout,
                           userUID,
                           userGID,
                           __DAFileSystemCallback,
@@ -578,6 +1231,8 @@ void DAFileSystemMountWithArguments( DAFileSystemRef      filesystem,
     {
         DACommandExecute( command,
                           kDACommandExecuteOptionDefault,
+                          queue,
+                          timeout,
                           userUID,
                           userGID,
                           __DAFileSystemCallback,
@@ -595,6 +1250,7 @@ DAFileSystemMountErr:
     if ( devicePath     )  CFRelease( devicePath     );
     if ( mountpointPath )  CFRelease( mountpointPath );
     if ( options        )  CFRelease( options        );
+    if ( queue          )  CFRelease( queue          );
 
     if ( status )
     {
@@ -609,20 +1265,24 @@ DAFileSystemMountErr:
 
 void DAFileSystemProbe( DAFileSystemRef           filesystem,
                         CFURLRef                  device,
+                        CFUUIDRef                 cleanUUID,
                         DAFileSystemProbeCallback callback,
                         void *                    callbackContext )
 {
     /*
-     * Probe the specified volume.  A status of 0 indicates success.
+     * Probe the specified volume.  A status of 0 indicates success.  The "is clean" command is
+     * skipped should the volume turn out to be the one identified by cleanUUID.
      */
 
     __DAFileSystemProbeContext * context           = NULL;
     CFStringRef                  deviceName        = NULL;
     CFStringRef                  devicePath        = NULL;
+    CFIndex                      index             = 0;
     CFDictionaryRef              mediaType         = NULL;
     CFDictionaryRef              mediaTypes        = NULL;
     CFDictionaryRef              personality       = NULL;
     CFDictionaryRef              personalities     = NULL;
+    CFStringRef                  probeArgument     = NULL;
     CFURLRef                     probeCommand      = NULL;
     CFStringRef                  probeCommandName  = NULL;
     CFURLRef                     repairCommand     = NULL;
@@ -651,6 +1311,20 @@ void DAFileSystemProbe( DAFileSystemRef           filesystem,
     probeCommand = ___CFBundleCopyResourceURLInDirectory( filesystem->_id, probeCommandName );
     if ( probeCommand == NULL )  { status = ENOTSUP; goto DAFileSystemProbeErr; }
 
+    probeArgument = CFDictionaryGetValue( mediaType, __kDAFileSystemProbeCombinedArgumentKey );
+
+    if ( probeArgument )
+    {
+        if ( CFGetTypeID( probeArgument ) == CFStringGetTypeID( ) )
+        {
+            CFRetain( probeArgument );
+        }
+        else
+        {
+            probeArgument = NULL;
+        }
+    }
+
     repairCommandName = CFDictionaryGetValue( personality, CFSTR( kFSRepairExecutableKey ) );
 
     if ( repairCommandName )
@@ -674,25 +1348,41 @@ void DAFileSystemProbe( DAFileSystemRef           filesystem,
 
     context->callback        = callback;
     context->callbackContext = callbackContext;
+    context->cleanUUID       = cleanUUID ? CFRetain( cleanUUID ) : NULL;
     context->deviceName      = deviceName;
     context->devicePath      = devicePath;
+    context->probeArgument   = probeArgument;
     context->probeCommand    = probeCommand;
+    context->probeFunction   = NULL;
+    context->queue           = __DAFileSystemCreateQueue( device );
     context->repairCommand   = repairCommand;
+    context->timeout         = __DAFileSystemGetTimeout( kDAPreferenceProbeTimeoutKey, __kDAFileSystemProbeTimeout );
     context->volumeClean     = NULL;
     context->volumeName      = NULL;
     context->volumeUUID      = NULL;
 
-    DACommandExecute( probeCommand,
-                      kDACommandExecuteOptionCaptureOutput,
-                      ___UID_ROOT,
-                      ___GID_WHEEL,
-                      __DAFileSystemProbeCallbackStage1,
-                      context,
-                      CFSTR( "-p" ),
-                      deviceName,
-                      CFSTR( "removable" ),
-                      CFSTR( "readonly"  ),
-                      NULL );
+    for ( index = 0; index < sizeof( __kDAFileSystemProbeProviderList ) / sizeof( __DAFileSystemProbeProvider ); index++ )
+    {
+        if ( CFEqual( __kDAFileSystemProbeProviderList[index].kind, DAFileSystemGetKind( filesystem ) ) )
+        {
+            context->probeFunction = __kDAFileSystemProbeProviderList[index].function;
+
+            break;
+        }
+    }
+
+    if ( context->probeFunction )
+    {
+        /*
+         * Execute the in-process probe provider, which defers to the probe command on failure.
+         */
+
+        DAThreadExecute( __DAFileSystemProbeProvider, context, __DAFileSystemProbeProviderCallback, context );
+    }
+    else
+    {
+        __DAFileSystemProbeExecute( context );
+    }
 
 DAFileSystemProbeErr:
 
@@ -700,6 +1390,7 @@ DAFileSystemProbeErr:
     {
         if ( deviceName    )  CFRelease( deviceName    );
         if ( devicePath    )  CFRelease( devicePath    );
+        if ( probeArgument )  CFRelease( probeArgument );
         if ( probeCommand  )  CFRelease( probeCommand  );
         if ( repairCommand )  CFRelease( repairCommand );
 
@@ -783,7 +1474,9 @@ void DAFileSystemRepair( DAFileSystemRef      filesystem,
     CFStringRef             devicePath    = NULL;
     CFDictionaryRef         personality   = NULL;
     CFDictionaryRef         personalities = NULL;
+    CFStringRef             queue         = NULL;
     int                     status        = 0;
+    CFTimeInterval          timeout       = 0;
 
     /*
      * Prepare to repair.
@@ -804,18 +1497,24 @@ void DAFileSystemRepair( DAFileSystemRef      filesystem,
     devicePath = ___CFURLCopyRawDeviceFileSystemPath( device, kCFURLPOSIXPathStyle );
     if ( devicePath == NULL )  { status = EINVAL; goto DAFileSystemRepairErr; }
 
+    queue = __DAFileSystemCreateQueue( device );
+
+    timeout = __DAFileSystemGetTimeout( kDAPreferenceRepairTimeoutKey, __kDAFileSystemRepairTimeout );
+
     context = malloc( sizeof( __DAFileSystemContext ) );
     if ( context == NULL )  { status = ENOMEM; goto DAFileSystemRepairErr; }
 
     /*
-     * Execute the repair command.
+     * Execute the repair command.  A repair yields to probes and mounts.
      */
 
     context->callback        = callback;
     context->callbackContext = callbackContext;
 
     DACommandExecute( command,
-                      kDACommandExecuteOptionDefault,
+                      kDACommandExecuteOptionBackground,
+                      queue,
+                      timeout,
                       ___UID_ROOT,
                       ___GID_WHEEL,
                       __DAFileSystemCallback,
@@ -828,6 +1527,7 @@ DAFileSystemRepairErr:
 
     if ( command    )  CFRelease( command    );
     if ( devicePath )  CFRelease( devicePath );
+    if ( queue      )  CFRelease( queue      );
 
     if ( status )
     {
@@ -876,6 +1576,8 @@ void DAFileSystemRepairQuotas( DAFileSystemRef      filesystem,
 
     DACommandExecute( command,
                       kDACommandExecuteOptionDefault,
+                      NULL,
+                      0,
                       ___UID_ROOT,
                       ___GID_WHEEL,
                       __DAFileSystemCallback,
@@ -968,6 +1670,8 @@ void DAFileSystemUnmountWithArguments( DAFileSystemRef      filesystem,
     {
         DACommandExecute( command,
                           kDACommandExecuteOptionDefault,
+                          NULL,
+                          0,
                           ___UID_ROOT,
                           ___GID_WHEEL,
                           __DAFileSystemCallback,
@@ -980,6 +1684,8 @@ void DAFileSystemUnmountWithArguments( DAFileSystemRef      filesystem,
     {
         DACommandExecute( command,
                           kDACommandExecuteOptionDefault,
+                          NULL,
+                          0,
                           ___UID_ROOT,
                           ___GID_WHEEL,
                           __DAFileSystemCallback,
@@ -52,6 +52,8 @@ extern CFStringRef _DAFileSystemCopyName( DAFileSystemRef filesystem, CFURLRef m
 
 extern CFUUIDRef _DAFileSystemCreateUUIDFromString( CFAllocatorRef allocator, CFStringRef string );
 
+extern void DAFileSystemCancel( CFURLRef device );
+
 extern DAFileSystemRef DAFileSystemCreate( CFAllocatorRef allocator, CFURLRef path );
 
 extern CFRunLoopSourceRef DAFileSystemCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order );
@@ -83,6 +85,7 @@ extern void DAFileSystemMountWithArguments( DAFileSystemRef      filesystem,
 
 extern void DAFileSystemProbe( DAFileSystemRef           filesystem,
                                CFURLRef                  device,
+                               CFUUIDRef                 cleanUUID,
                                DAFileSystemProbeCallback callback,
                                void *                    callbackContext );
 
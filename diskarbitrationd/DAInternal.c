@@ -38,12 +38,16 @@ __private_extern__ const CFStringRef _kDACallbackArgument1Key     = CFSTR( "DACa
 __private_extern__ const CFStringRef _kDACallbackContextKey       = CFSTR( "DACallbackContext"   );
 __private_extern__ const CFStringRef _kDACallbackDiskKey          = CFSTR( "DACallbackDisk"      );
 __private_extern__ const CFStringRef _kDACallbackKindKey          = CFSTR( "DACallbackKind"      );
+__private_extern__ const CFStringRef _kDACallbackLatencyKey       = CFSTR( "DACallbackLatency"   );
 __private_extern__ const CFStringRef _kDACallbackMatchKey         = CFSTR( "DACallbackMatch"     );
 __private_extern__ const CFStringRef _kDACallbackOrderKey         = CFSTR( "DACallbackOrder"     );
 __private_extern__ const CFStringRef _kDACallbackSessionKey       = CFSTR( "DACallbackSession"   );
 __private_extern__ const CFStringRef _kDACallbackTimeKey          = CFSTR( "DACallbackTime"      );
 __private_extern__ const CFStringRef _kDACallbackWatchKey         = CFSTR( "DACallbackWatch"     );
 
+__private_extern__ const CFStringRef _kDADiskGenerationKey        = CFSTR( "DADiskGeneration"    );
+__private_extern__ const CFStringRef _kDADiskGenerationBaseKey    = CFSTR( "DADiskBase"          );
+__private_extern__ const CFStringRef _kDADiskGenerationDeltaKey   = CFSTR( "DADiskDelta"         );
 __private_extern__ const CFStringRef _kDADiskIDKey                = CFSTR( "DADiskID"            );
 
 __private_extern__ const CFStringRef _kDADissenterProcessIDKey    = CFSTR( "DAProcessID"         );
@@ -121,7 +125,8 @@ static const char * __kDAKindNameList[] =
     "disk rename",
     "disk unmount",
     "disk unmount approval",
-    "idle"
+    "idle",
+    "unregister"
 };
 
 extern CFIndex __CFBinaryPlistWriteToStream( CFPropertyListRef plist, CFTypeRef stream );
@@ -315,6 +320,44 @@ __private_extern__ const char * _DACallbackKindGetName( _DACallbackKind kind )
     return __kDAKindNameList[kind];
 }
 
+__private_extern__ void _DACallbackRingRead( _DACallbackRing * ring, UInt32 offset, void * buffer, UInt32 length )
+{
+    /*
+     * Copy data out of the callback ring.  The offset runs freely, and the data wraps around the
+     * end of the ring.
+     */
+
+    UInt32 index;
+    UInt32 count;
+
+    index = offset % _kDACallbackRingSize;
+
+    count = MIN( length, _kDACallbackRingSize - index );
+
+    memcpy( buffer, ring->_data + index, count );
+
+    memcpy( ( UInt8 * ) buffer + count, ring->_data, length - count );
+}
+
+__private_extern__ void _DACallbackRingWrite( _DACallbackRing * ring, UInt32 offset, const void * buffer, UInt32 length )
+{
+    /*
+     * Copy data into the callback ring.  The offset runs freely, and the data wraps around the
+     * end of the ring.
+     */
+
+    UInt32 index;
+    UInt32 count;
+
+    index = offset % _kDACallbackRingSize;
+
+    count = MIN( length, _kDACallbackRingSize - index );
+
+    memcpy( ring->_data + index, buffer, count );
+
+    memcpy( ring->_data, ( const UInt8 * ) buffer + count, length - count );
+}
+
 __private_extern__ const char * _DARequestKindGetName( _DARequestKind kind )
 {
     return __kDAKindNameList[kind];
@@ -322,6 +365,11 @@ __private_extern__ const char * _DARequestKindGetName( _DARequestKind kind )
 
 __private_extern__ CFDataRef _DASerialize( CFAllocatorRef allocator, CFTypeRef object )
 {
+    /*
+     * Serialize the specified object in the binary property list format.  The unserialization
+     * routines detect the format, so that the XML property list format is still understood.
+     */
+
     CFDataRef data;
 
     data = CFDataCreateMutable( allocator, 0 );
@@ -406,14 +454,14 @@ __private_extern__ CFDataRef _DASerializeDiskDescription( CFAllocatorRef allocat
 
 __private_extern__ CFTypeRef _DAUnserialize( CFAllocatorRef allocator, CFDataRef data )
 {
-    return CFPropertyListCreateFromXMLData( allocator, data, kCFPropertyListImmutable, NULL );
+    return CFPropertyListCreateWithData( allocator, data, kCFPropertyListImmutable, NULL, NULL );
 }
 
 __private_extern__ CFMutableDictionaryRef _DAUnserializeDiskDescription( CFAllocatorRef allocator, CFDataRef data )
 {
     CFMutableDictionaryRef description;
 
-    description = ( void * ) CFPropertyListCreateFromXMLData( allocator, data, kCFPropertyListMutableContainers, NULL );
+    description = ( void * ) CFPropertyListCreateWithData( allocator, data, kCFPropertyListMutableContainers, NULL, NULL );
 
     if ( description )
     {
@@ -40,6 +40,13 @@ extern "C" {
 
 #define _kDADaemonName "com.apple.DiskArbitration.diskarbitrationd"
 
+/*
+ * The daemon posts this notify(3) name, and sets its state to 1, once the media found at
+ * startup have been probed and mounted.
+ */
+
+#define _kDADaemonSettledName "com.apple.DiskArbitration.diskarbitrationd.settled"
+
 enum
 {
     _kDAAuthorizeOptionDefault                   = 0x00000000,
@@ -66,11 +73,53 @@ enum
     _kDADiskRenameCallback,
     _kDADiskUnmountCallback,
     _kDADiskUnmountApprovalCallback,
-    _kDAIdleCallback
+    _kDAIdleCallback,
+    _kDAUnregisterCallback,
+    _kDAQueueOverflowCallback
 };
 
 typedef UInt32 _DACallbackKind;
 
+#define _kDACallbackKindCount ( _kDAUnregisterCallback + 1 )
+
+#define _kDACallbackRingSize 0x00010000
+
+struct __DACallbackRing
+{
+    volatile UInt32 _head;   /* ( written by the server ) */
+    volatile UInt32 _tail;   /* ( written by the client ) */
+    volatile UInt32 _queued; /* ( written by the server ) */
+    volatile UInt32 _mapped; /* ( written by the client ) */
+    UInt8           _data[_kDACallbackRingSize];
+};
+
+typedef struct __DACallbackRing _DACallbackRing;
+
+enum
+{
+    _kDAClientPortOptionDefault = 0x00000000,
+    _kDAClientPortOptionMessage = 0x00000001,
+    _kDAClientPortOptionLatency = 0x00000002
+};
+
+typedef UInt32 _DAClientPortOptions;
+
+enum
+{
+    _kDAClientMessageWakeup,
+    _kDAClientMessageQueue,
+    _kDAClientMessageComplete
+};
+
+struct __DAClientMessage
+{
+    mach_msg_header_t         _header;
+    mach_msg_body_t           _body;
+    mach_msg_ool_descriptor_t _queue;
+};
+
+typedef struct __DAClientMessage _DAClientMessage;
+
 enum
 {
     _kDADiskClaim   = _kDADiskClaimCallback,
@@ -96,12 +145,16 @@ const CFStringRef _kDACallbackArgument1Key;     /* ( CFType       ) */
 const CFStringRef _kDACallbackContextKey;       /* ( CFNumber     ) */
 const CFStringRef _kDACallbackDiskKey;          /* ( DADisk       ) */
 const CFStringRef _kDACallbackKindKey;          /* ( CFNumber     ) */
+const CFStringRef _kDACallbackLatencyKey;       /* ( CFNumber     ) */
 const CFStringRef _kDACallbackMatchKey;         /* ( CFDictionary ) */
 const CFStringRef _kDACallbackOrderKey;         /* ( CFNumber     ) */
 const CFStringRef _kDACallbackSessionKey;       /* ( DASession    ) */
 const CFStringRef _kDACallbackTimeKey;          /* ( CFDate       ) */
 const CFStringRef _kDACallbackWatchKey;         /* ( CFArray      ) */
 
+const CFStringRef _kDADiskGenerationKey;        /* ( CFNumber     ) */
+const CFStringRef _kDADiskGenerationBaseKey;    /* ( CFNumber     ) */
+const CFStringRef _kDADiskGenerationDeltaKey;   /* ( CFArray      ) */
 const CFStringRef _kDADiskIDKey;                /* ( CFData       ) */
 
 const CFStringRef _kDADissenterProcessIDKey;    /* ( CFNumber     ) */
@@ -132,6 +185,8 @@ __private_extern__ char *       ___CFStringCopyCString( CFStringRef string );
 __private_extern__ char *       ___CFURLCopyFileSystemRepresentation( CFURLRef url );
 
 __private_extern__ const char * _DACallbackKindGetName( _DACallbackKind kind );
+__private_extern__ void         _DACallbackRingRead( _DACallbackRing * ring, UInt32 offset, void * buffer, UInt32 length );
+__private_extern__ void         _DACallbackRingWrite( _DACallbackRing * ring, UInt32 offset, const void * buffer, UInt32 length );
 __private_extern__ const char * _DARequestKindGetName( _DARequestKind kind );
 
 __private_extern__ CFDataRef              _DASerialize( CFAllocatorRef allocator, CFTypeRef object );
@@ -26,7 +26,20 @@
 #include "DABase.h"
 
 #include <asl.h>
+#include <pthread.h>
 #include <syslog.h>
+#include <unistd.h>
+
+#define __kDALogQueueSize 1024
+
+struct __DALogMessage
+{
+    time_t clock;
+    int    level;
+    char * message;
+};
+
+typedef struct __DALogMessage __DALogMessage;
 
 static Boolean __gDALogDebug            = FALSE;
 static FILE *  __gDALogDebugFile        = NULL;
@@ -36,10 +49,193 @@ static Boolean __gDALogDebugHeaderReset = FALSE;
 static Boolean __gDALogError            = FALSE;
 static Boolean __gDALogVerbose          = FALSE;
 
+static __DALogMessage  __gDALogQueue[__kDALogQueueSize];
+static Boolean         __gDALogQueueActive    = FALSE;
+static Boolean         __gDALogQueueBusy      = FALSE;
+static pthread_cond_t  __gDALogQueueCondition = PTHREAD_COND_INITIALIZER;
+static CFIndex         __gDALogQueueCount     = 0;
+static CFIndex         __gDALogQueueDropped   = 0;
+static CFIndex         __gDALogQueueHead      = 0;
+static pthread_mutex_t __gDALogQueueLock      = PTHREAD_MUTEX_INITIALIZER;
+static pid_t           __gDALogQueueOwner     = 0;
+
+static Boolean __DALogGetEnabled( int level )
+{
+    /*
+     * Determine whether a message of the specified level would be written anywhere, such that a
+     * disabled message costs no more than this check.
+     */
+
+    switch ( level )
+    {
+        case LOG_DEBUG:
+        {
+            return ( __gDALogDebug && __gDALogDebugFile ) ? TRUE : FALSE;
+        }
+        case LOG_ERR:
+        {
+            return ( __gDALogError || __gDALogVerbose ) ? TRUE : FALSE;
+        }
+        case LOG_INFO:
+        {
+            return __gDALogVerbose;
+        }
+        default:
+        {
+            return TRUE;
+        }
+    }
+}
+
+static void __DALogWrite( int level, time_t clock, const char * message )
+{
+    if ( level == LOG_DEBUG )
+    {
+        FILE * file = __gDALogDebugFile;
+
+        if ( file )
+        {
+            char stamp[10];
+
+            if ( strftime( stamp, sizeof( stamp ), "%T ", localtime( &clock ) ) )
+            {
+                fprintf( file, "%s", stamp );
+            }
+
+            fprintf( file, "%s", message );
+            fprintf( file, "\n" );
+            fflush( file );
+        }
+    }
+    else
+    {
+        syslog( level, "%s", message );
+    }
+}
+
+static void __DALogQueueFlush( void )
+{
+    /*
+     * Wait for the messages that are queued up to be written out.  A forked child has no log
+     * thread to wait for, so it leaves the queue alone.
+     */
+
+    if ( __gDALogQueueActive && __gDALogQueueOwner == getpid( ) )
+    {
+        pthread_mutex_lock( &__gDALogQueueLock );
+
+        while ( __gDALogQueueCount || __gDALogQueueBusy )
+        {
+            pthread_cond_wait( &__gDALogQueueCondition, &__gDALogQueueLock );
+        }
+
+        pthread_mutex_unlock( &__gDALogQueueLock );
+    }
+}
+
+static void * __DALogQueueMain( void * context )
+{
+    /*
+     * Write out the queued messages, in order, away from the threads that logged them.
+     */
+
+    pthread_mutex_lock( &__gDALogQueueLock );
+
+    for ( ; ; )
+    {
+        __DALogMessage message;
+        CFIndex        dropped;
+
+        while ( __gDALogQueueCount == 0 )
+        {
+            __gDALogQueueBusy = FALSE;
+
+            pthread_cond_broadcast( &__gDALogQueueCondition );
+
+            pthread_cond_wait( &__gDALogQueueCondition, &__gDALogQueueLock );
+        }
+
+        message = __gDALogQueue[__gDALogQueueHead];
+
+        __gDALogQueueHead = ( __gDALogQueueHead + 1 ) % __kDALogQueueSize;
+        __gDALogQueueCount--;
+        __gDALogQueueBusy = TRUE;
+
+        dropped = ( __gDALogQueueCount == 0 ) ? __gDALogQueueDropped : 0;
+
+        __gDALogQueueDropped -= dropped;
+
+        pthread_cond_broadcast( &__gDALogQueueCondition );
+
+        pthread_mutex_unlock( &__gDALogQueueLock );
+
+        __DALogWrite( message.level, message.clock, message.message );
+
+        free( message.message );
+
+        if ( dropped )
+        {
+            char note[64];
+
+            snprintf( note, sizeof( note ), "%ld log messages dropped.", ( long ) dropped );
+
+            __DALogWrite( LOG_ERR, message.clock, note );
+        }
+
+        pthread_mutex_lock( &__gDALogQueueLock );
+    }
+
+    return NULL;
+}
+
+static Boolean __DALogQueuePush( int level, time_t clock, char * message )
+{
+    /*
+     * Queue the message for the log thread.  A full queue drops the message rather than hold up
+     * the caller; the log thread reports the count once it catches up.
+     */
+
+    if ( __gDALogQueueActive && __gDALogQueueOwner == getpid( ) )
+    {
+        CFIndex index;
+
+        pthread_mutex_lock( &__gDALogQueueLock );
+
+        if ( __gDALogQueueCount == __kDALogQueueSize )
+        {
+            __gDALogQueueDropped++;
+
+            pthread_mutex_unlock( &__gDALogQueueLock );
+
+            free( message );
+
+            return TRUE;
+        }
+
+        index = ( __gDALogQueueHead + __gDALogQueueCount ) % __kDALogQueueSize;
+
+        __gDALogQueue[index].clock   = clock;
+        __gDALogQueue[index].level   = level;
+        __gDALogQueue[index].message = message;
+
+        __gDALogQueueCount++;
+
+        pthread_cond_broadcast( &__gDALogQueueCondition );
+
+        pthread_mutex_unlock( &__gDALogQueueLock );
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 static void __DALog( int level, const char * format, va_list arguments )
 {
     char * message;
 
+    if ( __DALogGetEnabled( level ) == FALSE )  return;
+
     if ( arguments )
     {
         message = ___CFStringCreateCStringWithFormatAndArguments( format, arguments );
@@ -51,57 +247,14 @@ static void __DALog( int level, const char * format, va_list arguments )
 
     if ( message )
     {
-        switch ( level )
-        {
-            case LOG_DEBUG:
-            {
-                if ( __gDALogDebug )
-                {
-                    if ( __gDALogDebugFile )
-                    {
-                        time_t clock = time( NULL );
-                        char   stamp[10];
-
-                        if ( strftime( stamp, sizeof( stamp ), "%T ", localtime( &clock ) ) )
-                        {
-                            fprintf( __gDALogDebugFile, "%s", stamp );
-                        }
-
-                        fprintf( __gDALogDebugFile, "%s", message );
-                        fprintf( __gDALogDebugFile, "\n" );
-                        fflush( __gDALogDebugFile );
-                    }
-                }
-
-                break;
-            }
-            case LOG_ERR:
-            {
-                if ( __gDALogError )
-                {
-                    syslog( level, "%s", message );
-
-                    break;
-                }
-            }
-            case LOG_INFO:
-            {
-                if ( __gDALogVerbose )
-                {
-                    syslog( level, "%s", message );
-                }
+        time_t clock = time( NULL );
 
-                break;
-            }
-            default:
-            {
-                syslog( level, "%s", message );
+        if ( __DALogQueuePush( level, clock, message ) == FALSE )
+        {
+            __DALogWrite( level, clock, message );
 
-                break;
-            }
+            free( message );
         }
-
-        free( message );
     }
 }
 
@@ -122,6 +275,8 @@ void DALogClose( void )
     __gDALogError   = FALSE;
     __gDALogVerbose = FALSE;
 
+    __DALogQueueFlush( );
+
     if ( __gDALogDebugFile )
     {
         fclose( __gDALogDebugFile );
@@ -136,6 +291,8 @@ void DALogDebug( const char * format, ... )
 {
     va_list arguments;
 
+    if ( __DALogGetEnabled( LOG_DEBUG ) == FALSE )  return;
+
     va_start( arguments, format );
 
     if ( __gDALogDebugHeaderReset )
@@ -165,6 +322,8 @@ void DALogDebugHeader( const char * format, ... )
 {
     va_list arguments;
 
+    if ( __DALogGetEnabled( LOG_DEBUG ) == FALSE )  return;
+
     va_start( arguments, format );
 
     if ( __gDALogDebugHeaderNext )
@@ -246,6 +405,30 @@ void DALogOpen( char * name, Boolean debug, Boolean error, Boolean verbose )
     __gDALogDebug   = debug;
     __gDALogError   = error;
     __gDALogVerbose = verbose;
+
+    if ( __gDALogQueueActive == FALSE )
+    {
+        pthread_attr_t attributes;
+        pthread_t      thread;
+
+        /*
+         * Start the log thread.  Should that fail, messages are written out as they are logged.
+         */
+
+        pthread_attr_init( &attributes );
+
+        pthread_attr_setdetachstate( &attributes, PTHREAD_CREATE_DETACHED );
+
+        if ( pthread_create( &thread, &attributes, __DALogQueueMain, NULL ) == 0 )
+        {
+            __gDALogQueueActive = TRUE;
+            __gDALogQueueOwner  = getpid( );
+
+            atexit( __DALogQueueFlush );
+        }
+
+        pthread_attr_destroy( &attributes );
+    }
 }
 
 void DALogVerbose( const char * format, ... )
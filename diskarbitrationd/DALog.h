@@ -25,11 +25,41 @@
 #define __DISKARBITRATIOND_DALOG__
 
 #include <CoreFoundation/CoreFoundation.h>
+#include <sys/kdebug.h>
+#include <sys/kdebug_signpost.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/*
+ * The trace points are emitted as kdebug signposts, for ktrace and Instruments, and cost no more
+ * than a test when tracing is off.  Intervals are paired on their first argument.
+ */
+
+enum
+{
+    kDATraceCallbackDrain = 0x0DA0,
+    kDATraceCallbackQueue = 0x0DA1,
+    kDATraceCommand       = 0x0DA2,
+    kDATraceMount         = 0x0DA3,
+    kDATraceProbe         = 0x0DA4,
+    kDATraceRequest       = 0x0DA5
+};
+
+#define __DATrace( function, code, arg1, arg2, arg3 )                                                    \
+    do                                                                                                   \
+    {                                                                                                    \
+        if ( kdebug_is_enabled( APPSDBG_CODE( DBG_APP_SIGNPOST, code ) ) )                               \
+        {                                                                                                \
+            function( code, ( uintptr_t ) ( arg1 ), ( uintptr_t ) ( arg2 ), ( uintptr_t ) ( arg3 ), 0 ); \
+        }                                                                                                \
+    } while ( 0 )
+
+#define DATrace( code, arg1, arg2, arg3 )      __DATrace( kdebug_signpost,       code, arg1, arg2, arg3 )
+#define DATraceEnd( code, arg1, arg2, arg3 )   __DATrace( kdebug_signpost_end,   code, arg1, arg2, arg3 )
+#define DATraceStart( code, arg1, arg2, arg3 ) __DATrace( kdebug_signpost_start, code, arg1, arg2, arg3 )
+
 extern void DALog( const char * format, ... );
 extern void DALogClose( void );
 extern void DALogDebug( const char * format, ... );
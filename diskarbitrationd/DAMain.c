@@ -53,6 +53,7 @@ static const CFStringRef __kDABundlePath = CFSTR( "/System/Library/Frameworks/Di
 
 static SCDynamicStoreRef     __gDAConfigurationPort   = NULL;
 static Boolean               __gDAOptionDebug         = FALSE;
+static CFMachPortRef         __gDASignalPort          = NULL;
 static CFMachPortRef         __gDAVolumeMountedPort   = NULL;
 static CFMachPortRef         __gDAVolumeUnmountedPort = NULL;
 
@@ -81,7 +82,6 @@ char *                 gDAProcessNameID                = NULL;
 CFMutableArrayRef      gDARequestList                  = NULL;
 CFMutableArrayRef      gDAResponseList                 = NULL;
 CFMutableArrayRef      gDASessionList                  = NULL;
-CFMutableDictionaryRef gDAUnitList                     = NULL;
 
 static void __usage( void )
 {
@@ -195,21 +195,69 @@ static Boolean __DAMainCreateMountPointFolder( void )
 static void __DAMainSignal( int sig )
 {
     /*
-     * Process a SIGTERM signal.
+     * Process a SIGINFO or SIGTERM signal.  mach_msg() is safe from a signal handler.
      */
 
-    gDAExit = TRUE;
+    switch ( sig )
+    {
+        case SIGINFO:
+        {
+            mach_msg_header_t message;
+            kern_return_t     status;
+
+            message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
+            message.msgh_id          = 0;
+            message.msgh_local_port  = MACH_PORT_NULL;
+            message.msgh_remote_port = CFMachPortGetPort( __gDASignalPort );
+            message.msgh_reserved    = 0;
+            message.msgh_size        = sizeof( message );
+
+            status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+
+            if ( status == MACH_SEND_TIMED_OUT )
+            {
+                mach_msg_destroy( &message );
+            }
+
+            break;
+        }
+        default:
+        {
+            gDAExit = TRUE;
+
+            break;
+        }
+    }
+}
+
+static void __DAMainSignalCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info )
+{
+    /*
+     * Process a SIGINFO signal on the run loop, where our tables are safe to walk.
+     */
+
+    CFDictionaryRef statistics;
+
+    statistics = DAStatisticsCreate( );
+
+    if ( statistics )
+    {
+        DALog( "statistics = %@.", statistics );
+
+        CFRelease( statistics );
+    }
 }
 
 static void __DAMain( void )
 {
-    FILE *             file;
-    CFStringRef        key;
-    CFMutableArrayRef  keys;
-    char               path[MAXPATHLEN];
-    mach_port_t        port;
-    CFRunLoopSourceRef source;
-    int                token;
+    FILE *               file;
+    CFStringRef          key;
+    CFMutableArrayRef    keys;
+    CFRunLoopObserverRef observer;
+    char                 path[MAXPATHLEN];
+    mach_port_t          port;
+    CFRunLoopSourceRef   source;
+    int                  token;
 
     /*
      * Initialize classes.
@@ -328,14 +376,6 @@ static void __DAMain( void )
 
     assert( gDASessionList );
 
-    /*
-     * Create the unit list.
-     */
-
-    gDAUnitList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
-
-    assert( gDAUnitList );
-
     /*
      * Create the Disk Arbitration master run loop source.
      */
@@ -352,6 +392,22 @@ static void __DAMain( void )
 
     CFRelease( source );
 
+    /*
+     * Create the disk snapshot run loop observer.
+     */
+
+    observer = CFRunLoopObserverCreate( kCFAllocatorDefault, kCFRunLoopBeforeWaiting, TRUE, 0, _DAServerSnapshotCallback, NULL );
+
+    if ( observer == NULL )
+    {
+        DALogError( "could not create disk snapshot run loop observer." );
+        exit( EX_SOFTWARE );
+    }
+
+    CFRunLoopAddObserver( CFRunLoopGetCurrent( ), observer, kCFRunLoopDefaultMode );
+
+    CFRelease( observer );
+
     /*
      * Create the BSD notification run loop source.
      */
@@ -400,6 +456,32 @@ static void __DAMain( void )
 
     CFRelease( source );
 
+    /*
+     * Create the signal run loop source.
+     */
+
+    __gDASignalPort = CFMachPortCreate( kCFAllocatorDefault, __DAMainSignalCallback, NULL, NULL );
+
+    if ( __gDASignalPort == NULL )
+    {
+        DALogError( "could not create signal port." );
+        exit( EX_SOFTWARE );
+    }
+
+    source = CFMachPortCreateRunLoopSource( kCFAllocatorDefault, __gDASignalPort, 0 );
+
+    if ( source == NULL )
+    {
+        DALogError( "could not create signal run loop source." );
+        exit( EX_SOFTWARE );
+    }
+
+    CFRunLoopAddSource( CFRunLoopGetCurrent( ), source, kCFRunLoopDefaultMode );
+
+    CFRelease( source );
+
+    signal( SIGINFO, __DAMainSignal );
+
     /*
      * Create the I/O Kit notification run loop source.
      */
@@ -631,6 +713,12 @@ static void __DAMain( void )
 
     DAPreferenceListRefresh( );
 
+    /*
+     * Restore the probe results of our previous instance, if any.
+     */
+
+    DAProbeCacheLoad( );
+
     /*
      * Process the initial set of media objects in I/O Kit.
      */
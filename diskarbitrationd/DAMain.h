@@ -57,7 +57,6 @@ extern char *                 gDAProcessNameID;
 extern CFMutableArrayRef      gDARequestList;
 extern CFMutableArrayRef      gDAResponseList;
 extern CFMutableArrayRef      gDASessionList;
-extern CFMutableDictionaryRef gDAUnitList;
 
 #ifdef __cplusplus
 }
@@ -28,10 +28,13 @@
 #include "DALog.h"
 #include "DAMain.h"
 #include "DASupport.h"
+#include "DAThread.h"
 
 #include <fstab.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <unistd.h>
+#include <sys/mount.h>
 #include <sys/param.h>
 #include <sys/stat.h>
 
@@ -42,17 +45,149 @@ struct __DAMountCallbackContext
 ///w:stop
     DAMountCallback callback;
     void *          callbackContext;
+    CFDataRef       digest;
     DADiskRef       disk;
     Boolean         force;
     CFURLRef        mountpoint;
     CFStringRef     options;
+    char *          path;
+    UInt64          size;
 };
 
 typedef struct __DAMountCallbackContext __DAMountCallbackContext;
 
+/*
+ * The mount point list holds the names claimed under the mount point folder, whether by us or
+ * by mounts we learn of from the mount table, so that a free name is usually found at the first
+ * attempt.  A mount point may be removed from a helper thread, hence the lock.
+ */
+
+static CFMutableSetRef __gDAMountPointList     = NULL;
+static pthread_mutex_t __gDAMountPointListLock = PTHREAD_MUTEX_INITIALIZER;
+
 static void __DAMountWithArgumentsCallbackStage1( int status, void * context );
 static void __DAMountWithArgumentsCallbackStage2( int status, void * context );
 static void __DAMountWithArgumentsCallbackStage3( int status, void * context );
+static int  __DAMountWithArgumentsDigest( void * context );
+static void __DAMountWithArgumentsDigestCallback( int status, void * context );
+static void __DAMountWithArgumentsExecute( __DAMountCallbackContext * context );
+
+static CFStringRef __DAMountPointListCreateKey( const char * path )
+{
+    /*
+     * Obtain the name of the specified mount point, provided that it lies directly within the
+     * mount point folder.
+     */
+
+    size_t length;
+
+    length = strlen( kDAMainMountPointFolder );
+
+    if ( strncmp( path, kDAMainMountPointFolder, length ) == 0 )
+    {
+        if ( path[length] == '/' && path[length + 1] && strchr( path + length + 1, '/' ) == NULL )
+        {
+            return CFStringCreateWithCString( kCFAllocatorDefault, path + length + 1, kCFStringEncodingUTF8 );
+        }
+    }
+
+    return NULL;
+}
+
+static void __DAMountPointListAddPath( const char * path )
+{
+    CFStringRef key;
+
+    key = __DAMountPointListCreateKey( path );
+
+    if ( key )
+    {
+        pthread_mutex_lock( &__gDAMountPointListLock );
+
+        if ( __gDAMountPointList )
+        {
+            CFSetSetValue( __gDAMountPointList, key );
+        }
+
+        pthread_mutex_unlock( &__gDAMountPointListLock );
+
+        CFRelease( key );
+    }
+}
+
+static Boolean __DAMountPointListContainsPath( const char * path )
+{
+    Boolean     contains;
+    CFStringRef key;
+
+    contains = FALSE;
+
+    key = __DAMountPointListCreateKey( path );
+
+    if ( key )
+    {
+        pthread_mutex_lock( &__gDAMountPointListLock );
+
+        if ( __gDAMountPointList )
+        {
+            contains = CFSetContainsValue( __gDAMountPointList, key );
+        }
+
+        pthread_mutex_unlock( &__gDAMountPointListLock );
+
+        CFRelease( key );
+    }
+
+    return contains;
+}
+
+static void __DAMountPointListReconcile( void )
+{
+    struct statfs * mountList;
+    int             mountListCount;
+    int             mountListIndex;
+
+    /*
+     * Learn of the mount points claimed by mounts in the mount table.
+     */
+
+    pthread_mutex_lock( &__gDAMountPointListLock );
+
+    if ( __gDAMountPointList == NULL )
+    {
+        __gDAMountPointList = CFSetCreateMutable( kCFAllocatorDefault, 0, &kCFTypeSetCallBacks );
+    }
+
+    pthread_mutex_unlock( &__gDAMountPointListLock );
+
+    mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+
+    for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
+    {
+        __DAMountPointListAddPath( mountList[mountListIndex].f_mntonname );
+    }
+}
+
+static void __DAMountPointListRemovePath( const char * path )
+{
+    CFStringRef key;
+
+    key = __DAMountPointListCreateKey( path );
+
+    if ( key )
+    {
+        pthread_mutex_lock( &__gDAMountPointListLock );
+
+        if ( __gDAMountPointList )
+        {
+            CFSetRemoveValue( __gDAMountPointList, key );
+        }
+
+        pthread_mutex_unlock( &__gDAMountPointListLock );
+
+        CFRelease( key );
+    }
+}
 
 static void __DAMountWithArgumentsCallback( int status, void * parameter )
 {
@@ -83,6 +218,8 @@ static void __DAMountWithArgumentsCallback( int status, void * parameter )
 
     if ( context->mountpoint )  CFRelease( context->mountpoint );
 
+    if ( context->path )  free( context->path );
+
     free( context );
 }
 
@@ -128,49 +265,36 @@ static void __DAMountWithArgumentsCallbackStage1( int status, void * parameter )
          * We were able to repair the volume.
          */
 
+        CFNumberRef size;
+
         DADiskSetState( context->disk, kDADiskStateRequireRepair, FALSE );
 
         DALogDebug( "  repaired disk, id = %@, success.", context->disk );
-    }
-
-    /*
-     * Mount the volume.
-     */
 
-    if ( status == 0 )
-    {
         /*
-         * Create the mount point, in case one needs to be created.
+         * Sample the repaired media content, so that the next probe may skip the "is clean" command.
          */
 
-        if ( context->mountpoint == NULL )
+        size = DADiskGetDescription( context->disk, kDADiskDescriptionMediaSizeKey );
+
+        if ( size && DADiskGetDescription( context->disk, kDADiskDescriptionVolumeUUIDKey ) )
         {
-            context->mountpoint = DAMountCreateMountPointWithAction( context->disk, kDAMountPointActionMake );
-        }
+            context->path = strdup( DADiskGetBSDPath( context->disk, TRUE ) );
+            context->size = ___CFNumberGetIntegerValue( size );
 
-        /*
-         * Execute the mount command.
-         */
+            if ( context->path )
+            {
+                DAThreadExecute( __DAMountWithArgumentsDigest, context, __DAMountWithArgumentsDigestCallback, context );
 
-        if ( context->mountpoint )
-        {
-            DALogDebug( "  mounted disk, id = %@, ongoing.", context->disk );
-
-            DAFileSystemMountWithArguments( DADiskGetFileSystem( context->disk ),
-                                            DADiskGetDevice( context->disk ),
-                                            context->mountpoint,
-                                            DADiskGetUserUID( context->disk ),
-                                            DADiskGetUserGID( context->disk ),
-                                            __DAMountWithArgumentsCallbackStage2,
-                                            context,
-                                            context->options,
-                                            NULL );
-        }
-        else
-        {
-            __DAMountWithArgumentsCallback( ENOSPC, context );
+                return;
+            }
         }
     }
+
+    if ( status == 0 )
+    {
+        __DAMountWithArgumentsExecute( context );
+    }
 }
 
 static void __DAMountWithArgumentsCallbackStage2( int status, void * parameter )
@@ -205,6 +329,15 @@ static void __DAMountWithArgumentsCallbackStage2( int status, void * parameter )
 
         DALogDebug( "  mounted disk, id = %@, success.", context->disk );
 
+        /*
+         * Forget that the volume is clean, as it may now be written to.
+         */
+
+        if ( DAMountContainsArgument( context->options, kDAFileSystemMountArgumentNoWrite ) == FALSE )
+        {
+            DARepairListRemoveEntry( context->disk );
+        }
+
         _DAMountCreateTrashFolder( context->disk, context->mountpoint );
 
         /*
@@ -245,6 +378,72 @@ static void __DAMountWithArgumentsCallbackStage3( int status, void * parameter )
     __DAMountWithArgumentsCallback( 0, context );
 }
 
+static int __DAMountWithArgumentsDigest( void * parameter )
+{
+    __DAMountCallbackContext * context = parameter;
+
+    context->digest = DAProbeCacheCreateDigest( context->path, context->size );
+
+    return context->digest ? 0 : EIO;
+}
+
+static void __DAMountWithArgumentsDigestCallback( int status, void * parameter )
+{
+    /*
+     * Process the repaired media content's sample.
+     */
+
+    __DAMountCallbackContext * context = parameter;
+
+    DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+
+    if ( context->digest )
+    {
+        DARepairListSetEntry( context->disk, DADiskGetDescription( context->disk, kDADiskDescriptionVolumeUUIDKey ), context->digest );
+
+        CFRelease( context->digest );
+
+        context->digest = NULL;
+    }
+
+    __DAMountWithArgumentsExecute( context );
+}
+
+static void __DAMountWithArgumentsExecute( __DAMountCallbackContext * context )
+{
+    /*
+     * Mount the volume, creating the mount point in case one needs to be created.
+     */
+
+    if ( context->mountpoint == NULL )
+    {
+        context->mountpoint = DAMountCreateMountPointWithAction( context->disk, kDAMountPointActionMake );
+    }
+
+    /*
+     * Execute the mount command.
+     */
+
+    if ( context->mountpoint )
+    {
+        DALogDebug( "  mounted disk, id = %@, ongoing.", context->disk );
+
+        DAFileSystemMountWithArguments( DADiskGetFileSystem( context->disk ),
+                                        DADiskGetDevice( context->disk ),
+                                        context->mountpoint,
+                                        DADiskGetUserUID( context->disk ),
+                                        DADiskGetUserGID( context->disk ),
+                                        __DAMountWithArgumentsCallbackStage2,
+                                        context,
+                                        context->options,
+                                        NULL );
+    }
+    else
+    {
+        __DAMountWithArgumentsCallback( ENOSPC, context );
+    }
+}
+
 void _DAMountCreateTrashFolder( DADiskRef disk, CFURLRef mountpoint )
 {
     /*
@@ -405,10 +604,20 @@ CFURLRef DAMountCreateMountPointWithAction( DADiskRef disk, DAMountPointAction a
     CFURLRef    mountpoint;
     char        name[MAXPATHLEN];
     char        path[MAXPATHLEN];
+    Boolean     reconciled;
     CFStringRef string;
 
     mountpoint = NULL;
 
+    reconciled = FALSE;
+
+    if ( __gDAMountPointList == NULL )
+    {
+        __DAMountPointListReconcile( );
+
+        reconciled = TRUE;
+    }
+
     /*
      * Obtain the volume name.
      */
@@ -458,6 +667,18 @@ CFURLRef DAMountCreateMountPointWithAction( DADiskRef disk, DAMountPointAction a
                 snprintf( path, sizeof( path ), "%s/%s %lu", kDAMainMountPointFolder, name, index );
             }
 
+            if ( action != kDAMountPointActionNone )
+            {
+                /*
+                 * Pass over the names that are known to be claimed.
+                 */
+
+                if ( __DAMountPointListContainsPath( path ) )
+                {
+                    continue;
+                }
+            }
+
             switch ( action )
             {
                 case kDAMountPointActionLink:
@@ -478,6 +699,8 @@ CFURLRef DAMountCreateMountPointWithAction( DADiskRef disk, DAMountPointAction a
                         {
                             if ( symlink( source, path ) == 0 )
                             {
+                                __DAMountPointListAddPath( path );
+
                                 mountpoint = CFURLCreateFromFileSystemRepresentation( kCFAllocatorDefault, ( void * ) path, strlen( path ), TRUE );
                             }
                         }
@@ -493,6 +716,8 @@ CFURLRef DAMountCreateMountPointWithAction( DADiskRef disk, DAMountPointAction a
 
                     if ( mkdir( path, 0111 ) == 0 )
                     {
+                        __DAMountPointListAddPath( path );
+
                         if ( DADiskGetUserUID( disk ) )
                         {
                             chown( path, DADiskGetUserUID( disk ), -1 );
@@ -535,6 +760,10 @@ CFURLRef DAMountCreateMountPointWithAction( DADiskRef disk, DAMountPointAction a
                         {
                             if ( rename( source, path ) == 0 )
                             {
+                                __DAMountPointListRemovePath( source );
+
+                                __DAMountPointListAddPath( path );
+
                                 mountpoint = CFURLCreateFromFileSystemRepresentation( kCFAllocatorDefault, ( void * ) path, strlen( path ), TRUE );
                             }
                         }
@@ -554,6 +783,21 @@ CFURLRef DAMountCreateMountPointWithAction( DADiskRef disk, DAMountPointAction a
             {
                 break;
             }
+
+            if ( action != kDAMountPointActionNone )
+            {
+                /*
+                 * The name is taken by something we did not know about, so catch up with the mount
+                 * table once before trying further names.
+                 */
+
+                if ( reconciled == FALSE )
+                {
+                    __DAMountPointListReconcile( );
+
+                    reconciled = TRUE;
+                }
+            }
         }
     }
 
@@ -715,6 +959,15 @@ void DAMountRemoveMountPoint( CFURLRef mountpoint )
 
                 rmdir( path );
             }
+
+            /*
+             * Release the name of the mount point once it no longer exists.
+             */
+
+            if ( access( path, F_OK ) )
+            {
+                __DAMountPointListRemovePath( path );
+            }
         }
     }
 }
@@ -732,10 +985,8 @@ void DAMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DAMountCallback
     CFBooleanRef               automatic  = kCFBooleanTrue;
     CFBooleanRef               check      = NULL;
     __DAMountCallbackContext * context    = NULL;
-    CFIndex                    count      = 0;
     DAFileSystemRef            filesystem = DADiskGetFileSystem( disk );
     Boolean                    force      = FALSE;
-    CFIndex                    index      = 0;
     CFDictionaryRef            map        = NULL;
     CFMutableStringRef         options    = NULL;
     int                        status     = 0;
@@ -837,77 +1088,13 @@ void DAMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DAMountCallback
      * Scan the mount map list.
      */
 
-    count = CFArrayGetCount( gDAMountMapList1 );
-
-    for ( index = 0; index < count; index++ )
-    {
-        map = CFArrayGetValueAtIndex( gDAMountMapList1, index );
-
-        if ( map )
-        {
-            CFTypeRef   id;
-            CFStringRef kind;
-
-            id   = CFDictionaryGetValue( map, kDAMountMapProbeIDKey );
-            kind = CFDictionaryGetValue( map, kDAMountMapProbeKindKey );
-
-            if ( kind )
-            {
-                /*
-                 * Determine whether the volume kind matches.
-                 */
-
-                if ( CFEqual( kind, DAFileSystemGetKind( filesystem ) ) == FALSE )
-                {
-                    continue;
-                }
-            }
-
-            if ( CFGetTypeID( id ) == CFUUIDGetTypeID( ) )
-            {
-                /*
-                 * Determine whether the volume UUID matches.
-                 */
-
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionVolumeUUIDKey, id ) == kCFCompareEqualTo )
-                {
-                    break;
-                }
-            }
-            else if ( CFGetTypeID( id ) == CFStringGetTypeID( ) )
-            {
-                /*
-                 * Determine whether the volume name matches.
-                 */
-
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionVolumeNameKey, id ) == kCFCompareEqualTo )
-                {
-                    break;
-                }
-            }
-            else if ( CFGetTypeID( id ) == CFDictionaryGetTypeID( ) )
-            {
-                boolean_t match = FALSE;
-
-                /*
-                 * Determine whether the device description matches.
-                 */
-
-                IOServiceMatchPropertyTable( DADiskGetIOMedia( disk ), id, &match );
-
-                if ( match )
-                {
-                    break;
-                }
-            }
-        }
-    }
+    map = DAMountMapListGetMap1( disk );
 
     /*
      * Process the map.
      */
 
-    if ( index < count )
+    if ( map )
     {
         CFStringRef string;
 
@@ -957,34 +1144,13 @@ void DAMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DAMountCallback
      * Scan the mount map list.
      */
 
-    count = CFArrayGetCount( gDAMountMapList2 );
-
-    for ( index = 0; index < count; index++ )
-    {
-        map = CFArrayGetValueAtIndex( gDAMountMapList2, index );
-
-        if ( map )
-        {
-            CFTypeRef id;
-
-            id = CFDictionaryGetValue( map, kDAMountMapProbeIDKey );
-
-            /*
-             * Determine whether the volume UUID matches.
-             */
-
-            if ( DADiskCompareDescription( disk, kDADiskDescriptionVolumeUUIDKey, id ) == kCFCompareEqualTo )
-            {
-                break;
-            }
-        }
-    }
+    map = DAMountMapListGetMap2( disk );
 
     /*
      * Process the map.
      */
 
-    if ( index < count )
+    if ( map )
     {
         CFStringRef string;
 
@@ -1137,15 +1303,22 @@ void DAMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DAMountCallback
 
     context->callback        = callback;
     context->callbackContext = callbackContext;
+    context->digest          = NULL;
     context->disk            = disk;
     context->force           = force;
     context->mountpoint      = mountpoint;
     context->options         = options;
+    context->path            = NULL;
+    context->size            = 0;
 
     if ( check == kCFBooleanTrue )
     {
         DALogDebug( "  repaired disk, id = %@, ongoing.", disk );
 
+        DAProbeCacheRemoveEntry( disk );
+
+        DARepairListRemoveEntry( disk );
+
         DAFileSystemRepair( DADiskGetFileSystem( disk ),
                             DADiskGetDevice( disk ),
                             __DAMountWithArgumentsCallbackStage1,
@@ -29,6 +29,7 @@
 #include "DAMount.h"
 #include "DAQueue.h"
 #include "DAStage.h"
+#include "DASupport.h"
 #include "DAThread.h"
 
 #include <sysexits.h>
@@ -69,7 +70,7 @@ static int __DAFileSystemSetAdoption( DAFileSystemRef filesystem, CFURLRef mount
                 NULL,
                 NULL );
 
-        exit( EX_OSERR );
+        _exit( EX_OSERR );
     }
 
     waitpid( status, &status, 0 );
@@ -121,7 +122,7 @@ static int __DAFileSystemSetEncoding( DAFileSystemRef filesystem, CFURLRef mount
                 NULL,
                 NULL );
 
-        exit( EX_OSERR );
+        _exit( EX_OSERR );
     }
 
     waitpid( status, &status, 0 );
@@ -188,7 +189,7 @@ DAReturn _DADiskRefresh( DADiskRef disk )
 
                 DADiskSetState( disk, kDADiskStateZombie, TRUE );
 
-                ___CFArrayRemoveValue( gDADiskList, disk );
+                DADiskListRemoveDisk( disk );
             }
 
             DAStageSignal( );
@@ -320,76 +321,77 @@ _DADiskSetEncodingErr:
 
 Boolean _DAUnitIsUnreadable( DADiskRef disk )
 {
-    CFIndex count;
-    CFIndex index;
+    CFArrayRef list;
+    CFIndex    count;
+    CFIndex    index;
 
-    count = CFArrayGetCount( gDADiskList );
+    list = DAUnitGetDiskList( disk );
+
+    count = list ? CFArrayGetCount( list ) : 0;
 
     for ( index = 0; index < count; index++ )
     {
-        DADiskRef item;
+        DADiskRef   item;
+        CFStringRef name;
 
-        item = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+        item = ( void * ) CFArrayGetValueAtIndex( list, index );
 
-        if ( DADiskGetBSDUnit( disk ) == DADiskGetBSDUnit( item ) )
-        {
-            CFStringRef name;
+        name = DADiskGetDescription( item, kDADiskDescriptionMediaBSDNameKey );
 
-            name = DADiskGetDescription( item, kDADiskDescriptionMediaBSDNameKey );
+        /*
+         * Only the disks with a busy notification keep a busy state, the whole disk taking in
+         * that of the others.
+         */
 
-            if ( DADiskGetBusy( item ) )
-            {
-                return FALSE;
-            }
+        if ( DADiskGetBusyNotification( item ) && DADiskGetBusy( item ) )
+        {
+            return FALSE;
+        }
 
-            if ( DADiskGetClaim( item ) )
-            {
-                return FALSE;
-            }
+        if ( DADiskGetClaim( item ) )
+        {
+            return FALSE;
+        }
 
-            if ( DADiskGetOption( item, kDADiskOptionMountAutomatic ) == FALSE )
-            {
-                return FALSE;
-            }
+        if ( DADiskGetOption( item, kDADiskOptionMountAutomatic ) == FALSE )
+        {
+            return FALSE;
+        }
 
-            if ( DADiskGetDescription( item, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanTrue )
-            {
-                return FALSE;
-            }
+        if ( DADiskGetDescription( item, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanTrue )
+        {
+            return FALSE;
+        }
+
+        if ( DADiskGetDescription( item, kDADiskDescriptionMediaLeafKey ) == kCFBooleanFalse )
+        {
+            CFIndex subindex;
 
-            if ( DADiskGetDescription( item, kDADiskDescriptionMediaLeafKey ) == kCFBooleanFalse )
+            for ( subindex = 0; subindex < count; subindex++ )
             {
-                CFIndex subcount;
-                CFIndex subindex;
+                DADiskRef subitem;
 
-                subcount = CFArrayGetCount( gDADiskList );
+                subitem = ( void * ) CFArrayGetValueAtIndex( list, subindex );
 
-                for ( subindex = 0; subindex < subcount; subindex++ )
+                if ( item != subitem )
                 {
-                    DADiskRef subitem;
+                    CFStringRef subname;
 
-                    subitem = ( void * ) CFArrayGetValueAtIndex( gDADiskList, subindex );
+                    subname = DADiskGetDescription( subitem, kDADiskDescriptionMediaBSDNameKey );
 
-                    if ( item != subitem )
+                    if ( subname )
                     {
-                        CFStringRef subname;
-
-                        subname = DADiskGetDescription( subitem, kDADiskDescriptionMediaBSDNameKey );
-
-                        if ( subname )
+                        if ( CFStringHasPrefix( subname, name ) )
                         {
-                            if ( CFStringHasPrefix( subname, name ) )
-                            {
-                                break;
-                            }
+                            break;
                         }
                     }
                 }
+            }
 
-                if ( subindex == subcount )
-                {
-                    return FALSE;
-                }
+            if ( subindex == count )
+            {
+                return FALSE;
             }
         }
     }
@@ -31,6 +31,7 @@
 #include "DARequest.h"
 #include "DASession.h"
 #include "DAStage.h"
+#include "DASupport.h"
 
 struct __DAResponseContext
 {
@@ -41,10 +42,43 @@ struct __DAResponseContext
 
 typedef struct __DAResponseContext __DAResponseContext;
 
+enum
+{
+    __kDARequestPriorityBackground  = 0,
+    __kDARequestPriorityDefault     = 1,
+    __kDARequestPriorityInteractive = 2
+};
+
+typedef UInt32 __DARequestPriority;
+
 const CFGregorianUnits __kDAResponseTimerGrace = { 0, 0, 0, 0, 0,  1 };
 const CFGregorianUnits __kDAResponseTimerLimit = { 0, 0, 0, 0, 0, 10 };
 
-static void __DAResponseTimerRefresh( void );
+static CFComparisonResult __DAResponseHeapCompare( const void * value1, const void * value2, void * info );
+static void               __DAResponseHeapRelease( CFAllocatorRef allocator, const void * value );
+static const void *       __DAResponseHeapRetain( CFAllocatorRef allocator, const void * value );
+static CFAbsoluteTime     __DAResponseGetDeadline( DASessionRef session, CFAbsoluteTime clock );
+static void               __DAResponseTimerRefresh( void );
+
+static const CFBinaryHeapCallBacks __kDAResponseHeapCallBacks =
+{
+    0,
+    __DAResponseHeapRetain,
+    __DAResponseHeapRelease,
+    NULL,
+    __DAResponseHeapCompare
+};
+
+/*
+ * The outstanding responses are kept in gDAResponseList.  We index them by response ID, count
+ * them by disk and order those that can time out by the time at which they expire, which is the
+ * time at which they were dispatched plus the session's response limit.  An entry of the heap that
+ * is no longer outstanding is discarded once it reaches the top.
+ */
+
+static CFMutableBagRef        __gDAResponseDiskList = NULL;
+static CFBinaryHeapRef        __gDAResponseHeap     = NULL;
+static CFMutableDictionaryRef __gDAResponseIndex    = NULL;
 
 static void __DAQueueCallbacks( _DACallbackKind kind, DADiskRef argument0, CFTypeRef argument1 )
 {
@@ -67,7 +101,25 @@ static void __DAQueueCallbacks( _DACallbackKind kind, DADiskRef argument0, CFTyp
             }
         }
 
-        DAQueueCallbacks( session, kind, argument0, argument1 );
+        if ( kind == _kDADiskDisappearedCallback )
+        {
+            /*
+             * A disk that appears and disappears before the client drains its queue need not
+             * be announced to it at all.
+             */
+
+            if ( DASessionCancelCallbacks( session, argument0 ) )
+            {
+                DADiskRemoveSession( argument0, session );
+
+                continue;
+            }
+        }
+
+        if ( DASessionGetCallbackCount( session, kind ) )
+        {
+            DAQueueCallbacks( session, kind, argument0, argument1 );
+        }
 
         if ( kind == _kDAIdleCallback )
         {
@@ -76,6 +128,185 @@ static void __DAQueueCallbacks( _DACallbackKind kind, DADiskRef argument0, CFTyp
     }
 }
 
+static __DARequestPriority __DAQueueGetRequestPriority( DARequestRef request )
+{
+    /*
+     * Eject and unmount requests are typically waited upon by a user, whereas probe, refresh
+     * and automatic mount requests are generated by the system in the background.
+     */
+
+    switch ( DARequestGetKind( request ) )
+    {
+        case _kDADiskEject:
+        case _kDADiskUnmount:
+        {
+            return __kDARequestPriorityInteractive;
+        }
+        case _kDADiskMount:
+        {
+            return DARequestGetCallback( request ) ? __kDARequestPriorityDefault : __kDARequestPriorityBackground;
+        }
+        case _kDADiskProbe:
+        case _kDADiskRefresh:
+        {
+            return __kDARequestPriorityBackground;
+        }
+    }
+
+    return __kDARequestPriorityDefault;
+}
+
+static Boolean __DAQueueGetRequestTouchesDisk( DARequestRef request, DADiskRef disk )
+{
+    CFArrayRef link;
+
+    if ( DARequestGetDisk( request ) == disk )
+    {
+        return TRUE;
+    }
+
+    link = DARequestGetLink( request );
+
+    if ( link )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( link );
+
+        for ( index = 0; index < count; index++ )
+        {
+            DARequestRef subrequest;
+
+            subrequest = ( void * ) CFArrayGetValueAtIndex( link, index );
+
+            if ( DARequestGetDisk( subrequest ) == disk )
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static Boolean __DAQueueGetRequestsOverlap( DARequestRef request1, DARequestRef request2 )
+{
+    CFArrayRef link;
+
+    if ( DARequestGetDisk( request1 ) == NULL || DARequestGetDisk( request2 ) == NULL )
+    {
+        return TRUE;
+    }
+
+    if ( __DAQueueGetRequestTouchesDisk( request2, DARequestGetDisk( request1 ) ) )
+    {
+        return TRUE;
+    }
+
+    link = DARequestGetLink( request1 );
+
+    if ( link )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( link );
+
+        for ( index = 0; index < count; index++ )
+        {
+            DARequestRef subrequest;
+
+            subrequest = ( void * ) CFArrayGetValueAtIndex( link, index );
+
+            if ( __DAQueueGetRequestTouchesDisk( request2, DARequestGetDisk( subrequest ) ) )
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static Boolean __DAQueueGetRequestIsRedundant( DARequestRef request )
+{
+    /*
+     * Probe and refresh requests are idempotent.  One that nobody waits upon is redundant when
+     * an identical request for the disk is still queued, since that one has yet to be dispatched.
+     */
+
+    switch ( DARequestGetKind( request ) )
+    {
+        case _kDADiskProbe:
+        case _kDADiskRefresh:
+        {
+            if ( DARequestGetCallback( request ) == NULL )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = CFArrayGetCount( gDARequestList );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    DARequestRef item;
+
+                    item = ( void * ) CFArrayGetValueAtIndex( gDARequestList, index );
+
+                    if ( DARequestGetKind( item ) == DARequestGetKind( request ) )
+                    {
+                        if ( DARequestGetDisk( item ) == DARequestGetDisk( request ) )
+                        {
+                            return TRUE;
+                        }
+                    }
+                }
+            }
+
+            break;
+        }
+    }
+
+    return FALSE;
+}
+
+static void __DAQueueInsertRequest( DARequestRef request )
+{
+    CFIndex index;
+
+    index = CFArrayGetCount( gDARequestList );
+
+    /*
+     * An interactive request is placed ahead of the queued background requests, short of any
+     * that concern the same disks, so that the order of requests for a given disk is preserved.
+     */
+
+    if ( __DAQueueGetRequestPriority( request ) == __kDARequestPriorityInteractive )
+    {
+        while ( index > 0 )
+        {
+            DARequestRef item;
+
+            item = ( void * ) CFArrayGetValueAtIndex( gDARequestList, index - 1 );
+
+            if ( __DAQueueGetRequestPriority( item ) != __kDARequestPriorityBackground )
+            {
+                break;
+            }
+
+            if ( __DAQueueGetRequestsOverlap( item, request ) )
+            {
+                break;
+            }
+
+            index--;
+        }
+    }
+
+    CFArrayInsertValueAtIndex( gDARequestList, index, request );
+}
+
 static void __DAQueueRequest( _DARequestKind kind, DADiskRef argument0, CFIndex argument1, CFTypeRef argument2, CFTypeRef argument3, DACallbackRef callback )
 {
     DARequestRef request;
@@ -97,39 +328,177 @@ static void __DAQueueRequest( _DARequestKind kind, DADiskRef argument0, CFIndex
     }
 }
 
+static void __DAResponseListInitialize( void )
+{
+    if ( __gDAResponseIndex == NULL )
+    {
+        __gDAResponseDiskList = CFBagCreateMutable( kCFAllocatorDefault, 0, NULL );
+        __gDAResponseHeap     = CFBinaryHeapCreate( kCFAllocatorDefault, 0, &__kDAResponseHeapCallBacks, NULL );
+        __gDAResponseIndex    = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+
+        assert( __gDAResponseDiskList );
+        assert( __gDAResponseHeap     );
+        assert( __gDAResponseIndex    );
+    }
+}
+
 static void __DAResponseComplete( DADiskRef disk )
 {
+    __DAResponseListInitialize( );
+
+    if ( CFBagGetCountOfValue( __gDAResponseDiskList, disk ) == 0 )
+    {
+        __DAResponseContext context;
+
+        context = *( ( __DAResponseContext * ) CFDataGetBytePtr( DADiskGetContextRe( disk ) ) );
+
+        DADiskSetContextRe( disk, NULL );
+
+        ( context.callback )( context.response, context.callbackContext );
+
+        if ( context.response )  CFRelease( context.response );
+    }
+
+    __DAResponseTimerRefresh( );
+}
+
+static CFAbsoluteTime __DAResponseGetDeadline( DASessionRef session, CFAbsoluteTime clock )
+{
+    /*
+     * Obtain the time by which a response dispatched at the specified time is due.  A session may
+     * commit to a shorter limit than ours.
+     */
+
+    CFAbsoluteTime deadline;
+    CFTimeInterval timeout;
+
+    deadline = CFAbsoluteTimeAddGregorianUnits( clock, NULL, __kDAResponseTimerLimit );
+
+    timeout = DASessionGetResponseTimeout( session );
+
+    if ( timeout > 0 && clock + timeout < deadline )
+    {
+        deadline = clock + timeout;
+    }
+
+    return deadline;
+}
+
+static CFComparisonResult __DAResponseHeapCompare( const void * value1, const void * value2, void * info )
+{
+    CFAbsoluteTime time1;
+    CFAbsoluteTime time2;
+
+    time1 = DACallbackGetTime( ( void * ) value1 );
+    time2 = DACallbackGetTime( ( void * ) value2 );
+
+    if ( time1 < time2 )  return kCFCompareLessThan;
+    if ( time1 > time2 )  return kCFCompareGreaterThan;
+
+    return kCFCompareEqualTo;
+}
+
+static void __DAResponseHeapRelease( CFAllocatorRef allocator, const void * value )
+{
+    CFRelease( value );
+}
+
+static const void * __DAResponseHeapRetain( CFAllocatorRef allocator, const void * value )
+{
+    return CFRetain( value );
+}
+
+static void __DAResponseListAppend( DACallbackRef response )
+{
+    __DAResponseListInitialize( );
+
+    CFArrayAppendValue( gDAResponseList, response );
+
+    CFBagAddValue( __gDAResponseDiskList, DACallbackGetDisk( response ) );
+
+    CFDictionarySetValue( __gDAResponseIndex, ( void * ) ( intptr_t ) ___CFNumberGetIntegerValue( DACallbackGetArgument1( response ) ), response );
+
+    if ( DASessionGetOption( DACallbackGetSession( response ), kDASessionOptionNoTimeout ) == FALSE )
+    {
+        CFBinaryHeapAddValue( __gDAResponseHeap, response );
+    }
+}
+
+static void __DAResponseListCancel( DADiskRef disk )
+{
+    /*
+     * Withdraw the outstanding responses for the specified disk.  A response that arrives later
+     * is orphaned.
+     */
+
     CFIndex count;
     CFIndex index;
 
     count = CFArrayGetCount( gDAResponseList );
 
-    for ( index = 0; index < count; index++ )
+    for ( index = count - 1; index > -1; index-- )
     {
-        DACallbackRef callback;
+        DACallbackRef response;
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        response = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
 
-        if ( DACallbackGetDisk( callback ) == disk )
+        if ( DACallbackGetDisk( response ) == disk )
         {
-            break;
+            DALogDebug( "  cancelled response, id = %016llX:%016llX, kind = %s, disk = %@.",
+                        DACallbackGetAddress( response ),
+                        DACallbackGetContext( response ),
+                        _DACallbackKindGetName( DACallbackGetKind( response ) ),
+                        disk );
+
+            __DAResponseListRemove( index );
         }
     }
+}
 
-    if ( index == count )
-    {
-        __DAResponseContext context;
+static DACallbackRef __DAResponseListGetResponse( SInt32 responseID )
+{
+    __DAResponseListInitialize( );
 
-        context = *( ( __DAResponseContext * ) CFDataGetBytePtr( DADiskGetContextRe( disk ) ) );
+    return ( void * ) CFDictionaryGetValue( __gDAResponseIndex, ( void * ) ( intptr_t ) responseID );
+}
 
-        DADiskSetContextRe( disk, NULL );
+static void __DAResponseListRemove( CFIndex index )
+{
+    DACallbackRef response;
 
-        ( context.callback )( context.response, context.callbackContext );
+    response = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
 
-        if ( context.response )  CFRelease( context.response );
+    CFDictionaryRemoveValue( __gDAResponseIndex, ( void * ) ( intptr_t ) ___CFNumberGetIntegerValue( DACallbackGetArgument1( response ) ) );
+
+    CFBagRemoveValue( __gDAResponseDiskList, DACallbackGetDisk( response ) );
+
+    CFArrayRemoveValueAtIndex( gDAResponseList, index );
+}
+
+static DACallbackRef __DAResponseListGetNextTimeout( void )
+{
+    /*
+     * Obtain the outstanding response that is to time out first, discarding the stale entries
+     * at the top of the heap along the way.
+     */
+
+    __DAResponseListInitialize( );
+
+    while ( CFBinaryHeapGetCount( __gDAResponseHeap ) )
+    {
+        DACallbackRef response;
+
+        response = ( void * ) CFBinaryHeapGetMinimum( __gDAResponseHeap );
+
+        if ( __DAResponseListGetResponse( ___CFNumberGetIntegerValue( DACallbackGetArgument1( response ) ) ) == response )
+        {
+            return response;
+        }
+
+        CFBinaryHeapRemoveMinimumValue( __gDAResponseHeap );
     }
 
-    __DAResponseTimerRefresh( );
+    return NULL;
 }
 
 static void __DAResponsePrepare( DADiskRef disk, DAResponseCallback callback, void * callbackContext )
@@ -158,60 +527,54 @@ static void __DAResponsePrepare( DADiskRef disk, DAResponseCallback callback, vo
 static void __DAResponseTimerCallback( CFRunLoopTimerRef timer, void * info )
 {
     CFAbsoluteTime clock;
-    CFIndex        count;
-    CFIndex        index;
+    DACallbackRef  callback;
 
     clock = CFAbsoluteTimeGetCurrent( );
 
-    count = CFArrayGetCount( gDAResponseList );
-
-    for ( index = count - 1; index > -1; index-- )
+    while ( ( callback = __DAResponseListGetNextTimeout( ) ) )
     {
-        DACallbackRef callback;
+        CFAbsoluteTime timeout;
+        DADiskRef      disk;
+        DASessionRef   session;
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        timeout = DACallbackGetTime( callback );
 
-        if ( callback )
+        if ( timeout >= clock )
         {
-            DASessionRef session;
-
-            session = DACallbackGetSession( callback );
-
-            if ( DASessionGetOption( session, kDASessionOptionNoTimeout ) == FALSE )
-            {
-                CFAbsoluteTime timeout;
+            break;
+        }
 
-                timeout = DACallbackGetTime( callback );
+        CFRetain( callback );
 
-                timeout = CFAbsoluteTimeAddGregorianUnits( timeout, NULL, __kDAResponseTimerLimit );
+        CFBinaryHeapRemoveMinimumValue( __gDAResponseHeap );
 
-                if ( timeout < clock )
-                {
-                    DADiskRef disk;
+        disk = DACallbackGetDisk( callback );
 
-                    disk = DACallbackGetDisk( callback );
+        session = DACallbackGetSession( callback );
 
-                    if ( DASessionGetState( session, kDASessionStateTimeout ) == FALSE )
-                    {
-                        DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+        if ( DASessionGetOption( session, kDASessionOptionNoTimeout ) == FALSE )
+        {
+            if ( DASessionGetState( session, kDASessionStateTimeout ) == FALSE )
+            {
+                DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
 
-                        DALogDebug( "  timed out session, id = %@.", session );
+                DALogDebug( "  timed out session, id = %@.", session );
 
-                        DALogError( "%@ not responding.", session );
+                DALogError( "%@ not responding.", session );
 
-                        DASessionSetState( session, kDASessionStateTimeout, TRUE );
-                    }
+                DASessionSetState( session, kDASessionStateTimeout, TRUE );
+            }
 
-                    CFRetain( disk );
+            CFRetain( disk );
 
-                    CFArrayRemoveValueAtIndex( gDAResponseList, index );
+            __DAResponseListRemove( CFArrayGetFirstIndexOfValue( gDAResponseList, CFRangeMake( 0, CFArrayGetCount( gDAResponseList ) ), callback ) );
 
-                    __DAResponseComplete( disk );
+            __DAResponseComplete( disk );
 
-                    CFRelease( disk );
-                }
-            }
+            CFRelease( disk );
         }
+
+        CFRelease( callback );
     }
 }
 
@@ -220,39 +583,15 @@ static void __DAResponseTimerRefresh( void )
     static CFRunLoopTimerRef timer = NULL;
 
     CFAbsoluteTime clock;
-    CFIndex        count;
-    CFIndex        index;
+    DACallbackRef  callback;
 
     clock = kCFAbsoluteTimeIntervalSince1904;
 
-    count = CFArrayGetCount( gDAResponseList );
+    callback = __DAResponseListGetNextTimeout( );
 
-    for ( index = 0; index < count; index++ )
+    if ( callback )
     {
-        DACallbackRef callback;
-
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
-
-        if ( callback )
-        {
-            DASessionRef session;
-
-            session = DACallbackGetSession( callback );
-
-            if ( DASessionGetOption( session, kDASessionOptionNoTimeout ) == FALSE )
-            {
-                CFAbsoluteTime timeout;
-
-                timeout = DACallbackGetTime( callback );
-
-                timeout = CFAbsoluteTimeAddGregorianUnits( timeout, NULL, __kDAResponseTimerLimit );
-
-                if ( timeout < clock )
-                {
-                    clock = timeout;
-                }
-            }
-        }
+        clock = DACallbackGetTime( callback );
     }
 
     clock = CFAbsoluteTimeAddGregorianUnits( clock, NULL, __kDAResponseTimerGrace );
@@ -274,91 +613,98 @@ static void __DAResponseTimerRefresh( void )
 
 Boolean _DAResponseDispatch( CFTypeRef response, SInt32 responseID )
 {
-    CFIndex count;
-    CFIndex index;
+    DACallbackRef callback;
 
-    count = CFArrayGetCount( gDAResponseList );
+    callback = __DAResponseListGetResponse( responseID );
 
-    for ( index = 0; index < count; index++ )
+    if ( callback )
     {
-        DACallbackRef callback;
+        Boolean   decided = FALSE;
+        DADiskRef disk;
 
-        callback = ( void * ) CFArrayGetValueAtIndex( gDAResponseList, index );
+        disk = DACallbackGetDisk( callback );
 
-        if ( ___CFNumberGetIntegerValue( DACallbackGetArgument1( callback ) ) == responseID )
+        switch ( DACallbackGetKind( callback ) )
         {
-            DADiskRef disk;
+            case _kDADiskClaimReleaseCallback:
+            case _kDADiskEjectApprovalCallback:
+            case _kDADiskMountApprovalCallback:
+            case _kDADiskUnmountApprovalCallback:
+            {
+                DADissenterRef dissenter;
 
-            disk = DACallbackGetDisk( callback );
+                dissenter = ( void * ) response;
 
-            switch ( DACallbackGetKind( callback ) )
-            {
-                case _kDADiskClaimReleaseCallback:
-                case _kDADiskEjectApprovalCallback:
-                case _kDADiskMountApprovalCallback:
-                case _kDADiskUnmountApprovalCallback:
+                if ( dissenter )
                 {
-                    DADissenterRef dissenter;
+                    CFDataRef data;
 
-                    dissenter = ( void * ) response;
+                    data = DADiskGetContextRe( disk );
 
-                    if ( dissenter )
+                    if ( data )
                     {
-                        CFDataRef data;
+                        __DAResponseContext * context;
 
-                        data = DADiskGetContextRe( disk );
+                        context = ( void * ) CFDataGetBytePtr( data );
 
-                        if ( data )
+                        if ( context->response == NULL )
                         {
-                            __DAResponseContext * context;
-
-                            context = ( void * ) CFDataGetBytePtr( data );
-
-                            if ( context->response == NULL )
-                            {
-                                context->response = CFRetain( dissenter );
-                            }
+                            context->response = CFRetain( dissenter );
                         }
 
-                        DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, dissented, status = 0x%08X.",
-                                    DACallbackGetAddress( callback ),
-                                    DACallbackGetContext( callback ),
-                                    _DACallbackKindGetName( DACallbackGetKind( callback ) ),
-                                    disk,
-                                    DADissenterGetStatus( dissenter ) );
-                    }
-                    else
-                    {
-                        DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, approved.",
-                                    DACallbackGetAddress( callback ),
-                                    DACallbackGetContext( callback ),
-                                    _DACallbackKindGetName( DACallbackGetKind( callback ) ),
-                                    disk );
+                        /*
+                         * The first dissenter decides the approval, so there is no need to await
+                         * the other responses.
+                         */
+
+                        decided = TRUE;
                     }
 
-                    break;
+                    DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, dissented, status = 0x%08X.",
+                                DACallbackGetAddress( callback ),
+                                DACallbackGetContext( callback ),
+                                _DACallbackKindGetName( DACallbackGetKind( callback ) ),
+                                disk,
+                                DADissenterGetStatus( dissenter ) );
                 }
-                case _kDADiskPeekCallback:
+                else
                 {
-                    DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@.",
+                    DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@, approved.",
                                 DACallbackGetAddress( callback ),
                                 DACallbackGetContext( callback ),
                                 _DACallbackKindGetName( DACallbackGetKind( callback ) ),
                                 disk );
-
-                    break;
                 }
+
+                break;
             }
+            case _kDADiskPeekCallback:
+            {
+                DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %@.",
+                            DACallbackGetAddress( callback ),
+                            DACallbackGetContext( callback ),
+                            _DACallbackKindGetName( DACallbackGetKind( callback ) ),
+                            disk );
 
-            CFArrayRemoveValueAtIndex( gDAResponseList, index );
+                break;
+            }
+        }
 
-            __DAResponseComplete( disk );
+        CFRetain( disk );
 
-            break;
+        __DAResponseListRemove( CFArrayGetFirstIndexOfValue( gDAResponseList, CFRangeMake( 0, CFArrayGetCount( gDAResponseList ) ), callback ) );
+
+        if ( decided )
+        {
+            __DAResponseListCancel( disk );
         }
+
+        __DAResponseComplete( disk );
+
+        CFRelease( disk );
     }
 
-    return ( index < count ) ? TRUE : FALSE;
+    return callback ? TRUE : FALSE;
 }
 
 void DADiskAppearedCallback( DADiskRef disk )
@@ -407,6 +753,17 @@ void DADiskEject( DADiskRef disk, DADiskEjectOptions options, DACallbackRef call
 
 void DADiskEjectApprovalCallback( DADiskRef disk, DAResponseCallback response, void * responseContext )
 {
+    if ( DASessionGetCallbackCount( NULL, _kDADiskEjectApprovalCallback ) == 0 )
+    {
+        /*
+         * No session has registered for the approval, so there is no response to wait for.
+         */
+
+        ( response )( NULL, responseContext );
+
+        return;
+    }
+
     __DAResponsePrepare( disk, response, responseContext );
 
     __DAQueueCallbacks( _kDADiskEjectApprovalCallback, disk, NULL );
@@ -421,6 +778,13 @@ void DADiskMount( DADiskRef disk, CFURLRef mountpoint, DADiskMountOptions option
 
 void DADiskMountApprovalCallback( DADiskRef disk, DAResponseCallback response, void * responseContext )
 {
+    if ( DASessionGetCallbackCount( NULL, _kDADiskMountApprovalCallback ) == 0 )
+    {
+        ( response )( NULL, responseContext );
+
+        return;
+    }
+
     __DAResponsePrepare( disk, response, responseContext );
 
     __DAQueueCallbacks( _kDADiskMountApprovalCallback, disk, NULL );
@@ -433,11 +797,24 @@ void DADiskMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DADiskMountO
     __DAQueueRequest( _kDADiskMount, disk, options, mountpoint, arguments, callback );
 }
 
-void DADiskPeekCallback( DADiskRef disk, DACallbackRef callback, DAResponseCallback response, void * responseContext )
+void DADiskPeekCallback( DADiskRef disk, CFArrayRef callbacks, DAResponseCallback response, void * responseContext )
 {
+    /*
+     * Dispatch the specified peek callbacks at once.  The response callback is called once all of
+     * them have responded.
+     */
+
+    CFIndex count;
+    CFIndex index;
+
     __DAResponsePrepare( disk, response, responseContext );
-    
-    DAQueueCallback( callback, disk, NULL );
+
+    count = CFArrayGetCount( callbacks );
+
+    for ( index = 0; index < count; index++ )
+    {
+        DAQueueCallback( ( void * ) CFArrayGetValueAtIndex( callbacks, index ), disk, NULL );
+    }
 
     __DAResponseComplete( disk );
 }
@@ -459,6 +836,13 @@ void DADiskUnmount( DADiskRef disk, DADiskUnmountOptions options, DACallbackRef
 
 void DADiskUnmountApprovalCallback( DADiskRef disk, DAResponseCallback response, void * responseContext )
 {
+    if ( DASessionGetCallbackCount( NULL, _kDADiskUnmountApprovalCallback ) == 0 )
+    {
+        ( response )( NULL, responseContext );
+
+        return;
+    }
+
     __DAResponsePrepare( disk, response, responseContext );
 
     __DAQueueCallbacks( _kDADiskUnmountApprovalCallback, disk, NULL );
@@ -504,14 +888,16 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                 {
                     if ( DADiskGetOption( argument0, kDADiskOptionPrivate ) == FALSE )
                     {
-                        callback = DACallbackCreateCopy( kCFAllocatorDefault, callback );
+                        CFDataRef serialization;
+
+                        serialization = DADiskCopySerialization( argument0, session, FALSE );
+
+                        callback = DACallbackCreateEvent( kCFAllocatorDefault, callback, serialization, NULL );
 
                         if ( callback )
                         {
                             DACallbackSetDisk( callback, argument0 );
 
-                            DACallbackSetArgument0( callback, DADiskGetSerialization( argument0 ) );
-
                             DASessionQueueCallback( session, callback );
 
                             DALogDebug( "  dispatched callback, id = %016llX:%016llX, kind = %s, disk = %@.",
@@ -520,8 +906,15 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                                         _DACallbackKindGetName( DACallbackGetKind( callback ) ),
                                         argument0 );
 
+                            if ( DACallbackGetKind( callback ) == _kDADiskDisappearedCallback )
+                            {
+                                DADiskRemoveSession( argument0, session );
+                            }
+
                             CFRelease( callback );
                         }
+
+                        if ( serialization )  CFRelease( serialization );
                     }
 
                     break;
@@ -532,12 +925,18 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                 case _kDADiskRenameCallback:
                 case _kDADiskUnmountCallback:
                 {
+                    CFDataRef serialization;
+
+                    serialization = DADiskCopySerialization( argument0, session, FALSE );
+
                     DACallbackSetDisk( callback, argument0 );
 
-                    DACallbackSetArgument0( callback, DADiskGetSerialization( argument0 ) );
+                    DACallbackSetArgument0( callback, serialization );
 
                     DACallbackSetArgument1( callback, argument1 );
 
+                    if ( serialization )  CFRelease( serialization );
+
                     DASessionQueueCallback( session, callback );
 
                     if ( argument1 )
@@ -571,6 +970,7 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                         if ( argument1 )
                         {
                             DACallbackRef response;
+                            CFDataRef     serialization;
 
                             response = DACallbackCreateCopy( kCFAllocatorDefault, callback );
 
@@ -580,23 +980,23 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
 
                                 DACallbackSetArgument1( response, argument1 );
 
-                                DACallbackSetTime( response, CFAbsoluteTimeGetCurrent( ) );
+                                DACallbackSetTime( response, __DAResponseGetDeadline( session, CFAbsoluteTimeGetCurrent( ) ) );
 
-                                CFArrayAppendValue( gDAResponseList, response );
+                                __DAResponseListAppend( response );
 
                                 CFRelease( response );
                             }
 
-                            callback = DACallbackCreateCopy( kCFAllocatorDefault, callback );
+                            serialization = DADiskCopySerialization( argument0, session, FALSE );
+
+                            callback = DACallbackCreateEvent( kCFAllocatorDefault, callback, serialization, argument1 );
+
+                            if ( serialization )  CFRelease( serialization );
 
                             if ( callback )
                             {
                                 DACallbackSetDisk( callback, argument0 );
 
-                                DACallbackSetArgument0( callback, DADiskGetSerialization( argument0 ) );
-
-                                DACallbackSetArgument1( callback, argument1 );
-
                                 DASessionQueueCallback( session, callback );
 
                                 DALogDebug( "  dispatched callback, id = %016llX:%016llX, kind = %s, disk = %@.",
@@ -632,6 +1032,7 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                             if ( argument1 )
                             {
                                 DACallbackRef response;
+                                CFDataRef     serialization;
 
                                 response = DACallbackCreateCopy( kCFAllocatorDefault, callback );
 
@@ -641,23 +1042,23 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
 
                                     DACallbackSetArgument1( response, argument1 );
 
-                                    DACallbackSetTime( response, CFAbsoluteTimeGetCurrent( ) );
+                                    DACallbackSetTime( response, __DAResponseGetDeadline( session, CFAbsoluteTimeGetCurrent( ) ) );
 
-                                    CFArrayAppendValue( gDAResponseList, response );
+                                    __DAResponseListAppend( response );
 
                                     CFRelease( response );
                                 }
 
-                                callback = DACallbackCreateCopy( kCFAllocatorDefault, callback );
+                                serialization = DADiskCopySerialization( argument0, session, FALSE );
+
+                                callback = DACallbackCreateEvent( kCFAllocatorDefault, callback, serialization, argument1 );
+
+                                if ( serialization )  CFRelease( serialization );
 
                                 if ( callback )
                                 {
                                     DACallbackSetDisk( callback, argument0 );
 
-                                    DACallbackSetArgument0( callback, DADiskGetSerialization( argument0 ) );
-
-                                    DACallbackSetArgument1( callback, argument1 );
-
                                     DASessionQueueCallback( session, callback );
 
                                     DALogDebug( "  dispatched callback, id = %016llX:%016llX, kind = %s, disk = %@.",
@@ -708,7 +1109,13 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                             {
                                 if ( CFArrayGetCount( intersection ) )
                                 {
-                                    callback = DACallbackCreateCopy( kCFAllocatorDefault, callback );
+                                    CFDataRef serialization;
+
+                                    serialization = DADiskCopySerialization( argument0, session, TRUE );
+
+                                    callback = DACallbackCreateEvent( kCFAllocatorDefault, callback, serialization, intersection );
+
+                                    if ( serialization )  CFRelease( serialization );
 
                                     if ( callback )
                                     {
@@ -729,10 +1136,6 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
 
                                         DACallbackSetDisk( callback, argument0 );
 
-                                        DACallbackSetArgument0( callback, DADiskGetSerialization( argument0 ) );
-
-                                        DACallbackSetArgument1( callback, intersection );
-
                                         DASessionQueueCallback( session, callback );
 
                                         CFRelease( callback );
@@ -748,7 +1151,7 @@ void DAQueueCallback( DACallbackRef callback, DADiskRef argument0, CFTypeRef arg
                 }
                 case _kDAIdleCallback:
                 {
-                    callback = DACallbackCreateCopy( kCFAllocatorDefault, callback );
+                    callback = DACallbackCreateEvent( kCFAllocatorDefault, callback, NULL, NULL );
 
                     if ( callback )
                     {
@@ -773,7 +1176,7 @@ void DAQueueCallbacks( DASessionRef session, _DACallbackKind kind, DADiskRef arg
 {
     CFArrayRef callbacks;
 
-    callbacks = DASessionGetCallbackRegister( session );
+    callbacks = DASessionCopyCallbackRegister( session, kind, argument0, ( kind == _kDADiskDescriptionChangedCallback ) ? argument1 : NULL );
 
     if ( callbacks )
     {
@@ -788,11 +1191,10 @@ void DAQueueCallbacks( DASessionRef session, _DACallbackKind kind, DADiskRef arg
 
             callback = ( void * ) CFArrayGetValueAtIndex( callbacks, index );
 
-            if ( DACallbackGetKind( callback ) == kind )
-            {
-                DAQueueCallback( callback, argument0, argument1 );
-            }
+            DAQueueCallback( callback, argument0, argument1 );
         }
+
+        CFRelease( callbacks );
     }
 }
 
@@ -811,7 +1213,7 @@ void DAQueueReleaseDisk( DADiskRef disk )
 
         if ( DACallbackGetDisk( callback ) == disk )
         {
-            CFArrayRemoveValueAtIndex( gDAResponseList, index );
+            __DAResponseListRemove( index );
 
             __DAResponseComplete( disk );
         }
@@ -853,7 +1255,7 @@ void DAQueueReleaseSession( DASessionRef session )
 
             disk = DACallbackGetDisk( callback );
 
-            CFArrayRemoveValueAtIndex( gDAResponseList, index );
+            __DAResponseListRemove( index );
 
             __DAResponseComplete( disk );
         }
@@ -904,6 +1306,8 @@ void DAQueueReleaseSession( DASessionRef session )
                     DADiskSetClaim( disk, NULL );
                 }
             }
+
+            DADiskRemoveSession( disk, session );
         }
     }
 }
@@ -914,6 +1318,8 @@ void DAQueueRequest( DARequestRef request )
 
     status = kDAReturnSuccess;
 
+    DATraceStart( kDATraceRequest, request, DARequestGetKind( request ), DARequestGetDisk( request ) );
+
     switch ( DARequestGetKind( request ) )
     {
         case _kDADiskEject:
@@ -969,41 +1375,41 @@ void DAQueueRequest( DARequestRef request )
 
                     if ( link )
                     {
-                        CFIndex count;
-                        CFIndex index;
+                        CFArrayRef list;
+                        CFIndex    count;
+                        CFIndex    index;
+
+                        list = DAUnitGetDiskList( disk );
 
-                        count = CFArrayGetCount( gDADiskList );
+                        count = list ? CFArrayGetCount( list ) : 0;
 
                         for ( index = 0; index < count; index++ )
                         {
                             DADiskRef subdisk;
 
-                            subdisk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+                            subdisk = ( void * ) CFArrayGetValueAtIndex( list, index );
 
                             if ( disk != subdisk )
                             {
-                                if ( DADiskGetBSDUnit( disk ) == DADiskGetBSDUnit( subdisk ) )
+                                DARequestRef subrequest;
+
+                                subrequest = DARequestCreate( kCFAllocatorDefault,
+                                                              DARequestGetKind( request ),
+                                                              subdisk,
+                                                              options,
+                                                              NULL,
+                                                              NULL,
+                                                              DARequestGetUserUID( request ),
+                                                              DARequestGetUserGID( request ),
+                                                              NULL );
+
+                                if ( subrequest )
                                 {
-                                    DARequestRef subrequest;
-
-                                    subrequest = DARequestCreate( kCFAllocatorDefault,
-                                                                  DARequestGetKind( request ),
-                                                                  subdisk,
-                                                                  options,
-                                                                  NULL,
-                                                                  NULL,
-                                                                  DARequestGetUserUID( request ),
-                                                                  DARequestGetUserGID( request ),
-                                                                  NULL );
-
-                                    if ( subrequest )
-                                    {
-                                        CFArrayAppendValue( link, subrequest );
+                                    CFArrayAppendValue( link, subrequest );
 
-                                        CFArrayAppendValue( gDARequestList, subrequest );
+                                    __DAQueueInsertRequest( subrequest );
 
-                                        CFRelease( subrequest );
-                                    }
+                                    CFRelease( subrequest );
                                 }
                             }
                         }
@@ -1023,9 +1429,9 @@ void DAQueueRequest( DARequestRef request )
     {
         DARequestDispatchCallback( request, status );
     }
-    else
+    else if ( __DAQueueGetRequestIsRedundant( request ) == FALSE )
     {
-        CFArrayAppendValue( gDARequestList, request );
+        __DAQueueInsertRequest( request );
 
         DAStageSignal( );
     }
@@ -1054,7 +1460,7 @@ void DAQueueUnregisterCallback( DACallbackRef callback )
 
                     disk = DACallbackGetDisk( item );
 
-                    CFArrayRemoveValueAtIndex( gDAResponseList, index );
+                    __DAResponseListRemove( index );
 
                     __DAResponseComplete( disk );
                 }
@@ -57,7 +57,7 @@ extern void DADiskMountApprovalCallback( DADiskRef disk, DAResponseCallback resp
 
 extern void DADiskMountWithArguments( DADiskRef disk, CFURLRef mountpoint, DADiskMountOptions options, DACallbackRef callback, CFStringRef arguments );
 
-extern void DADiskPeekCallback( DADiskRef disk, DACallbackRef callback, DAResponseCallback response, void * responseContext );
+extern void DADiskPeekCallback( DADiskRef disk, CFArrayRef callbacks, DAResponseCallback response, void * responseContext );
 
 extern void DADiskProbe( DADiskRef disk, DACallbackRef callback );
 
@@ -39,23 +39,88 @@
 
 #include <fcntl.h>
 #include <libproc.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/disk.h>
+#include <sys/mount.h>
 #include <DiskArbitration/DiskArbitration.h>
 
-static void __DARequestClaimCallback( int status, void * context );
-static void __DARequestClaimReleaseCallback( CFTypeRef response, void * context );
-static void __DARequestEjectCallback( int status, void * context );
-static void __DARequestEjectApprovalCallback( CFTypeRef response, void * context );
-static int  __DARequestEjectEject( void * context );
-static void __DARequestMountCallback( int status, CFURLRef mountpoint, void * context );
-static void __DARequestMountApprovalCallback( CFTypeRef response, void * context );
-static void __DARequestProbeCallback( int status, void * context );
-static void __DARequestRefreshCallback( int status, void * context );
-static void __DARequestRenameCallback( int status, void * context );
-static void __DARequestUnmountCallback( int status, void * context );
-static void __DARequestUnmountApprovalCallback( CFTypeRef response, void * context );
-static int  __DARequestUnmountGetProcessID( void * context );
+static void            __DARequestClaimCallback( int status, void * context );
+static void            __DARequestClaimReleaseCallback( CFTypeRef response, void * context );
+static void            __DARequestEjectCallback( int status, void * context );
+static void            __DARequestEjectApprovalCallback( CFTypeRef response, void * context );
+static int             __DARequestEjectEject( void * context );
+static void            __DARequestMountCallback( int status, CFURLRef mountpoint, void * context );
+static void            __DARequestMountApprovalCallback( CFTypeRef response, void * context );
+static void            __DARequestProbeCallback( int status, void * context );
+static void            __DARequestRefreshCallback( int status, void * context );
+static void            __DARequestRenameCallback( int status, void * context );
+static void            __DARequestUnmountCallback( int status, void * context );
+static void            __DARequestUnmountApprovalCallback( CFTypeRef response, void * context );
+static CFDictionaryRef __DARequestUnmountCopyHolderList( CFArrayRef mountpoints );
+static Boolean         __DARequestUnmountCreateHolderContext( DARequestRef request );
+static int             __DARequestUnmountGetProcessID( void * context );
+static void            __DARequestUnmountGetProcessIDCallback( int status, void * context );
+static void            __DARequestUnmountHolderListRemove( DADiskRef disk );
+static void            __DARequestUnmountHolderMark( const fsid_t * fsid, pid_t pid, const fsid_t * fsids, pid_t * pids, CFIndex count, CFIndex * remaining );
+
+struct __DARequestUnmountHolderContext
+{
+    CFURLRef     mountpoint;
+    CFArrayRef   mountpoints;
+    DARequestRef request;
+    CFNumberRef  unit;
+};
+
+typedef struct __DARequestUnmountHolderContext __DARequestUnmountHolderContext;
+
+static const CFStringRef __kDARequestTimeKey = CFSTR( "DARequestTime" );
+
+static CFAllocatorRef __gDARequestAllocator = NULL;
+
+/*
+ * The holder list maps each unit with a failed unmount in progress to the processes found to hold
+ * its mounted volumes, by mount point.  One sweep of the process table covers every volume of the
+ * unit, so that the partitions of a whole-disk unmount do not each sweep it.  The list is filled
+ * in from a helper thread, hence the lock, which is held for the dictionary operations alone.
+ *
+ * The sweep list maps each unit with a sweep in progress to the requests waiting on its results.
+ * It is only used on the main thread.  A waiting request holds no helper thread, as the sweeper
+ * completes it once the sweep is over.
+ */
+
+static CFMutableDictionaryRef __gDARequestUnmountHolderList     = NULL;
+static pthread_mutex_t        __gDARequestUnmountHolderListLock = PTHREAD_MUTEX_INITIALIZER;
+static CFMutableDictionaryRef __gDARequestUnmountSweepList      = NULL;
+
+static void __DARequestLatencyBegin( DARequestRef request )
+{
+    CFDateRef date;
+
+    date = CFDateCreate( CFGetAllocator( request ), CFAbsoluteTimeGetCurrent( ) );
+
+    if ( date )
+    {
+        CFDictionarySetValue( ( void * ) request, __kDARequestTimeKey, date );
+
+        CFRelease( date );
+    }
+}
+
+static void __DARequestLatencyEnd( DARequestRef request, DALatencyPhase phase )
+{
+    CFDateRef date;
+
+    date = CFDictionaryGetValue( ( void * ) request, __kDARequestTimeKey );
+
+    if ( date )
+    {
+        DALatencyListAddSample( phase, DARequestGetDisk( request ), CFDateGetAbsoluteTime( date ) );
+
+        CFDictionaryRemoveValue( ( void * ) request, __kDARequestTimeKey );
+    }
+}
+
 ///w:start
 static void __DARequestMountAuthorizationCallback( DAReturn status, void * context );
 static int  __DARequestUnmountTickle( void * context );
@@ -105,6 +170,8 @@ static void __DARequestDispatchCallback( DARequestRef request, DADissenterRef di
 {
     DACallbackRef callback;
 
+    DATraceEnd( kDATraceRequest, request, dissenter ? DADissenterGetStatus( dissenter ) : 0, 0 );
+
     callback = DARequestGetCallback( request );
 
     if ( callback )
@@ -328,6 +395,8 @@ static Boolean __DARequestEject( DARequestRef request )
 
             DARequestSetState( request, kDARequestStateStagedApprove, TRUE );
 
+            __DARequestLatencyBegin( request );
+
             DADiskEjectApprovalCallback( disk, __DARequestEjectApprovalCallback, request );
 
             return FALSE;
@@ -361,7 +430,9 @@ static Boolean __DARequestEject( DARequestRef request )
 
         DALogDebug( "  ejected disk, id = %@, ongoing.", disk );
 
-        DAThreadExecute( __DARequestEjectEject, disk, __DARequestEjectCallback, request );
+        __DARequestLatencyBegin( request );
+
+        DAThreadExecuteBlocking( __DARequestEjectEject, disk, __DARequestEjectCallback, request );
 
         return TRUE;
     }
@@ -380,6 +451,8 @@ static void __DARequestEjectCallback( int status, void * context )
 
     disk = DARequestGetDisk( request );
 
+    __DARequestLatencyEnd( request, kDALatencyPhaseRequestEject );
+
     if ( status )
     {
         /*
@@ -422,6 +495,8 @@ static void __DARequestEjectApprovalCallback( CFTypeRef response, void * context
 {
     DARequestRef request = context;
 
+    __DARequestLatencyEnd( request, kDALatencyPhaseRequestApprove );
+
     DARequestSetDissenter( request, response );
 
     DADiskSetState( DARequestGetDisk( request ), kDADiskStateCommandActive, FALSE );
@@ -565,6 +640,8 @@ static Boolean __DARequestMount( DARequestRef request )
 
             DARequestSetState( request, kDARequestStateStagedApprove, TRUE );
 
+            __DARequestLatencyBegin( request );
+
             DADiskMountApprovalCallback( disk, __DARequestMountApprovalCallback, request );
 
             return FALSE;
@@ -673,6 +750,8 @@ static Boolean __DARequestMount( DARequestRef request )
 
         DAUnitSetState( disk, kDAUnitStateCommandActive, TRUE );
 
+        __DARequestLatencyBegin( request );
+
         DAMountWithArguments( disk, path, __DARequestMountCallback, request, DARequestGetArgument3( request ), NULL );
 
         if ( path )
@@ -695,6 +774,8 @@ static void __DARequestMountCallback( int status, CFURLRef mountpoint, void * co
 
     disk = DARequestGetDisk( request );
 
+    __DARequestLatencyEnd( request, kDALatencyPhaseRequestMount );
+
     if ( status )
     {
         /*
@@ -744,6 +825,8 @@ static void __DARequestMountApprovalCallback( CFTypeRef response, void * context
 {
     DARequestRef request = context;
 
+    __DARequestLatencyEnd( request, kDALatencyPhaseRequestApprove );
+
     DARequestSetDissenter( request, response );
 
     DADiskSetState( DARequestGetDisk( request ), kDADiskStateCommandActive, FALSE );
@@ -1043,6 +1126,8 @@ static void __DARequestRenameCallback( int status, void * context )
 
         CFMutableArrayRef keys;
 
+        DAProbeCacheRemoveEntry( disk );
+
         keys = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
         if ( keys )
@@ -1114,6 +1199,48 @@ static void __DARequestRenameCallback( int status, void * context )
     CFRelease( request );
 }
 
+static Boolean __DARequestUnmountIsShared( DARequestRef request )
+{
+    /*
+     * Determine whether the request unmounts one partition on behalf of a whole-disk unmount.
+     * Such subrequests carry the whole option but, unlike the parent request, have no link.
+     */
+
+    if ( DARequestGetKind( request ) == _kDADiskUnmount )
+    {
+        if ( ( DARequestGetArgument1( request ) & kDADiskUnmountOptionWhole ) )
+        {
+            if ( DARequestGetLink( request ) == NULL )
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static Boolean __DARequestUnmountAcquireUnit( DARequestRef request )
+{
+    DADiskRef disk;
+
+    disk = DARequestGetDisk( request );
+
+    if ( __DARequestUnmountIsShared( request ) )
+    {
+        return DAUnitAcquireSharedCommand( disk );
+    }
+
+    if ( DAUnitGetState( disk, kDAUnitStateCommandActive ) == FALSE )
+    {
+        DAUnitSetState( disk, kDAUnitStateCommandActive, TRUE );
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 static Boolean __DARequestUnmount( DARequestRef request )
 {
     DADiskRef disk;
@@ -1203,10 +1330,12 @@ static Boolean __DARequestUnmount( DARequestRef request )
                 DADiskSetState( disk, kDADiskStateCommandActive, TRUE );
 
                 DARequestSetState( request, kDARequestStateStagedApprove, TRUE );
+
+                __DARequestLatencyBegin( request );
 ///w:start
                 if ( DADiskGetDescription( disk, kDADiskDescriptionMediaWritableKey ) == kCFBooleanTrue )
                 {
-                    DAThreadExecute( __DARequestUnmountTickle, disk, __DARequestUnmountTickleCallback, request );
+                    DAThreadExecuteBlocking( __DARequestUnmountTickle, disk, __DARequestUnmountTickleCallback, request );
 
                     return FALSE;
                 }
@@ -1233,10 +1362,11 @@ static Boolean __DARequestUnmount( DARequestRef request )
     }
 
     /*
-     * Commence the unmount.
+     * Commence the unmount.  The partitions of a whole-disk unmount are unmounted concurrently,
+     * with the whole disk itself waiting on them through its link.
      */
 
-    if ( DAUnitGetState( disk, kDAUnitStateCommandActive ) == FALSE )
+    if ( __DARequestUnmountAcquireUnit( request ) )
     {
         DADiskUnmountOptions options;
 
@@ -1246,10 +1376,10 @@ static Boolean __DARequestUnmount( DARequestRef request )
 
         DADiskSetState( disk, kDADiskStateCommandActive, TRUE );
 
-        DAUnitSetState( disk, kDAUnitStateCommandActive, TRUE );
-
         DALogDebug( "  unmounted disk, id = %@, ongoing.", disk );
 
+        __DARequestLatencyBegin( request );
+
         DAFileSystemUnmountWithArguments( DADiskGetFileSystem( disk ),
                                           DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ),
                                           __DARequestUnmountCallback,
@@ -1274,6 +1404,8 @@ static void __DARequestUnmountCallback( int status, void * context )
 
     disk = DARequestGetDisk( request );
 
+    __DARequestLatencyEnd( request, kDALatencyPhaseRequestUnmount );
+
     if ( status )
     {
         /*
@@ -1297,11 +1429,14 @@ static void __DARequestUnmountCallback( int status, void * context )
 
             DARequestSetDissenter( request, dissenter );
 
-            DAThreadExecute( __DARequestUnmountGetProcessID, request, __DARequestUnmountCallback, request );
-
             CFRelease( dissenter );
 
-            return;
+            if ( __DARequestUnmountCreateHolderContext( request ) )
+            {
+                return;
+            }
+
+            dissenter = DARequestGetDissenter( request );
         }
 
         __DARequestDispatchCallback( request, dissenter );
@@ -1338,13 +1473,25 @@ static void __DARequestUnmountCallback( int status, void * context )
 
             DADiskSetState( disk, kDADiskStateZombie, TRUE );
 
-            ___CFArrayRemoveValue( gDADiskList, disk );
+            DADiskListRemoveDisk( disk );
         }
 
         __DARequestDispatchCallback( request, NULL );
     }
 
-    DAUnitSetState( disk, kDAUnitStateCommandActive, FALSE );
+    if ( __DARequestUnmountIsShared( request ) )
+    {
+        DAUnitReleaseSharedCommand( disk );
+    }
+    else
+    {
+        DAUnitSetState( disk, kDAUnitStateCommandActive, FALSE );
+    }
+
+    if ( DAUnitGetState( disk, kDAUnitStateCommandActive ) == FALSE )
+    {
+        __DARequestUnmountHolderListRemove( disk );
+    }
 
     DADiskSetState( disk, kDADiskStateCommandActive, FALSE );
 
@@ -1357,6 +1504,8 @@ static void __DARequestUnmountApprovalCallback( CFTypeRef response, void * conte
 {
     DARequestRef request = context;
 
+    __DARequestLatencyEnd( request, kDALatencyPhaseRequestApprove );
+
     if ( response )
     {
         DADiskUnmountOptions options;
@@ -1382,39 +1531,499 @@ static void __DARequestUnmountApprovalCallback( CFTypeRef response, void * conte
     CFRelease( request );
 }
 
-static int  __DARequestUnmountGetProcessID( void * context )
+static CFDictionaryRef __DARequestUnmountCopyHolderList( CFArrayRef mountpoints )
 {
-    DADiskRef    disk;
-    CFURLRef     mountpoint;
-    char *       path;
-    DARequestRef request = context;
+    /*
+     * Sweep the process table once for a process holding each of the specified volumes, through its
+     * working or root directory, an open file or a mapped file, as proc_listpidspath() would do for
+     * one volume at a time.  Open files with O_EVTONLY are not considered to hold a volume.
+     */
+
+    CFIndex                count;
+    fsid_t *               fsids;
+    CFMutableDictionaryRef holders;
+    CFIndex                index;
+    pid_t *                pids;
+    pid_t *                processes;
+    int                    processesCount;
+    CFIndex                remaining;
+
+    holders = NULL;
+
+    count = CFArrayGetCount( mountpoints );
+
+    fsids = malloc( count * sizeof( fsid_t ) );
+    pids  = calloc( count, sizeof( pid_t ) );
+
+    processes = NULL;
+
+    if ( fsids == NULL || pids == NULL )  goto __DARequestUnmountCopyHolderListErr;
+
+    remaining = 0;
+
+    for ( index = 0; index < count; index++ )
+    {
+        char * path;
+
+        pids[index] = -1;
+
+        path = ___CFURLCopyFileSystemRepresentation( CFArrayGetValueAtIndex( mountpoints, index ) );
+
+        if ( path )
+        {
+            struct statfs fs;
+
+            if ( statfs( path, &fs ) == 0 )
+            {
+                fsids[index] = fs.f_fsid;
+
+                pids[index] = 0;
+
+                remaining++;
+            }
+
+            free( path );
+        }
+    }
+
+    processesCount = proc_listallpids( NULL, 0 );
+
+    if ( processesCount < 1 )  goto __DARequestUnmountCopyHolderListErr;
+
+    /*
+     * Leave room for the processes created in the meantime.
+     */
+
+    processesCount += 32;
+
+    processes = malloc( processesCount * sizeof( pid_t ) );
+
+    if ( processes == NULL )  goto __DARequestUnmountCopyHolderListErr;
+
+    processesCount = proc_listallpids( processes, processesCount * sizeof( pid_t ) );
+
+    for ( index = 0; index < processesCount && remaining; index++ )
+    {
+        struct proc_regionwithpathinfo region;
+        struct proc_vnodepathinfo      directories;
+        struct proc_fdinfo *           files;
+        int                            filesSize;
+        pid_t                          process;
+        uint64_t                       address;
+
+        process = processes[index];
+
+        if ( process == 0 )
+        {
+            continue;
+        }
+
+        if ( proc_pidinfo( process, PROC_PIDVNODEPATHINFO, 0, &directories, sizeof( directories ) ) == sizeof( directories ) )
+        {
+            __DARequestUnmountHolderMark( &directories.pvi_cdir.vip_vi.vi_fsid, process, fsids, pids, count, &remaining );
+            __DARequestUnmountHolderMark( &directories.pvi_rdir.vip_vi.vi_fsid, process, fsids, pids, count, &remaining );
+        }
+
+        filesSize = remaining ? proc_pidinfo( process, PROC_PIDLISTFDS, 0, NULL, 0 ) : 0;
+
+        if ( filesSize > 0 )
+        {
+            files = malloc( filesSize );
+
+            if ( files )
+            {
+                int filesIndex;
+
+                filesSize = proc_pidinfo( process, PROC_PIDLISTFDS, 0, files, filesSize );
+
+                for ( filesIndex = 0; filesIndex < filesSize / ( int ) sizeof( struct proc_fdinfo ) && remaining; filesIndex++ )
+                {
+                    struct vnode_fdinfowithpath file;
+
+                    if ( files[filesIndex].proc_fdtype != PROX_FDTYPE_VNODE )
+                    {
+                        continue;
+                    }
+
+                    if ( proc_pidfdinfo( process, files[filesIndex].proc_fd, PROC_PIDFDVNODEPATHINFO, &file, sizeof( file ) ) == sizeof( file ) )
+                    {
+                        if ( ( file.pfi.fi_openflags & O_EVTONLY ) == 0 )
+                        {
+                            __DARequestUnmountHolderMark( &file.pvip.vip_vi.vi_fsid, process, fsids, pids, count, &remaining );
+                        }
+                    }
+                }
+
+                free( files );
+            }
+        }
+
+        for ( address = 0; remaining; address = region.prp_prinfo.pri_address + region.prp_prinfo.pri_size )
+        {
+            if ( proc_pidinfo( process, PROC_PIDREGIONPATHINFO, address, &region, sizeof( region ) ) != sizeof( region ) )
+            {
+                break;
+            }
+
+            if ( region.prp_vip.vip_path[0] )
+            {
+                __DARequestUnmountHolderMark( &region.prp_vip.vip_vi.vi_fsid, process, fsids, pids, count, &remaining );
+            }
+        }
+    }
+
+    holders = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( holders )
+    {
+        for ( index = 0; index < count; index++ )
+        {
+            if ( pids[index] > 0 )
+            {
+                CFNumberRef pid;
+
+                pid = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, pids[index] );
+
+                if ( pid )
+                {
+                    CFDictionarySetValue( holders, CFArrayGetValueAtIndex( mountpoints, index ), pid );
+
+                    CFRelease( pid );
+                }
+            }
+        }
+    }
+
+__DARequestUnmountCopyHolderListErr:
+
+    if ( fsids     )  free( fsids     );
+    if ( pids      )  free( pids      );
+    if ( processes )  free( processes );
+
+    return holders;
+}
+
+static Boolean __DARequestUnmountCreateHolderContext( DARequestRef request )
+{
+    /*
+     * Look for the process holding the volume from a helper thread.  The volumes of the other disks
+     * on the unit are looked for alongside, so that their own failed unmounts find them ready.
+     */
+
+    __DARequestUnmountHolderContext * context;
+    DADiskRef                         disk;
+    CFMutableArrayRef                 mountpoints;
 
     disk = DARequestGetDisk( request );
 
-    mountpoint = DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey );
+    if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) == NULL )
+    {
+        return FALSE;
+    }
+
+    mountpoints = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+    if ( mountpoints == NULL )
+    {
+        return FALSE;
+    }
+
+    context = malloc( sizeof( __DARequestUnmountHolderContext ) );
+
+    if ( context == NULL )
+    {
+        CFRelease( mountpoints );
+
+        return FALSE;
+    }
+
+    context->mountpoint  = DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey );
+    context->mountpoints = mountpoints;
+    context->request     = request;
+    context->unit        = NULL;
+
+    CFArrayAppendValue( mountpoints, context->mountpoint );
+
+    if ( ( SInt32 ) DADiskGetBSDUnit( disk ) >= 0 )
+    {
+        CFArrayRef list;
+
+        list = DAUnitGetDiskList( disk );
+
+        if ( list )
+        {
+            CFIndex count;
+            CFIndex index;
+
+            count = CFArrayGetCount( list );
+
+            for ( index = 0; index < count; index++ )
+            {
+                CFURLRef mountpoint;
+
+                mountpoint = DADiskGetDescription( ( void * ) CFArrayGetValueAtIndex( list, index ), kDADiskDescriptionVolumePathKey );
+
+                if ( mountpoint )
+                {
+                    if ( CFEqual( mountpoint, context->mountpoint ) == FALSE )
+                    {
+                        CFArrayAppendValue( mountpoints, mountpoint );
+                    }
+                }
+            }
+        }
+
+        context->unit = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, DADiskGetBSDUnit( disk ) );
+    }
+
+    if ( __gDARequestUnmountSweepList == NULL )
+    {
+        __gDARequestUnmountSweepList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+    }
+
+    if ( context->unit && __gDARequestUnmountSweepList )
+    {
+        CFMutableArrayRef requests;
+
+        /*
+         * Wait on the sweep in progress for the unit, if any, rather than on a helper thread.
+         */
+
+        requests = ( void * ) CFDictionaryGetValue( __gDARequestUnmountSweepList, context->unit );
+
+        if ( requests )
+        {
+            CFArrayAppendValue( requests, request );
+
+            CFRelease( context->unit );
+            CFRelease( mountpoints );
+
+            free( context );
+
+            return TRUE;
+        }
+
+        requests = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( requests )
+        {
+            CFDictionarySetValue( __gDARequestUnmountSweepList, context->unit, requests );
+
+            CFRelease( requests );
+        }
+    }
+
+    CFRetain( context->mountpoint );
+
+    DAThreadExecute( __DARequestUnmountGetProcessID, context, __DARequestUnmountGetProcessIDCallback, context );
+
+    return TRUE;
+}
+
+static int  __DARequestUnmountGetProcessID( void * parameter )
+{
+    __DARequestUnmountHolderContext * context = parameter;
+    CFDictionaryRef                   holders;
+
+    /*
+     * Use the results of an earlier sweep of the unit, if any.  The sweep list ensures that no
+     * other sweep of the unit is in progress, so the lock need not be held across our own.
+     */
+
+    holders = NULL;
+
+    if ( context->unit )
+    {
+        pthread_mutex_lock( &__gDARequestUnmountHolderListLock );
+
+        if ( __gDARequestUnmountHolderList )
+        {
+            holders = CFDictionaryGetValue( __gDARequestUnmountHolderList, context->unit );
+        }
+
+        if ( holders )
+        {
+            CFRetain( holders );
+        }
+
+        pthread_mutex_unlock( &__gDARequestUnmountHolderListLock );
+    }
+
+    if ( holders == NULL )
+    {
+        holders = __DARequestUnmountCopyHolderList( context->mountpoints );
+
+        if ( holders )
+        {
+            if ( context->unit )
+            {
+                pthread_mutex_lock( &__gDARequestUnmountHolderListLock );
+
+                if ( __gDARequestUnmountHolderList == NULL )
+                {
+                    __gDARequestUnmountHolderList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+                }
+
+                if ( __gDARequestUnmountHolderList )
+                {
+                    CFDictionarySetValue( __gDARequestUnmountHolderList, context->unit, holders );
+                }
 
-    path = ___CFURLCopyFileSystemRepresentation( mountpoint );
+                pthread_mutex_unlock( &__gDARequestUnmountHolderListLock );
+            }
+        }
+    }
 
-    if ( path )
+    if ( holders )
     {
-        pid_t dissenterPID = 0;
+        CFNumberRef dissenterPID;
 
-        proc_listpidspath( PROC_ALL_PIDS, 0, path, PROC_LISTPIDSPATH_EXCLUDE_EVTONLY | PROC_LISTPIDSPATH_PATH_IS_VOLUME, &dissenterPID, sizeof( dissenterPID ) );
+        dissenterPID = CFDictionaryGetValue( holders, context->mountpoint );
 
         if ( dissenterPID )
         {
             DADissenterRef dissenter;
 
-            dissenter = DARequestGetDissenter( request );
+            dissenter = DARequestGetDissenter( context->request );
 
-            DADissenterSetProcessID( dissenter, dissenterPID );
+            DADissenterSetProcessID( dissenter, ___CFNumberGetIntegerValue( dissenterPID ) );
         }
 
-        free( path );
+        CFRelease( holders );
     }
 
     return -1;
 }
+
+static void __DARequestUnmountGetProcessIDCallback( int status, void * parameter )
+{
+    /*
+     * Complete the requests that waited on our sweep of the unit, then our own.
+     */
+
+    __DARequestUnmountHolderContext * context = parameter;
+    DARequestRef                      request = context->request;
+
+    if ( context->unit )
+    {
+        CFArrayRef requests = NULL;
+
+        if ( __gDARequestUnmountSweepList )
+        {
+            requests = CFDictionaryGetValue( __gDARequestUnmountSweepList, context->unit );
+
+            if ( requests )
+            {
+                CFRetain( requests );
+
+                CFDictionaryRemoveValue( __gDARequestUnmountSweepList, context->unit );
+            }
+        }
+
+        if ( requests )
+        {
+            CFDictionaryRef holders = NULL;
+            CFIndex         count;
+            CFIndex         index;
+
+            pthread_mutex_lock( &__gDARequestUnmountHolderListLock );
+
+            if ( __gDARequestUnmountHolderList )
+            {
+                holders = CFDictionaryGetValue( __gDARequestUnmountHolderList, context->unit );
+            }
+
+            if ( holders )
+            {
+                CFRetain( holders );
+            }
+
+            pthread_mutex_unlock( &__gDARequestUnmountHolderListLock );
+
+            count = CFArrayGetCount( requests );
+
+            for ( index = 0; index < count; index++ )
+            {
+                DARequestRef waiter;
+
+                waiter = ( void * ) CFArrayGetValueAtIndex( requests, index );
+
+                if ( holders )
+                {
+                    CFNumberRef dissenterPID;
+
+                    dissenterPID = CFDictionaryGetValue( holders, DADiskGetDescription( DARequestGetDisk( waiter ), kDADiskDescriptionVolumePathKey ) );
+
+                    if ( dissenterPID )
+                    {
+                        DADissenterSetProcessID( DARequestGetDissenter( waiter ), ___CFNumberGetIntegerValue( dissenterPID ) );
+                    }
+                }
+
+                __DARequestUnmountCallback( status, waiter );
+            }
+
+            if ( holders )  CFRelease( holders );
+
+            CFRelease( requests );
+        }
+
+        CFRelease( context->unit );
+    }
+
+    CFRelease( context->mountpoint  );
+    CFRelease( context->mountpoints );
+
+    free( context );
+
+    __DARequestUnmountCallback( status, request );
+}
+
+static void __DARequestUnmountHolderListRemove( DADiskRef disk )
+{
+    /*
+     * Forget the holders found for the unit once its unmount is over, as they are only good for as
+     * long as the volumes stay busy.
+     */
+
+    if ( ( SInt32 ) DADiskGetBSDUnit( disk ) >= 0 )
+    {
+        pthread_mutex_lock( &__gDARequestUnmountHolderListLock );
+
+        if ( __gDARequestUnmountHolderList )
+        {
+            CFNumberRef unit;
+
+            unit = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, DADiskGetBSDUnit( disk ) );
+
+            if ( unit )
+            {
+                CFDictionaryRemoveValue( __gDARequestUnmountHolderList, unit );
+
+                CFRelease( unit );
+            }
+        }
+
+        pthread_mutex_unlock( &__gDARequestUnmountHolderListLock );
+    }
+}
+static void __DARequestUnmountHolderMark( const fsid_t * fsid, pid_t pid, const fsid_t * fsids, pid_t * pids, CFIndex count, CFIndex * remaining )
+{
+    CFIndex index;
+
+    for ( index = 0; index < count; index++ )
+    {
+        if ( pids[index] == 0 )
+        {
+            if ( fsid->val[0] == fsids[index].val[0] && fsid->val[1] == fsids[index].val[1] )
+            {
+                pids[index] = pid;
+
+                ( *remaining )--;
+            }
+        }
+    }
+}
 ///w:start
 static int __DARequestUnmountTickle( void * context )
 {
@@ -1467,7 +2076,17 @@ DARequestRef DARequestCreate( CFAllocatorRef allocator,
 {
     CFMutableDictionaryRef request;
 
-    request = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+    /*
+     * Requests are created for every queued operation and are discarded once they complete, so
+     * they are recycled through a pool.
+     */
+
+    if ( __gDARequestAllocator == NULL )
+    {
+        __gDARequestAllocator = ___CFAllocatorCreatePool( 256 );
+    }
+
+    request = CFDictionaryCreateMutable( __gDARequestAllocator ? __gDARequestAllocator : kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
     if ( request )
     {
@@ -40,6 +40,7 @@
 #include "DASupport.h"
 
 #include <paths.h>
+#include <pthread.h>
 #include <servers/bootstrap.h>
 #include <sys/stat.h>
 #include <IOKit/IOMessage.h>
@@ -48,62 +49,67 @@
 #include <SystemConfiguration/SCDynamicStoreCopySpecificPrivate.h>
 ///w:end
 
-static CFMachPortRef       __gDAServer      = NULL;
-static mach_port_t         __gDAServerPort  = MACH_PORT_NULL;
-static mach_msg_header_t * __gDAServerReply = NULL;
+static CFMachPortRef       __gDAServer          = NULL;
+static mach_port_t         __gDAServerPort      = MACH_PORT_NULL;
+static mach_port_t         __gDAServerQueryPort = MACH_PORT_NULL;
+static mach_msg_header_t * __gDAServerReply     = NULL;
 
-static void __DAMediaBusyStateChangedCallback( void * context, io_service_t service, void * argument );
-static void __DAMediaPropertyChangedCallback( void * context, io_service_t service, void * argument );
-
-static DADiskRef __DADiskListGetDisk( const char * diskID )
-{
-    CFIndex count;
-    CFIndex index;
-
-    count = CFArrayGetCount( gDADiskList );
-
-    for ( index = 0; index < count; index++ )
-    {
-        DADiskRef disk;
+/*
+ * The processes that may use the query port, which is to say those that obtained it through a
+ * session, by session and by process ID.  The query thread consults the latter, hence the lock.
+ */
 
-        disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+static CFMutableDictionaryRef __gDAServerQueryList    = NULL;
+static pthread_mutex_t        __gDAServerQueryLock    = PTHREAD_MUTEX_INITIALIZER;
+static CFMutableBagRef        __gDAServerQueryPIDList = NULL;
 
-        if ( strcmp( DADiskGetID( disk ), diskID ) == 0 )
-        {
-            return disk;
-        }
-    }
+static CFMutableDictionaryRef __gDAVolumeList = NULL;
 
-    return NULL;
-}
+/*
+ * The media properties that can change over the life of a media object, along with the keys of
+ * the disk description under which they are kept.  The wholeness of a media object is set once,
+ * when it is published, and is left out.
+ */
 
-static DADiskRef __DADiskListGetDiskWithIOMedia( io_service_t media )
+static const struct
 {
-    CFIndex count;
-    CFIndex index;
-
-    count = CFArrayGetCount( gDADiskList );
-
-    for ( index = 0; index < count; index++ )
-    {
-        DADiskRef disk;
+    CFStringRef         property;
+    const CFStringRef * key;
+} __kDAMediaPropertyList[] =
+{
+    { CFSTR( kIOMediaContentKey            ), &kDADiskDescriptionMediaContentKey   },
+    { CFSTR( kIOMediaEjectableKey          ), &kDADiskDescriptionMediaEjectableKey },
+    { CFSTR( kIOMediaLeafKey               ), &kDADiskDescriptionMediaLeafKey      },
+    { CFSTR( kIOMediaPreferredBlockSizeKey ), &kDADiskDescriptionMediaBlockSizeKey },
+    { CFSTR( kIOMediaRemovableKey          ), &kDADiskDescriptionMediaRemovableKey },
+    { CFSTR( kIOMediaSizeKey               ), &kDADiskDescriptionMediaSizeKey      },
+    { CFSTR( kIOMediaWritableKey           ), &kDADiskDescriptionMediaWritableKey  }
+};
 
-        disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+/*
+ * The disks with a property change not yet read back.  A burst of changes, such as those to the
+ * partitions of a unit being repartitioned, is read back in one pass once the burst is over.
+ */
 
-        if ( IOObjectIsEqualTo( DADiskGetIOMedia( disk ), media ) )
-        {
-            return disk;
-        }
-    }
+static CFMutableSetRef   __gDAMediaPropertyChangedList      = NULL;
+static CFRunLoopTimerRef __gDAMediaPropertyChangedListTimer = NULL;
 
-    return NULL;
-}
+static void      __DAMediaBusyStateChangedCallback( void * context, io_service_t service, void * argument );
+static DADiskRef __DAMediaGetWholeDisk( DADiskRef disk );
+static void      __DAMediaPropertyChangedCallback( void * context, io_service_t service, void * argument );
+static void      __DAMediaPropertyChangedListAdd( io_service_t service );
+static void      __DAMediaPropertyChangedListCallback( CFRunLoopTimerRef timer, void * info );
+static Boolean   __DAServerQueryListGetPermitted( mach_msg_header_t * message );
+static void      __DAServerQueryListRemoveSession( mach_port_t _session );
+static boolean_t __DAServerQueryServer( mach_msg_header_t * message, mach_msg_header_t * reply );
+static void *    __DAServerQueryThread( void * context );
+static void      __DAVolumeListRefresh( void );
 
 static void __DAMediaBusyStateChangedCallback( void * context, io_service_t service, void * argument )
 {
     DADiskRef disk;
 
-    disk = __DADiskListGetDiskWithIOMedia( service );
+    disk = DADiskListGetDiskWithIOMedia( service );
 
     if ( disk )
     {
@@ -130,18 +136,47 @@ static void __DAMediaChangedCallback( void * context, io_service_t service, natu
         }
         case kIOMessageServicePropertyChange:
         {
-            __DAMediaPropertyChangedCallback( context, service, argument );
+            __DAMediaPropertyChangedListAdd( service );
 
             break;
         }
     }
 }
 
+static DADiskRef __DAMediaGetWholeDisk( DADiskRef disk )
+{
+    CFArrayRef list;
+
+    list = DAUnitGetDiskList( disk );
+
+    if ( list )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( list );
+
+        for ( index = 0; index < count; index++ )
+        {
+            DADiskRef item;
+
+            item = ( void * ) CFArrayGetValueAtIndex( list, index );
+
+            if ( DADiskGetDescription( item, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue )
+            {
+                return item;
+            }
+        }
+    }
+
+    return NULL;
+}
+
 static void __DAMediaPropertyChangedCallback( void * context, io_service_t service, void * argument )
 {
     DADiskRef disk;
 
-    disk = __DADiskListGetDiskWithIOMedia( service );
+    disk = DADiskListGetDiskWithIOMedia( service );
 
     if ( disk )
     {
@@ -157,98 +192,245 @@ static void __DAMediaPropertyChangedCallback( void * context, io_service_t servi
 
             if ( properties )
             {
-                CFTypeRef object;
-
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaContentKey ) );
+                size_t index;
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaContentKey, object ) )
+                for ( index = 0; index < sizeof( __kDAMediaPropertyList ) / sizeof( __kDAMediaPropertyList[0] ); index++ )
                 {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaContentKey, object );
+                    CFStringRef key;
+                    CFTypeRef   object;
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaContentKey );
-                }
+                    key = *__kDAMediaPropertyList[index].key;
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaEjectableKey ) );
+                    object = CFDictionaryGetValue( properties, __kDAMediaPropertyList[index].property );
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaEjectableKey, object ) )
-                {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaEjectableKey, object );
+                    if ( DADiskCompareDescription( disk, key, object ) )
+                    {
+                        DADiskSetDescription( disk, key, object );
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaEjectableKey );
+                        CFArrayAppendValue( keys, key );
+                    }
                 }
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaLeafKey ) );
-
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaLeafKey, object ) )
+                if ( CFArrayGetCount( keys ) )
                 {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaLeafKey, object );
+                    DALogDebugHeader( "iokit [0] -> %s", gDAProcessNameID );
+
+                    DALogDebug( "  updated disk, id = %@.", disk );
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaLeafKey );
+                    if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
+                    {
+                        DADiskDescriptionChangedCallback( disk, keys );
+                    }
                 }
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaPreferredBlockSizeKey ) );
+                CFRelease( properties );
+            }
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaBlockSizeKey, object ) )
-                {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaBlockSizeKey, object );
+            CFRelease( keys );
+        }
+    }
+}
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaBlockSizeKey );
-                }
+static void __DAMediaPropertyChangedListAdd( io_service_t service )
+{
+    DADiskRef disk;
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaRemovableKey ) );
+    disk = DADiskListGetDiskWithIOMedia( service );
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaRemovableKey, object ) )
-                {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaRemovableKey, object );
+    if ( disk )
+    {
+        if ( __gDAMediaPropertyChangedList == NULL )
+        {
+            __gDAMediaPropertyChangedList = CFSetCreateMutable( kCFAllocatorDefault, 0, &kCFTypeSetCallBacks );
+        }
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaRemovableKey );
-                }
+        assert( __gDAMediaPropertyChangedList );
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaSizeKey ) );
+        CFSetAddValue( __gDAMediaPropertyChangedList, disk );
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaSizeKey, object ) )
-                {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaSizeKey, object );
+        /*
+         * Read the changes back once the notifications at hand, which the run loop serves first,
+         * have all been added.
+         */
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaSizeKey );
-                }
+        if ( __gDAMediaPropertyChangedListTimer )
+        {
+            CFRunLoopTimerSetNextFireDate( __gDAMediaPropertyChangedListTimer, CFAbsoluteTimeGetCurrent( ) );
+        }
+        else
+        {
+            __gDAMediaPropertyChangedListTimer = CFRunLoopTimerCreate( kCFAllocatorDefault, CFAbsoluteTimeGetCurrent( ), kCFAbsoluteTimeIntervalSince1904, 0, 0, __DAMediaPropertyChangedListCallback, NULL );
+
+            if ( __gDAMediaPropertyChangedListTimer )
+            {
+                CFRunLoopAddTimer( CFRunLoopGetCurrent( ), __gDAMediaPropertyChangedListTimer, kCFRunLoopDefaultMode );
+            }
+            else
+            {
+                __DAMediaPropertyChangedListCallback( NULL, NULL );
+            }
+        }
+    }
+}
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaWholeKey ) );
+static void __DAMediaPropertyChangedListCallback( CFRunLoopTimerRef timer, void * info )
+{
+    CFMutableSetRef list;
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaWholeKey, object ) )
-                {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaWholeKey, object );
+    list = __gDAMediaPropertyChangedList;
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaWholeKey );
-                }
+    __gDAMediaPropertyChangedList = NULL;
 
-                object = CFDictionaryGetValue( properties, CFSTR( kIOMediaWritableKey ) );
+    if ( list )
+    {
+        CFIndex     count;
+        DADiskRef * disks;
 
-                if ( DADiskCompareDescription( disk, kDADiskDescriptionMediaWritableKey, object ) )
-                {
-                    DADiskSetDescription( disk, kDADiskDescriptionMediaWritableKey, object );
+        count = CFSetGetCount( list );
 
-                    CFArrayAppendValue( keys, kDADiskDescriptionMediaWritableKey );
-                }
+        disks = malloc( count * sizeof( DADiskRef ) );
 
-                if ( CFArrayGetCount( keys ) )
-                {
-                    DALogDebugHeader( "iokit [0] -> %s", gDAProcessNameID );
+        if ( disks )
+        {
+            CFIndex index;
 
-                    DALogDebug( "  updated disk, id = %@.", disk );
+            CFSetGetValues( list, ( const void ** ) disks );
 
-                    if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
-                    {
-                        DADiskDescriptionChangedCallback( disk, keys );
-                    }
-                }
+            for ( index = 0; index < count; index++ )
+            {
+                /*
+                 * The disk object is looked up again from its media object, so one that has gone
+                 * away in the meantime is passed over.
+                 */
 
-                CFRelease( properties );
+                __DAMediaPropertyChangedCallback( NULL, DADiskGetIOMedia( disks[index] ), NULL );
             }
 
-            CFRelease( keys );
+            free( disks );
+        }
+
+        CFRelease( list );
+    }
+}
+
+static Boolean __DAServerQueryListGetPermitted( mach_msg_header_t * message )
+{
+    /*
+     * Determine whether the sender of the message obtained the query port through a session.  The
+     * sender is known from the audit trailer, whose process ID the sender cannot forge.
+     */
+
+    mach_msg_audit_trailer_t * trailer;
+    Boolean                    permitted = FALSE;
+
+    trailer = ( void * ) ( ( uint8_t * ) message + round_msg( message->msgh_size ) );
+
+    if ( trailer->msgh_trailer_type == MACH_MSG_TRAILER_FORMAT_0 && trailer->msgh_trailer_size >= sizeof( mach_msg_audit_trailer_t ) )
+    {
+        CFNumberRef pid;
+
+        pid = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &trailer->msgh_audit.val[5] );
+
+        if ( pid )
+        {
+            pthread_mutex_lock( &__gDAServerQueryLock );
+
+            if ( __gDAServerQueryPIDList )
+            {
+                permitted = CFBagContainsValue( __gDAServerQueryPIDList, pid );
+            }
+
+            pthread_mutex_unlock( &__gDAServerQueryLock );
+
+            CFRelease( pid );
+        }
+    }
+
+    return permitted;
+}
+
+static void __DAServerQueryListRemoveSession( mach_port_t _session )
+{
+    /*
+     * Withdraw the use of the query port from the process behind the session.
+     */
+
+    CFNumberRef key;
+
+    key = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &_session );
+
+    if ( key )
+    {
+        pthread_mutex_lock( &__gDAServerQueryLock );
+
+        if ( __gDAServerQueryList )
+        {
+            CFNumberRef pid;
+
+            pid = CFDictionaryGetValue( __gDAServerQueryList, key );
+
+            if ( pid )
+            {
+                CFBagRemoveValue( __gDAServerQueryPIDList, pid );
+
+                CFDictionaryRemoveValue( __gDAServerQueryList, key );
+            }
+        }
+
+        pthread_mutex_unlock( &__gDAServerQueryLock );
+
+        CFRelease( key );
+    }
+}
+
+static boolean_t __DAServerQueryServer( mach_msg_header_t * message, mach_msg_header_t * reply )
+{
+    /*
+     * Serve the read-only routines, which is to say _DAServerDiskCopyDescription, the first
+     * routine of the subsystem.  Every other routine must reach us on the main thread.  Only the
+     * processes that obtained the query port through a session are served.
+     */
+
+    kern_return_t status;
+
+    status = MIG_BAD_ID;
+
+    if ( message->msgh_id == DAServer_subsystem.start )
+    {
+        if ( __DAServerQueryListGetPermitted( message ) )
+        {
+            return DAServer_server( message, reply );
         }
+
+        status = kDAReturnNotPermitted;
     }
+
+    reply->msgh_bits        = MACH_MSGH_BITS( MACH_MSGH_BITS_REMOTE( message->msgh_bits ), 0 );
+    reply->msgh_id          = message->msgh_id + 100;
+    reply->msgh_local_port  = MACH_PORT_NULL;
+    reply->msgh_remote_port = message->msgh_remote_port;
+    reply->msgh_reserved    = 0;
+    reply->msgh_size        = sizeof( mig_reply_error_t );
+
+    ( ( mig_reply_error_t * ) reply )->NDR     = NDR_record;
+    ( ( mig_reply_error_t * ) reply )->RetCode = status;
+
+    return FALSE;
+}
+
+static void * __DAServerQueryThread( void * context )
+{
+    /*
+     * Serve queries against the published disk serializations, so that they need not wait on
+     * the main thread while it is busy staging.
+     */
+
+    mach_msg_server( __DAServerQueryServer,
+                     DAServer_subsystem.maxsize,
+                     __gDAServerQueryPort,
+                     MACH_RCV_TRAILER_TYPE( MACH_MSG_TRAILER_FORMAT_0 ) | MACH_RCV_TRAILER_ELEMENTS( MACH_RCV_TRAILER_AUDIT ) );
+
+    return NULL;
 }
 
 static DASessionRef __DASessionListGetSession( mach_port_t sessionID )
@@ -351,6 +533,15 @@ void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void
 ///w:stop
     userList = ___SCDynamicStoreCopyConsoleInformation( session );
 
+    if ( userUID != previousUserUID )
+    {
+        /*
+         * The agent connection targets the previous user.
+         */
+
+        DADialogInvalidate( );
+    }
+
     gDAConsoleUser     = user;
     gDAConsoleUserGID  = userGID;
     gDAConsoleUserUID  = userUID;
@@ -396,68 +587,53 @@ void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void
 
         if ( index == count )
         {
-            count = CFArrayGetCount( gDADiskList );
+            CFArrayRef disks;
 
-            for ( index = 0; index < count; index++ )
-            {
-                DADiskRef disk;
+            /*
+             * Release the disks of the previous user in one batch, taken from the owner index.  The
+             * requests are all queued before any is dispatched, such that those against different
+             * units proceed in parallel.
+             */
 
-                disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+            disks = DADiskListCopyDisksWithUserUID( previousUserUID );
 
-                /*
-                 * Unmount this volume.
-                 */
+            if ( disks )
+            {
+                count = CFArrayGetCount( disks );
 
-                if ( DADiskGetDescription( disk, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanTrue )
+                for ( index = 0; index < count; index++ )
                 {
-                    Boolean unmount;
+                    DADiskRef disk;
 
-                    unmount = FALSE;
+                    disk = ( void * ) CFArrayGetValueAtIndex( disks, index );
 
-                    if ( DADiskGetUserUID( disk ) )
-                    {
-                        if ( DADiskGetUserUID( disk ) == previousUserUID )
-                        {
-                            unmount = TRUE;
-                        }
-                    }
+                    /*
+                     * Unmount this volume.
+                     */
 
-                    if ( unmount )
+                    if ( DADiskGetDescription( disk, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanTrue )
                     {
                         DADiskUnmount( disk, kDADiskUnmountOptionDefault, NULL );
                     }
                 }
-            }
-
-            for ( index = 0; index < count; index++ )
-            {
-                DADiskRef disk;
 
-                disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
-
-                /*
-                 * Eject this disk.
-                 */
-
-                if ( DADiskGetDescription( disk, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue )
+                for ( index = 0; index < count; index++ )
                 {
-                    Boolean eject;
+                    DADiskRef disk;
 
-                    eject = FALSE;
+                    disk = ( void * ) CFArrayGetValueAtIndex( disks, index );
 
-                    if ( DADiskGetUserUID( disk ) )
-                    {
-                        if ( DADiskGetUserUID( disk ) == previousUserUID )
-                        {
-                            eject = TRUE;
-                        }
-                    }
+                    /*
+                     * Eject this disk.
+                     */
 
-                    if ( eject )
+                    if ( DADiskGetDescription( disk, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue )
                     {
                         DADiskEject( disk, kDADiskEjectOptionDefault, NULL );
                     }
                 }
+
+                CFRelease( disks );
             }
         }
     }
@@ -626,6 +802,13 @@ void _DAConfigurationCallback( SCDynamicStoreRef session, CFArrayRef keys, void
                     DADiskEject( disk, kDADiskEjectOptionDefault, NULL );
                 }
             }
+
+            /*
+             * Have the stage pass look at this disk again, since the unreadable media check
+             * depends on the console user.
+             */
+
+            DAStageAddDisk( disk );
         }
     }
 
@@ -662,7 +845,7 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
          * Determine whether this is a re-registration.
          */
 
-        disk = __DADiskListGetDiskWithIOMedia( media );
+        disk = DADiskListGetDiskWithIOMedia( media );
 
         if ( disk )
         {
@@ -677,19 +860,33 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
             }
 ///w:stop
         }
+        else if ( DAPreferenceListGetIgnore( media ) )
+        {
+            ___io_path_t path;
+
+            /*
+             * Leave the media object alone, as the administrator has asked us to.
+             */
+
+            if ( ___IORegistryEntryGetPath( media, kIOServicePlane, path ) == KERN_SUCCESS )
+            {
+                DALogDebugHeader( "iokit [0] -> %s", gDAProcessNameID );
+
+                DALogDebug( "  ignored media, path = %s.", path );
+            }
+        }
         else
         {
             io_object_t busyNotification;
             io_object_t propertyNotification;
 
             /*
-             * Create the "media changed" notification.
+             * Create the "media changed" notification.  The busy notification is created once the
+             * disk object is, as it depends on whether the media object is whole.
              */
 
             busyNotification = IO_OBJECT_NULL;
 
-            IOServiceAddInterestNotification( gDAMediaPort, media, kIOBusyInterest, __DAMediaChangedCallback, NULL, &busyNotification );
-
             propertyNotification = IO_OBJECT_NULL;
 
             IOServiceAddInterestNotification( gDAMediaPort, media, kIOGeneralInterest, __DAMediaChangedCallback, NULL, &propertyNotification );
@@ -712,36 +909,68 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
                  * it first.  The appearances and disappearances within each queue do occur in proper order.
                  */
 
-                if ( ___CFArrayContainsValue( gDADiskList, disk ) )
+                if ( DADiskListGetDisk( DADiskGetID( disk ) ) )
                 {
                     /*
                      * Process the disappearance.
                      */
 
-                    _DAMediaDisappearedCallback( ( void * ) ___CFArrayGetValue( gDADiskList, disk ), IO_OBJECT_NULL );
+                    _DAMediaDisappearedCallback( ( void * ) DADiskListGetDisk( DADiskGetID( disk ) ), IO_OBJECT_NULL );
 
-                    assert( ___CFArrayContainsValue( gDADiskList, disk ) == FALSE );
+                    assert( DADiskListGetDisk( DADiskGetID( disk ) ) == NULL );
                 }
 
                 /*
-                 * Set the "media changed" notification.
+                 * Only the whole disk of a unit needs a busy notification, as its busy state takes in
+                 * that of the media objects beneath it, and the busy state is only ever looked at for
+                 * the unit as a whole.  The other disks of a unit with no whole disk of ours, such as
+                 * one that is ignored, each get their own.
                  */
 
-                if ( busyNotification )
-                {
-                    DADiskSetBusyNotification( disk, busyNotification );
-                }
-
-                if ( propertyNotification )
+                if ( DADiskGetDescription( disk, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue || __DAMediaGetWholeDisk( disk ) == NULL )
                 {
-                    DADiskSetPropertyNotification( disk, propertyNotification );
+                    IOServiceAddInterestNotification( gDAMediaPort, media, kIOBusyInterest, __DAMediaChangedCallback, NULL, &busyNotification );
                 }
 
                 /*
-                 * Set the BSD permissions for this media object.
+                 * Set the "media changed" notification.
                  */
 
-                if ( DADiskGetDescription( disk, kDADiskDescriptionMediaTypeKey ) )
+                if ( busyNotification )
+                {
+                    uint32_t busy;
+
+                    DADiskSetBusyNotification( disk, busyNotification );
+
+                    /*
+                     * Take the busy state anew, as it may have changed ahead of the notification.
+                     */
+
+                    busy = 0;
+
+                    IOServiceGetBusyState( media, &busy );
+
+                    DADiskSetBusy( disk, busy ? CFAbsoluteTimeGetCurrent( ) : 0 );
+                }
+                else
+                {
+                    /*
+                     * Nothing would tell us once the disk is no longer busy.
+                     */
+
+                    DADiskSetBusy( disk, 0 );
+                }
+
+                if ( propertyNotification )
+                {
+                    DADiskSetPropertyNotification( disk, propertyNotification );
+                }
+
+                /*
+                 * Set the BSD permissions for this media object.
+                 */
+
+                if ( DADiskGetDescription( disk, kDADiskDescriptionMediaTypeKey ) )
                 {
                     if ( DADiskGetMode( disk ) )
                     {
@@ -844,7 +1073,7 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
 
                 DAUnitSetState( disk, kDAUnitStateStagedUnreadable, FALSE );
 
-                CFArrayInsertValueAtIndex( gDADiskList, 0, disk );
+                DADiskListAddDisk( disk );
 
                 CFRelease( disk );
             }
@@ -863,6 +1092,12 @@ void _DAMediaAppearedCallback( void * context, io_iterator_t notification )
         IOObjectRelease( media );
     }
 
+    /*
+     * Forget the device descriptions shared across this batch of media objects.
+     */
+
+    DADiskDeviceCacheRemoveAllEntries( );
+
     DAStageSignal( );
 }
 
@@ -895,7 +1130,7 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
          * Obtain the disk object for this media object.
          */
 
-        disk = __DADiskListGetDiskWithIOMedia( media );
+        disk = DADiskListGetDiskWithIOMedia( media );
 
         /*
          * Determine whether a media object appearance and disappearance occurred.  We must do this
@@ -915,7 +1150,7 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
 
             _DAMediaAppearedCallback( NULL, gDAMediaAppearedNotification );
 
-            disk = __DADiskListGetDiskWithIOMedia( media );
+            disk = DADiskListGetDiskWithIOMedia( media );
         }
 
         if ( disk )
@@ -928,6 +1163,15 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
 
             DALogDebug( "  removed disk, id = %@.", disk );
 
+            /*
+             * Cancel the commands outstanding against the unit, which can no longer complete.
+             */
+
+            if ( DADiskGetDescription( disk, kDADiskDescriptionMediaWholeKey ) == kCFBooleanTrue )
+            {
+                DAFileSystemCancel( DADiskGetDevice( disk ) );
+            }
+
             if ( DADiskGetBSDLink( disk, TRUE ) )
             {
                 unlink( DADiskGetBSDLink( disk, TRUE ) );
@@ -952,7 +1196,7 @@ void _DAMediaDisappearedCallback( void * context, io_iterator_t notification )
 
             DADiskSetState( disk, kDADiskStateZombie, TRUE );
 
-            ___CFArrayRemoveValue( gDADiskList, disk );
+            DADiskListRemoveDisk( disk );
         }
 
         if ( context )
@@ -974,6 +1218,23 @@ void _DAServerCallback( CFMachPortRef port, void * parameter, CFIndex messageSiz
     {
         _DAServerSessionRelease( message->msgh_local_port );
     }
+    else if ( message->msgh_id == MACH_NOTIFY_SEND_POSSIBLE )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( message->msgh_local_port );
+
+        if ( session )
+        {
+            DASessionSetState( session, kDASessionStateNotify, FALSE );
+
+            DASessionWakeup( session );
+        }
+    }
+    else if ( message->msgh_id == MACH_NOTIFY_DEAD_NAME )
+    {
+        mach_port_deallocate( mach_task_self( ), ( ( mach_dead_name_notification_t * ) message )->not_port );
+    }
     else if ( DAServer_server( message, __gDAServerReply ) )
     {
         kern_return_t status;
@@ -1024,6 +1285,33 @@ kern_return_t _DAServerDiskCopyDescription( mach_port_t _session, caddr_t _disk,
 
     status = kDAReturnBadArgument;
 
+    if ( _session == __gDAServerQueryPort )
+    {
+        CFDataRef description;
+
+        /*
+         * We are on the query thread.  Answer from the published serialization, which leaves the
+         * main thread's state untouched.  Nothing is logged, since the log is written from the
+         * main thread alone.
+         */
+
+        description = DADiskCopySnapshot( _disk );
+
+        if ( description )
+        {
+            *_description = ___CFDataCopyBytes( description, _descriptionSize );
+
+            if ( *_description )
+            {
+                status = kDAReturnSuccess;
+            }
+
+            CFRelease( description );
+        }
+
+        return status;
+    }
+
     DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
 
     if ( _session )
@@ -1038,7 +1326,7 @@ kern_return_t _DAServerDiskCopyDescription( mach_port_t _session, caddr_t _disk,
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1089,7 +1377,7 @@ kern_return_t _DAServerDiskGetOptions( mach_port_t _session, caddr_t _disk, int3
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1126,7 +1414,7 @@ kern_return_t _DAServerDiskGetUserUID( mach_port_t _session, caddr_t _disk, uid_
         {
             DADiskRef disk;
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1160,7 +1448,7 @@ kern_return_t _DAServerDiskIsClaimed( mach_port_t _session, caddr_t _disk, boole
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1201,7 +1489,7 @@ kern_return_t _DAServerDiskSetAdoption( mach_port_t _session, caddr_t _disk, boo
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1245,7 +1533,7 @@ kern_return_t _DAServerDiskSetEncoding( mach_port_t _session, caddr_t _disk, int
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1289,7 +1577,7 @@ kern_return_t _DAServerDiskSetOptions( mach_port_t _session, caddr_t _disk, int3
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1357,7 +1645,7 @@ kern_return_t _DAServerDiskUnclaim( mach_port_t _session, caddr_t _disk )
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _disk );
+            disk = DADiskListGetDisk( _disk );
 
             if ( disk )
             {
@@ -1382,13 +1670,322 @@ kern_return_t _DAServerDiskUnclaim( mach_port_t _session, caddr_t _disk )
 
     if ( status )
     {
-        DALogDebug( "unable to unclaim disk, id = %s (status code 0x%08X).", _disk, status );
+        DALogDebug( "unable to unclaim disk, id = %s (status code 0x%08X).", _disk, status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopyCallbackQueue( mach_port_t _session, vm_address_t * _queue, mach_msg_type_number_t * _queueSize )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFMutableArrayRef callbacks;
+
+            DALogDebugHeader( "%s -> %@", gDAProcessNameID, session );
+
+            callbacks = DASessionGetCallbackQueue( session );
+
+            if ( callbacks )
+            {
+                CFIndex        count;
+                CFIndex        index;
+                CFDataRef      queue;
+                CFAbsoluteTime time;
+
+                count = CFArrayGetCount( callbacks );
+
+                time = CFAbsoluteTimeGetCurrent( );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    DACallbackRef callback;
+
+                    callback = ( void * ) CFArrayGetValueAtIndex( callbacks, index );
+
+                    DACallbackSetDisk( callback, NULL );
+
+                    DACallbackSetMatch( callback, NULL );
+
+                    DACallbackSetSession( callback, NULL );
+                }
+
+                queue = _DASerialize( kCFAllocatorDefault, callbacks );
+
+                DASessionSetQueueUsage( session, DASessionGetQueueUsage( session ) + CFAbsoluteTimeGetCurrent( ) - time );
+
+                if ( queue )
+                {
+                    *_queue = ___CFDataCopyBytes( queue, _queueSize );
+
+                    if ( *_queue )
+                    {
+                        DASessionSetQueueSize( session, DASessionGetQueueSize( session ) + *_queueSize );
+
+                        DATrace( kDATraceCallbackDrain, session, count, *_queueSize );
+
+                        DALogDebug( "  dispatched callback queue." );
+
+                        status = kDAReturnSuccess;
+                    }
+
+                    CFRelease( queue );
+                }
+
+                DASessionRemoveCallbacks( session );
+            }
+
+            DASessionSetState( session, kDASessionStateTimeout, FALSE );
+
+            DASessionSetState( session, kDASessionStateWakeup, FALSE );
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to copy callback queue (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopyCallbackRing( mach_port_t _session, mach_port_t * _ring )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            *_ring = DASessionCreateCallbackRing( session );
+
+            if ( *_ring )
+            {
+                DALogDebug( "  created callback ring." );
+
+                status = kDAReturnSuccess;
+            }
+            else
+            {
+                status = kDAReturnNoResources;
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to create callback ring (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopyDiskList( mach_port_t            _session,
+                                           vm_address_t           _match,
+                                           mach_msg_type_number_t _matchSize,
+                                           vm_address_t *         _disks,
+                                           mach_msg_type_number_t * _disksSize )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            CFMutableArrayRef disks;
+            CFDictionaryRef   match = NULL;
+
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            if ( _match )
+            {
+                match = _DAUnserializeDiskDescriptionWithBytes( kCFAllocatorDefault, _match, _matchSize );
+            }
+
+            /*
+             * Gather the serializations of the disks that have appeared, in the order in which they
+             * appeared, so that the whole set reaches the client in a single reply.  The deliveries
+             * are recorded, as the client keeps these descriptions as the base for later deltas.
+             */
+
+            disks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( disks )
+            {
+                CFIndex   count;
+                CFIndex   index;
+                CFDataRef list;
+
+                count = CFArrayGetCount( gDADiskList );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    DADiskRef disk;
+
+                    disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+
+                    if ( DADiskGetState( disk, kDADiskStateStagedAppear ) )
+                    {
+                        if ( match == NULL || DADiskMatch( disk, match ) )
+                        {
+                            CFDataRef serialization;
+
+                            serialization = DADiskCopySerialization( disk, session, FALSE );
+
+                            if ( serialization )
+                            {
+                                CFArrayAppendValue( disks, serialization );
+
+                                CFRelease( serialization );
+                            }
+                        }
+                    }
+                }
+
+                list = _DASerialize( kCFAllocatorDefault, disks );
+
+                if ( list )
+                {
+                    *_disks = ___CFDataCopyBytes( list, _disksSize );
+
+                    if ( *_disks )
+                    {
+                        DALogDebug( "  copied disk list, count = %d.", ( int ) CFArrayGetCount( disks ) );
+
+                        status = kDAReturnSuccess;
+                    }
+
+                    CFRelease( list );
+                }
+
+                CFRelease( disks );
+            }
+
+            if ( match )
+            {
+                CFRelease( match );
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to copy disk list (status code 0x%08X).", status );
+    }
+
+    return status;
+}
+
+kern_return_t _DAServerSessionCopyQueryPort( mach_port_t _session, mach_port_t * _query, audit_token_t _token )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            if ( __gDAServerQueryPort )
+            {
+                CFNumberRef key;
+                CFNumberRef pid;
+
+                /*
+                 * Permit the process behind the session to use the query port.
+                 */
+
+                key = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &_session );
+                pid = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &_token.val[5] );
+
+                if ( key && pid )
+                {
+                    pthread_mutex_lock( &__gDAServerQueryLock );
+
+                    if ( __gDAServerQueryList == NULL )
+                    {
+                        __gDAServerQueryList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                        assert( __gDAServerQueryList );
+
+                        __gDAServerQueryPIDList = CFBagCreateMutable( kCFAllocatorDefault, 0, &kCFTypeBagCallBacks );
+
+                        assert( __gDAServerQueryPIDList );
+                    }
+
+                    if ( CFDictionaryGetValue( __gDAServerQueryList, key ) == NULL )
+                    {
+                        CFDictionarySetValue( __gDAServerQueryList, key, pid );
+
+                        CFBagAddValue( __gDAServerQueryPIDList, pid );
+                    }
+
+                    pthread_mutex_unlock( &__gDAServerQueryLock );
+                }
+
+                if ( key )  CFRelease( key );
+                if ( pid )  CFRelease( pid );
+
+                *_query = __gDAServerQueryPort;
+
+                DALogDebug( "  copied query port." );
+
+                status = kDAReturnSuccess;
+            }
+            else
+            {
+                status = kDAReturnUnsupported;
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to copy query port (status code 0x%08X).", status );
     }
 
     return status;
 }
 
-kern_return_t _DAServerSessionCopyCallbackQueue( mach_port_t _session, vm_address_t * _queue, mach_msg_type_number_t * _queueSize )
+kern_return_t _DAServerSessionCopyStatistics( mach_port_t _session, vm_address_t * _statistics, mach_msg_type_number_t * _statisticsSize )
 {
     kern_return_t status;
 
@@ -1404,59 +2001,42 @@ kern_return_t _DAServerSessionCopyCallbackQueue( mach_port_t _session, vm_addres
 
         if ( session )
         {
-            CFMutableArrayRef callbacks;
-
-            DALogDebugHeader( "%s -> %@", gDAProcessNameID, session );
-
-            callbacks = DASessionGetCallbackQueue( session );
-
-            if ( callbacks )
-            {
-                CFIndex   count;
-                CFIndex   index;
-                CFDataRef queue;
-
-                count = CFArrayGetCount( callbacks );
+            CFDictionaryRef statistics;
 
-                for ( index = 0; index < count; index++ )
-                {
-                    DACallbackRef callback;
-
-                    callback = ( void * ) CFArrayGetValueAtIndex( callbacks, index );
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-                    DACallbackSetDisk( callback, NULL );
+            status = kDAReturnNoResources;
 
-                    DACallbackSetMatch( callback, NULL );
+            statistics = DAStatisticsCreate( );
 
-                    DACallbackSetSession( callback, NULL );
-                }
+            if ( statistics )
+            {
+                CFDataRef data;
 
-                queue = _DASerialize( kCFAllocatorDefault, callbacks );
+                data = _DASerialize( kCFAllocatorDefault, statistics );
 
-                if ( queue )
+                if ( data )
                 {
-                    *_queue = ___CFDataCopyBytes( queue, _queueSize );
+                    *_statistics = ___CFDataCopyBytes( data, _statisticsSize );
 
-                    if ( *_queue )
+                    if ( *_statistics )
                     {
-                        DALogDebug( "  dispatched callback queue." );
+                        DALogDebug( "  copied statistics." );
 
                         status = kDAReturnSuccess;
                     }
 
-                    CFRelease( queue );
+                    CFRelease( data );
                 }
 
-                CFArrayRemoveAllValues( callbacks );
+                CFRelease( statistics );
             }
-
-            DASessionSetState( session, kDASessionStateTimeout, FALSE );
         }
     }
 
     if ( status )
     {
-        DALogDebug( "unable to copy callback queue (status code 0x%08X).", status );
+        DALogDebug( "unable to copy statistics (status code 0x%08X).", status );
     }
 
     return status;
@@ -1549,7 +2129,7 @@ kern_return_t _DAServerSessionQueueRequest( mach_port_t            _session,
 
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
-            disk = __DADiskListGetDisk( _argument0 );
+            disk = DADiskListGetDisk( _argument0 );
 
             if ( disk )
             {
@@ -1693,6 +2273,12 @@ kern_return_t _DAServerSessionQueueResponse( mach_port_t            _session,
                 DALogDebug( "  dispatched response, id = %016llX:%016llX, kind = %s, disk = %s, orphaned.", _address, _context, _DACallbackKindGetName( _kind ), _disk );
             }
 
+            /*
+             * The client is responding again, even if too late for this response.
+             */
+
+            DASessionSetState( session, kDASessionStateTimeout, FALSE );
+
             if ( response )
             {
                 CFRelease( response );
@@ -1881,12 +2467,7 @@ kern_return_t _DAServerSessionRelease( mach_port_t _session )
                 CFArrayRemoveAllValues( callbacks );
             }
 
-            callbacks = DASessionGetCallbackRegister( session );
-
-            if ( callbacks )
-            {
-                CFArrayRemoveAllValues( callbacks );
-            }
+            DASessionUnregisterCallbacks( session );
 
             DAQueueReleaseSession( session );
 
@@ -1904,6 +2485,8 @@ kern_return_t _DAServerSessionRelease( mach_port_t _session )
 
             ___CFArrayRemoveValue( gDASessionList, session );
 
+            __DAServerQueryListRemoveSession( _session );
+
             ___vproc_transaction_end( );
 
             status = kDAReturnSuccess;
@@ -1960,6 +2543,11 @@ kern_return_t _DAServerSessionSetAuthorization( mach_port_t _session, Authorizat
 }
 
 kern_return_t _DAServerSessionSetClientPort( mach_port_t _session, mach_port_t _client )
+{
+    return _DAServerSessionSetClientPortWithOptions( _session, _client, _kDAClientPortOptionDefault );
+}
+
+kern_return_t _DAServerSessionSetClientPortWithOptions( mach_port_t _session, mach_port_t _client, int32_t _options )
 {
     kern_return_t status;
 
@@ -1977,6 +2565,10 @@ kern_return_t _DAServerSessionSetClientPort( mach_port_t _session, mach_port_t _
         {
             DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
 
+            DASessionSetOption( session, kDASessionOptionMessage, ( _options & _kDAClientPortOptionMessage ) ? TRUE : FALSE );
+
+            DASessionSetOption( session, kDASessionOptionLatency, ( _options & _kDAClientPortOptionLatency ) ? TRUE : FALSE );
+
             DASessionSetClientPort( session, _client );
 
             DALogDebug( "  set client port, id = %@.", session );
@@ -1993,6 +2585,48 @@ kern_return_t _DAServerSessionSetClientPort( mach_port_t _session, mach_port_t _
     return status;
 }
 
+kern_return_t _DAServerSessionSetResponseTimeout( mach_port_t _session, int32_t _timeout )
+{
+    kern_return_t status;
+
+    status = kDAReturnBadArgument;
+
+    DALogDebugHeader( "? [?]:%d -> %s", _session, gDAProcessNameID );
+
+    if ( _session )
+    {
+        DASessionRef session;
+
+        session = __DASessionListGetSession( _session );
+
+        if ( session )
+        {
+            DALogDebugHeader( "%@ -> %s", session, gDAProcessNameID );
+
+            if ( _timeout >= 0 )
+            {
+                /*
+                 * The session commits to respond within the specified time, in milliseconds.  A time
+                 * of 0 restores the default.
+                 */
+
+                DASessionSetResponseTimeout( session, _timeout / 1000.0 );
+
+                DALogDebug( "  set response timeout, id = %@, timeout = %d ms.", session, _timeout );
+
+                status = kDAReturnSuccess;
+            }
+        }
+    }
+
+    if ( status )
+    {
+        DALogDebug( "unable to set response timeout, id = ? [?]:%d.", _session );
+    }
+
+    return status;
+}
+
 kern_return_t _DAServerSessionUnregisterCallback( mach_port_t _session, mach_vm_offset_t _address, mach_vm_offset_t _context )
 {
     kern_return_t status;
@@ -2038,80 +2672,249 @@ kern_return_t _DAServerSessionUnregisterCallback( mach_port_t _session, mach_vm_
     return status;
 }
 
-void _DAVolumeMountedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
+void _DAServerSnapshotCallback( CFRunLoopObserverRef observer, CFRunLoopActivity activity, void * info )
 {
-    struct statfs * mountList;
-    int             mountListCount;
-    int             mountListIndex;
+    /*
+     * Publish the serializations of the disks whose descriptions have changed since, before we go
+     * to sleep.  A burst of changes to one disk is thus published once.
+     */
 
-    mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+    DADiskPublishSnapshots( );
+}
 
-    for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
+static CFNumberRef __DAVolumeListCreateKey( const struct statfs * fs )
+{
+    SInt64 fsid;
+
+    fsid = ( ( SInt64 ) ( UInt32 ) fs->f_fsid.val[0] << 32 ) | ( UInt32 ) fs->f_fsid.val[1];
+
+    return CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt64Type, &fsid );
+}
+
+static CFDataRef __DAVolumeListCreateValue( const struct statfs * fs )
+{
+    /*
+     * Create the snapshot of a mount, which is to say its volume ID followed by its mount point and
+     * its flags.  The volume ID comes first and is terminated, so that it may be read back as is.
+     */
+
+    CFMutableDataRef value;
+
+    value = CFDataCreateMutable( kCFAllocatorDefault, 0 );
+
+    if ( value )
     {
-        DADiskRef disk;
+        char * name;
 
-        disk = __DADiskListGetDisk( _DAVolumeGetID( mountList + mountListIndex ) );
+        name = _DAVolumeGetID( fs );
 
-        if ( disk )
+        CFDataAppendBytes( value, ( void * ) name,            strlen( name ) + 1 );
+        CFDataAppendBytes( value, ( void * ) fs->f_mntonname, strlen( fs->f_mntonname ) + 1 );
+        CFDataAppendBytes( value, ( void * ) &fs->f_flags,    sizeof( fs->f_flags ) );
+    }
+
+    return value;
+}
+
+static void __DAVolumeListMounted( struct statfs * fs )
+{
+    DADiskRef disk;
+
+    disk = DADiskListGetDisk( _DAVolumeGetID( fs ) );
+
+    if ( disk )
+    {
+        /*
+         * Forget that the volume is clean, should it be mounted writable behind our back.
+         */
+
+        if ( ( fs->f_flags & MNT_RDONLY ) == 0 )
+        {
+            DARepairListRemoveEntry( disk );
+        }
+
+        if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) == NULL )
         {
-            if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) == NULL )
-            {
 ///w:start
-                if ( DADiskGetDescription( disk, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanFalse )
-                {
-                    DADiskProbe( disk, NULL );
-                }
-///w:stop
-                DADiskRefresh( disk, NULL );
+            if ( DADiskGetDescription( disk, kDADiskDescriptionVolumeMountableKey ) == kCFBooleanFalse )
+            {
+                DADiskProbe( disk, NULL );
             }
+///w:stop
+            DADiskRefresh( disk, NULL );
         }
-        else
-        {
+    }
+    else
+    {
 ///w:start
-            if ( strncmp( mountList[mountListIndex].f_mntfromname, _PATH_DEV "disk", strlen( _PATH_DEV "disk" ) ) )
+        if ( strncmp( fs->f_mntfromname, _PATH_DEV "disk", strlen( _PATH_DEV "disk" ) ) )
 ///w:stop
-            if ( ( mountList[mountListIndex].f_flags & MNT_UNION ) == 0 )
+        if ( ( fs->f_flags & MNT_UNION ) == 0 )
+        {
+            if ( strcmp( fs->f_fstypename, "devfs" ) )
             {
-                if ( strcmp( mountList[mountListIndex].f_fstypename, "devfs" ) )
-                {
-                    disk = DADiskCreateFromVolumePath( kCFAllocatorDefault, mountList + mountListIndex );
+                disk = DADiskCreateFromVolumePath( kCFAllocatorDefault, fs );
 
-                    if ( disk )
-                    {
-                        DALogDebugHeader( "bsd [0] -> %s", gDAProcessNameID );
+                if ( disk )
+                {
+                    DALogDebugHeader( "bsd [0] -> %s", gDAProcessNameID );
 
-                        DALogDebug( "  created disk, id = %@.", disk );
+                    DALogDebug( "  created disk, id = %@.", disk );
 
-                        CFArrayInsertValueAtIndex( gDADiskList, 0, disk );
+                    DADiskListAddDisk( disk );
 
-                        DAStageSignal( );
+                    DAStageSignal( );
 
-                        CFRelease( disk );
-                    }
+                    CFRelease( disk );
                 }
             }
         }
     }
 }
 
-void _DAVolumeUnmountedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
+static void __DAVolumeListRefresh( void )
 {
-    CFIndex count;
-    CFIndex index;
+    /*
+     * Bring the mount table snapshot up to date.  Only the mounts that were added, removed or moved
+     * since the last snapshot are processed, along with those whose disk has yet to pick up its
+     * volume path.  Lacking a snapshot, every mount is considered added and every mounted disk is
+     * refreshed.
+     */
 
-    count = CFArrayGetCount( gDADiskList );
+    CFMutableDictionaryRef list;
+    struct statfs *        mountList;
+    int                    mountListCount;
+    int                    mountListIndex;
 
-    for ( index = 0; index < count; index++ )
+    list = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( list == NULL )
     {
-        DADiskRef disk;
+        return;
+    }
 
-        disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+    mountListCount = getmntinfo( &mountList, MNT_NOWAIT );
+
+    for ( mountListIndex = 0; mountListIndex < mountListCount; mountListIndex++ )
+    {
+        CFDataRef   id;
+        CFNumberRef key;
 
-        if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) )
+        id  = __DAVolumeListCreateValue( mountList + mountListIndex );
+        key = __DAVolumeListCreateKey( mountList + mountListIndex );
+
+        if ( id && key )
         {
-            DADiskRefresh( disk, NULL );
+            CFDataRef previous;
+
+            previous = __gDAVolumeList ? CFDictionaryGetValue( __gDAVolumeList, key ) : NULL;
+
+            if ( previous == NULL || CFEqual( previous, id ) == FALSE )
+            {
+                __DAVolumeListMounted( mountList + mountListIndex );
+            }
+            else
+            {
+                DADiskRef disk;
+
+                /*
+                 * Retry a disk that has yet to pick up its volume path, as each notification did
+                 * before.
+                 */
+
+                disk = DADiskListGetDisk( ( void * ) CFDataGetBytePtr( id ) );
+
+                if ( disk )
+                {
+                    if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) == NULL )
+                    {
+                        __DAVolumeListMounted( mountList + mountListIndex );
+                    }
+                }
+            }
+
+            CFDictionarySetValue( list, key, id );
+        }
+
+        if ( id  )  CFRelease( id  );
+        if ( key )  CFRelease( key );
+    }
+
+    if ( __gDAVolumeList )
+    {
+        CFIndex     count;
+        CFIndex     index;
+        CFTypeRef * keys;
+        CFTypeRef * values;
+
+        count = CFDictionaryGetCount( __gDAVolumeList );
+
+        keys   = malloc( count * sizeof( CFTypeRef ) );
+        values = malloc( count * sizeof( CFTypeRef ) );
+
+        if ( keys && values )
+        {
+            CFDictionaryGetKeysAndValues( __gDAVolumeList, keys, values );
+
+            for ( index = 0; index < count; index++ )
+            {
+                CFDataRef id;
+
+                id = CFDictionaryGetValue( list, keys[index] );
+
+                if ( id == NULL || CFEqual( id, values[index] ) == FALSE )
+                {
+                    DADiskRef disk;
+
+                    disk = DADiskListGetDisk( ( void * ) CFDataGetBytePtr( values[index] ) );
+
+                    if ( disk )
+                    {
+                        if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) )
+                        {
+                            DADiskRefresh( disk, NULL );
+                        }
+                    }
+                }
+            }
+        }
+
+        if ( keys   )  free( keys   );
+        if ( values )  free( values );
+
+        CFRelease( __gDAVolumeList );
+    }
+    else
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( gDADiskList );
+
+        for ( index = 0; index < count; index++ )
+        {
+            DADiskRef disk;
+
+            disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+
+            if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) )
+            {
+                DADiskRefresh( disk, NULL );
+            }
         }
     }
+
+    __gDAVolumeList = list;
+}
+
+void _DAVolumeMountedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
+{
+    __DAVolumeListRefresh( );
+}
+
+void _DAVolumeUnmountedCallback( CFMachPortRef port, void * parameter, CFIndex messageSize, void * info )
+{
+    __DAVolumeListRefresh( );
 }
 
 CFRunLoopSourceRef DAServerCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
@@ -2147,9 +2950,42 @@ CFRunLoopSourceRef DAServerCreateRunLoopSource( CFAllocatorRef allocator, CFInde
 
             if ( __gDAServer )
             {
+                kern_return_t status;
+
                 __gDAServerReply = malloc( DAServer_subsystem.maxsize );
 
                 assert( __gDAServerReply );
+
+                /*
+                 * Create the Disk Arbitration query port, which is served by a thread of its own.
+                 */
+
+                status = mach_port_allocate( mach_task_self( ), MACH_PORT_RIGHT_RECEIVE, &__gDAServerQueryPort );
+
+                if ( status == KERN_SUCCESS )
+                {
+                    pthread_attr_t attributes;
+                    pthread_t      thread;
+
+                    pthread_attr_init( &attributes );
+
+                    pthread_attr_setdetachstate( &attributes, PTHREAD_CREATE_DETACHED );
+
+                    status = pthread_create( &thread, &attributes, __DAServerQueryThread, NULL );
+
+                    pthread_attr_destroy( &attributes );
+
+                    if ( status )
+                    {
+                        mach_port_mod_refs( mach_task_self( ), __gDAServerQueryPort, MACH_PORT_RIGHT_RECEIVE, -1 );
+
+                        __gDAServerQueryPort = MACH_PORT_NULL;
+                    }
+                }
+                else
+                {
+                    __gDAServerQueryPort = MACH_PORT_NULL;
+                }
             }
         }
     }
@@ -36,6 +36,7 @@ extern void _DAConfigurationCallback( SCDynamicStoreRef store, CFArrayRef keys,
 extern void _DAMediaAppearedCallback( void * context, io_iterator_t notification );
 extern void _DAMediaDisappearedCallback( void * context, io_iterator_t notification );
 extern void _DAServerCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info );
+extern void _DAServerSnapshotCallback( CFRunLoopObserverRef observer, CFRunLoopActivity activity, void * info );
 extern void _DAVolumeMountedCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info );
 extern void _DAVolumeUnmountedCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info );
 
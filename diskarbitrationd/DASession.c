@@ -24,35 +24,80 @@
 #include "DASession.h"
 
 #include "DACallback.h"
+#include "DADisk.h"
+#include "DALog.h"
 #include "DAServer.h"
 
+#include <libkern/OSAtomic.h>
 #include <mach/mach.h>
+#include <mach/mach_time.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <CoreFoundation/CFRuntime.h>
 
+#define __kDASessionMessageLimit 4
+
+/*
+ * A session whose client falls behind is held to a bounded callback queue.  Past either limit, we
+ * drop description changes and count the drop, and queue an overflow marker on which the client
+ * forgets its copies of the descriptions, such that it fetches them anew.  An idle event replaces
+ * the one of its registration still queued, if any, as it is only the last that matters.  Events
+ * that await a response, or that answer a request of the client, are always queued, since the
+ * response timeout bounds them already.
+ */
+
+#define __kDASessionQueueLimit     2048
+#define __kDASessionQueueSizeLimit 0x00800000
+
 struct __DASession
 {
-    CFRuntimeBase      _base;
-
-    AuthorizationRef   _authorization;
-    mach_port_t        _client;
-    char *             _name;
-    pid_t              _pid;
-    DASessionOptions   _options;
-    CFMutableArrayRef  _queue;
-    CFMutableArrayRef  _register;
-    CFMachPortRef      _server;
-    CFRunLoopSourceRef _source;
-    DASessionState     _state;
+    CFRuntimeBase          _base;
+
+    AuthorizationRef       _authorization;
+    mach_port_t            _client;
+    CFMutableArrayRef      _matchAny[_kDACallbackKindCount];
+    CFMutableDictionaryRef _matchIndex[_kDACallbackKindCount];
+    char *                 _name;
+    pid_t                  _pid;
+    DASessionOptions       _options;
+    CFMutableArrayRef      _queue;
+    UInt32                 _queueDrops;
+    UInt64                 _queueLoad;
+    Boolean                _queueOverflow;
+    UInt64                 _queueSize;
+    CFAbsoluteTime         _queueUsage;
+    CFMutableArrayRef      _register;
+    CFMutableArrayRef      _registerList[_kDACallbackKindCount];
+    CFTimeInterval         _responseTimeout;
+    _DACallbackRing *      _ring;
+    UInt32                 _ringHead;
+    UInt32                 _ringTail;
+    CFMachPortRef          _server;
+    CFRunLoopSourceRef     _source;
+    DASessionState         _state;
+    CFMutableArrayRef      _watchAny;
+    CFMutableDictionaryRef _watchIndex;
 };
 
 typedef struct __DASession __DASession;
 
-static CFStringRef  __DASessionCopyDescription( CFTypeRef object );
-static CFStringRef  __DASessionCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
-static void         __DASessionDeallocate( CFTypeRef object );
-static Boolean      __DASessionEqual( CFTypeRef object1, CFTypeRef object2 );
-static CFHashCode   __DASessionHash( CFTypeRef object );
+static CFStringRef   __DASessionCopyDescription( CFTypeRef object );
+static CFStringRef   __DASessionCopyFormattingDescription( CFTypeRef object, CFDictionaryRef options );
+static CFArrayRef    __DASessionCopyMatchCandidates( DASessionRef session, _DACallbackKind kind, DADiskRef disk );
+static CFSetRef      __DASessionCopyWatchCandidates( DASessionRef session, CFArrayRef keys );
+static void          __DASessionDeallocate( CFTypeRef object );
+static Boolean       __DASessionEqual( CFTypeRef object1, CFTypeRef object2 );
+static CFHashCode    __DASessionHash( CFTypeRef object );
+static CFStringRef   __DASessionMatchGetKey( CFDictionaryRef match );
+static void          __DASessionMatchInsert( DASessionRef session, DACallbackRef callback );
+static void          __DASessionMatchRemove( DASessionRef session, DACallbackRef callback );
+static void          __DASessionPeekInsert( DACallbackRef callback );
+static Boolean       __DASessionQueueAdmit( DASessionRef session, DACallbackRef callback );
+static Boolean       __DASessionQueueCoalesce( DASessionRef session, DACallbackRef callback );
+static UInt64        __DASessionQueueGetLoad( DACallbackRef callback );
+static Boolean       __DASessionQueueRing( DASessionRef session, DACallbackRef callback, Boolean * wake );
+static kern_return_t __DASessionSendQueue( DASessionRef session );
+static void          __DASessionWatchInsert( DASessionRef session, DACallbackRef callback );
+static void          __DASessionWatchRemove( DASessionRef session, DACallbackRef callback );
 
 static const CFRuntimeClass __DASessionClass =
 {
@@ -69,6 +114,15 @@ static const CFRuntimeClass __DASessionClass =
 
 static CFTypeID __kDASessionTypeID = _kCFRuntimeNotATypeID;
 
+static CFIndex __gDASessionCallbackCount[_kDACallbackKindCount];
+
+/*
+ * The peek register holds the peek callback registrations of every session, kept in peek order
+ * as they come and go, so that no peek needs to gather and sort them.
+ */
+
+static CFMutableArrayRef __gDASessionPeekRegister = NULL;
+
 static CFStringRef __DASessionCopyDescription( CFTypeRef object )
 {
     DASessionRef session = ( DASessionRef ) object;
@@ -95,6 +149,193 @@ static CFStringRef __DASessionCopyFormattingDescription( CFTypeRef object, CFDic
                                      CFMachPortGetPort( session->_server ) );
 }
 
+static CFArrayRef __DASessionCopyMatchCandidates( DASessionRef session, _DACallbackKind kind, DADiskRef disk )
+{
+    /*
+     * Copy the callback registrations of the specified kind that might match the specified disk,
+     * in the order in which they were registered.  A registration indexed under a description
+     * key is a candidate only if the disk has the value it looks for, so that most registrations
+     * are never evaluated.
+     */
+
+    CFArrayRef        candidates = NULL;
+    CFMutableArrayRef lists;
+
+    if ( kind >= _kDACallbackKindCount || session->_registerList[kind] == NULL )
+    {
+        return CFArrayCreate( kCFAllocatorDefault, NULL, 0, &kCFTypeArrayCallBacks );
+    }
+
+    if ( disk == NULL || CFDictionaryGetCount( session->_matchIndex[kind] ) == 0 )
+    {
+        return CFArrayCreateCopy( kCFAllocatorDefault, session->_registerList[kind] );
+    }
+
+    lists = CFArrayCreateMutable( kCFAllocatorDefault, 0, NULL );
+
+    if ( lists )
+    {
+        CFIndex       count;
+        const void ** keys;
+        const void ** values;
+
+        if ( CFArrayGetCount( session->_matchAny[kind] ) )
+        {
+            CFArrayAppendValue( lists, session->_matchAny[kind] );
+        }
+
+        count = CFDictionaryGetCount( session->_matchIndex[kind] );
+
+        keys   = malloc( count * sizeof( const void * ) );
+        values = malloc( count * sizeof( const void * ) );
+
+        if ( keys && values )
+        {
+            CFIndex index;
+
+            CFDictionaryGetKeysAndValues( session->_matchIndex[kind], keys, values );
+
+            for ( index = 0; index < count; index++ )
+            {
+                CFTypeRef value;
+
+                value = DADiskGetDescription( disk, keys[index] );
+
+                if ( value )
+                {
+                    CFArrayRef callbacks;
+
+                    callbacks = CFDictionaryGetValue( values[index], value );
+
+                    if ( callbacks )
+                    {
+                        CFArrayAppendValue( lists, callbacks );
+                    }
+                }
+            }
+
+            count = CFArrayGetCount( lists );
+
+            if ( count == 0 )
+            {
+                candidates = CFArrayCreate( kCFAllocatorDefault, NULL, 0, &kCFTypeArrayCallBacks );
+            }
+            else if ( count == 1 )
+            {
+                candidates = CFArrayCreateCopy( kCFAllocatorDefault, CFArrayGetValueAtIndex( lists, 0 ) );
+            }
+            else
+            {
+                CFMutableSetRef members;
+
+                /*
+                 * Restore the registration order across the candidate lists.
+                 */
+
+                members = CFSetCreateMutable( kCFAllocatorDefault, 0, NULL );
+
+                if ( members )
+                {
+                    CFMutableArrayRef callbacks;
+
+                    for ( index = 0; index < count; index++ )
+                    {
+                        CFArrayRef list;
+                        CFIndex    listCount;
+                        CFIndex    listIndex;
+
+                        list      = CFArrayGetValueAtIndex( lists, index );
+                        listCount = CFArrayGetCount( list );
+
+                        for ( listIndex = 0; listIndex < listCount; listIndex++ )
+                        {
+                            CFSetAddValue( members, CFArrayGetValueAtIndex( list, listIndex ) );
+                        }
+                    }
+
+                    callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                    if ( callbacks )
+                    {
+                        count = CFArrayGetCount( session->_registerList[kind] );
+
+                        for ( index = 0; index < count; index++ )
+                        {
+                            DACallbackRef callback;
+
+                            callback = ( void * ) CFArrayGetValueAtIndex( session->_registerList[kind], index );
+
+                            if ( CFSetContainsValue( members, callback ) )
+                            {
+                                CFArrayAppendValue( callbacks, callback );
+                            }
+                        }
+
+                        candidates = callbacks;
+                    }
+
+                    CFRelease( members );
+                }
+            }
+        }
+
+        if ( keys   )  free( keys );
+        if ( values )  free( values );
+
+        CFRelease( lists );
+    }
+
+    return candidates;
+}
+
+static CFSetRef __DASessionCopyWatchCandidates( DASessionRef session, CFArrayRef keys )
+{
+    /*
+     * Copy the description changed callback registrations that watch any of the specified keys.
+     */
+
+    CFMutableSetRef candidates;
+
+    candidates = CFSetCreateMutable( kCFAllocatorDefault, 0, NULL );
+
+    if ( candidates )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( session->_watchAny );
+
+        for ( index = 0; index < count; index++ )
+        {
+            CFSetAddValue( candidates, CFArrayGetValueAtIndex( session->_watchAny, index ) );
+        }
+
+        count = CFArrayGetCount( keys );
+
+        for ( index = 0; index < count; index++ )
+        {
+            CFArrayRef callbacks;
+
+            callbacks = CFDictionaryGetValue( session->_watchIndex, CFArrayGetValueAtIndex( keys, index ) );
+
+            if ( callbacks )
+            {
+                CFIndex callbacksCount;
+                CFIndex callbacksIndex;
+
+                callbacksCount = CFArrayGetCount( callbacks );
+
+                for ( callbacksIndex = 0; callbacksIndex < callbacksCount; callbacksIndex++ )
+                {
+                    CFSetAddValue( candidates, CFArrayGetValueAtIndex( callbacks, callbacksIndex ) );
+                }
+            }
+        }
+    }
+
+    return candidates;
+}
+
 static DASessionRef __DASessionCreate( CFAllocatorRef allocator )
 {
     __DASession * session;
@@ -103,19 +344,36 @@ static DASessionRef __DASessionCreate( CFAllocatorRef allocator )
 
     if ( session )
     {
-        session->_authorization = NULL;
-        session->_client        = MACH_PORT_NULL;
-        session->_name          = NULL;
-        session->_pid           = 0;
-        session->_options       = 0;
-        session->_queue         = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
-        session->_register      = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
-        session->_server        = NULL;
-        session->_source        = NULL;
-        session->_state         = 0;
-
-        assert( session->_queue    );
-        assert( session->_register );
+        session->_authorization   = NULL;
+        session->_client          = MACH_PORT_NULL;
+        session->_name            = NULL;
+        session->_pid             = 0;
+        session->_options         = 0;
+        session->_queue           = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
+        session->_queueDrops      = 0;
+        session->_queueLoad       = 0;
+        session->_queueOverflow   = FALSE;
+        session->_queueSize       = 0;
+        session->_queueUsage      = 0;
+        session->_register        = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
+        session->_responseTimeout = 0;
+        session->_ring            = NULL;
+        session->_ringHead        = 0;
+        session->_ringTail        = 0;
+        session->_server          = NULL;
+        session->_source          = NULL;
+        session->_state           = 0;
+        session->_watchAny        = CFArrayCreateMutable( allocator, 0, &kCFTypeArrayCallBacks );
+        session->_watchIndex      = CFDictionaryCreateMutable( allocator, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        bzero( session->_matchAny,     sizeof( session->_matchAny     ) );
+        bzero( session->_matchIndex,   sizeof( session->_matchIndex   ) );
+        bzero( session->_registerList, sizeof( session->_registerList ) );
+
+        assert( session->_queue      );
+        assert( session->_register   );
+        assert( session->_watchAny   );
+        assert( session->_watchIndex );
     }
 
     return session;
@@ -125,11 +383,16 @@ static void __DASessionDeallocate( CFTypeRef object )
 {
     DASessionRef session = ( DASessionRef ) object;
 
+    DASessionUnregisterCallbacks( session );
+
     if ( session->_authorization )  AuthorizationFree( session->_authorization, kAuthorizationFlagDefaults );
     if ( session->_client        )  mach_port_deallocate( mach_task_self( ), session->_client );
     if ( session->_name          )  free( session->_name );
     if ( session->_queue         )  CFRelease( session->_queue );
     if ( session->_register      )  CFRelease( session->_register );
+    if ( session->_watchAny      )  CFRelease( session->_watchAny );
+    if ( session->_watchIndex    )  CFRelease( session->_watchIndex );
+    if ( session->_ring          )  vm_deallocate( mach_task_self( ), ( vm_address_t ) session->_ring, round_page( sizeof( _DACallbackRing ) ) );
 
     if ( session->_source )
     {
@@ -167,101 +430,967 @@ static CFHashCode __DASessionHash( CFTypeRef object )
     return ( CFHashCode ) CFMachPortGetPort( session->_server );
 }
 
-///w:start
-const char * _DASessionGetName( DASessionRef session )
+static CFStringRef __DASessionMatchGetKey( CFDictionaryRef match )
 {
-    return session->_name;
+    /*
+     * Select the key under which a match dictionary is indexed.  Any key will do but the media
+     * match, which is no description key, though we prefer one whose value is not a boolean, as
+     * a boolean is shared by a great many disks.
+     */
+
+    CFStringRef key = NULL;
+
+    if ( match )
+    {
+        CFIndex count;
+
+        count = CFDictionaryGetCount( match );
+
+        if ( count )
+        {
+            const void ** keys;
+            const void ** values;
+
+            keys   = malloc( count * sizeof( const void * ) );
+            values = malloc( count * sizeof( const void * ) );
+
+            if ( keys && values )
+            {
+                CFIndex index;
+
+                CFDictionaryGetKeysAndValues( match, keys, values );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    if ( CFEqual( keys[index], kDADiskDescriptionMediaMatchKey ) == FALSE )
+                    {
+                        if ( key == NULL || CFGetTypeID( values[index] ) != CFBooleanGetTypeID( ) )
+                        {
+                            key = keys[index];
+                        }
+
+                        if ( CFGetTypeID( values[index] ) != CFBooleanGetTypeID( ) )
+                        {
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if ( keys   )  free( keys );
+            if ( values )  free( values );
+        }
+    }
+
+    return key;
 }
-///w:stop
-DASessionRef DASessionCreate( CFAllocatorRef allocator, const char * _name, pid_t _pid )
-{
-    DASessionRef session;
 
+static void __DASessionMatchInsert( DASessionRef session, DACallbackRef callback )
+{
     /*
-     * Create the session.
+     * File the callback registration under its kind, and index it by the value of one key of its
+     * match dictionary.  It need not be evaluated against a disk that lacks that value.
      */
 
-    session = __DASessionCreate( allocator );
+    CFDictionaryRef match;
+    CFStringRef     key;
+    _DACallbackKind kind;
 
-    if ( session )
+    kind = DACallbackGetKind( callback );
+
+    if ( kind >= _kDACallbackKindCount )
     {
-        mach_port_t   serverPort;
-        kern_return_t status;
+        return;
+    }
 
-        status = mach_port_allocate( mach_task_self( ), MACH_PORT_RIGHT_RECEIVE, &serverPort );
+    if ( session->_registerList[kind] == NULL )
+    {
+        session->_matchAny[kind]     = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+        session->_matchIndex[kind]   = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+        session->_registerList[kind] = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
-        if ( status == KERN_SUCCESS )
+        assert( session->_matchAny[kind]     );
+        assert( session->_matchIndex[kind]   );
+        assert( session->_registerList[kind] );
+    }
+
+    CFArrayAppendValue( session->_registerList[kind], callback );
+
+    __gDASessionCallbackCount[kind]++;
+
+    if ( kind == _kDADiskDescriptionChangedCallback )
+    {
+        __DASessionWatchInsert( session, callback );
+    }
+
+    if ( kind == _kDADiskPeekCallback )
+    {
+        __DASessionPeekInsert( callback );
+    }
+
+    match = DACallbackGetMatch( callback );
+
+    key = __DASessionMatchGetKey( match );
+
+    if ( key )
+    {
+        CFMutableDictionaryRef values;
+
+        values = ( void * ) CFDictionaryGetValue( session->_matchIndex[kind], key );
+
+        if ( values == NULL )
         {
-            CFMachPortRef     server;
-            CFMachPortContext serverContext;
+            values = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
-            serverContext.version         = 0;
-            serverContext.info            = session;
-            serverContext.retain          = NULL;
-            serverContext.release         = NULL;
-            serverContext.copyDescription = NULL;
+            if ( values )
+            {
+                CFDictionarySetValue( session->_matchIndex[kind], key, values );
 
-            /*
-             * Create the session's server port.
-             */
+                CFRelease( values );
+            }
+        }
 
-            server = CFMachPortCreateWithPort( allocator, serverPort, _DAServerCallback, &serverContext, NULL );
+        if ( values )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         value;
 
-            if ( server )
+            value = CFDictionaryGetValue( match, key );
+
+            callbacks = ( void * ) CFDictionaryGetValue( values, value );
+
+            if ( callbacks == NULL )
             {
-                CFRunLoopSourceRef source;
+                callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
-                /*
-                 * Create the session's server port run loop source.
-                 */
+                if ( callbacks )
+                {
+                    CFDictionarySetValue( values, value, callbacks );
 
-                source = CFMachPortCreateRunLoopSource( allocator, server, 0 );
+                    CFRelease( callbacks );
+                }
+            }
 
-                if ( source )
+            if ( callbacks )
+            {
+                CFArrayAppendValue( callbacks, callback );
+            }
+        }
+    }
+    else
+    {
+        CFArrayAppendValue( session->_matchAny[kind], callback );
+    }
+}
+
+static void __DASessionMatchRemove( DASessionRef session, DACallbackRef callback )
+{
+    CFDictionaryRef match;
+    CFStringRef     key;
+    _DACallbackKind kind;
+
+    kind = DACallbackGetKind( callback );
+
+    if ( kind >= _kDACallbackKindCount || session->_registerList[kind] == NULL )
+    {
+        return;
+    }
+
+    if ( ___CFArrayContainsValue( session->_registerList[kind], callback ) == FALSE )
+    {
+        return;
+    }
+
+    ___CFArrayRemoveValue( session->_registerList[kind], callback );
+
+    __gDASessionCallbackCount[kind]--;
+
+    if ( kind == _kDADiskDescriptionChangedCallback )
+    {
+        __DASessionWatchRemove( session, callback );
+    }
+
+    if ( kind == _kDADiskPeekCallback )
+    {
+        ___CFArrayRemoveValue( __gDASessionPeekRegister, callback );
+    }
+
+    match = DACallbackGetMatch( callback );
+
+    key = __DASessionMatchGetKey( match );
+
+    if ( key )
+    {
+        CFMutableDictionaryRef values;
+
+        values = ( void * ) CFDictionaryGetValue( session->_matchIndex[kind], key );
+
+        if ( values )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         value;
+
+            value = CFDictionaryGetValue( match, key );
+
+            callbacks = ( void * ) CFDictionaryGetValue( values, value );
+
+            if ( callbacks )
+            {
+                ___CFArrayRemoveValue( callbacks, callback );
+
+                if ( CFArrayGetCount( callbacks ) == 0 )
                 {
-                    mach_port_t port;
+                    CFDictionaryRemoveValue( values, value );
+                }
+            }
 
-                    /*
-                     * Set up the session's server port.
-                     */
+            if ( CFDictionaryGetCount( values ) == 0 )
+            {
+                CFDictionaryRemoveValue( session->_matchIndex[kind], key );
+            }
+        }
+    }
+    else
+    {
+        ___CFArrayRemoveValue( session->_matchAny[kind], callback );
+    }
+}
 
-                    status = mach_port_request_notification( mach_task_self( ),
-                                                             CFMachPortGetPort( server ),
-                                                             MACH_NOTIFY_NO_SENDERS,
-                                                             1,
-                                                             CFMachPortGetPort( server ),
-                                                             MACH_MSG_TYPE_MAKE_SEND_ONCE,
-                                                             &port );
+static void __DASessionPeekInsert( DACallbackRef callback )
+{
+    /*
+     * Insert the peek callback registration after those of lower or equal order.
+     */
 
-                    if ( status == KERN_SUCCESS )
-                    {
-                        assert( port == MACH_PORT_NULL );
+    CFIndex index;
+    SInt32  order;
 
-                        session->_name   = strdup( _name );
-                        session->_pid    = _pid;
-                        session->_server = server;
-                        session->_source = source;
+    if ( __gDASessionPeekRegister == NULL )
+    {
+        __gDASessionPeekRegister = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        assert( __gDASessionPeekRegister );
+    }
+
+    order = DACallbackGetOrder( callback );
+
+    for ( index = CFArrayGetCount( __gDASessionPeekRegister ); index > 0; index-- )
+    {
+        if ( DACallbackGetOrder( ( void * ) CFArrayGetValueAtIndex( __gDASessionPeekRegister, index - 1 ) ) <= order )
+        {
+            break;
+        }
+    }
+
+    CFArrayInsertValueAtIndex( __gDASessionPeekRegister, index, callback );
+}
+
+static Boolean __DASessionQueueAdmit( DASessionRef session, DACallbackRef callback )
+{
+    /*
+     * Determine whether the callback fits in the callback queue.  The load is kept as a running
+     * sum that overstates the queue for as long as events are removed from it out of turn, so we
+     * take the true measure before we hold a client to its limit.
+     */
+
+    CFIndex count;
+    UInt64  load;
+
+    count = CFArrayGetCount( session->_queue );
+
+    load = __DASessionQueueGetLoad( callback );
+
+    if ( count == 0 )
+    {
+        session->_queueLoad     = 0;
+        session->_queueOverflow = FALSE;
+    }
+
+    if ( count >= __kDASessionQueueLimit || session->_queueLoad + load > __kDASessionQueueSizeLimit )
+    {
+        CFIndex index;
+
+        session->_queueLoad = 0;
+
+        for ( index = 0; index < count; index++ )
+        {
+            session->_queueLoad += __DASessionQueueGetLoad( ( void * ) CFArrayGetValueAtIndex( session->_queue, index ) );
+        }
+
+        if ( count >= __kDASessionQueueLimit || session->_queueLoad + load > __kDASessionQueueSizeLimit )
+        {
+            switch ( DACallbackGetKind( callback ) )
+            {
+                case _kDADiskDescriptionChangedCallback:
+                {
+                    if ( session->_queueDrops == 0 )
+                    {
+                        DALogError( "%@ is not draining its callback queue, events are being dropped.", session );
+                    }
+
+                    session->_queueDrops++;
+
+                    /*
+                     * The marker is queued once until the queue is fetched, as it lies behind
+                     * every drop made in the meantime all the same.
+                     */
+
+                    if ( session->_queueOverflow == FALSE )
+                    {
+                        DACallbackRef marker;
+
+                        marker = DACallbackCreate( kCFAllocatorDefault, session, 0, 0, _kDAQueueOverflowCallback, 0, NULL, NULL );
+
+                        if ( marker )
+                        {
+                            CFArrayAppendValue( session->_queue, marker );
+
+                            session->_queueLoad    += __DASessionQueueGetLoad( marker );
+                            session->_queueOverflow = TRUE;
+
+                            CFRelease( marker );
+                        }
+                    }
+
+                    return FALSE;
+                }
+                case _kDAIdleCallback:
+                {
+                    for ( index = count - 1; index > -1; index-- )
+                    {
+                        DACallbackRef item;
+
+                        item = ( void * ) CFArrayGetValueAtIndex( session->_queue, index );
+
+                        if ( DACallbackGetKind( item ) == _kDAIdleCallback )
+                        {
+                            if ( DACallbackGetAddress( item ) == DACallbackGetAddress( callback ) )
+                            {
+                                if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
+                                {
+                                    session->_queueLoad -= __DASessionQueueGetLoad( item );
+
+                                    CFArrayRemoveValueAtIndex( session->_queue, index );
+
+                                    break;
+                                }
+                            }
+                        }
+                    }
+
+                    break;
+                }
+                default:
+                {
+                    break;
+                }
+            }
+        }
+    }
+
+    session->_queueLoad += load;
+
+    return TRUE;
+}
+
+static Boolean __DASessionQueueCoalesce( DASessionRef session, DACallbackRef callback )
+{
+    /*
+     * Merge a description changed event into one still queued for the same registration and the
+     * same disk, provided that no other kind of event for that disk was queued in between.  The
+     * merged event carries the union of the changed keys and the description in full, since the
+     * delta it was queued with presumes the client saw the event merged into.
+     */
+
+    CFIndex   count;
+    DADiskRef disk;
+    CFIndex   index;
+
+    disk = DACallbackGetDisk( callback );
+
+    if ( disk )
+    {
+        count = CFArrayGetCount( session->_queue );
+
+        for ( index = count - 1; index > -1; index-- )
+        {
+            DACallbackRef item;
+
+            item = ( void * ) CFArrayGetValueAtIndex( session->_queue, index );
+
+            if ( DACallbackGetDisk( item ) == disk )
+            {
+                if ( DACallbackGetKind( item ) != _kDADiskDescriptionChangedCallback )
+                {
+                    break;
+                }
+
+                if ( DACallbackGetAddress( item ) == DACallbackGetAddress( callback ) )
+                {
+                    if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
+                    {
+                        CFMutableArrayRef keys;
+
+                        keys = CFArrayCreateMutableCopy( kCFAllocatorDefault, 0, DACallbackGetArgument1( item ) );
+
+                        if ( keys )
+                        {
+                            CFArrayRef argument1;
+                            CFIndex    subcount;
+                            CFIndex    subindex;
+
+                            argument1 = DACallbackGetArgument1( callback );
+
+                            subcount = CFArrayGetCount( argument1 );
+
+                            for ( subindex = 0; subindex < subcount; subindex++ )
+                            {
+                                CFTypeRef key;
+
+                                key = CFArrayGetValueAtIndex( argument1, subindex );
+
+                                if ( ___CFArrayContainsValue( keys, key ) == FALSE )
+                                {
+                                    CFArrayAppendValue( keys, key );
+                                }
+                            }
+
+                            DACallbackSetArgument0( item, DADiskGetSerialization( disk ) );
+
+                            DACallbackSetArgument1( item, keys );
+
+                            CFRelease( keys );
+
+                            return TRUE;
+                        }
+
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static UInt64 __DASessionQueueGetLoad( DACallbackRef callback )
+{
+    /*
+     * Estimate the size of the callback when serialized, which its disk serialization dominates.
+     */
+
+    CFTypeRef argument0;
+    UInt64    load = 128;
+
+    argument0 = DACallbackGetArgument0( callback );
+
+    if ( argument0 )
+    {
+        if ( CFGetTypeID( argument0 ) == CFDataGetTypeID( ) )
+        {
+            load += CFDataGetLength( argument0 );
+        }
+    }
+
+    return load;
+}
+
+static Boolean __DASessionQueueRing( DASessionRef session, DACallbackRef callback, Boolean * wake )
+{
+    /*
+     * Write the callback into the callback ring shared with the client, so that the client need
+     * not fetch it with a request of its own.  We keep to the callback queue once anything waits
+     * in it, since the client drains the ring before it fetches the queue.  We use the ring only
+     * once the client has mapped it, and since the client may write to any of it, we trust none
+     * of it but for a tail that is within bounds.
+     */
+
+    Boolean written = FALSE;
+
+    if ( session->_ring && session->_ring->_mapped )
+    {
+        if ( CFArrayGetCount( session->_queue ) == 0 )
+        {
+            DACallbackRef event;
+
+            session->_ring->_queued = FALSE;
+
+            event = DACallbackCreateEvent( kCFAllocatorDefault, callback, DACallbackGetArgument0( callback ), DACallbackGetArgument1( callback ) );
+
+            if ( event )
+            {
+                CFDataRef      data;
+                CFAbsoluteTime time;
+
+                time = CFAbsoluteTimeGetCurrent( );
+
+                data = _DASerialize( kCFAllocatorDefault, event );
+
+                session->_queueUsage += CFAbsoluteTimeGetCurrent( ) - time;
+
+                if ( data )
+                {
+                    UInt32 head;
+                    UInt32 length;
+                    UInt32 size;
+                    UInt32 tail;
+
+                    head   = session->_ringHead;
+                    length = CFDataGetLength( data );
+                    size   = ( sizeof( length ) + length + 3 ) & ~3;
+                    tail   = session->_ring->_tail;
+
+                    if ( head - tail <= _kDACallbackRingSize )
+                    {
+                        if ( size <= _kDACallbackRingSize - ( head - tail ) )
+                        {
+                            _DACallbackRingWrite( session->_ring, head, &length, sizeof( length ) );
+
+                            _DACallbackRingWrite( session->_ring, head + sizeof( length ), CFDataGetBytePtr( data ), length );
+
+                            OSMemoryBarrier( );
+
+                            session->_ringHead = head + size;
+
+                            session->_queueSize += length;
+
+                            session->_ring->_head = session->_ringHead;
+
+                            OSMemoryBarrier( );
+
+                            /*
+                             * Wake the client only if it had drained the ring, as otherwise it
+                             * looks at the head again before it goes back to sleep.
+                             */
+
+                            *wake = ( session->_ring->_tail == head ) ? TRUE : FALSE;
+
+                            written = TRUE;
+                        }
+                    }
+
+                    CFRelease( data );
+                }
+
+                CFRelease( event );
+            }
+        }
+    }
+
+    return written;
+}
+
+static kern_return_t __DASessionSendQueue( DASessionRef session )
+{
+    /*
+     * Send the callback queue to the client within the wakeup message itself, so that the client
+     * need not fetch it with a request of its own.  The queue is sent in its lean form, as though
+     * it were fetched, and is emptied once the message is sent.
+     */
+
+    CFMutableArrayRef events;
+    kern_return_t     status;
+
+    status = KERN_FAILURE;
+
+    events = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+    if ( events )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( session->_queue );
+
+        for ( index = 0; index < count; index++ )
+        {
+            DACallbackRef callback;
+            DACallbackRef event;
+
+            callback = ( void * ) CFArrayGetValueAtIndex( session->_queue, index );
+
+            event = DACallbackCreateEvent( kCFAllocatorDefault, callback, DACallbackGetArgument0( callback ), DACallbackGetArgument1( callback ) );
+
+            if ( event )
+            {
+                CFArrayAppendValue( events, event );
+
+                CFRelease( event );
+            }
+        }
+
+        if ( CFArrayGetCount( events ) == count )
+        {
+            CFDataRef      data;
+            CFAbsoluteTime time;
+
+            time = CFAbsoluteTimeGetCurrent( );
+
+            data = _DASerialize( kCFAllocatorDefault, events );
+
+            session->_queueUsage += CFAbsoluteTimeGetCurrent( ) - time;
+
+            if ( data )
+            {
+                _DAClientMessage message;
+
+                message._header.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 ) | MACH_MSGH_BITS_COMPLEX;
+                message._header.msgh_id          = _kDAClientMessageQueue;
+                message._header.msgh_local_port  = MACH_PORT_NULL;
+                message._header.msgh_remote_port = session->_client;
+                message._header.msgh_reserved    = 0;
+                message._header.msgh_size        = sizeof( message );
+
+                message._body.msgh_descriptor_count = 1;
+
+                message._queue.address    = ( void * ) CFDataGetBytePtr( data );
+                message._queue.copy       = MACH_MSG_VIRTUAL_COPY;
+                message._queue.deallocate = FALSE;
+                message._queue.size       = CFDataGetLength( data );
+                message._queue.type       = MACH_MSG_OOL_DESCRIPTOR;
+
+                status = mach_msg( &message._header, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message._header.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+
+                if ( status == MACH_MSG_SUCCESS )
+                {
+                    CFArrayRemoveAllValues( session->_queue );
+
+                    session->_queueSize += CFDataGetLength( data );
+
+                    /*
+                     * The client took the message, as a fetch of the queue would have shown.
+                     */
+
+                    session->_state &= ~kDASessionStateTimeout;
+                }
+
+                if ( status == MACH_SEND_TIMED_OUT )
+                {
+                    mach_msg_destroy( &message._header );
+                }
+
+                CFRelease( data );
+            }
+        }
+
+        CFRelease( events );
+    }
+
+    return status;
+}
+
+static void __DASessionWatchInsert( DASessionRef session, DACallbackRef callback )
+{
+    /*
+     * Index the description changed callback registration by each key it watches.
+     */
+
+    CFArrayRef watch;
+
+    watch = DACallbackGetWatch( callback );
+
+    if ( watch )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( watch );
+
+        for ( index = 0; index < count; index++ )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         key;
+
+            key = CFArrayGetValueAtIndex( watch, index );
+
+            callbacks = ( void * ) CFDictionaryGetValue( session->_watchIndex, key );
+
+            if ( callbacks == NULL )
+            {
+                callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                if ( callbacks )
+                {
+                    CFDictionarySetValue( session->_watchIndex, key, callbacks );
+
+                    CFRelease( callbacks );
+                }
+            }
+
+            if ( callbacks )
+            {
+                CFArrayAppendValue( callbacks, callback );
+            }
+        }
+    }
+    else
+    {
+        CFArrayAppendValue( session->_watchAny, callback );
+    }
+}
+
+static void __DASessionWatchRemove( DASessionRef session, DACallbackRef callback )
+{
+    CFArrayRef watch;
+
+    watch = DACallbackGetWatch( callback );
+
+    if ( watch )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( watch );
+
+        for ( index = 0; index < count; index++ )
+        {
+            CFMutableArrayRef callbacks;
+            CFTypeRef         key;
+
+            key = CFArrayGetValueAtIndex( watch, index );
+
+            callbacks = ( void * ) CFDictionaryGetValue( session->_watchIndex, key );
+
+            if ( callbacks )
+            {
+                ___CFArrayRemoveValue( callbacks, callback );
+
+                if ( CFArrayGetCount( callbacks ) == 0 )
+                {
+                    CFDictionaryRemoveValue( session->_watchIndex, key );
+                }
+            }
+        }
+    }
+    else
+    {
+        ___CFArrayRemoveValue( session->_watchAny, callback );
+    }
+}
+
+///w:start
+const char * _DASessionGetName( DASessionRef session )
+{
+    return session->_name;
+}
+///w:stop
+CFArrayRef DASessionCopyCallbackRegister( DASessionRef session, _DACallbackKind kind, DADiskRef disk, CFArrayRef keys )
+{
+    /*
+     * Copy the callback registrations of the specified kind that might match the specified disk.
+     * A description changed registration is a candidate only if it watches one of the changed
+     * keys, which we settle before any registration is matched against the disk.
+     */
+
+    CFArrayRef candidates;
+    CFSetRef   watchers = NULL;
+
+    if ( keys && kind == _kDADiskDescriptionChangedCallback )
+    {
+        if ( session->_registerList[kind] )
+        {
+            if ( CFArrayGetCount( session->_watchAny ) < CFArrayGetCount( session->_registerList[kind] ) )
+            {
+                watchers = __DASessionCopyWatchCandidates( session, keys );
+
+                if ( watchers && CFSetGetCount( watchers ) == 0 )
+                {
+                    CFRelease( watchers );
+
+                    return CFArrayCreate( kCFAllocatorDefault, NULL, 0, &kCFTypeArrayCallBacks );
+                }
+            }
+        }
+    }
+
+    candidates = __DASessionCopyMatchCandidates( session, kind, disk );
+
+    if ( watchers )
+    {
+        if ( candidates )
+        {
+            CFMutableArrayRef callbacks;
+
+            callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( callbacks )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = CFArrayGetCount( candidates );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    DACallbackRef callback;
+
+                    callback = ( void * ) CFArrayGetValueAtIndex( candidates, index );
+
+                    if ( CFSetContainsValue( watchers, callback ) )
+                    {
+                        CFArrayAppendValue( callbacks, callback );
+                    }
+                }
+
+                CFRelease( candidates );
+
+                candidates = callbacks;
+            }
+        }
+
+        CFRelease( watchers );
+    }
+
+    return candidates;
+}
+
+DASessionRef DASessionCreate( CFAllocatorRef allocator, const char * _name, pid_t _pid )
+{
+    DASessionRef session;
+
+    /*
+     * Create the session.
+     */
+
+    session = __DASessionCreate( allocator );
+
+    if ( session )
+    {
+        mach_port_t   serverPort;
+        kern_return_t status;
+
+        status = mach_port_allocate( mach_task_self( ), MACH_PORT_RIGHT_RECEIVE, &serverPort );
+
+        if ( status == KERN_SUCCESS )
+        {
+            CFMachPortRef     server;
+            CFMachPortContext serverContext;
+
+            serverContext.version         = 0;
+            serverContext.info            = session;
+            serverContext.retain          = NULL;
+            serverContext.release         = NULL;
+            serverContext.copyDescription = NULL;
+
+            /*
+             * Create the session's server port.
+             */
+
+            server = CFMachPortCreateWithPort( allocator, serverPort, _DAServerCallback, &serverContext, NULL );
+
+            if ( server )
+            {
+                CFRunLoopSourceRef source;
+
+                /*
+                 * Create the session's server port run loop source.
+                 */
+
+                source = CFMachPortCreateRunLoopSource( allocator, server, 0 );
+
+                if ( source )
+                {
+                    mach_port_t port;
+
+                    /*
+                     * Set up the session's server port.
+                     */
+
+                    status = mach_port_request_notification( mach_task_self( ),
+                                                             CFMachPortGetPort( server ),
+                                                             MACH_NOTIFY_NO_SENDERS,
+                                                             1,
+                                                             CFMachPortGetPort( server ),
+                                                             MACH_MSG_TYPE_MAKE_SEND_ONCE,
+                                                             &port );
+
+                    if ( status == KERN_SUCCESS )
+                    {
+                        assert( port == MACH_PORT_NULL );
+
+                        session->_name   = strdup( _name );
+                        session->_pid    = _pid;
+                        session->_server = server;
+                        session->_source = source;
+
+                        return session;
+                    }
+
+                    CFRunLoopSourceInvalidate( source );
+
+                    CFRelease( source );
+                }
+
+                CFMachPortInvalidate( server );
+
+                CFRelease( server );
+            }
+
+            mach_port_mod_refs( mach_task_self( ), serverPort, MACH_PORT_RIGHT_RECEIVE, -1 );
+        }
+
+        CFRelease( session );
+    }
+
+    return NULL;
+}
+
+CFArrayRef DASessionCopyPeekRegister( void )
+{
+    /*
+     * Copy the peek callback registrations of every session, in ascending order of their order
+     * values.  Registrations of equal order are in the order in which they were registered.
+     */
+
+    if ( __gDASessionPeekRegister )
+    {
+        return CFArrayCreateCopy( kCFAllocatorDefault, __gDASessionPeekRegister );
+    }
+
+    return CFArrayCreate( kCFAllocatorDefault, NULL, 0, &kCFTypeArrayCallBacks );
+}
+
+mach_port_t DASessionCreateCallbackRing( DASessionRef session )
+{
+    /*
+     * Create the callback ring shared with the client, and a memory entry with which the client
+     * maps it.
+     */
+
+    mach_port_t port = MACH_PORT_NULL;
+
+    if ( session->_ring == NULL )
+    {
+        vm_address_t  address;
+        kern_return_t status;
 
-                        return session;
-                    }
+        status = vm_allocate( mach_task_self( ), &address, round_page( sizeof( _DACallbackRing ) ), VM_FLAGS_ANYWHERE );
 
-                    CFRunLoopSourceInvalidate( source );
+        if ( status == KERN_SUCCESS )
+        {
+            memory_object_size_t size;
 
-                    CFRelease( source );
-                }
+            size = round_page( sizeof( _DACallbackRing ) );
 
-                CFMachPortInvalidate( server );
+            status = mach_make_memory_entry_64( mach_task_self( ), &size, address, VM_PROT_READ | VM_PROT_WRITE, &port, MACH_PORT_NULL );
 
-                CFRelease( server );
+            if ( status == KERN_SUCCESS )
+            {
+                session->_ring     = ( void * ) address;
+                session->_ringHead = 0;
+                session->_ringTail = 0;
             }
+            else
+            {
+                vm_deallocate( mach_task_self( ), address, round_page( sizeof( _DACallbackRing ) ) );
 
-            mach_port_mod_refs( mach_task_self( ), serverPort, MACH_PORT_RIGHT_RECEIVE, -1 );
+                port = MACH_PORT_NULL;
+            }
         }
-
-        CFRelease( session );
     }
 
-    return NULL;
+    return port;
 }
 
 AuthorizationRef DASessionGetAuthorization( DASessionRef session )
@@ -269,6 +1398,23 @@ AuthorizationRef DASessionGetAuthorization( DASessionRef session )
     return session->_authorization;
 }
 
+CFIndex DASessionGetCallbackCount( DASessionRef session, _DACallbackKind kind )
+{
+    if ( kind < _kDACallbackKindCount )
+    {
+        if ( session )
+        {
+            return session->_registerList[kind] ? CFArrayGetCount( session->_registerList[kind] ) : 0;
+        }
+        else
+        {
+            return __gDASessionCallbackCount[kind];
+        }
+    }
+
+    return 0;
+}
+
 CFMutableArrayRef DASessionGetCallbackQueue( DASessionRef session )
 {
     return session->_queue;
@@ -294,6 +1440,26 @@ DASessionOptions DASessionGetOptions( DASessionRef session )
     return session->_options;
 }
 
+UInt32 DASessionGetQueueDrops( DASessionRef session )
+{
+    return session->_queueDrops;
+}
+
+UInt64 DASessionGetQueueSize( DASessionRef session )
+{
+    return session->_queueSize;
+}
+
+CFAbsoluteTime DASessionGetQueueUsage( DASessionRef session )
+{
+    return session->_queueUsage;
+}
+
+CFTimeInterval DASessionGetResponseTimeout( DASessionRef session )
+{
+    return session->_responseTimeout;
+}
+
 mach_port_t DASessionGetServerPort( DASessionRef session )
 {
     return CFMachPortGetPort( session->_server );
@@ -301,6 +1467,19 @@ mach_port_t DASessionGetServerPort( DASessionRef session )
 
 Boolean DASessionGetState( DASessionRef session, DASessionState state )
 {
+    if ( ( state & kDASessionStateTimeout ) && ( session->_state & kDASessionStateTimeout ) )
+    {
+        /*
+         * A client with a ring seldom calls on us, so we take it to be responding again once it
+         * has taken callbacks off its ring since it timed out.
+         */
+
+        if ( session->_ring && session->_ring->_tail != session->_ringTail )
+        {
+            session->_state &= ~kDASessionStateTimeout;
+        }
+    }
+
     return ( session->_state & state ) ? TRUE : FALSE;
 }
 
@@ -314,39 +1493,139 @@ void DASessionInitialize( void )
     __kDASessionTypeID = _CFRuntimeRegisterClass( &__DASessionClass );
 }
 
-void DASessionQueueCallback( DASessionRef session, DACallbackRef callback )
+Boolean DASessionCancelCallbacks( DASessionRef session, DADiskRef disk )
 {
-    session->_state &= ~kDASessionStateIdle;
-    
-    CFArrayAppendValue( session->_queue, callback );
+    /*
+     * Drop the events queued for a disk that disappeared before the client heard that it appeared.
+     * We only do so when nothing but appeared and description changed events are queued for it,
+     * since any other event either was delivered on an earlier appearance or awaits a response.
+     */
+
+    Boolean appeared = FALSE;
+    CFIndex count;
+    CFIndex index;
 
-    if ( CFArrayGetCount( session->_queue ) == 1 )
+    count = CFArrayGetCount( session->_queue );
+
+    for ( index = 0; index < count; index++ )
     {
-        if ( session->_client )
+        DACallbackRef item;
+
+        item = ( void * ) CFArrayGetValueAtIndex( session->_queue, index );
+
+        if ( DACallbackGetDisk( item ) == disk )
         {
-            mach_msg_header_t message;
-            kern_return_t     status;
+            switch ( DACallbackGetKind( item ) )
+            {
+                case _kDADiskAppearedCallback:
+                {
+                    appeared = TRUE;
 
-            message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
-            message.msgh_id          = 0;
-            message.msgh_local_port  = MACH_PORT_NULL;
-            message.msgh_remote_port = session->_client;
-            message.msgh_reserved    = 0;
-            message.msgh_size        = sizeof( message );
+                    break;
+                }
+                case _kDADiskDescriptionChangedCallback:
+                {
+                    break;
+                }
+                default:
+                {
+                    return FALSE;
+                }
+            }
+        }
+    }
 
-            status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+    if ( appeared )
+    {
+        for ( index = count - 1; index > -1; index-- )
+        {
+            DACallbackRef item;
 
-            if ( status == MACH_SEND_TIMED_OUT )
+            item = ( void * ) CFArrayGetValueAtIndex( session->_queue, index );
+
+            if ( DACallbackGetDisk( item ) == disk )
             {
-                mach_msg_destroy( &message );
+                CFArrayRemoveValueAtIndex( session->_queue, index );
             }
         }
     }
+
+    return appeared;
+}
+
+void DASessionQueueCallback( DASessionRef session, DACallbackRef callback )
+{
+    Boolean wake = FALSE;
+
+    session->_state &= ~kDASessionStateIdle;
+
+    if ( DACallbackGetKind( callback ) == _kDADiskDescriptionChangedCallback )
+    {
+        if ( __DASessionQueueCoalesce( session, callback ) )
+        {
+            return;
+        }
+    }
+
+    DATrace( kDATraceCallbackQueue, session, DACallbackGetKind( callback ), CFArrayGetCount( session->_queue ) );
+
+    if ( DASessionGetOption( session, kDASessionOptionLatency ) )
+    {
+        /*
+         * Stamp the event with the time it was queued, against which the client measures the time
+         * taken to reach it.  A merged event keeps the stamp of the event it was merged into.
+         */
+
+        ___CFDictionarySetIntegerValue( ( void * ) callback, _kDACallbackLatencyKey, mach_absolute_time( ) );
+    }
+
+    if ( __DASessionQueueRing( session, callback, &wake ) == FALSE )
+    {
+        if ( __DASessionQueueAdmit( session, callback ) == FALSE )
+        {
+            return;
+        }
+
+        CFArrayAppendValue( session->_queue, callback );
+
+        if ( session->_ring )
+        {
+            session->_ring->_queued = TRUE;
+
+            wake = ( CFArrayGetCount( session->_queue ) == 1 ) ? TRUE : FALSE;
+        }
+        else
+        {
+            wake = TRUE;
+        }
+    }
+
+    if ( wake )
+    {
+        DASessionWakeup( session );
+    }
 }
 
 void DASessionRegisterCallback( DASessionRef session, DACallbackRef callback )
 {
     CFArrayAppendValue( session->_register, callback );
+
+    __DASessionMatchInsert( session, callback );
+}
+
+void DASessionRemoveCallbacks( DASessionRef session )
+{
+    /*
+     * Empty the callback queue once the client has fetched it.  A client with a ring need not fetch
+     * the queue again until we fall back to it anew.
+     */
+
+    CFArrayRemoveAllValues( session->_queue );
+
+    if ( session->_ring )
+    {
+        session->_ring->_queued = FALSE;
+    }
 }
 
 void DASessionScheduleWithRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode )
@@ -373,27 +1652,15 @@ void DASessionSetClientPort( DASessionRef session, mach_port_t client )
 
     session->_client = client;
 
-    if ( CFArrayGetCount( session->_queue ) )
-    {
-        if ( session->_client )
-        {
-            mach_msg_header_t message;
-            kern_return_t     status;
-
-            message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
-            message.msgh_id          = 0;
-            message.msgh_local_port  = MACH_PORT_NULL;
-            message.msgh_remote_port = session->_client;
-            message.msgh_reserved    = 0;
-            message.msgh_size        = sizeof( message );
+    /*
+     * Any wakeup outstanding was sent to the previous client port.
+     */
 
-            status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+    session->_state &= ~( kDASessionStateNotify | kDASessionStateWakeup );
 
-            if ( status == MACH_SEND_TIMED_OUT )
-            {
-                mach_msg_destroy( &message );
-            }
-        }
+    if ( CFArrayGetCount( session->_queue ) || ( session->_ring && session->_ring->_tail != session->_ringHead ) )
+    {
+        DASessionWakeup( session );
     }
 }
 
@@ -408,8 +1675,31 @@ void DASessionSetOptions( DASessionRef session, DASessionOptions options, Boolea
     session->_options |= value ? options : 0;
 }
 
+void DASessionSetQueueSize( DASessionRef session, UInt64 size )
+{
+    session->_queueSize = size;
+}
+
+void DASessionSetQueueUsage( DASessionRef session, CFAbsoluteTime usage )
+{
+    session->_queueUsage = usage;
+}
+
+void DASessionSetResponseTimeout( DASessionRef session, CFTimeInterval timeout )
+{
+    session->_responseTimeout = timeout;
+}
+
 void DASessionSetState( DASessionRef session, DASessionState state, Boolean value )
 {
+    if ( ( state & kDASessionStateTimeout ) && value )
+    {
+        if ( session->_ring )
+        {
+            session->_ringTail = session->_ring->_tail;
+        }
+    }
+
     session->_state &= ~state;
     session->_state |= value ? state : 0;
 }
@@ -431,6 +1721,8 @@ void DASessionUnregisterCallback( DASessionRef session, DACallbackRef callback )
         {
             if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
             {
+                __DASessionMatchRemove( session, item );
+
                 CFArrayRemoveValueAtIndex( session->_register, index );
             }
         }
@@ -444,17 +1736,184 @@ void DASessionUnregisterCallback( DASessionRef session, DACallbackRef callback )
 
         item = ( void * ) CFArrayGetValueAtIndex( session->_queue, index );
 
-        if ( DACallbackGetAddress( item ) == DACallbackGetAddress( callback ) )
+        if ( DACallbackGetKind( item ) != _kDAUnregisterCallback )
         {
-            if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
+            if ( DACallbackGetAddress( item ) == DACallbackGetAddress( callback ) )
             {
-                CFArrayRemoveValueAtIndex( session->_queue, index );
+                if ( DACallbackGetContext( item ) == DACallbackGetContext( callback ) )
+                {
+                    CFArrayRemoveValueAtIndex( session->_queue, index );
+                }
+            }
+        }
+    }
+
+    if ( session->_ring && session->_ring->_mapped )
+    {
+        DACallbackRef item;
+
+        /*
+         * Callbacks for the registration that reached the callback ring can no longer be taken
+         * back, so tell the client when it has seen the last of them.
+         */
+
+        item = DACallbackCreate( kCFAllocatorDefault, session, DACallbackGetAddress( callback ), DACallbackGetContext( callback ), _kDAUnregisterCallback, 0, NULL, NULL );
+
+        if ( item )
+        {
+            /*
+             * The marker may end up behind the ring in our callback queue, where it must not
+             * retain the session that holds the queue.
+             */
+
+            DACallbackSetSession( item, NULL );
+
+            DASessionQueueCallback( session, item );
+
+            CFRelease( item );
+        }
+    }
+}
+
+void DASessionUnregisterCallbacks( DASessionRef session )
+{
+    _DACallbackKind kind;
+
+    for ( kind = 0; kind < _kDACallbackKindCount; kind++ )
+    {
+        if ( session->_registerList[kind] )
+        {
+            __gDASessionCallbackCount[kind] -= CFArrayGetCount( session->_registerList[kind] );
+
+            if ( kind == _kDADiskPeekCallback )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = CFArrayGetCount( session->_registerList[kind] );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    ___CFArrayRemoveValue( __gDASessionPeekRegister, CFArrayGetValueAtIndex( session->_registerList[kind], index ) );
+                }
             }
+
+            CFRelease( session->_matchAny[kind]     );
+            CFRelease( session->_matchIndex[kind]   );
+            CFRelease( session->_registerList[kind] );
+
+            session->_matchAny[kind]     = NULL;
+            session->_matchIndex[kind]   = NULL;
+            session->_registerList[kind] = NULL;
         }
     }
+
+    if ( session->_register )
+    {
+        CFArrayRemoveAllValues( session->_register );
+    }
+
+    if ( session->_watchAny   )  CFArrayRemoveAllValues( session->_watchAny );
+    if ( session->_watchIndex )  CFDictionaryRemoveAllValues( session->_watchIndex );
 }
 
 void DASessionUnscheduleFromRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode )
 {
     CFRunLoopRemoveSource( runLoop, session->_source, runLoopMode );
 }
+
+void DASessionWakeup( DASessionRef session )
+{
+    /*
+     * Wake the client up to its callbacks.  A client that takes callback messages, and that has
+     * no ring, is sent a small queue within the message itself.  Any other client is sent a bare
+     * message, after which it fetches the queue, so we need not wake it again until it does.  We
+     * never block on a full client port; a client that has no ring is instead woken again once
+     * its port has room, since the message already in the port need not have it fetch the queue.
+     */
+
+    if ( session->_client )
+    {
+        kern_return_t status;
+
+        status = KERN_FAILURE;
+
+        if ( session->_ring == NULL )
+        {
+            CFIndex count;
+
+            if ( ( session->_state & ( kDASessionStateNotify | kDASessionStateWakeup ) ) )
+            {
+                return;
+            }
+
+            count = CFArrayGetCount( session->_queue );
+
+            if ( count == 0 )
+            {
+                return;
+            }
+
+            if ( count <= __kDASessionMessageLimit )
+            {
+                if ( DASessionGetOption( session, kDASessionOptionMessage ) )
+                {
+                    status = __DASessionSendQueue( session );
+                }
+            }
+        }
+
+        if ( status != MACH_MSG_SUCCESS && status != MACH_SEND_TIMED_OUT )
+        {
+            mach_msg_header_t message;
+
+            message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
+            message.msgh_id          = _kDAClientMessageWakeup;
+            message.msgh_local_port  = MACH_PORT_NULL;
+            message.msgh_remote_port = session->_client;
+            message.msgh_reserved    = 0;
+            message.msgh_size        = sizeof( message );
+
+            status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+
+            if ( status == MACH_MSG_SUCCESS )
+            {
+                if ( session->_ring == NULL )
+                {
+                    session->_state |= kDASessionStateWakeup;
+                }
+            }
+
+            if ( status == MACH_SEND_TIMED_OUT )
+            {
+                mach_msg_destroy( &message );
+            }
+        }
+
+        if ( status == MACH_SEND_TIMED_OUT )
+        {
+            if ( session->_ring == NULL )
+            {
+                mach_port_t previous;
+
+                status = mach_port_request_notification( mach_task_self( ),
+                                                         session->_client,
+                                                         MACH_NOTIFY_SEND_POSSIBLE,
+                                                         1,
+                                                         CFMachPortGetPort( session->_server ),
+                                                         MACH_MSG_TYPE_MAKE_SEND_ONCE,
+                                                         &previous );
+
+                if ( status == KERN_SUCCESS )
+                {
+                    if ( previous )
+                    {
+                        mach_port_deallocate( mach_task_self( ), previous );
+                    }
+
+                    session->_state |= kDASessionStateNotify;
+                }
+            }
+        }
+    }
+}
@@ -28,12 +28,16 @@
 #include <DiskArbitration/DiskArbitration.h>
 #include <Security/Authorization.h>
 
+#include "DAInternal.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
 enum
 {
+    kDASessionOptionMessage   = 0x00000001,
+    kDASessionOptionLatency   = 0x00000002,
     kDASessionOptionNoTimeout = 0x01000000
 };
 
@@ -44,6 +48,8 @@ typedef UInt32 DASessionOptions;
 enum
 {
     kDASessionStateIdle    = 0x00000001,
+    kDASessionStateNotify  = 0x00000002,
+    kDASessionStateWakeup  = 0x00000004,
     kDASessionStateTimeout = 0x01000000,
     kDASessionStateZombie  = 0x10000000
 };
@@ -57,27 +63,42 @@ typedef struct __DASession * DASessionRef;
 ///w:start
 extern const char * _DASessionGetName( DASessionRef session );
 ///w:stop
+extern Boolean           DASessionCancelCallbacks( DASessionRef session, DADiskRef disk );
+extern CFArrayRef        DASessionCopyCallbackRegister( DASessionRef session, _DACallbackKind kind, DADiskRef disk, CFArrayRef keys );
+extern CFArrayRef        DASessionCopyPeekRegister( void );
 extern DASessionRef      DASessionCreate( CFAllocatorRef allocator, const char * _name, pid_t _pid );
+extern mach_port_t       DASessionCreateCallbackRing( DASessionRef session );
 extern AuthorizationRef  DASessionGetAuthorization( DASessionRef session );
+extern CFIndex           DASessionGetCallbackCount( DASessionRef session, _DACallbackKind kind );
 extern CFMutableArrayRef DASessionGetCallbackQueue( DASessionRef session );
 extern CFMutableArrayRef DASessionGetCallbackRegister( DASessionRef session );
 extern mach_port_t       DASessionGetID( DASessionRef session );
 extern Boolean           DASessionGetOption( DASessionRef session, DASessionOption option );
 extern DASessionOptions  DASessionGetOptions( DASessionRef session );
+extern UInt32            DASessionGetQueueDrops( DASessionRef session );
+extern UInt64            DASessionGetQueueSize( DASessionRef session );
+extern CFAbsoluteTime    DASessionGetQueueUsage( DASessionRef session );
+extern CFTimeInterval    DASessionGetResponseTimeout( DASessionRef session );
 extern mach_port_t       DASessionGetServerPort( DASessionRef session );
 extern Boolean           DASessionGetState( DASessionRef session, DASessionState state );
 extern CFTypeID          DASessionGetTypeID( void );
 extern void              DASessionInitialize( void );
 extern void              DASessionQueueCallback( DASessionRef session, DACallbackRef callback );
 extern void              DASessionRegisterCallback( DASessionRef session, DACallbackRef callback );
+extern void              DASessionRemoveCallbacks( DASessionRef session );
 extern void              DASessionScheduleWithRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode );
 extern void              DASessionSetAuthorization( DASessionRef session, AuthorizationRef authorization );
 extern void              DASessionSetClientPort( DASessionRef session, mach_port_t client );
 extern void              DASessionSetOption( DASessionRef session, DASessionOption option, Boolean value );
 extern void              DASessionSetOptions( DASessionRef session, DASessionOptions options, Boolean value );
+extern void              DASessionSetQueueSize( DASessionRef session, UInt64 size );
+extern void              DASessionSetQueueUsage( DASessionRef session, CFAbsoluteTime usage );
+extern void              DASessionSetResponseTimeout( DASessionRef session, CFTimeInterval timeout );
 extern void              DASessionSetState( DASessionRef session, DASessionState state, Boolean value );
 extern void              DASessionUnregisterCallback( DASessionRef session, DACallbackRef callback );
+extern void              DASessionUnregisterCallbacks( DASessionRef session );
 extern void              DASessionUnscheduleFromRunLoop( DASessionRef session, CFRunLoopRef runLoop, CFStringRef runLoopMode );
+extern void              DASessionWakeup( DASessionRef session );
 
 #ifdef __cplusplus
 }
@@ -34,26 +34,85 @@
 #include "DAPrivate.h"
 #include "DAQueue.h"
 #include "DASupport.h"
+#include "DAThread.h"
 
 #include <fsproperties.h>
+#include <notify.h>
 #include <unistd.h>
 #include <sys/loadable_fs.h>
 #include <sys/mount.h>
 
+struct __DAStageProbeCacheContext
+{
+    CFArrayRef candidates;
+    CFDataRef  digest;
+    DADiskRef  disk;
+    char *     path;
+    UInt64     size;
+};
+
+typedef struct __DAStageProbeCacheContext __DAStageProbeCacheContext;
+
+struct __DAStageProbeParallelResult
+{
+    CFBooleanRef clean;
+    Boolean      finished;
+    CFStringRef  name;
+    int          status;
+    CFUUIDRef    uuid;
+};
+
+typedef struct __DAStageProbeParallelResult __DAStageProbeParallelResult;
+
+struct __DAStageProbeParallelContext
+{
+    CFMutableArrayRef              candidates;
+    CFIndex                        concurrency;
+    CFIndex                        count;
+    DADiskRef                      disk;
+    Boolean                        done;
+    CFIndex                        next;
+    CFIndex                        pending;
+    CFIndex                        references;
+    __DAStageProbeParallelResult * results;
+};
+
+typedef struct __DAStageProbeParallelContext __DAStageProbeParallelContext;
+
+struct __DAStageProbeParallelJob
+{
+    __DAStageProbeParallelContext * context;
+    CFIndex                         index;
+};
+
+typedef struct __DAStageProbeParallelJob __DAStageProbeParallelJob;
+
+static CFMutableArrayRef  __gDAStageDiskList      = NULL;
+static CFMutableSetRef    __gDAStageDiskSet       = NULL;
 static CFRunLoopSourceRef __gDAStageRunLoopSource = NULL;
+static Boolean            __gDAStageSettled       = FALSE;
 
 static void               __DAStageAppeared( DADiskRef disk );
 static void               __DAStageMount( DADiskRef disk );
 static void               __DAStageMountCallback( int status, CFURLRef mountpoint, void * context );
-static void               __DAStageMountApproval( DADiskRef disk );
+static Boolean            __DAStageMountApproval( DADiskRef disk );
+static Boolean            __DAStageMountIsNested( DADiskRef disk );
+static Boolean            __DAStageMountMapEncloses( CFDictionaryRef map, CFStringRef path );
 static void               __DAStageMountApprovalCallback( CFTypeRef response, void * context );
 static void               __DAStageMountAuthorization( DADiskRef disk );
 static void               __DAStageMountAuthorizationCallback( DAReturn status, void * context );
-static void               __DAStagePeek( DADiskRef disk );
+static Boolean            __DAStagePeek( DADiskRef disk );
 static void               __DAStagePeekCallback( CFTypeRef response, void * context );
-static CFComparisonResult __DAStagePeekCompare( const void * value1, const void * value2, void * context );
 static void               __DAStageProbe( DADiskRef disk );
+static void               __DAStageProbeCacheCallback( int status, void * context );
+static int                __DAStageProbeCacheDigest( void * context );
 static void               __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid, void * context );
+static void               __DAStageProbeDispatch( DADiskRef disk, CFArrayRef candidates );
+static void               __DAStageProbeParallel( DADiskRef disk, CFArrayRef candidates, CFIndex concurrency );
+static void               __DAStageProbeParallelCallback( int status, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid, void * context );
+static void               __DAStageProbeParallelDispatch( __DAStageProbeParallelContext * context );
+static void               __DAStageProbeParallelRelease( __DAStageProbeParallelContext * context );
+static void               __DAStageRemoveDisk( DADiskRef disk );
 
 static void __DAStageAppeared( DADiskRef disk )
 {
@@ -72,17 +131,37 @@ static void __DAStageDispatch( void * info )
 {
     static Boolean fresh = FALSE;
 
-    CFIndex count;
-    CFIndex index;
-    Boolean quiet = TRUE;
+    CFIndex    count;
+    CFIndex    index;
+    CFArrayRef list;
+    Boolean    quiet = TRUE;
+
+    /*
+     * Process the disks whose state has changed since they were last seen settled.  A disk is kept
+     * on the stage list for as long as it has stages outstanding or a command active, so the cost
+     * of a pass is bound by the work in flight rather than by the number of disks.
+     */
+
+    list = __gDAStageDiskList ? CFArrayCreateCopy( kCFAllocatorDefault, __gDAStageDiskList ) : NULL;
 
-    count = CFArrayGetCount( gDADiskList );
+    count = list ? CFArrayGetCount( list ) : 0;
 
     for ( index = 0; index < count; index++ )
     {
         DADiskRef disk;
 
-        disk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+        disk = ( void * ) CFArrayGetValueAtIndex( list, index );
+
+        /*
+         * Determine whether the disk object is still in our tables.
+         */
+
+        if ( DADiskListGetDisk( DADiskGetID( disk ) ) != disk )
+        {
+            __DAStageRemoveDisk( disk );
+
+            continue;
+        }
 
         if ( DADiskGetState( disk, kDADiskStateCommandActive ) == FALSE )
         {
@@ -103,14 +182,29 @@ static void __DAStageDispatch( void * info )
             }
             else if ( DADiskGetState( disk, kDADiskStateStagedPeek ) == FALSE )
             {
-                __DAStagePeek( disk );
+                if ( __DAStagePeek( disk ) )
+                {
+                    /*
+                     * The stage was passed over, so take the disk on to its next stage in this
+                     * same pass.
+                     */
+
+                    index--;
+
+                    continue;
+                }
             }
 ///w:start
             else if ( DADiskGetState( disk, kDADiskStateRequireRepair ) == FALSE )
             {
                 if ( DADiskGetState( disk, kDADiskStateStagedApprove ) == FALSE )
                 {
-                    __DAStageMountApproval( disk );
+                    if ( __DAStageMountApproval( disk ) )
+                    {
+                        index--;
+
+                        continue;
+                    }
                 }
                 else if ( DADiskGetState( disk, kDADiskStateStagedAuthorize ) == FALSE )
                 {
@@ -153,6 +247,8 @@ static void __DAStageDispatch( void * info )
                         }
                     }
 ///w:stop
+                    __DAStageRemoveDisk( disk );
+
                     continue;
                 }
             }
@@ -165,30 +261,30 @@ static void __DAStageDispatch( void * info )
 
                 if ( DADiskGetState( disk, kDADiskStateRequireRepair ) )
                 {
-                    CFIndex subcount;
-                    CFIndex subindex;
+                    CFArrayRef sublist;
+                    CFIndex    subcount;
+                    CFIndex    subindex;
+
+                    sublist = DAUnitGetDiskList( disk );
 
-                    subcount = CFArrayGetCount( gDADiskList );
+                    subcount = sublist ? CFArrayGetCount( sublist ) : 0;
 
                     for ( subindex = 0; subindex < subcount; subindex++ )
                     {
                         DADiskRef subdisk;
 
-                        subdisk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, subindex );
+                        subdisk = ( void * ) CFArrayGetValueAtIndex( sublist, subindex );
 
-                        if ( DADiskGetBSDUnit( disk ) == DADiskGetBSDUnit( subdisk ) )
+                        if ( DADiskGetState( subdisk, kDADiskStateStagedProbe ) == FALSE )
                         {
-                            if ( DADiskGetState( subdisk, kDADiskStateStagedProbe ) == FALSE )
-                            {
-                                break;
-                            }
+                            break;
+                        }
 
-                            if ( DADiskGetState( subdisk, kDADiskStateStagedAppear ) == FALSE )
+                        if ( DADiskGetState( subdisk, kDADiskStateStagedAppear ) == FALSE )
+                        {
+                            if ( DADiskGetState( subdisk, kDADiskStateRequireRepair ) == FALSE )
                             {
-                                if ( DADiskGetState( subdisk, kDADiskStateRequireRepair ) == FALSE )
-                                {
-                                    break;
-                                }
+                                break;
                             }
                         }
                     }
@@ -205,7 +301,12 @@ static void __DAStageDispatch( void * info )
             }
             else if ( DADiskGetState( disk, kDADiskStateStagedApprove ) == FALSE )
             {
-                __DAStageMountApproval( disk );
+                if ( __DAStageMountApproval( disk ) )
+                {
+                    index--;
+
+                    continue;
+                }
             }
             else if ( DADiskGetState( disk, kDADiskStateStagedAuthorize ) == FALSE )
             {
@@ -222,6 +323,8 @@ static void __DAStageDispatch( void * info )
             }
             else
             {
+                __DAStageRemoveDisk( disk );
+
                 continue;
             }
         }
@@ -229,6 +332,11 @@ static void __DAStageDispatch( void * info )
         quiet = FALSE;
     }
 
+    if ( list )
+    {
+        CFRelease( list );
+    }
+
     count = CFArrayGetCount( gDARequestList );
 
     if ( count )
@@ -383,6 +491,39 @@ static void __DAStageDispatch( void * info )
 
         DAIdleCallback( );
 
+        DAProbeCacheSave( );
+
+        if ( __gDAStageSettled == FALSE )
+        {
+            CFDictionaryRef summary;
+            int             token;
+
+            /*
+             * Signal that the media found at startup have settled.  We hold on to the registration
+             * so that the state outlives the post for those who check it later.
+             */
+
+            if ( notify_register_check( _kDADaemonSettledName, &token ) == NOTIFY_STATUS_OK )
+            {
+                notify_set_state( token, 1 );
+            }
+
+            notify_post( _kDADaemonSettledName );
+
+            __gDAStageSettled = TRUE;
+
+            summary = DALatencyListCreateSummary( );
+
+            if ( summary )
+            {
+                DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+
+                DALogDebug( "  settled, latency = %@.", summary );
+
+                CFRelease( summary );
+            }
+        }
+
         ___vproc_transaction_end( );
 
         if ( gDAConsoleUser )
@@ -449,6 +590,11 @@ static void __DAStageMount( DADiskRef disk )
      * We commence the "mount" stage if the conditions are right.
      */
 
+    if ( __DAStageMountIsNested( disk ) )
+    {
+        return;
+    }
+
     if ( DAUnitGetState( disk, kDAUnitStateCommandActive ) == FALSE )
     {
         /*
@@ -457,6 +603,8 @@ static void __DAStageMount( DADiskRef disk )
 
         CFRetain( disk );
 
+        DATraceStart( kDATraceMount, disk, 0, 0 );
+
         DADiskSetState( disk, kDADiskStateStagedMount, TRUE );
 
         DADiskSetState( disk, kDADiskStateCommandActive, TRUE );
@@ -471,6 +619,8 @@ static void __DAStageMountCallback( int status, CFURLRef mountpoint, void * cont
 {
     DADiskRef disk = context;
 
+    DATraceEnd( kDATraceMount, disk, status, 0 );
+
     if ( status == 0 )
     {
         /*
@@ -496,10 +646,11 @@ static void __DAStageMountCallback( int status, CFURLRef mountpoint, void * cont
     CFRelease( disk );
 }
 
-static void __DAStageMountApproval( DADiskRef disk )
+static Boolean __DAStageMountApproval( DADiskRef disk )
 {
     /*
-     * We commence the "mount approval" stage if the conditions are right.
+     * We commence the "mount approval" stage if the conditions are right.  We pass over the stage
+     * in place when no session has registered for mount approvals, and return TRUE to say so.
      */
 
     Boolean mount = TRUE;
@@ -530,6 +681,11 @@ static void __DAStageMountApproval( DADiskRef disk )
 
     if ( mount )
     {
+        if ( DASessionGetCallbackCount( NULL, _kDADiskMountApprovalCallback ) == 0 )
+        {
+            return TRUE;
+        }
+
         CFRetain( disk );
 
         DADiskSetState( disk, kDADiskStateCommandActive, TRUE );
@@ -540,8 +696,10 @@ static void __DAStageMountApproval( DADiskRef disk )
     {
         DADiskSetState( disk, kDADiskStateStagedMount, TRUE );
 
-        DAStageSignal( );
+        return TRUE;
     }
+
+    return FALSE;
 }
 
 static void __DAStageMountApprovalCallback( CFTypeRef response, void * context )
@@ -582,6 +740,143 @@ static void __DAStageMountApprovalCallback( CFTypeRef response, void * context )
     CFRelease( disk );
 }
 
+static Boolean __DAStageMountIsNested( DADiskRef disk )
+{
+    /*
+     * Determine whether the mount point set out for the volume in the mount map list lies within
+     * the mount point set out for a volume that has yet to be mounted, in which case the mount is
+     * held back.  Volumes are otherwise mounted in whichever order they become ready.
+     */
+
+    CFDictionaryRef map;
+    CFURLRef        mountpoint;
+    CFStringRef     path;
+    Boolean         nested = FALSE;
+
+    map = DAMountMapListGetMap1( disk );
+
+    mountpoint = map ? CFDictionaryGetValue( map, kDAMountMapMountPathKey ) : NULL;
+
+    path = mountpoint ? CFURLCopyFileSystemPath( mountpoint, kCFURLPOSIXPathStyle ) : NULL;
+
+    if ( path )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        /*
+         * Determine whether any mount point in the mount map list encloses that of the volume.
+         */
+
+        count = CFArrayGetCount( gDAMountMapList1 );
+
+        for ( index = 0; index < count; index++ )
+        {
+            if ( __DAStageMountMapEncloses( CFArrayGetValueAtIndex( gDAMountMapList1, index ), path ) )
+            {
+                break;
+            }
+        }
+
+        if ( index < count )
+        {
+            count = CFArrayGetCount( gDADiskList );
+
+            for ( index = 0; index < count; index++ )
+            {
+                DADiskRef subdisk;
+
+                subdisk = ( void * ) CFArrayGetValueAtIndex( gDADiskList, index );
+
+                if ( subdisk == disk )
+                {
+                    continue;
+                }
+
+                if ( DADiskGetState( subdisk, kDADiskStateStagedMount ) )
+                {
+                    continue;
+                }
+
+                if ( DADiskGetState( subdisk, kDADiskStateZombie ) )
+                {
+                    continue;
+                }
+
+                if ( DADiskGetDescription( subdisk, kDADiskDescriptionVolumePathKey ) )
+                {
+                    continue;
+                }
+
+                if ( DADiskGetFileSystem( subdisk ) == NULL )
+                {
+                    /*
+                     * The volume has yet to be probed, so we cannot tell where it is to be mounted.
+                     */
+
+                    if ( DADiskGetState( subdisk, kDADiskStateStagedProbe ) == FALSE || DADiskGetState( subdisk, kDADiskStateCommandActive ) )
+                    {
+                        nested = TRUE;
+
+                        break;
+                    }
+                }
+                else if ( __DAStageMountMapEncloses( DAMountMapListGetMap1( subdisk ), path ) )
+                {
+                    nested = TRUE;
+
+                    break;
+                }
+            }
+        }
+
+        CFRelease( path );
+    }
+
+    return nested;
+}
+
+static Boolean __DAStageMountMapEncloses( CFDictionaryRef map, CFStringRef path )
+{
+    /*
+     * Determine whether the mount point of the mount map entry is a proper ancestor of the path.
+     */
+
+    CFURLRef mountpoint;
+    Boolean  encloses = FALSE;
+
+    mountpoint = map ? CFDictionaryGetValue( map, kDAMountMapMountPathKey ) : NULL;
+
+    if ( mountpoint )
+    {
+        CFStringRef mountpath;
+
+        mountpath = CFURLCopyFileSystemPath( mountpoint, kCFURLPOSIXPathStyle );
+
+        if ( mountpath )
+        {
+            CFIndex length;
+
+            length = CFStringGetLength( mountpath );
+
+            if ( length > 1 && CFStringGetLength( path ) > length )
+            {
+                if ( CFStringHasPrefix( path, mountpath ) )
+                {
+                    if ( CFStringGetCharacterAtIndex( path, length ) == '/' )
+                    {
+                        encloses = TRUE;
+                    }
+                }
+            }
+
+            CFRelease( mountpath );
+        }
+    }
+
+    return encloses;
+}
+
 static void __DAStageMountAuthorization( DADiskRef disk )
 {
     /*
@@ -662,51 +957,35 @@ static void __DAStageMountAuthorizationCallback( DAReturn status, void * context
     CFRelease( disk );
 }
 
-static void __DAStagePeek( DADiskRef disk )
+static Boolean __DAStagePeek( DADiskRef disk )
 {
     /*
-     * We commence the "peek" stage if the conditions are right.
+     * We commence the "peek" stage if the conditions are right.  We pass over the stage in place
+     * when no session has registered for peeks, and return TRUE to say so.
      */
 
+    CFArrayRef        callbacks;
     CFMutableArrayRef candidates;
 
-    candidates = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
-
-    if ( candidates )
+    if ( DASessionGetCallbackCount( NULL, _kDADiskPeekCallback ) == 0 )
     {
-        DASessionRef session;
-        CFArrayRef   sessionList;
-        CFIndex      sessionListCount;
-        CFIndex      sessionListIndex;
-
-        sessionList      = gDASessionList;
-        sessionListCount = CFArrayGetCount( sessionList );
+        DADiskSetState( disk, kDADiskStateStagedPeek, TRUE );
 
-        for ( sessionListIndex = 0; sessionListIndex < sessionListCount; sessionListIndex++ )
-        {
-            DACallbackRef callback;
-            CFArrayRef    callbackList;
-            CFIndex       callbackListCount;
-            CFIndex       callbackListIndex;
-            
-            session = ( void * ) CFArrayGetValueAtIndex( sessionList, sessionListIndex );
+        return TRUE;
+    }
 
-            callbackList      = DASessionGetCallbackRegister( session );
-            callbackListCount = CFArrayGetCount( callbackList );
+    /*
+     * Obtain the peek callback registrations, which the session register keeps in peek order.
+     */
 
-            for ( callbackListIndex = 0; callbackListIndex < callbackListCount; callbackListIndex++ )
-            {
-                callback = ( void * ) CFArrayGetValueAtIndex( callbackList, callbackListIndex );
+    callbacks = DASessionCopyPeekRegister( );
 
-                if ( DACallbackGetKind( callback ) == _kDADiskPeekCallback )
-                {
-                    CFArrayAppendValue( candidates, callback );
-                }
-            }
-        }
+    candidates = callbacks ? CFArrayCreateMutableCopy( kCFAllocatorDefault, 0, callbacks ) : NULL;
 
-        CFArraySortValues( candidates, CFRangeMake( 0, CFArrayGetCount( candidates ) ), __DAStagePeekCompare, NULL );
+    if ( callbacks )  CFRelease( callbacks );
 
+    if ( candidates )
+    {
         /*
          * Commence the peek.
          */
@@ -723,6 +1002,8 @@ static void __DAStagePeek( DADiskRef disk )
 
         CFRelease( candidates );
     }
+
+    return FALSE;
 }
 
 static void __DAStagePeekCallback( CFTypeRef response, void * context )
@@ -734,19 +1015,39 @@ static void __DAStagePeekCallback( CFTypeRef response, void * context )
 
     if ( CFArrayGetCount( candidates ) )
     {
-        DACallbackRef candidate;
+        CFMutableArrayRef callbacks;
+        CFIndex           count;
+        SInt32            order;
 
-        candidate = ( void * ) CFArrayGetValueAtIndex( candidates, 0 );
+        /*
+         * Peek with every callback of the next order at once.  The callbacks of a higher order
+         * wait for all of them to respond.
+         */
+
+        order = DACallbackGetOrder( ( void * ) CFArrayGetValueAtIndex( candidates, 0 ) );
+
+        for ( count = 1; count < CFArrayGetCount( candidates ); count++ )
+        {
+            if ( DACallbackGetOrder( ( void * ) CFArrayGetValueAtIndex( candidates, count ) ) != order )
+            {
+                break;
+            }
+        }
+
+        callbacks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
-        CFRetain( candidate );
+        if ( callbacks )
+        {
+            CFArrayAppendArray( callbacks, candidates, CFRangeMake( 0, count ) );
 
-        CFArrayRemoveValueAtIndex( candidates, 0 );
+            CFArrayReplaceValues( candidates, CFRangeMake( 0, count ), NULL, 0 );
 
-        DADiskPeekCallback( disk, candidate, __DAStagePeekCallback, context );
+            DADiskPeekCallback( disk, callbacks, __DAStagePeekCallback, context );
 
-        CFRelease( candidate );
+            CFRelease( callbacks );
 
-        return;
+            return;
+        }
     }
     
     DADiskSetState( disk, kDADiskStateCommandActive, FALSE );
@@ -758,17 +1059,6 @@ static void __DAStagePeekCallback( CFTypeRef response, void * context )
     CFRelease( disk );
 }
 
-static CFComparisonResult __DAStagePeekCompare( const void * value1, const void * value2, void * context )
-{
-    SInt32 order1 = DACallbackGetOrder( ( void * ) value1 );
-    SInt32 order2 = DACallbackGetOrder( ( void * ) value2 );
-
-    if ( order1 > order2 )  return kCFCompareGreaterThan;
-    if ( order1 < order2 )  return kCFCompareLessThan;
-
-    return kCFCompareEqualTo;
-}
-
 static void __DAStageProbe( DADiskRef disk )
 {
     /*
@@ -779,7 +1069,7 @@ static void __DAStageProbe( DADiskRef disk )
     {
         CFMutableArrayRef candidates;
 
-        candidates = CFArrayCreateMutableCopy( kCFAllocatorDefault, 0, gDAFileSystemProbeList );
+        candidates = DAFileSystemProbeListCreateCandidates( disk );
 
         if ( candidates )
         {
@@ -805,9 +1095,9 @@ static void __DAStageProbe( DADiskRef disk )
 
             CFRetain( disk );
 
-            DADiskSetFileSystem( disk, NULL );
+            DATraceStart( kDATraceProbe, disk, CFArrayGetCount( candidates ), 0 );
 
-            DADiskSetContext( disk, candidates );
+            DADiskSetFileSystem( disk, NULL );
 
             DADiskSetState( disk, kDADiskStateStagedProbe, TRUE );
 
@@ -815,46 +1105,225 @@ static void __DAStageProbe( DADiskRef disk )
 
             DAUnitSetState( disk, kDAUnitStateCommandActive, TRUE );
 
-            __DAStageProbeCallback( -1, NULL, NULL, NULL, disk );
+            /*
+             * Determine whether the probe result might be cached.
+             */
+
+            if ( CFArrayGetCount( candidates ) && DADiskGetIOMedia( disk ) && size )
+            {
+                __DAStageProbeCacheContext * context;
+
+                context = malloc( sizeof( __DAStageProbeCacheContext ) );
+
+                if ( context )
+                {
+                    context->candidates = CFRetain( candidates );
+                    context->digest     = NULL;
+                    context->disk       = disk;
+                    context->path       = strdup( DADiskGetBSDPath( disk, TRUE ) );
+                    context->size       = ___CFNumberGetIntegerValue( size );
+
+                    if ( context->path )
+                    {
+                        DAThreadExecute( __DAStageProbeCacheDigest, context, __DAStageProbeCacheCallback, context );
+
+                        CFRelease( candidates );
+
+                        return;
+                    }
+
+                    CFRelease( context->candidates );
+
+                    free( context );
+                }
+            }
+
+            __DAStageProbeDispatch( disk, candidates );
 
             CFRelease( candidates );
         }
     }
 }
 
-static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid, void * context )
+static void __DAStageProbeCacheCallback( int status, void * parameter )
 {
-    DADiskRef         disk = context;
-    CFMutableArrayRef keys = NULL;
-    CFStringRef       kind = NULL;
-
-    DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+    __DAStageProbeCacheContext * context = parameter;
+    DADiskRef                    disk    = context->disk;
 
-    if ( status )
+    if ( context->digest )
     {
-        CFMutableArrayRef candidates;
+        CFDictionaryRef entry;
 
-        candidates = ( void * ) DADiskGetContext( disk );
+        entry = DAProbeCacheGetEntry( disk, context->digest );
 
-        if ( DADiskGetFileSystem( disk ) )
+        if ( entry )
         {
-            kind = DAFileSystemGetKind( DADiskGetFileSystem( disk ) );
+            CFBooleanRef    clean;
+            DAFileSystemRef filesystem;
+            CFIndex         count;
+            CFIndex         index;
 
-            DALogDebug( "  probed disk, id = %@, with %@, failure.", disk, kind );
+            filesystem = ( void * ) CFDictionaryGetValue( entry, kDAFileSystemKey );
 
-            if ( status != FSUR_UNRECOGNIZED )
-            {
-                DALogError( "unable to probe %@ (status code 0x%08X).", disk, status );
-            }
-        }
+            /*
+             * Determine whether the cached file system is still a probe candidate for this media object.
+             */
 
-        /*
-         * Find a probe candidate for this media object.
-         */
+            count = CFArrayGetCount( context->candidates );
 
-        while ( CFArrayGetCount( candidates ) )
-        {
-            CFDictionaryRef candidate;
+            for ( index = 0; index < count; index++ )
+            {
+                CFDictionaryRef candidate;
+
+                candidate = CFArrayGetValueAtIndex( context->candidates, index );
+
+                if ( CFEqual( CFDictionaryGetValue( candidate, kDAFileSystemKey ), filesystem ) )
+                {
+                    CFDictionaryRef properties;
+
+                    properties = CFDictionaryGetValue( candidate, CFSTR( kFSMediaPropertiesKey ) );
+
+                    if ( properties )
+                    {
+                        boolean_t match = FALSE;
+
+                        IOServiceMatchPropertyTable( DADiskGetIOMedia( disk ), properties, &match );
+
+                        if ( match )
+                        {
+                            if ( CFDictionaryGetValue( candidate, CFSTR( "autodiskmount" ) ) == kCFBooleanFalse )
+                            {
+                                DADiskSetOption( disk, kDADiskOptionMountAutomatic,        FALSE );
+                                DADiskSetOption( disk, kDADiskOptionMountAutomaticNoDefer, FALSE );
+                            }
+
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if ( index < count )
+            {
+                /*
+                 * The cache does not keep a clean state, since the mark may lie outside of the
+                 * media content sampled for the digest.  A volume not known to need repair is only
+                 * taken from the cache if the repair list vouches for it.
+                 */
+
+                clean = CFDictionaryGetValue( entry, kDAProbeCacheVolumeCleanKey );
+
+                if ( clean != kCFBooleanFalse )
+                {
+                    CFUUIDRef known;
+                    CFUUIDRef uuid;
+
+                    known = DARepairListGetVolumeUUID( disk, context->digest );
+
+                    uuid = CFDictionaryGetValue( entry, kDAProbeCacheVolumeUUIDKey );
+
+                    if ( known && uuid && CFEqual( known, uuid ) )
+                    {
+                        clean = kCFBooleanTrue;
+                    }
+                    else
+                    {
+                        index = count;
+                    }
+                }
+            }
+
+            if ( index < count )
+            {
+                /*
+                 * We have found a cached probe match for this media object.
+                 */
+
+                CFMutableArrayRef candidates;
+
+                DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+
+                DALogDebug( "  probed disk, id = %@, with %@, cached.", disk, DAFileSystemGetKind( filesystem ) );
+
+                candidates = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                DADiskSetContext( disk, candidates );
+
+                DADiskSetFileSystem( disk, filesystem );
+
+                __DAStageProbeCallback( 0,
+                                        clean,
+                                        CFDictionaryGetValue( entry, kDAProbeCacheVolumeNameKey ),
+                                        CFDictionaryGetValue( entry, kDAProbeCacheVolumeUUIDKey ),
+                                        disk );
+
+                if ( candidates )
+                {
+                    CFRelease( candidates );
+                }
+
+                goto __DAStageProbeCacheCallbackErr;
+            }
+        }
+
+        DAProbeCacheSetDigest( disk, context->digest );
+    }
+
+    __DAStageProbeDispatch( disk, context->candidates );
+
+__DAStageProbeCacheCallbackErr:
+
+    if ( context->digest )  CFRelease( context->digest );
+
+    CFRelease( context->candidates );
+
+    free( context->path );
+
+    free( context );
+}
+
+static int __DAStageProbeCacheDigest( void * parameter )
+{
+    __DAStageProbeCacheContext * context = parameter;
+
+    context->digest = DAProbeCacheCreateDigest( context->path, context->size );
+
+    return context->digest ? 0 : EIO;
+}
+
+static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid, void * context )
+{
+    DADiskRef         disk = context;
+    CFMutableArrayRef keys = NULL;
+    CFStringRef       kind = NULL;
+
+    DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+
+    if ( status )
+    {
+        CFMutableArrayRef candidates;
+
+        candidates = ( void * ) DADiskGetContext( disk );
+
+        if ( DADiskGetFileSystem( disk ) )
+        {
+            kind = DAFileSystemGetKind( DADiskGetFileSystem( disk ) );
+
+            DALogDebug( "  probed disk, id = %@, with %@, failure.", disk, kind );
+
+            if ( status != FSUR_UNRECOGNIZED )
+            {
+                DALogError( "unable to probe %@ (status code 0x%08X).", disk, status );
+            }
+        }
+
+        /*
+         * Find a probe candidate for this media object.
+         */
+
+        while ( CFArrayGetCount( candidates ) )
+        {
+            CFDictionaryRef candidate;
 
             candidate = CFArrayGetValueAtIndex( candidates, 0 );
 
@@ -896,7 +1365,11 @@ static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef
 
                             DALogDebug( "  probed disk, id = %@, with %@, ongoing.", disk, kind );
 
-                            DAFileSystemProbe( filesystem, DADiskGetDevice( disk ), __DAStageProbeCallback, context );
+                            DAFileSystemProbe( filesystem,
+                                               DADiskGetDevice( disk ),
+                                               DARepairListGetVolumeUUID( disk, DAProbeCacheGetDigest( disk ) ),
+                                               __DAStageProbeCallback,
+                                               context );
 
                             return;
                         }
@@ -919,6 +1392,8 @@ static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef
 
         kind = NULL;
 
+        DAProbeCacheRemoveEntry( disk );
+
         if ( DADiskGetFileSystem( disk ) )
         {
             DADiskSetFileSystem( disk, NULL );
@@ -934,6 +1409,21 @@ static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef
 
         kind = DAFileSystemGetKind( DADiskGetFileSystem( disk ) );
 
+        DAProbeCacheSetResult( disk, DADiskGetFileSystem( disk ), clean, name, uuid );
+
+        /*
+         * Remember a clean volume, so that the next probe of the same media content may skip the
+         * "is clean" command.  A mounted volume may be written to at any moment, hence no entry.
+         */
+
+        if ( clean == kCFBooleanTrue && uuid && DAProbeCacheGetDigest( disk ) )
+        {
+            if ( DADiskGetDescription( disk, kDADiskDescriptionVolumePathKey ) == NULL )
+            {
+                DARepairListSetEntry( disk, uuid, DAProbeCacheGetDigest( disk ) );
+            }
+        }
+
 ///w:start
         if ( DADiskGetDescription( disk, kDADiskDescriptionMediaWritableKey ) == kCFBooleanFalse )
         {
@@ -1057,6 +1547,8 @@ static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef
         }
     }
 
+    DATraceEnd( kDATraceProbe, disk, status, 0 );
+
     DAUnitSetState( disk, kDAUnitStateCommandActive, FALSE );
 
     DADiskSetState( disk, kDADiskStateCommandActive, FALSE );
@@ -1068,6 +1560,379 @@ static void __DAStageProbeCallback( int status, CFBooleanRef clean, CFStringRef
     CFRelease( disk );
 }
 
+static void __DAStageProbeDispatch( DADiskRef disk, CFArrayRef candidates )
+{
+    CFNumberRef concurrency;
+
+    /*
+     * Determine whether to probe the candidates concurrently.
+     */
+
+    concurrency = CFDictionaryGetValue( gDAPreferenceList, kDAPreferenceProbeConcurrencyKey );
+
+    if ( concurrency && ___CFNumberGetIntegerValue( concurrency ) > 1 )
+    {
+        __DAStageProbeParallel( disk, candidates, ___CFNumberGetIntegerValue( concurrency ) );
+    }
+    else
+    {
+        DADiskSetContext( disk, candidates );
+
+        __DAStageProbeCallback( -1, NULL, NULL, NULL, disk );
+    }
+}
+
+static void __DAStageProbeParallel( DADiskRef disk, CFArrayRef candidates, CFIndex concurrency )
+{
+    /*
+     * Probe the disk with up to the specified number of candidates at once.  The candidates are
+     * in priority order.  We only settle on a candidate once every candidate ahead of it failed,
+     * and abandon the candidates behind it once it succeeded.
+     */
+
+    __DAStageProbeParallelContext * context;
+    CFIndex                         count;
+    CFIndex                         index;
+
+    DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+
+    context = malloc( sizeof( __DAStageProbeParallelContext ) );
+
+    if ( context )
+    {
+        context->candidates  = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+        context->concurrency = concurrency;
+        context->count       = 0;
+        context->disk        = disk;
+        context->done        = FALSE;
+        context->next        = 0;
+        context->pending     = 0;
+        context->references  = 1;
+        context->results     = NULL;
+
+        if ( context->candidates )
+        {
+            /*
+             * Determine which candidates match this media object.
+             */
+
+            count = CFArrayGetCount( candidates );
+
+            for ( index = 0; index < count; index++ )
+            {
+                CFDictionaryRef candidate;
+
+                candidate = CFArrayGetValueAtIndex( candidates, index );
+
+                if ( CFDictionaryGetValue( candidate, kDAFileSystemKey ) )
+                {
+                    CFDictionaryRef properties;
+
+                    properties = CFDictionaryGetValue( candidate, CFSTR( kFSMediaPropertiesKey ) );
+
+                    if ( properties )
+                    {
+                        boolean_t match = FALSE;
+
+                        IOServiceMatchPropertyTable( DADiskGetIOMedia( disk ), properties, &match );
+
+                        if ( match )
+                        {
+                            CFArrayAppendValue( context->candidates, candidate );
+                        }
+                    }
+                }
+            }
+
+            context->count = CFArrayGetCount( context->candidates );
+
+            context->results = calloc( context->count ? context->count : 1, sizeof( __DAStageProbeParallelResult ) );
+        }
+
+        if ( context->results )
+        {
+            DADiskSetContext( disk, context->candidates );
+
+            __DAStageProbeParallelDispatch( context );
+
+            __DAStageProbeParallelRelease( context );
+
+            return;
+        }
+
+        if ( context->candidates )  CFRelease( context->candidates );
+
+        free( context );
+    }
+
+    /*
+     * Fall back to the serial probe.
+     */
+
+    DADiskSetContext( disk, candidates );
+
+    __DAStageProbeCallback( -1, NULL, NULL, NULL, disk );
+}
+
+static void __DAStageProbeParallelCallback( int status, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid, void * parameter )
+{
+    __DAStageProbeParallelJob *     job     = parameter;
+    __DAStageProbeParallelContext * context = job->context;
+    __DAStageProbeParallelResult *  result  = context->results + job->index;
+
+    /*
+     * Record the outcome of this candidate.
+     */
+
+    result->finished = TRUE;
+    result->status   = status;
+
+    if ( status == 0 )
+    {
+        if ( clean )  result->clean = CFRetain( clean );
+        if ( name  )  result->name  = CFRetain( name  );
+        if ( uuid  )  result->uuid  = CFRetain( uuid  );
+    }
+
+    context->pending--;
+
+    if ( context->done == FALSE )
+    {
+        DAFileSystemRef filesystem;
+
+        filesystem = ( void * ) CFDictionaryGetValue( CFArrayGetValueAtIndex( context->candidates, job->index ), kDAFileSystemKey );
+
+        DALogDebugHeader( "%s -> %s", gDAProcessNameID, gDAProcessNameID );
+
+        if ( status )
+        {
+            DALogDebug( "  probed disk, id = %@, with %@, failure.", context->disk, DAFileSystemGetKind( filesystem ) );
+
+            if ( status != FSUR_UNRECOGNIZED )
+            {
+                DALogError( "unable to probe %@ (status code 0x%08X).", context->disk, status );
+            }
+        }
+
+        __DAStageProbeParallelDispatch( context );
+    }
+
+    __DAStageProbeParallelRelease( context );
+
+    free( job );
+}
+
+static void __DAStageProbeParallelDispatch( __DAStageProbeParallelContext * context )
+{
+    CFIndex count;
+    CFIndex index;
+
+    count = context->count;
+
+    context->references++;
+
+    while ( context->done == FALSE )
+    {
+        /*
+         * Determine whether the outcome is settled.
+         */
+
+        for ( index = 0; index < count; index++ )
+        {
+            if ( context->results[index].finished == FALSE )
+            {
+                break;
+            }
+
+            if ( context->results[index].status == 0 )
+            {
+                break;
+            }
+        }
+
+        if ( index == count || context->results[index].finished )
+        {
+            DADiskRef disk;
+
+            disk = context->disk;
+
+            context->done = TRUE;
+
+            if ( context->pending )
+            {
+                DALogDebug( "  probed disk, id = %@, abandoned %d candidates.", disk, ( int ) context->pending );
+            }
+
+            if ( index < count )
+            {
+                /*
+                 * We have found a probe match for this media object.
+                 */
+
+                CFDictionaryRef candidate;
+
+                candidate = CFArrayGetValueAtIndex( context->candidates, index );
+
+                DADiskSetFileSystem( disk, CFDictionaryGetValue( candidate, kDAFileSystemKey ) );
+
+                if ( CFDictionaryGetValue( candidate, CFSTR( "autodiskmount" ) ) == kCFBooleanFalse )
+                {
+                    DADiskSetOption( disk, kDADiskOptionMountAutomatic,        FALSE );
+                    DADiskSetOption( disk, kDADiskOptionMountAutomaticNoDefer, FALSE );
+                }
+
+                __DAStageProbeCallback( 0, context->results[index].clean, context->results[index].name, context->results[index].uuid, disk );
+            }
+            else
+            {
+                /*
+                 * We have found no probe match for this media object.
+                 */
+
+                CFArrayRemoveAllValues( context->candidates );
+
+                DADiskSetFileSystem( disk, NULL );
+
+                __DAStageProbeCallback( FSUR_UNRECOGNIZED, NULL, NULL, NULL, disk );
+            }
+
+            break;
+        }
+
+        /*
+         * Commence the next candidate, should we have room for it.
+         */
+
+        if ( context->pending < context->concurrency && context->next < count )
+        {
+            __DAStageProbeParallelJob * job;
+
+            job = malloc( sizeof( __DAStageProbeParallelJob ) );
+
+            if ( job )
+            {
+                DAFileSystemRef filesystem;
+
+                job->context = context;
+                job->index   = context->next;
+
+                filesystem = ( void * ) CFDictionaryGetValue( CFArrayGetValueAtIndex( context->candidates, job->index ), kDAFileSystemKey );
+
+                context->next++;
+                context->pending++;
+                context->references++;
+
+                DALogDebug( "  probed disk, id = %@, with %@, ongoing.", context->disk, DAFileSystemGetKind( filesystem ) );
+
+                DAFileSystemProbe( filesystem,
+                                   DADiskGetDevice( context->disk ),
+                                   DARepairListGetVolumeUUID( context->disk, DAProbeCacheGetDigest( context->disk ) ),
+                                   __DAStageProbeParallelCallback,
+                                   job );
+            }
+            else
+            {
+                context->results[context->next].finished = TRUE;
+                context->results[context->next].status   = ENOMEM;
+
+                context->next++;
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    __DAStageProbeParallelRelease( context );
+}
+
+static void __DAStageProbeParallelRelease( __DAStageProbeParallelContext * context )
+{
+    context->references--;
+
+    if ( context->references == 0 )
+    {
+        CFIndex index;
+
+        for ( index = 0; index < context->count; index++ )
+        {
+            if ( context->results[index].clean )  CFRelease( context->results[index].clean );
+            if ( context->results[index].name  )  CFRelease( context->results[index].name  );
+            if ( context->results[index].uuid  )  CFRelease( context->results[index].uuid  );
+        }
+
+        CFRelease( context->candidates );
+
+        free( context->results );
+
+        free( context );
+    }
+}
+
+static void __DAStageRemoveDisk( DADiskRef disk )
+{
+    /*
+     * Remove the disk object from the stage list.
+     */
+
+    if ( CFSetContainsValue( __gDAStageDiskSet, disk ) )
+    {
+        CFIndex index;
+
+        index = CFArrayGetFirstIndexOfValue( __gDAStageDiskList, CFRangeMake( 0, CFArrayGetCount( __gDAStageDiskList ) ), disk );
+
+        if ( index != kCFNotFound )
+        {
+            CFArrayRemoveValueAtIndex( __gDAStageDiskList, index );
+        }
+
+        CFSetRemoveValue( __gDAStageDiskSet, disk );
+    }
+}
+
+void DAStageAddDisk( DADiskRef disk )
+{
+    /*
+     * Add the disk object to the stage list, such that the next stage pass reconsiders it.
+     */
+
+    if ( __gDAStageDiskList == NULL )
+    {
+        CFArrayCallBacks arrayCallBacks = kCFTypeArrayCallBacks;
+        CFSetCallBacks   setCallBacks   = kCFTypeSetCallBacks;
+
+        /*
+         * Disk objects compare equal by identifier, yet a stale disk object and its replacement may
+         * share one, hence we compare by identity.
+         */
+
+        arrayCallBacks.equal = NULL;
+
+        setCallBacks.equal = NULL;
+        setCallBacks.hash  = NULL;
+
+        __gDAStageDiskList = CFArrayCreateMutable( kCFAllocatorDefault, 0, &arrayCallBacks );
+
+        assert( __gDAStageDiskList );
+
+        __gDAStageDiskSet = CFSetCreateMutable( kCFAllocatorDefault, 0, &setCallBacks );
+
+        assert( __gDAStageDiskSet );
+    }
+
+    if ( CFSetContainsValue( __gDAStageDiskSet, disk ) == FALSE )
+    {
+        /*
+         * Mirror the order of the disk list, in which the most recent disk object comes first.
+         */
+
+        CFArrayInsertValueAtIndex( __gDAStageDiskList, 0, disk );
+
+        CFSetAddValue( __gDAStageDiskSet, disk );
+    }
+}
+
 CFRunLoopSourceRef DAStageCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
 {
     /*
@@ -26,10 +26,13 @@
 
 #include <CoreFoundation/CoreFoundation.h>
 
+#include "DADisk.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+extern void               DAStageAddDisk( DADiskRef disk );
 extern CFRunLoopSourceRef DAStageCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order );
 
 extern void DAStageSignal( void );
@@ -25,22 +25,44 @@
 
 #include "vsdb.h"
 #include "DABase.h"
+#include "DACommand.h"
 #include "DAFileSystem.h"
 #include "DAInternal.h"
 #include "DALog.h"
 #include "DAMain.h"
+#include "DASession.h"
+#include "DAStage.h"
 #include "DAThread.h"
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <fsproperties.h>
 #include <fstab.h>
 #include <libgen.h>
 #include <pthread.h>
 #include <sys/loadable_fs.h>
+#include <unistd.h>
+#include <sys/event.h>
+#include <sys/param.h>
 #include <sys/stat.h>
+#include <CommonCrypto/CommonDigest.h>
+#include <IOKit/storage/IOMedia.h>
 #include <IOKit/storage/IOStorageProtocolCharacteristics.h>
 #include <SystemConfiguration/SystemConfiguration.h>
 
+struct __DAWatch
+{
+    Boolean      changed;
+    int          fd;
+    const char * path;
+};
+
+typedef struct __DAWatch __DAWatch;
+
+static void    __DAUnitListAddDisk( DADiskRef disk );
+static void    __DAUnitListRemoveDisk( DADiskRef disk );
+static Boolean __DAWatchGetChanged( __DAWatch * watch );
+
 struct __DAAuthorizeWithCallbackContext
 {
     DAAuthorizeCallback callback;
@@ -228,7 +250,7 @@ void DAAuthorizeWithCallback( DASessionRef        session,
         context->userGID         = userGID;
         context->userUID         = userUID;
 
-        DAThreadExecute( __DAAuthorizeWithCallback, context, __DAAuthorizeWithCallbackCallback, context );
+        DAThreadExecuteBlocking( __DAAuthorizeWithCallback, context, __DAAuthorizeWithCallbackCallback, context );
     }
     else
     {
@@ -236,672 +258,2995 @@ void DAAuthorizeWithCallback( DASessionRef        session,
     }
 }
 
-static struct timespec __gDAFileSystemListTime = { 0, 0 };
+static CFMutableDictionaryRef __gDADiskListIDIndex    = NULL;
+static CFMutableDictionaryRef __gDADiskListMediaIndex = NULL;
+static CFMutableDictionaryRef __gDADiskListNodeIndex  = NULL;
+static CFMutableDictionaryRef __gDADiskListUserIndex  = NULL;
 
-const CFStringRef kDAFileSystemKey = CFSTR( "DAFileSystem" );
+static CFDataRef __DADiskListCreateIDKey( const char * id )
+{
+    return CFDataCreate( kCFAllocatorDefault, ( void * ) id, strlen( id ) );
+}
 
-static void __DAFileSystemProbeListAppendValue( const void * key, const void * value, void * context )
+static CFNumberRef __DADiskListCreateMediaKey( io_service_t media )
 {
-    CFMutableDictionaryRef probe;
+    CFNumberRef key;
+    uint64_t    id;
 
-    probe = CFDictionaryCreateMutableCopy( kCFAllocatorDefault, 0, value );
+    key = NULL;
 
-    if ( probe )
+    if ( IORegistryEntryGetRegistryEntryID( media, &id ) == KERN_SUCCESS )
     {
-        CFDictionarySetValue( probe, kDAFileSystemKey, context );
-        CFArrayAppendValue( gDAFileSystemProbeList, probe );
-        CFRelease( probe );
+        key = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt64Type, &id );
     }
+
+    return key;
 }
 
-static CFComparisonResult __DAFileSystemProbeListCompare( const void * value1, const void * value2, void * context )
+static CFNumberRef __DADiskListCreateNodeKey( dev_t node )
 {
-    CFNumberRef order1 = CFDictionaryGetValue( value1, CFSTR( kFSProbeOrderKey ) );
-    CFNumberRef order2 = CFDictionaryGetValue( value2, CFSTR( kFSProbeOrderKey ) );
-
-    if ( order1 == NULL )  return kCFCompareGreaterThan;
-    if ( order2 == NULL )  return kCFCompareLessThan;
-
-    return CFNumberCompare( order1, order2, NULL );
+    return CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &node );
 }
 
-void DAFileSystemListRefresh( void )
+static CFNumberRef __DADiskListCreateUserKey( uid_t userUID )
 {
-    struct stat status;
-
-    /*
-     * Determine whether the file system list is up-to-date.
-     */
+    return CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt32Type, &userUID );
+}
 
-    if ( stat( FS_DIR_LOCATION, &status ) )
+static void __DADiskListInitialize( void )
+{
+    if ( __gDADiskListIDIndex == NULL )
     {
-        __gDAFileSystemListTime.tv_sec  = 0;
-        __gDAFileSystemListTime.tv_nsec = 0;
-    }
+        __gDADiskListIDIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
-    if ( __gDAFileSystemListTime.tv_sec  != status.st_mtimespec.tv_sec  ||
-         __gDAFileSystemListTime.tv_nsec != status.st_mtimespec.tv_nsec )
-    {
-        CFURLRef base;
+        assert( __gDADiskListIDIndex );
 
-        __gDAFileSystemListTime.tv_sec  = status.st_mtimespec.tv_sec;
-        __gDAFileSystemListTime.tv_nsec = status.st_mtimespec.tv_nsec;
+        __gDADiskListMediaIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
-        /*
-         * Clear the file system list.
-         */
+        assert( __gDADiskListMediaIndex );
 
-        CFArrayRemoveAllValues( gDAFileSystemList );
-        CFArrayRemoveAllValues( gDAFileSystemProbeList );
+        __gDADiskListNodeIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDADiskListNodeIndex );
 
         /*
-         * Build the file system list.
+         * The owner index maps each user, other than root, to the disks that user owns.  A disk's
+         * owner is set once, as the disk object is created.
          */
 
-        base = CFURLCreateWithFileSystemPath( kCFAllocatorDefault, CFSTR( FS_DIR_LOCATION ), kCFURLPOSIXPathStyle, TRUE );
+        __gDADiskListUserIndex = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
 
-        if ( base )
-        {
-            DIR * folder;
+        assert( __gDADiskListUserIndex );
+    }
+}
 
-            /*
-             * Scan the filesystems in the file system folder.
-             */
+void DADiskListAddDisk( DADiskRef disk )
+{
+    CFTypeRef key;
 
-            folder = opendir( FS_DIR_LOCATION );
+    __DADiskListInitialize( );
 
-            if ( folder )
-            {
-                struct dirent * item;
+    /*
+     * Add the disk object to the disk list.
+     */
 
-                DALogDebugHeader( "filesystems have been refreshed." );
+    CFArrayInsertValueAtIndex( gDADiskList, 0, disk );
 
-                while ( ( item = readdir( folder ) ) )
-                {
-                    char * suffix;
+    /*
+     * Add the disk object to the disk list indices.
+     */
 
-                    suffix = item->d_name + strlen( item->d_name ) - strlen( FS_DIR_SUFFIX );
+    key = __DADiskListCreateIDKey( DADiskGetID( disk ) );
 
-                    if ( suffix > item->d_name )
-                    {
-                        if ( strcmp( suffix, FS_DIR_SUFFIX ) == 0 )
-                        {
-                            CFURLRef path;
+    if ( key )
+    {
+        CFDictionarySetValue( __gDADiskListIDIndex, key, disk );
 
-                            path = CFURLCreateFromFileSystemRepresentationRelativeToBase( kCFAllocatorDefault,
-                                                                                          ( void * ) item->d_name,
-                                                                                          strlen( item->d_name ),
-                                                                                          TRUE,
-                                                                                          base );
+        CFRelease( key );
+    }
 
-                            if ( path )
-                            {
-                                DAFileSystemRef filesystem;
+    if ( DADiskGetIOMedia( disk ) )
+    {
+        key = __DADiskListCreateMediaKey( DADiskGetIOMedia( disk ) );
 
-                                /*
-                                 * Create a file system object for this file system.
-                                 */
+        if ( key )
+        {
+            CFDictionarySetValue( __gDADiskListMediaIndex, key, disk );
 
-                                filesystem = DAFileSystemCreate( kCFAllocatorDefault, path );
+            CFRelease( key );
+        }
+    }
 
-                                if ( filesystem )
-                                {
-                                    CFDictionaryRef probe;
+    if ( DADiskGetBSDNode( disk ) )
+    {
+        key = __DADiskListCreateNodeKey( DADiskGetBSDNode( disk ) );
 
-                                    /*
-                                     * Add this file system object to our list.
-                                     */
+        if ( key )
+        {
+            CFDictionarySetValue( __gDADiskListNodeIndex, key, disk );
 
-                                    DALogDebug( "  created filesystem, id = %@.", filesystem );
+            CFRelease( key );
+        }
+    }
 
-                                    CFArrayAppendValue( gDAFileSystemList, filesystem );
+    if ( DADiskGetUserUID( disk ) )
+    {
+        key = __DADiskListCreateUserKey( DADiskGetUserUID( disk ) );
 
-                                    probe = DAFileSystemGetProbeList( filesystem );
+        if ( key )
+        {
+            CFMutableArrayRef disks;
 
-                                    if ( probe )
-                                    {
-                                        CFDictionaryApplyFunction( probe, __DAFileSystemProbeListAppendValue, filesystem );
-                                    }
+            disks = ( void * ) CFDictionaryGetValue( __gDADiskListUserIndex, key );
 
-                                    CFRelease( filesystem );
-                                }
+            if ( disks == NULL )
+            {
+                disks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
-                                CFRelease( path );
-                            }
-                        }
-                    }
+                if ( disks )
+                {
+                    CFDictionarySetValue( __gDADiskListUserIndex, key, disks );
+
+                    CFRelease( disks );
                 }
+            }
 
-                closedir( folder );
+            if ( disks )
+            {
+                CFArrayInsertValueAtIndex( disks, 0, disk );
             }
 
-            CFRelease( base );
+            CFRelease( key );
         }
+    }
 
-        /*
-         * Order the probe list.
-         */
+    __DAUnitListAddDisk( disk );
 
-        CFArraySortValues( gDAFileSystemProbeList,
-                           CFRangeMake( 0, CFArrayGetCount( gDAFileSystemProbeList ) ),
-                           __DAFileSystemProbeListCompare,
-                           NULL );
-    }
+    DAStageAddDisk( disk );
 }
 
-static struct timespec __gDAMountMapListTime1 = { 0, 0 };
-static struct timespec __gDAMountMapListTime2 = { 0, 0 };
+CFArrayRef DADiskListCopyDisksWithUserUID( uid_t userUID )
+{
+    /*
+     * Obtain the disks owned by the specified user, other than root, newest first.
+     */
 
-const CFStringRef kDAMountMapMountAutomaticKey = CFSTR( "DAMountAutomatic" );
-const CFStringRef kDAMountMapMountOptionsKey   = CFSTR( "DAMountOptions"   );
-const CFStringRef kDAMountMapMountPathKey      = CFSTR( "DAMountPath"      );
-const CFStringRef kDAMountMapProbeIDKey        = CFSTR( "DAProbeID"        );
-const CFStringRef kDAMountMapProbeKindKey      = CFSTR( "DAProbeKind"      );
+    CFArrayRef disks;
 
-static CFDictionaryRef __DAMountMapCreate1( CFAllocatorRef allocator, struct fstab * fs )
-{
-    CFMutableDictionaryRef map = NULL;
+    disks = NULL;
 
-    if ( strcmp( fs->fs_type, FSTAB_SW ) )
+    if ( __gDADiskListUserIndex && userUID )
     {
-        char * idAsCString = fs->fs_spec;
+        CFNumberRef key;
 
-        strsep( &idAsCString, "=" );
+        key = __DADiskListCreateUserKey( userUID );
 
-        if ( idAsCString )
+        if ( key )
         {
-            CFStringRef idAsString;
+            disks = CFDictionaryGetValue( __gDADiskListUserIndex, key );
 
-            idAsString = CFStringCreateWithCString( kCFAllocatorDefault, idAsCString, kCFStringEncodingUTF8 );
-
-            if ( idAsString )
+            if ( disks )
             {
-                CFTypeRef id = NULL;
+                disks = CFArrayCreateCopy( kCFAllocatorDefault, disks );
+            }
 
-                if ( strcmp( fs->fs_spec, "UUID" ) == 0 )
-                {
-                    id = ___CFUUIDCreateFromString( kCFAllocatorDefault, idAsString );
-                }
-                else if ( strcmp( fs->fs_spec, "LABEL" ) == 0 )
-                {
-                    id = CFRetain( idAsString );
-                }
-                else if ( strcmp( fs->fs_spec, "DEVICE" ) == 0 )
-                {
-                    id = ___CFDictionaryCreateFromXMLString( kCFAllocatorDefault, idAsString );
-                }
+            CFRelease( key );
+        }
+    }
 
-                if ( id )
-                {
-                    map = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+    return disks;
+}
 
-                    if ( map )
-                    {
-                        CFMutableStringRef options;
+DADiskRef DADiskListGetDisk( const char * id )
+{
+    DADiskRef disk;
 
-                        options = CFStringCreateMutable( kCFAllocatorDefault, 0 );
+    disk = NULL;
 
-                        if ( options )
-                        {
-                            char *       argument  = NULL;
-                            char *       arguments = fs->fs_mntops;
-                            CFBooleanRef automatic = NULL;
+    if ( __gDADiskListIDIndex )
+    {
+        CFDataRef key;
 
-                            while ( ( argument = strsep( &arguments, "," ) ) )
-                            {
-                                if ( strcmp( argument, "auto" ) == 0 )
-                                {
-                                    automatic = kCFBooleanTrue;
-                                }
-                                else if ( strcmp( argument, "noauto" ) == 0 )
-                                {
-                                    automatic = kCFBooleanFalse;
-                                }
-                                else
-                                {
-                                    CFStringAppendCString( options, argument, kCFStringEncodingUTF8 );    
-                                    CFStringAppendCString( options, ",", kCFStringEncodingUTF8 );
-                                }
-                            }
+        key = __DADiskListCreateIDKey( id );
 
-                            if ( automatic )
-                            {
-                                CFDictionarySetValue( map, kDAMountMapMountAutomaticKey, automatic );
-                            }
+        if ( key )
+        {
+            disk = ( void * ) CFDictionaryGetValue( __gDADiskListIDIndex, key );
 
-                            if ( CFStringGetLength( options ) )
-                            {
-                                CFStringTrim( options, CFSTR( "," ) );
+            CFRelease( key );
+        }
+    }
 
-                                CFDictionarySetValue( map, kDAMountMapMountOptionsKey, options );
-                            }
+    return disk;
+}
 
-                            CFRelease( options );
-                        }
+DADiskRef DADiskListGetDiskWithBSDNode( dev_t node )
+{
+    DADiskRef disk;
 
-                        if ( strcmp( fs->fs_file, "none" ) )
-                        {
-                            CFURLRef path;
+    disk = NULL;
 
-                            path = CFURLCreateFromFileSystemRepresentation( kCFAllocatorDefault, ( void * ) fs->fs_file, strlen( fs->fs_file ), TRUE );
+    if ( __gDADiskListNodeIndex )
+    {
+        CFNumberRef key;
 
-                            if ( path )
-                            {
-                                CFDictionarySetValue( map, kDAMountMapMountPathKey, path );
+        key = __DADiskListCreateNodeKey( node );
 
-                                CFRelease( path );
-                            }
-                        }
+        if ( key )
+        {
+            disk = ( void * ) CFDictionaryGetValue( __gDADiskListNodeIndex, key );
 
-                        if ( strcmp( fs->fs_vfstype, "auto" ) )
-                        {
-                            CFStringRef kind;
+            CFRelease( key );
+        }
+    }
 
-                            kind = CFStringCreateWithCString( kCFAllocatorDefault, fs->fs_vfstype, kCFStringEncodingUTF8 );
+    return disk;
+}
 
-                            if ( kind )
-                            {
-                                CFDictionarySetValue( map, kDAMountMapProbeKindKey, kind );
+DADiskRef DADiskListGetDiskWithIOMedia( io_service_t media )
+{
+    DADiskRef disk;
 
-                                CFRelease( kind );
-                            }
-                        }
+    disk = NULL;
 
-                        CFDictionarySetValue( map, kDAMountMapProbeIDKey, id );
-                    }
+    if ( __gDADiskListMediaIndex )
+    {
+        CFNumberRef key;
 
-                    CFRelease( id );
-                }
+        key = __DADiskListCreateMediaKey( media );
 
-                CFRelease( idAsString );
-            }
+        if ( key )
+        {
+            disk = ( void * ) CFDictionaryGetValue( __gDADiskListMediaIndex, key );
+
+            CFRelease( key );
         }
     }
 
-    return map;
+    return disk;
 }
 
-void DAMountMapListRefresh1( void )
+void DADiskListRemoveDisk( DADiskRef disk )
 {
-    struct stat status;
+    CFTypeRef key;
+
+    __DADiskListInitialize( );
 
     /*
-     * Determine whether the mount map list is up-to-date.
+     * Retain the disk object for as long as we need it, since the disk list may hold the last reference.
      */
 
-    if ( stat( _PATH_FSTAB, &status ) )
-    {
-        __gDAMountMapListTime1.tv_sec  = 0;
-        __gDAMountMapListTime1.tv_nsec = 0;
-    }
-
-    if ( __gDAMountMapListTime1.tv_sec  != status.st_mtimespec.tv_sec  ||
-         __gDAMountMapListTime1.tv_nsec != status.st_mtimespec.tv_nsec )
-    {
-        __gDAMountMapListTime1.tv_sec  = status.st_mtimespec.tv_sec;
-        __gDAMountMapListTime1.tv_nsec = status.st_mtimespec.tv_nsec;
-
-        /*
-         * Clear the mount map list.
-         */
+    CFRetain( disk );
 
-        CFArrayRemoveAllValues( gDAMountMapList1 );
+    /*
+     * Remove the disk object from the disk list indices.  We only remove an entry that refers to this
+     * disk object, in order to leave the entry of an identical disk object that has since replaced it.
+     */
 
-        /*
-         * Build the mount map list.
-         */
+    key = __DADiskListCreateIDKey( DADiskGetID( disk ) );
 
-        if ( setfsent( ) )
+    if ( key )
+    {
+        if ( CFDictionaryGetValue( __gDADiskListIDIndex, key ) == disk )
         {
-            struct fstab * item;
+            CFDictionaryRemoveValue( __gDADiskListIDIndex, key );
 
-            while ( ( item = getfsent( ) ) )
-            {
-                CFDictionaryRef map;
+            DADiskRemoveSnapshot( disk );
+        }
 
-                map = __DAMountMapCreate1( kCFAllocatorDefault, item );
+        CFRelease( key );
+    }
 
-                if ( map )
-                {
-                    CFArrayAppendValue( gDAMountMapList1, map );
+    if ( DADiskGetIOMedia( disk ) )
+    {
+        key = __DADiskListCreateMediaKey( DADiskGetIOMedia( disk ) );
 
-                    CFRelease( map );
-                }
+        if ( key )
+        {
+            if ( CFDictionaryGetValue( __gDADiskListMediaIndex, key ) == disk )
+            {
+                CFDictionaryRemoveValue( __gDADiskListMediaIndex, key );
             }
 
-            endfsent( );
+            CFRelease( key );
         }
     }
-}
 
-static CFDictionaryRef __DAMountMapCreate2( CFAllocatorRef allocator, struct vsdb * vs )
+    if ( DADiskGetBSDNode( disk ) )
+    {
+        key = __DADiskListCreateNodeKey( DADiskGetBSDNode( disk ) );
+
+        if ( key )
+        {
+            if ( CFDictionaryGetValue( __gDADiskListNodeIndex, key ) == disk )
+            {
+                CFDictionaryRemoveValue( __gDADiskListNodeIndex, key );
+            }
+
+            CFRelease( key );
+        }
+    }
+
+    if ( DADiskGetUserUID( disk ) )
+    {
+        key = __DADiskListCreateUserKey( DADiskGetUserUID( disk ) );
+
+        if ( key )
+        {
+            CFMutableArrayRef disks;
+
+            disks = ( void * ) CFDictionaryGetValue( __gDADiskListUserIndex, key );
+
+            if ( disks )
+            {
+                ___CFArrayRemoveValue( disks, disk );
+
+                if ( CFArrayGetCount( disks ) == 0 )
+                {
+                    CFDictionaryRemoveValue( __gDADiskListUserIndex, key );
+                }
+            }
+
+            CFRelease( key );
+        }
+    }
+
+    __DAUnitListRemoveDisk( disk );
+
+    /*
+     * Forget the probe results and that the volume is clean, as the media may be written to elsewhere
+     * while it is away.  A label kept past the sampled media content could not be trusted on return.
+     */
+
+    DAProbeCacheRemoveEntry( disk );
+
+    DARepairListRemoveEntry( disk );
+
+    /*
+     * Remove the disk object from the disk list.
+     */
+
+    ___CFArrayRemoveValue( gDADiskList, disk );
+
+    CFRelease( disk );
+}
+
+static CFMutableDictionaryRef __gDAFileSystemListCache      = NULL;
+static struct timespec        __gDAFileSystemListTime       = { 0, 0 };
+static __DAWatch              __gDAFileSystemListWatch      = { FALSE, -1, FS_DIR_LOCATION };
+static CFMutableDictionaryRef __gDAFileSystemProbeHintList = NULL;
+
+const CFStringRef kDAFileSystemKey = CFSTR( "DAFileSystem" );
+
+static void __DAFileSystemProbeListAppendValue( const void * key, const void * value, void * context )
+{
+    CFMutableDictionaryRef probe;
+
+    probe = CFDictionaryCreateMutableCopy( kCFAllocatorDefault, 0, value );
+
+    if ( probe )
+    {
+        CFDictionarySetValue( probe, kDAFileSystemKey, context );
+        CFArrayAppendValue( gDAFileSystemProbeList, probe );
+        CFRelease( probe );
+    }
+}
+
+static void __DAFileSystemProbeHintListRefresh( void )
+{
+    CFIndex count;
+    CFIndex index;
+
+    /*
+     * Index the probe list by the content hint that each personality matches on, if any, so that
+     * the probes that name the partition type of a disk can be tried first.
+     */
+
+    if ( __gDAFileSystemProbeHintList == NULL )
+    {
+        __gDAFileSystemProbeHintList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDAFileSystemProbeHintList );
+    }
+
+    CFDictionaryRemoveAllValues( __gDAFileSystemProbeHintList );
+
+    count = CFArrayGetCount( gDAFileSystemProbeList );
+
+    for ( index = 0; index < count; index++ )
+    {
+        CFDictionaryRef probe;
+        CFDictionaryRef properties;
+
+        probe = CFArrayGetValueAtIndex( gDAFileSystemProbeList, index );
+
+        properties = CFDictionaryGetValue( probe, CFSTR( kFSMediaPropertiesKey ) );
+
+        if ( properties )
+        {
+            CFStringRef hint;
+
+            hint = CFDictionaryGetValue( properties, CFSTR( kIOMediaContentHintKey ) );
+
+            if ( hint && CFGetTypeID( hint ) == CFStringGetTypeID( ) )
+            {
+                CFMutableArrayRef list;
+
+                list = ( CFMutableArrayRef ) CFDictionaryGetValue( __gDAFileSystemProbeHintList, hint );
+
+                if ( list )
+                {
+                    CFArrayAppendValue( list, probe );
+                }
+                else
+                {
+                    list = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                    if ( list )
+                    {
+                        CFArrayAppendValue( list, probe );
+
+                        CFDictionarySetValue( __gDAFileSystemProbeHintList, hint, list );
+
+                        CFRelease( list );
+                    }
+                }
+            }
+        }
+    }
+}
+
+static CFComparisonResult __DAFileSystemProbeListCompare( const void * value1, const void * value2, void * context )
+{
+    CFNumberRef order1 = CFDictionaryGetValue( value1, CFSTR( kFSProbeOrderKey ) );
+    CFNumberRef order2 = CFDictionaryGetValue( value2, CFSTR( kFSProbeOrderKey ) );
+
+    if ( order1 == NULL )  return kCFCompareGreaterThan;
+    if ( order2 == NULL )  return kCFCompareLessThan;
+
+    return CFNumberCompare( order1, order2, NULL );
+}
+
+CFMutableArrayRef DAFileSystemProbeListCreateCandidates( DADiskRef disk )
+{
+    /*
+     * Create the list of probe candidates for the specified disk.  This is the probe list, with
+     * the probes whose personality names the content hint of the disk moved to the front.
+     */
+
+    CFMutableArrayRef candidates;
+
+    candidates = CFArrayCreateMutableCopy( kCFAllocatorDefault, 0, gDAFileSystemProbeList );
+
+    if ( candidates && __gDAFileSystemProbeHintList )
+    {
+        CFStringRef content;
+
+        content = DADiskGetDescription( disk, kDADiskDescriptionMediaContentKey );
+
+        if ( content )
+        {
+            CFArrayRef list;
+
+            list = CFDictionaryGetValue( __gDAFileSystemProbeHintList, content );
+
+            if ( list )
+            {
+                CFIndex count;
+                CFIndex index;
+
+                count = CFArrayGetCount( list );
+
+                for ( index = 0; index < count; index++ )
+                {
+                    CFDictionaryRef probe;
+                    CFIndex         subindex;
+
+                    probe = CFArrayGetValueAtIndex( list, index );
+
+                    subindex = CFArrayGetFirstIndexOfValue( candidates, CFRangeMake( index, CFArrayGetCount( candidates ) - index ), probe );
+
+                    if ( subindex != kCFNotFound )
+                    {
+                        CFRetain( probe );
+
+                        CFArrayRemoveValueAtIndex( candidates, subindex );
+
+                        CFArrayInsertValueAtIndex( candidates, index, probe );
+
+                        CFRelease( probe );
+                    }
+                }
+            }
+        }
+    }
+
+    return candidates;
+}
+
+void DAFileSystemListRefresh( void )
+{
+    struct stat status;
+
+    /*
+     * Determine whether the file system folder has changed since we last looked at it.
+     */
+
+    if ( __DAWatchGetChanged( &__gDAFileSystemListWatch ) == FALSE )
+    {
+        return;
+    }
+
+    /*
+     * Determine whether the file system list is up-to-date.
+     */
+
+    if ( stat( FS_DIR_LOCATION, &status ) )
+    {
+        __gDAFileSystemListTime.tv_sec  = 0;
+        __gDAFileSystemListTime.tv_nsec = 0;
+    }
+
+    if ( __gDAFileSystemListTime.tv_sec  != status.st_mtimespec.tv_sec  ||
+         __gDAFileSystemListTime.tv_nsec != status.st_mtimespec.tv_nsec )
+    {
+        CFURLRef               base;
+        CFMutableDictionaryRef cache;
+        Boolean                changed = FALSE;
+
+        __gDAFileSystemListTime.tv_sec  = status.st_mtimespec.tv_sec;
+        __gDAFileSystemListTime.tv_nsec = status.st_mtimespec.tv_nsec;
+
+        /*
+         * Build the file system list.  A file system bundle that is unchanged since the previous
+         * scan keeps its file system object, so only the bundles that were added or replaced are
+         * loaded anew.
+         */
+
+        base  = CFURLCreateWithFileSystemPath( kCFAllocatorDefault, CFSTR( FS_DIR_LOCATION ), kCFURLPOSIXPathStyle, TRUE );
+        cache = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( base && cache )
+        {
+            CFMutableArrayRef list;
+
+            list = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+            if ( list )
+            {
+                DIR * folder;
+
+                /*
+                 * Scan the filesystems in the file system folder.
+                 */
+
+                folder = opendir( FS_DIR_LOCATION );
+
+                if ( folder )
+                {
+                    struct dirent * item;
+
+                    while ( ( item = readdir( folder ) ) )
+                    {
+                        char * suffix;
+
+                        suffix = item->d_name + strlen( item->d_name ) - strlen( FS_DIR_SUFFIX );
+
+                        if ( suffix > item->d_name )
+                        {
+                            if ( strcmp( suffix, FS_DIR_SUFFIX ) == 0 )
+                            {
+                                struct stat itemStatus;
+                                char *      itemPath;
+
+                                itemPath = NULL;
+
+                                asprintf( &itemPath, "%s/%s", FS_DIR_LOCATION, item->d_name );
+
+                                if ( itemPath && stat( itemPath, &itemStatus ) == 0 )
+                                {
+                                    CFStringRef key;
+                                    CFDataRef   stamp;
+                                    UInt64      value[3];
+
+                                    value[0] = itemStatus.st_ino;
+                                    value[1] = itemStatus.st_mtimespec.tv_sec;
+                                    value[2] = itemStatus.st_mtimespec.tv_nsec;
+
+                                    key   = CFStringCreateWithCString( kCFAllocatorDefault, item->d_name, kCFStringEncodingUTF8 );
+                                    stamp = CFDataCreate( kCFAllocatorDefault, ( void * ) value, sizeof( value ) );
+
+                                    if ( key && stamp )
+                                    {
+                                        DAFileSystemRef filesystem = NULL;
+                                        CFArrayRef      entry;
+
+                                        entry = __gDAFileSystemListCache ? CFDictionaryGetValue( __gDAFileSystemListCache, key ) : NULL;
+
+                                        if ( entry && CFEqual( CFArrayGetValueAtIndex( entry, 1 ), stamp ) )
+                                        {
+                                            filesystem = ( void * ) CFArrayGetValueAtIndex( entry, 0 );
+
+                                            CFRetain( filesystem );
+                                        }
+                                        else
+                                        {
+                                            CFURLRef path;
+
+                                            path = CFURLCreateFromFileSystemRepresentationRelativeToBase( kCFAllocatorDefault,
+                                                                                                          ( void * ) item->d_name,
+                                                                                                          strlen( item->d_name ),
+                                                                                                          TRUE,
+                                                                                                          base );
+
+                                            if ( path )
+                                            {
+                                                /*
+                                                 * Create a file system object for this file system.
+                                                 */
+
+                                                filesystem = DAFileSystemCreate( kCFAllocatorDefault, path );
+
+                                                if ( filesystem )
+                                                {
+                                                    if ( changed == FALSE )
+                                                    {
+                                                        DALogDebugHeader( "filesystems have been refreshed." );
+                                                    }
+
+                                                    DALogDebug( "  created filesystem, id = %@.", filesystem );
+                                                }
+
+                                                CFRelease( path );
+                                            }
+
+                                            changed = TRUE;
+                                        }
+
+                                        if ( filesystem )
+                                        {
+                                            CFTypeRef values[2];
+
+                                            values[0] = filesystem;
+                                            values[1] = stamp;
+
+                                            entry = CFArrayCreate( kCFAllocatorDefault, values, 2, &kCFTypeArrayCallBacks );
+
+                                            if ( entry )
+                                            {
+                                                CFDictionarySetValue( cache, key, entry );
+
+                                                CFRelease( entry );
+                                            }
+
+                                            CFArrayAppendValue( list, filesystem );
+
+                                            CFRelease( filesystem );
+                                        }
+                                    }
+
+                                    if ( key   )  CFRelease( key   );
+                                    if ( stamp )  CFRelease( stamp );
+                                }
+
+                                if ( itemPath )  free( itemPath );
+                            }
+                        }
+                    }
+
+                    closedir( folder );
+                }
+
+                /*
+                 * Determine whether a file system was removed.
+                 */
+
+                if ( __gDAFileSystemListCache == NULL || CFDictionaryGetCount( __gDAFileSystemListCache ) != CFDictionaryGetCount( cache ) )
+                {
+                    changed = TRUE;
+                }
+
+                if ( changed )
+                {
+                    CFIndex count;
+                    CFIndex index;
+
+                    /*
+                     * Replace the file system list.
+                     */
+
+                    CFArrayRemoveAllValues( gDAFileSystemList );
+                    CFArrayRemoveAllValues( gDAFileSystemProbeList );
+
+                    DAProbeCacheRemoveAllEntries( );
+
+                    count = CFArrayGetCount( list );
+
+                    for ( index = 0; index < count; index++ )
+                    {
+                        DAFileSystemRef filesystem;
+                        CFDictionaryRef probe;
+
+                        filesystem = ( void * ) CFArrayGetValueAtIndex( list, index );
+
+                        /*
+                         * Add this file system object to our list.
+                         */
+
+                        CFArrayAppendValue( gDAFileSystemList, filesystem );
+
+                        probe = DAFileSystemGetProbeList( filesystem );
+
+                        if ( probe )
+                        {
+                            CFDictionaryApplyFunction( probe, __DAFileSystemProbeListAppendValue, filesystem );
+                        }
+                    }
+
+                    /*
+                     * Order the probe list.
+                     */
+
+                    CFArraySortValues( gDAFileSystemProbeList,
+                                       CFRangeMake( 0, CFArrayGetCount( gDAFileSystemProbeList ) ),
+                                       __DAFileSystemProbeListCompare,
+                                       NULL );
+
+                    __DAFileSystemProbeHintListRefresh( );
+                }
+
+                if ( __gDAFileSystemListCache )
+                {
+                    CFRelease( __gDAFileSystemListCache );
+                }
+
+                __gDAFileSystemListCache = cache;
+
+                cache = NULL;
+
+                CFRelease( list );
+            }
+        }
+
+        if ( base  )  CFRelease( base  );
+        if ( cache )  CFRelease( cache );
+    }
+}
+
+#define __kDALatencyBucketCount 16
+
+struct __DALatency
+{
+    UInt64         buckets[__kDALatencyBucketCount];
+    UInt64         count;
+    CFAbsoluteTime maximum;
+    CFAbsoluteTime total;
+};
+
+typedef struct __DALatency __DALatency;
+
+static const char * __kDALatencyPhaseName[kDALatencyPhaseCount] =
+{
+    "StageProbe",
+    "StagePeek",
+    "StageAppear",
+    "StageApprove",
+    "StageAuthorize",
+    "StageMount",
+    "RequestApprove",
+    "RequestEject",
+    "RequestMount",
+    "RequestUnmount"
+};
+
+static CFMutableDictionaryRef __gDALatencyList = NULL;
+
+static void __DALatencyListCreateSummary( const void * key, const void * value, void * context )
+{
+    CFMutableDictionaryRef summary;
+
+    summary = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( summary )
+    {
+        const __DALatency * latency;
+        CFIndex             phase;
+
+        latency = ( void * ) CFDataGetBytePtr( value );
+
+        for ( phase = 0; phase < kDALatencyPhaseCount; phase++ )
+        {
+            CFMutableDictionaryRef entry;
+
+            if ( latency[phase].count == 0 )  continue;
+
+            entry = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( entry )
+            {
+                CFMutableArrayRef histogram;
+                CFStringRef       name;
+
+                ___CFDictionarySetIntegerValue( entry, CFSTR( "Count" ),   latency[phase].count );
+                ___CFDictionarySetIntegerValue( entry, CFSTR( "Maximum" ), latency[phase].maximum * 1000 );
+                ___CFDictionarySetIntegerValue( entry, CFSTR( "Total" ),   latency[phase].total   * 1000 );
+
+                histogram = CFArrayCreateMutable( kCFAllocatorDefault, __kDALatencyBucketCount, &kCFTypeArrayCallBacks );
+
+                if ( histogram )
+                {
+                    CFIndex index;
+
+                    for ( index = 0; index < __kDALatencyBucketCount; index++ )
+                    {
+                        CFNumberRef number;
+
+                        number = ___CFNumberCreateWithIntegerValue( kCFAllocatorDefault, latency[phase].buckets[index] );
+
+                        if ( number )
+                        {
+                            CFArrayAppendValue( histogram, number );
+
+                            CFRelease( number );
+                        }
+                    }
+
+                    CFDictionarySetValue( entry, CFSTR( "Histogram" ), histogram );
+
+                    CFRelease( histogram );
+                }
+
+                name = CFStringCreateWithCString( kCFAllocatorDefault, __kDALatencyPhaseName[phase], kCFStringEncodingUTF8 );
+
+                if ( name )
+                {
+                    CFDictionarySetValue( summary, name, entry );
+
+                    CFRelease( name );
+                }
+
+                CFRelease( entry );
+            }
+        }
+
+        CFDictionarySetValue( context, key, summary );
+
+        CFRelease( summary );
+    }
+}
+
+void DALatencyListAddSample( DALatencyPhase phase, DADiskRef disk, CFAbsoluteTime start )
+{
+    /*
+     * Account for the time spent in the specified phase, by file system.  The histogram buckets
+     * double in width, the first holding the samples under a millisecond and the last those over
+     * about sixteen seconds.
+     */
+
+    CFMutableDataRef data;
+    CFAbsoluteTime   duration;
+    CFStringRef      kind;
+
+    if ( phase >= kDALatencyPhaseCount )  return;
+
+    duration = CFAbsoluteTimeGetCurrent( ) - start;
+
+    if ( duration < 0 )  duration = 0;
+
+    kind = NULL;
+
+    if ( DADiskGetFileSystem( disk ) )
+    {
+        kind = DAFileSystemGetKind( DADiskGetFileSystem( disk ) );
+    }
+
+    if ( kind == NULL )
+    {
+        kind = DADiskGetDescription( disk, kDADiskDescriptionVolumeKindKey );
+    }
+
+    if ( kind == NULL )
+    {
+        kind = CFSTR( "none" );
+    }
+
+    if ( __gDALatencyList == NULL )
+    {
+        __gDALatencyList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDALatencyList );
+    }
+
+    data = ( CFMutableDataRef ) CFDictionaryGetValue( __gDALatencyList, kind );
+
+    if ( data == NULL )
+    {
+        data = CFDataCreateMutable( kCFAllocatorDefault, 0 );
+
+        if ( data )
+        {
+            CFDataSetLength( data, kDALatencyPhaseCount * sizeof( __DALatency ) );
+
+            CFDictionarySetValue( __gDALatencyList, kind, data );
+
+            CFRelease( data );
+        }
+    }
+
+    if ( data )
+    {
+        __DALatency * latency;
+        UInt64        milliseconds;
+        CFIndex       index;
+
+        latency = ( ( __DALatency * ) CFDataGetMutableBytePtr( data ) ) + phase;
+
+        milliseconds = duration * 1000;
+
+        for ( index = 0; milliseconds && index < __kDALatencyBucketCount - 1; index++ )
+        {
+            milliseconds >>= 1;
+        }
+
+        latency->buckets[index]++;
+        latency->count++;
+        latency->total += duration;
+
+        if ( latency->maximum < duration )
+        {
+            latency->maximum = duration;
+        }
+    }
+}
+
+CFDictionaryRef DALatencyListCreateSummary( void )
+{
+    /*
+     * Create a summary of the latency histograms, by file system and by phase, with the times in
+     * milliseconds.
+     */
+
+    CFMutableDictionaryRef summary;
+
+    summary = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( summary )
+    {
+        if ( __gDALatencyList )
+        {
+            CFDictionaryApplyFunction( __gDALatencyList, __DALatencyListCreateSummary, summary );
+        }
+    }
+
+    return summary;
+}
+
+static struct timespec __gDAMountMapListTime1  = { 0, 0 };
+static struct timespec __gDAMountMapListTime2  = { 0, 0 };
+static __DAWatch       __gDAMountMapListWatch1 = { FALSE, -1, _PATH_FSTAB };
+static __DAWatch       __gDAMountMapListWatch2 = { FALSE, -1, _PATH_VSDB  };
+
+/*
+ * The mount map lists are indexed as they are built, so that the entry for a volume is found
+ * without a scan.  Entries of the fstab that identify the device by a matching description are
+ * kept aside in order, since only matching against the media can resolve them.
+ */
+
+static CFMutableArrayRef      __gDAMountMapListDevice1 = NULL;
+static CFMutableDictionaryRef __gDAMountMapListName1   = NULL;
+static CFMutableDictionaryRef __gDAMountMapListOrder1  = NULL;
+static CFMutableDictionaryRef __gDAMountMapListUUID1   = NULL;
+static CFMutableDictionaryRef __gDAMountMapListUUID2   = NULL;
+
+const CFStringRef kDAMountMapMountAutomaticKey = CFSTR( "DAMountAutomatic" );
+const CFStringRef kDAMountMapMountOptionsKey   = CFSTR( "DAMountOptions"   );
+const CFStringRef kDAMountMapMountPathKey      = CFSTR( "DAMountPath"      );
+const CFStringRef kDAMountMapProbeIDKey        = CFSTR( "DAProbeID"        );
+const CFStringRef kDAMountMapProbeKindKey      = CFSTR( "DAProbeKind"      );
+
+static CFDictionaryRef __DAMountMapCreate1( CFAllocatorRef allocator, struct fstab * fs )
+{
+    CFMutableDictionaryRef map = NULL;
+
+    if ( strcmp( fs->fs_type, FSTAB_SW ) )
+    {
+        char * idAsCString = fs->fs_spec;
+
+        strsep( &idAsCString, "=" );
+
+        if ( idAsCString )
+        {
+            CFStringRef idAsString;
+
+            idAsString = CFStringCreateWithCString( kCFAllocatorDefault, idAsCString, kCFStringEncodingUTF8 );
+
+            if ( idAsString )
+            {
+                CFTypeRef id = NULL;
+
+                if ( strcmp( fs->fs_spec, "UUID" ) == 0 )
+                {
+                    id = ___CFUUIDCreateFromString( kCFAllocatorDefault, idAsString );
+                }
+                else if ( strcmp( fs->fs_spec, "LABEL" ) == 0 )
+                {
+                    id = CFRetain( idAsString );
+                }
+                else if ( strcmp( fs->fs_spec, "DEVICE" ) == 0 )
+                {
+                    id = ___CFDictionaryCreateFromXMLString( kCFAllocatorDefault, idAsString );
+                }
+
+                if ( id )
+                {
+                    map = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                    if ( map )
+                    {
+                        CFMutableStringRef options;
+
+                        options = CFStringCreateMutable( kCFAllocatorDefault, 0 );
+
+                        if ( options )
+                        {
+                            char *       argument  = NULL;
+                            char *       arguments = fs->fs_mntops;
+                            CFBooleanRef automatic = NULL;
+
+                            while ( ( argument = strsep( &arguments, "," ) ) )
+                            {
+                                if ( strcmp( argument, "auto" ) == 0 )
+                                {
+                                    automatic = kCFBooleanTrue;
+                                }
+                                else if ( strcmp( argument, "noauto" ) == 0 )
+                                {
+                                    automatic = kCFBooleanFalse;
+                                }
+                                else
+                                {
+                                    CFStringAppendCString( options, argument, kCFStringEncodingUTF8 );    
+                                    CFStringAppendCString( options, ",", kCFStringEncodingUTF8 );
+                                }
+                            }
+
+                            if ( automatic )
+                            {
+                                CFDictionarySetValue( map, kDAMountMapMountAutomaticKey, automatic );
+                            }
+
+                            if ( CFStringGetLength( options ) )
+                            {
+                                CFStringTrim( options, CFSTR( "," ) );
+
+                                CFDictionarySetValue( map, kDAMountMapMountOptionsKey, options );
+                            }
+
+                            CFRelease( options );
+                        }
+
+                        if ( strcmp( fs->fs_file, "none" ) )
+                        {
+                            CFURLRef path;
+
+                            path = CFURLCreateFromFileSystemRepresentation( kCFAllocatorDefault, ( void * ) fs->fs_file, strlen( fs->fs_file ), TRUE );
+
+                            if ( path )
+                            {
+                                CFDictionarySetValue( map, kDAMountMapMountPathKey, path );
+
+                                CFRelease( path );
+                            }
+                        }
+
+                        if ( strcmp( fs->fs_vfstype, "auto" ) )
+                        {
+                            CFStringRef kind;
+
+                            kind = CFStringCreateWithCString( kCFAllocatorDefault, fs->fs_vfstype, kCFStringEncodingUTF8 );
+
+                            if ( kind )
+                            {
+                                CFDictionarySetValue( map, kDAMountMapProbeKindKey, kind );
+
+                                CFRelease( kind );
+                            }
+                        }
+
+                        CFDictionarySetValue( map, kDAMountMapProbeIDKey, id );
+                    }
+
+                    CFRelease( id );
+                }
+
+                CFRelease( idAsString );
+            }
+        }
+    }
+
+    return map;
+}
+
+static void __DAMountMapListAddIndex1( CFMutableDictionaryRef index, CFTypeRef key, CFDictionaryRef map )
+{
+    CFMutableArrayRef list;
+
+    list = ( CFMutableArrayRef ) CFDictionaryGetValue( index, key );
+
+    if ( list )
+    {
+        CFArrayAppendValue( list, map );
+    }
+    else
+    {
+        list = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( list )
+        {
+            CFArrayAppendValue( list, map );
+
+            CFDictionarySetValue( index, key, list );
+
+            CFRelease( list );
+        }
+    }
+}
+
+static Boolean __DAMountMapMatchKind( CFDictionaryRef map, DAFileSystemRef filesystem )
+{
+    CFStringRef kind;
+
+    kind = CFDictionaryGetValue( map, kDAMountMapProbeKindKey );
+
+    if ( kind )
+    {
+        /*
+         * Determine whether the volume kind matches.
+         */
+
+        if ( filesystem == NULL || CFEqual( kind, DAFileSystemGetKind( filesystem ) ) == FALSE )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void __DAMountMapListIndex1( void )
+{
+    CFIndex count;
+    CFIndex index;
+
+    if ( __gDAMountMapListOrder1 == NULL )
+    {
+        __gDAMountMapListDevice1 = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+        __gDAMountMapListName1   = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+        __gDAMountMapListOrder1  = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, NULL, NULL );
+        __gDAMountMapListUUID1   = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDAMountMapListDevice1 );
+        assert( __gDAMountMapListName1   );
+        assert( __gDAMountMapListOrder1  );
+        assert( __gDAMountMapListUUID1   );
+    }
+
+    CFArrayRemoveAllValues( __gDAMountMapListDevice1 );
+    CFDictionaryRemoveAllValues( __gDAMountMapListName1 );
+    CFDictionaryRemoveAllValues( __gDAMountMapListOrder1 );
+    CFDictionaryRemoveAllValues( __gDAMountMapListUUID1 );
+
+    count = CFArrayGetCount( gDAMountMapList1 );
+
+    for ( index = 0; index < count; index++ )
+    {
+        CFTypeRef       id;
+        CFDictionaryRef map;
+
+        map = CFArrayGetValueAtIndex( gDAMountMapList1, index );
+
+        id = CFDictionaryGetValue( map, kDAMountMapProbeIDKey );
+
+        CFDictionarySetValue( __gDAMountMapListOrder1, map, ( void * ) ( index + 1 ) );
+
+        if ( CFGetTypeID( id ) == CFUUIDGetTypeID( ) )
+        {
+            __DAMountMapListAddIndex1( __gDAMountMapListUUID1, id, map );
+        }
+        else if ( CFGetTypeID( id ) == CFStringGetTypeID( ) )
+        {
+            __DAMountMapListAddIndex1( __gDAMountMapListName1, id, map );
+        }
+        else if ( CFGetTypeID( id ) == CFDictionaryGetTypeID( ) )
+        {
+            CFArrayAppendValue( __gDAMountMapListDevice1, map );
+        }
+    }
+}
+
+CFDictionaryRef DAMountMapListGetMap1( DADiskRef disk )
+{
+    /*
+     * Obtain the entry of the fstab mount map list that applies to the specified volume.  Should
+     * several entries apply, the one that comes first in the list is chosen.
+     */
+
+    CFIndex         count;
+    DAFileSystemRef filesystem;
+    CFIndex         index;
+    CFTypeRef       key[2];
+    CFDictionaryRef map      = NULL;
+    CFIndex         order    = 0;
+    CFDictionaryRef table[2];
+
+    if ( __gDAMountMapListOrder1 == NULL )
+    {
+        return NULL;
+    }
+
+    filesystem = DADiskGetFileSystem( disk );
+
+    key[0]   = DADiskGetDescription( disk, kDADiskDescriptionVolumeUUIDKey );
+    key[1]   = DADiskGetDescription( disk, kDADiskDescriptionVolumeNameKey );
+    table[0] = __gDAMountMapListUUID1;
+    table[1] = __gDAMountMapListName1;
+
+    for ( index = 0; index < 2; index++ )
+    {
+        CFArrayRef list;
+
+        list = key[index] ? CFDictionaryGetValue( table[index], key[index] ) : NULL;
+
+        if ( list )
+        {
+            CFIndex subcount;
+            CFIndex subindex;
+
+            subcount = CFArrayGetCount( list );
+
+            for ( subindex = 0; subindex < subcount; subindex++ )
+            {
+                CFDictionaryRef item;
+
+                item = CFArrayGetValueAtIndex( list, subindex );
+
+                if ( __DAMountMapMatchKind( item, filesystem ) )
+                {
+                    CFIndex suborder;
+
+                    suborder = ( CFIndex ) CFDictionaryGetValue( __gDAMountMapListOrder1, item );
+
+                    if ( map == NULL || suborder < order )
+                    {
+                        map   = item;
+                        order = suborder;
+                    }
+
+                    break;
+                }
+            }
+        }
+    }
+
+    count = CFArrayGetCount( __gDAMountMapListDevice1 );
+
+    for ( index = 0; index < count; index++ )
+    {
+        CFDictionaryRef item;
+
+        item = CFArrayGetValueAtIndex( __gDAMountMapListDevice1, index );
+
+        if ( map && ( CFIndex ) CFDictionaryGetValue( __gDAMountMapListOrder1, item ) > order )
+        {
+            break;
+        }
+
+        if ( __DAMountMapMatchKind( item, filesystem ) )
+        {
+            boolean_t match = FALSE;
+
+            /*
+             * Determine whether the device description matches.
+             */
+
+            IOServiceMatchPropertyTable( DADiskGetIOMedia( disk ), CFDictionaryGetValue( item, kDAMountMapProbeIDKey ), &match );
+
+            if ( match )
+            {
+                map = item;
+
+                break;
+            }
+        }
+    }
+
+    return map;
+}
+
+void DAMountMapListRefresh1( void )
+{
+    struct stat status;
+
+    /*
+     * Determine whether the mount map list has changed since we last looked at it.
+     */
+
+    if ( __DAWatchGetChanged( &__gDAMountMapListWatch1 ) == FALSE )
+    {
+        return;
+    }
+
+    /*
+     * Determine whether the mount map list is up-to-date.
+     */
+
+    if ( stat( _PATH_FSTAB, &status ) )
+    {
+        __gDAMountMapListTime1.tv_sec  = 0;
+        __gDAMountMapListTime1.tv_nsec = 0;
+    }
+
+    if ( __gDAMountMapListTime1.tv_sec  != status.st_mtimespec.tv_sec  ||
+         __gDAMountMapListTime1.tv_nsec != status.st_mtimespec.tv_nsec )
+    {
+        __gDAMountMapListTime1.tv_sec  = status.st_mtimespec.tv_sec;
+        __gDAMountMapListTime1.tv_nsec = status.st_mtimespec.tv_nsec;
+
+        /*
+         * Clear the mount map list.
+         */
+
+        CFArrayRemoveAllValues( gDAMountMapList1 );
+
+        /*
+         * Build the mount map list.
+         */
+
+        if ( setfsent( ) )
+        {
+            struct fstab * item;
+
+            while ( ( item = getfsent( ) ) )
+            {
+                CFDictionaryRef map;
+
+                map = __DAMountMapCreate1( kCFAllocatorDefault, item );
+
+                if ( map )
+                {
+                    CFArrayAppendValue( gDAMountMapList1, map );
+
+                    CFRelease( map );
+                }
+            }
+
+            endfsent( );
+        }
+
+        __DAMountMapListIndex1( );
+    }
+}
+
+static CFDictionaryRef __DAMountMapCreate2( CFAllocatorRef allocator, struct vsdb * vs )
+{
+    CFStringRef            idAsString;
+    CFMutableDictionaryRef map = NULL;
+
+    idAsString = CFStringCreateWithCString( kCFAllocatorDefault, vs->vs_spec, kCFStringEncodingUTF8 );
+
+    if ( idAsString )
+    {
+        CFTypeRef id;
+
+        id = _DAFileSystemCreateUUIDFromString( kCFAllocatorDefault, idAsString );
+
+        if ( id )
+        {
+            map = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+            if ( map )
+            {
+                CFMutableStringRef options;
+
+                options = CFStringCreateMutable( kCFAllocatorDefault, 0 );
+
+                if ( options )
+                {
+                    if ( ( vs->vs_ops & VSDB_PERM ) )
+                    {
+                        CFStringAppend( options, CFSTR( "owners" ) );
+                        CFStringAppend( options, CFSTR( "," ) );
+                    }
+                    else
+                    {
+                        CFStringAppend( options, CFSTR( "noowners" ) );
+                        CFStringAppend( options, CFSTR( "," ) );
+                    }
+
+                    if ( CFStringGetLength( options ) )
+                    {
+                        CFStringTrim( options, CFSTR( "," ) );
+
+                        CFDictionarySetValue( map, kDAMountMapMountOptionsKey, options );
+                    }
+
+                    CFRelease( options );
+                }
+
+                CFDictionarySetValue( map, kDAMountMapProbeIDKey, id );
+            }
+
+            CFRelease( id );
+        }
+
+        CFRelease( idAsString );
+    }
+
+    return map;
+}
+
+static void __DAMountMapListIndex2( void )
+{
+    CFIndex count;
+    CFIndex index;
+
+    if ( __gDAMountMapListUUID2 == NULL )
+    {
+        __gDAMountMapListUUID2 = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDAMountMapListUUID2 );
+    }
+
+    CFDictionaryRemoveAllValues( __gDAMountMapListUUID2 );
+
+    count = CFArrayGetCount( gDAMountMapList2 );
+
+    for ( index = 0; index < count; index++ )
+    {
+        CFDictionaryRef map;
+
+        map = CFArrayGetValueAtIndex( gDAMountMapList2, index );
+
+        /*
+         * The first entry for a given volume UUID prevails.
+         */
+
+        CFDictionaryAddValue( __gDAMountMapListUUID2, CFDictionaryGetValue( map, kDAMountMapProbeIDKey ), map );
+    }
+}
+
+CFDictionaryRef DAMountMapListGetMap2( DADiskRef disk )
+{
+    /*
+     * Obtain the entry of the vsdb mount map list that applies to the specified volume.
+     */
+
+    CFUUIDRef uuid;
+
+    uuid = DADiskGetDescription( disk, kDADiskDescriptionVolumeUUIDKey );
+
+    if ( uuid && __gDAMountMapListUUID2 )
+    {
+        return CFDictionaryGetValue( __gDAMountMapListUUID2, uuid );
+    }
+
+    return NULL;
+}
+
+void DAMountMapListRefresh2( void )
+{
+    struct stat status;
+
+    /*
+     * Determine whether the mount map list has changed since we last looked at it.
+     */
+
+    if ( __DAWatchGetChanged( &__gDAMountMapListWatch2 ) == FALSE )
+    {
+        return;
+    }
+
+    /*
+     * Determine whether the mount map list is up-to-date.
+     */
+
+    if ( stat( _PATH_VSDB, &status ) )
+    {
+        __gDAMountMapListTime2.tv_sec  = 0;
+        __gDAMountMapListTime2.tv_nsec = 0;
+    }
+
+    if ( __gDAMountMapListTime2.tv_sec  != status.st_mtimespec.tv_sec  ||
+         __gDAMountMapListTime2.tv_nsec != status.st_mtimespec.tv_nsec )
+    {
+        __gDAMountMapListTime2.tv_sec  = status.st_mtimespec.tv_sec;
+        __gDAMountMapListTime2.tv_nsec = status.st_mtimespec.tv_nsec;
+
+        /*
+         * Clear the mount map list.
+         */
+
+        CFArrayRemoveAllValues( gDAMountMapList2 );
+
+        /*
+         * Build the mount map list.
+         */
+
+        if ( setvsent( ) )
+        {
+            struct vsdb * item;
+
+            while ( ( item = getvsent( ) ) )
+            {
+                CFDictionaryRef map;
+
+                map = __DAMountMapCreate2( kCFAllocatorDefault, item );
+
+                if ( map )
+                {
+                    CFArrayAppendValue( gDAMountMapList2, map );
+
+                    CFRelease( map );
+                }
+            }
+
+            endvsent( );
+        }
+
+        __DAMountMapListIndex2( );
+    }
+}
+
+static struct timespec __gDAPreferenceListTime1 = { 0, 0 };
+static struct timespec __gDAPreferenceListTime2 = { 0, 0 };
+
+const CFStringRef kDAPreferenceIgnoreKey              = CFSTR( "DAIgnore"              );
+const CFStringRef kDAPreferenceMountDeferExternalKey  = CFSTR( "DAMountDeferExternal"  );
+const CFStringRef kDAPreferenceMountDeferInternalKey  = CFSTR( "DAMountDeferInternal"  );
+const CFStringRef kDAPreferenceMountDeferRemovableKey = CFSTR( "DAMountDeferRemovable" );
+const CFStringRef kDAPreferenceMountTimeoutKey        = CFSTR( "DAMountTimeout"        );
+const CFStringRef kDAPreferenceMountTrustExternalKey  = CFSTR( "DAMountTrustExternal"  );
+const CFStringRef kDAPreferenceMountTrustInternalKey  = CFSTR( "DAMountTrustInternal"  );
+const CFStringRef kDAPreferenceMountTrustRemovableKey = CFSTR( "DAMountTrustRemovable" );
+const CFStringRef kDAPreferenceProbeConcurrencyKey    = CFSTR( "DAProbeConcurrency"    );
+const CFStringRef kDAPreferenceProbeTimeoutKey        = CFSTR( "DAProbeTimeout"        );
+const CFStringRef kDAPreferenceRepairTimeoutKey       = CFSTR( "DARepairTimeout"       );
+
+static Boolean __DAPreferenceListMatchIgnore( CFArrayRef list, io_service_t media )
+{
+    /*
+     * Determine whether the media object matches one of the property tables of the ignore list.
+     */
+
+    CFIndex count;
+    CFIndex index;
+
+    count = CFArrayGetCount( list );
+
+    for ( index = 0; index < count; index++ )
+    {
+        boolean_t match = FALSE;
+
+        IOServiceMatchPropertyTable( media, CFArrayGetValueAtIndex( list, index ), &match );
+
+        if ( match )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+Boolean DAPreferenceListGetIgnore( io_service_t media )
+{
+    /*
+     * Determine whether the media object, or any media object it descends from, matches one of the
+     * property tables of the ignore list.  A partition of an ignored disk is thus ignored as well.
+     */
+
+    CFArrayRef list;
+    Boolean    match = FALSE;
+
+    list = CFDictionaryGetValue( gDAPreferenceList, kDAPreferenceIgnoreKey );
+
+    if ( list )
+    {
+        io_iterator_t services;
+
+        match = __DAPreferenceListMatchIgnore( list, media );
+
+        if ( match == FALSE )
+        {
+            if ( IORegistryEntryCreateIterator( media,
+                                                kIOServicePlane,
+                                                kIORegistryIterateParents | kIORegistryIterateRecursively,
+                                                &services ) == KERN_SUCCESS )
+            {
+                io_service_t service;
+
+                while ( match == FALSE && ( service = IOIteratorNext( services ) ) )
+                {
+                    if ( service != media && IOObjectConformsTo( service, kIOMediaClass ) )
+                    {
+                        match = __DAPreferenceListMatchIgnore( list, service );
+                    }
+
+                    IOObjectRelease( service );
+                }
+
+                IOObjectRelease( services );
+            }
+        }
+    }
+
+    return match;
+}
+
+void DAPreferenceListRefresh( void )
+{
+    struct stat status1;
+    struct stat status2;
+
+    /*
+     * Determine whether the preference list is up-to-date.
+     */
+
+    if ( stat( ___PREFS_DEFAULT_DIR "/" "autodiskmount.plist", &status1 ) )
+    {
+        __gDAPreferenceListTime1.tv_sec  = 0;
+        __gDAPreferenceListTime1.tv_nsec = 0;
+    }
+
+    if ( stat( ___PREFS_DEFAULT_DIR "/" _kDADaemonName ".plist", &status2 ) )
+    {
+        __gDAPreferenceListTime2.tv_sec  = 0;
+        __gDAPreferenceListTime2.tv_nsec = 0;
+    }
+
+    if ( __gDAPreferenceListTime1.tv_sec  != status1.st_mtimespec.tv_sec  ||
+         __gDAPreferenceListTime1.tv_nsec != status1.st_mtimespec.tv_nsec ||
+         __gDAPreferenceListTime2.tv_sec  != status2.st_mtimespec.tv_sec  ||
+         __gDAPreferenceListTime2.tv_nsec != status2.st_mtimespec.tv_nsec )
+    {
+        SCPreferencesRef preferences;
+
+        __gDAPreferenceListTime1.tv_sec  = status1.st_mtimespec.tv_sec;
+        __gDAPreferenceListTime1.tv_nsec = status1.st_mtimespec.tv_nsec;
+        __gDAPreferenceListTime2.tv_sec  = status2.st_mtimespec.tv_sec;
+        __gDAPreferenceListTime2.tv_nsec = status2.st_mtimespec.tv_nsec;
+
+        /*
+         * Clear the preference list.
+         */
+
+        CFDictionaryRemoveAllValues( gDAPreferenceList );
+
+        /*
+         * Build the preference list.
+         */
+
+        preferences = SCPreferencesCreate( kCFAllocatorDefault, CFSTR( "autodiskmount" ), CFSTR( "autodiskmount.plist" ) );
+
+        if ( preferences )
+        {
+            CFTypeRef value;
+
+            value = SCPreferencesGetValue( preferences, CFSTR( "AutomountDisksWithoutUserLogin" ) );
+
+            if ( value == kCFBooleanTrue )
+            {
+                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferExternalKey,  kCFBooleanFalse );
+                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferRemovableKey, kCFBooleanFalse );
+                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustExternalKey,  kCFBooleanTrue  );
+            }
+            else if ( value == kCFBooleanFalse )
+            {
+                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferExternalKey,  kCFBooleanFalse );
+                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferRemovableKey, kCFBooleanTrue  );
+                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustExternalKey,  kCFBooleanTrue  );
+            }
+
+            CFRelease( preferences );
+        }
+
+        preferences = SCPreferencesCreate( kCFAllocatorDefault, CFSTR( _kDADaemonName ), CFSTR( _kDADaemonName ".plist" ) );
+
+        if ( preferences )
+        {
+            CFTypeRef value;
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceIgnoreKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFArrayGetTypeID( ) )
+                {
+                    CFMutableArrayRef list;
+
+                    /*
+                     * Keep the well-formed property tables, such that the list need not be checked
+                     * again as media objects appear.
+                     */
+
+                    list = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+                    if ( list )
+                    {
+                        CFIndex count;
+                        CFIndex index;
+
+                        count = CFArrayGetCount( value );
+
+                        for ( index = 0; index < count; index++ )
+                        {
+                            CFTypeRef item;
+
+                            item = CFArrayGetValueAtIndex( value, index );
+
+                            if ( CFGetTypeID( item ) == CFDictionaryGetTypeID( ) )
+                            {
+                                if ( CFDictionaryGetCount( item ) )
+                                {
+                                    CFArrayAppendValue( list, item );
+                                }
+                            }
+                        }
+
+                        if ( CFArrayGetCount( list ) )
+                        {
+                            CFDictionarySetValue( gDAPreferenceList, kDAPreferenceIgnoreKey, list );
+                        }
+
+                        CFRelease( list );
+                    }
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountDeferExternalKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferExternalKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountDeferInternalKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferInternalKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountDeferRemovableKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferRemovableKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTrustExternalKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustExternalKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTrustInternalKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustInternalKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTrustRemovableKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustRemovableKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceProbeConcurrencyKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFNumberGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceProbeConcurrencyKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTimeoutKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFNumberGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTimeoutKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceProbeTimeoutKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFNumberGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceProbeTimeoutKey, value );
+                }
+            }
+
+            value = SCPreferencesGetValue( preferences, kDAPreferenceRepairTimeoutKey );
+
+            if ( value )
+            {
+                if ( CFGetTypeID( value ) == CFNumberGetTypeID( ) )
+                {
+                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceRepairTimeoutKey, value );
+                }
+            }
+
+            CFRelease( preferences );
+        }
+    }
+}
+
+const CFStringRef kDAProbeCacheDigestKey      = CFSTR( "DAProbeDigest"      );
+const CFStringRef kDAProbeCacheVolumeCleanKey = CFSTR( "DAProbeVolumeClean" );
+const CFStringRef kDAProbeCacheVolumeNameKey  = CFSTR( "DAProbeVolumeName"  );
+const CFStringRef kDAProbeCacheVolumeUUIDKey  = CFSTR( "DAProbeVolumeUUID"  );
+
+static const CFStringRef __kDAProbeCacheFileSystemKindKey = CFSTR( "DAProbeFileSystemKind" );
+static const CFStringRef __kDAProbeCacheMediaIDKey        = CFSTR( "DAProbeMediaID"        );
+static const CFStringRef __kDAProbeCacheMediaUUIDKey      = CFSTR( "DAProbeMediaUUID"      );
+
+static const CFIndex __kDAProbeCacheLimit      = 512;
+static const char *  __kDAProbeCachePath       = "/var/run/diskarbitrationd.state";
+static const size_t  __kDAProbeCacheSampleSize = 65536;
+
+static Boolean                __gDAProbeCacheDirty     = FALSE;
+static CFIndex                __gDAProbeCacheHitCount  = 0;
+static CFMutableDictionaryRef __gDAProbeCacheList      = NULL;
+static CFIndex                __gDAProbeCacheMissCount = 0;
+
+/*
+ * The repair list remembers, for each media object, the volume that last checked or repaired as
+ * clean, so that a probe can spare the "is clean" command.  It is not saved, as a restart should
+ * err on the side of a fresh check.
+ */
+
+static CFMutableDictionaryRef __gDARepairList = NULL;
+
+static CFTypeRef __DAProbeCacheCreateKey( DADiskRef disk )
+{
+    /*
+     * Obtain the media identity, by its media UUID where it has one, else by its registry entry ID.
+     */
+
+    CFTypeRef key;
+
+    key = DADiskGetDescription( disk, kDADiskDescriptionMediaUUIDKey );
+
+    if ( key )
+    {
+        CFRetain( key );
+    }
+    else if ( DADiskGetIOMedia( disk ) )
+    {
+        uint64_t id;
+
+        if ( IORegistryEntryGetRegistryEntryID( DADiskGetIOMedia( disk ), &id ) == KERN_SUCCESS )
+        {
+            key = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt64Type, &id );
+        }
+    }
+
+    return key;
+}
+
+static void __DAProbeCacheLoadEntry( const void * value, void * context )
+{
+    /*
+     * Restore an entry from the state file.  The entry is dropped if its media object is gone or
+     * if its file system is no longer installed.  The media object is matched by its registry entry
+     * ID, even where the entry is keyed by media UUID, as media detached and reattached while we
+     * were not running may have been written to elsewhere.
+     */
+
+    CFDictionaryRef        entry = value;
+    DAFileSystemRef        filesystem;
+    CFTypeRef              key;
+    CFStringRef            kind;
+    CFNumberRef            number;
+    CFMutableDictionaryRef restore;
+    CFStringRef            string;
+
+    if ( CFGetTypeID( entry ) != CFDictionaryGetTypeID( ) )  return;
+
+    filesystem = NULL;
+
+    kind = CFDictionaryGetValue( entry, __kDAProbeCacheFileSystemKindKey );
+
+    if ( kind )
+    {
+        CFIndex count;
+        CFIndex index;
+
+        count = CFArrayGetCount( gDAFileSystemList );
+
+        for ( index = 0; index < count; index++ )
+        {
+            filesystem = ( void * ) CFArrayGetValueAtIndex( gDAFileSystemList, index );
+
+            if ( CFEqual( DAFileSystemGetKind( filesystem ), kind ) )  break;
+
+            filesystem = NULL;
+        }
+    }
+
+    if ( filesystem == NULL )  return;
+
+    if ( CFDictionaryGetValue( entry, kDAProbeCacheDigestKey ) == NULL )  return;
+
+    number = CFDictionaryGetValue( entry, __kDAProbeCacheMediaIDKey );
+
+    if ( number == NULL )  return;
+
+    if ( CFGetTypeID( number ) != CFNumberGetTypeID( ) )  return;
+
+    {
+        io_service_t media;
+        uint64_t     id;
+
+        CFNumberGetValue( number, kCFNumberSInt64Type, &id );
+
+        media = IOServiceGetMatchingService( kIOMasterPortDefault, IORegistryEntryIDMatching( id ) );
+
+        if ( media == IO_OBJECT_NULL )  return;
+
+        IOObjectRelease( media );
+    }
+
+    string = CFDictionaryGetValue( entry, __kDAProbeCacheMediaUUIDKey );
+
+    if ( string )
+    {
+        key = ___CFUUIDCreateFromString( kCFAllocatorDefault, string );
+
+        if ( key == NULL )  return;
+    }
+    else
+    {
+        key = CFRetain( number );
+    }
+
+    restore = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( restore )
+    {
+        CFTypeRef object;
+
+        CFDictionarySetValue( restore, kDAFileSystemKey,          filesystem );
+        CFDictionarySetValue( restore, kDAProbeCacheDigestKey,    CFDictionaryGetValue( entry, kDAProbeCacheDigestKey ) );
+        CFDictionarySetValue( restore, __kDAProbeCacheMediaIDKey, number );
+
+        object = CFDictionaryGetValue( entry, kDAProbeCacheVolumeCleanKey );
+
+        if ( object )  CFDictionarySetValue( restore, kDAProbeCacheVolumeCleanKey, object );
+
+        object = CFDictionaryGetValue( entry, kDAProbeCacheVolumeNameKey );
+
+        if ( object )  CFDictionarySetValue( restore, kDAProbeCacheVolumeNameKey, object );
+
+        string = CFDictionaryGetValue( entry, kDAProbeCacheVolumeUUIDKey );
+
+        if ( string )
+        {
+            object = ___CFUUIDCreateFromString( kCFAllocatorDefault, string );
+
+            if ( object )
+            {
+                CFDictionarySetValue( restore, kDAProbeCacheVolumeUUIDKey, object );
+
+                CFRelease( object );
+            }
+        }
+
+        CFDictionarySetValue( context, key, restore );
+
+        CFRelease( restore );
+    }
+
+    CFRelease( key );
+}
+
+static void __DAProbeCacheSaveEntry( const void * key, const void * value, void * context )
+{
+    /*
+     * Flatten an entry for the state file.  Entries for probes still in progress are left out.
+     */
+
+    CFDictionaryRef        entry = value;
+    DAFileSystemRef        filesystem;
+    CFNumberRef            number;
+    CFMutableDictionaryRef save;
+
+    filesystem = ( void * ) CFDictionaryGetValue( entry, kDAFileSystemKey );
+
+    if ( filesystem == NULL )  return;
+
+    number = CFDictionaryGetValue( entry, __kDAProbeCacheMediaIDKey );
+
+    if ( number == NULL )  return;
+
+    save = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( save )
+    {
+        CFTypeRef object;
+
+        if ( CFGetTypeID( key ) == CFUUIDGetTypeID( ) )
+        {
+            object = CFUUIDCreateString( kCFAllocatorDefault, key );
+
+            if ( object )
+            {
+                CFDictionarySetValue( save, __kDAProbeCacheMediaUUIDKey, object );
+
+                CFRelease( object );
+            }
+        }
+
+        CFDictionarySetValue( save, __kDAProbeCacheMediaIDKey,        number );
+        CFDictionarySetValue( save, __kDAProbeCacheFileSystemKindKey, DAFileSystemGetKind( filesystem ) );
+        CFDictionarySetValue( save, kDAProbeCacheDigestKey,           CFDictionaryGetValue( entry, kDAProbeCacheDigestKey ) );
+
+        object = CFDictionaryGetValue( entry, kDAProbeCacheVolumeCleanKey );
+
+        if ( object )  CFDictionarySetValue( save, kDAProbeCacheVolumeCleanKey, object );
+
+        object = CFDictionaryGetValue( entry, kDAProbeCacheVolumeNameKey );
+
+        if ( object )  CFDictionarySetValue( save, kDAProbeCacheVolumeNameKey, object );
+
+        object = CFDictionaryGetValue( entry, kDAProbeCacheVolumeUUIDKey );
+
+        if ( object )
+        {
+            object = CFUUIDCreateString( kCFAllocatorDefault, object );
+
+            if ( object )
+            {
+                CFDictionarySetValue( save, kDAProbeCacheVolumeUUIDKey, object );
+
+                CFRelease( object );
+            }
+        }
+
+        CFArrayAppendValue( context, save );
+
+        CFRelease( save );
+    }
+}
+
+CFDataRef DAProbeCacheCreateDigest( const char * path, UInt64 size )
+{
+    /*
+     * Create a digest of the media size and of the media content at which the file systems keep
+     * their labels, identifiers and state.  This call is blocking and is safe to make off of the
+     * main thread.
+     */
+
+    UInt8 *   buffer = NULL;
+    ssize_t   count  = 0;
+    CFDataRef digest = NULL;
+    int       file   = -1;
+
+    buffer = malloc( __kDAProbeCacheSampleSize );
+    if ( buffer == NULL )  goto DAProbeCacheCreateDigestErr;
+
+    file = open( path, O_RDONLY );
+    if ( file == -1 )  goto DAProbeCacheCreateDigestErr;
+
+    count = pread( file, buffer, ( size < __kDAProbeCacheSampleSize ) ? size : __kDAProbeCacheSampleSize, 0 );
+    if ( count < 1 )  goto DAProbeCacheCreateDigestErr;
+
+    {
+        CC_SHA1_CTX   context;
+        unsigned char value[CC_SHA1_DIGEST_LENGTH];
+
+        CC_SHA1_Init( &context );
+        CC_SHA1_Update( &context, &size, sizeof( size ) );
+        CC_SHA1_Update( &context, buffer, count );
+        CC_SHA1_Final( value, &context );
+
+        digest = CFDataCreate( kCFAllocatorDefault, value, sizeof( value ) );
+    }
+
+DAProbeCacheCreateDigestErr:
+
+    if ( buffer    )  free( buffer );
+    if ( file > -1 )  close( file );
+
+    return digest;
+}
+
+CFDataRef DAProbeCacheGetDigest( DADiskRef disk )
+{
+    /*
+     * Obtain the digest of the media content, as last sampled for a probe.
+     */
+
+    CFDataRef digest = NULL;
+
+    if ( __gDAProbeCacheList )
+    {
+        CFTypeRef key;
+
+        key = __DAProbeCacheCreateKey( disk );
+
+        if ( key )
+        {
+            CFDictionaryRef entry;
+
+            entry = CFDictionaryGetValue( __gDAProbeCacheList, key );
+
+            if ( entry )
+            {
+                digest = CFDictionaryGetValue( entry, kDAProbeCacheDigestKey );
+            }
+
+            CFRelease( key );
+        }
+    }
+
+    return digest;
+}
+
+CFDictionaryRef DAProbeCacheGetEntry( DADiskRef disk, CFDataRef digest )
 {
-    CFStringRef            idAsString;
-    CFMutableDictionaryRef map = NULL;
+    CFDictionaryRef entry = NULL;
 
-    idAsString = CFStringCreateWithCString( kCFAllocatorDefault, vs->vs_spec, kCFStringEncodingUTF8 );
+    if ( __gDAProbeCacheList )
+    {
+        CFTypeRef key;
 
-    if ( idAsString )
+        key = __DAProbeCacheCreateKey( disk );
+
+        if ( key )
+        {
+            entry = CFDictionaryGetValue( __gDAProbeCacheList, key );
+
+            if ( entry )
+            {
+                /*
+                 * Determine whether the entry is complete and whether the media content is unchanged.
+                 */
+
+                if ( CFDictionaryGetValue( entry, kDAFileSystemKey ) == NULL )
+                {
+                    entry = NULL;
+                }
+                else if ( CFEqual( CFDictionaryGetValue( entry, kDAProbeCacheDigestKey ), digest ) == FALSE )
+                {
+                    entry = NULL;
+                }
+            }
+
+            CFRelease( key );
+        }
+    }
+
+    if ( entry )
     {
-        CFTypeRef id;
+        __gDAProbeCacheHitCount++;
+    }
+    else
+    {
+        __gDAProbeCacheMissCount++;
+    }
 
-        id = _DAFileSystemCreateUUIDFromString( kCFAllocatorDefault, idAsString );
+    return entry;
+}
 
-        if ( id )
+void DAProbeCacheLoad( void )
+{
+    /*
+     * Restore the probe results saved by a previous instance of the daemon.  The state file lives
+     * in /var/run, so that it does not outlive the registry entry IDs it refers to.
+     */
+
+    CFDataRef data = NULL;
+    int       file;
+    CFTypeRef list = NULL;
+
+    file = open( __kDAProbeCachePath, O_RDONLY );
+
+    if ( file != -1 )
+    {
+        struct stat status;
+
+        if ( fstat( file, &status ) == 0 && status.st_size > 0 )
         {
-            map = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+            UInt8 * buffer;
 
-            if ( map )
+            buffer = malloc( status.st_size );
+
+            if ( buffer )
             {
-                CFMutableStringRef options;
+                if ( read( file, buffer, status.st_size ) == status.st_size )
+                {
+                    data = CFDataCreate( kCFAllocatorDefault, buffer, status.st_size );
+                }
 
-                options = CFStringCreateMutable( kCFAllocatorDefault, 0 );
+                free( buffer );
+            }
+        }
 
-                if ( options )
+        close( file );
+    }
+
+    if ( data )
+    {
+        list = CFPropertyListCreateWithData( kCFAllocatorDefault, data, kCFPropertyListImmutable, NULL, NULL );
+
+        CFRelease( data );
+    }
+
+    if ( list )
+    {
+        if ( CFGetTypeID( list ) == CFArrayGetTypeID( ) )
+        {
+            if ( __gDAProbeCacheList == NULL )
+            {
+                __gDAProbeCacheList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                assert( __gDAProbeCacheList );
+            }
+
+            CFArrayApplyFunction( list, CFRangeMake( 0, CFArrayGetCount( list ) ), __DAProbeCacheLoadEntry, __gDAProbeCacheList );
+
+            DALogDebug( "  restored %ld probe results.", ( long ) CFDictionaryGetCount( __gDAProbeCacheList ) );
+        }
+
+        CFRelease( list );
+    }
+}
+
+void DAProbeCacheRemoveAllEntries( void )
+{
+    if ( __gDAProbeCacheList )
+    {
+        CFDictionaryRemoveAllValues( __gDAProbeCacheList );
+
+        __gDAProbeCacheDirty = TRUE;
+    }
+}
+
+void DAProbeCacheRemoveEntry( DADiskRef disk )
+{
+    if ( __gDAProbeCacheList )
+    {
+        CFTypeRef key;
+
+        key = __DAProbeCacheCreateKey( disk );
+
+        if ( key )
+        {
+            CFDictionaryRemoveValue( __gDAProbeCacheList, key );
+
+            __gDAProbeCacheDirty = TRUE;
+
+            CFRelease( key );
+        }
+    }
+}
+
+void DAProbeCacheSave( void )
+{
+    /*
+     * Save the complete probe results for the benefit of the next instance of the daemon, should we
+     * be restarted.  The file is replaced atomically.
+     */
+
+    if ( __gDAProbeCacheDirty )
+    {
+        CFMutableArrayRef list;
+
+        list = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( list )
+        {
+            CFDataRef data;
+
+            if ( __gDAProbeCacheList )
+            {
+                CFDictionaryApplyFunction( __gDAProbeCacheList, __DAProbeCacheSaveEntry, list );
+            }
+
+            data = CFPropertyListCreateData( kCFAllocatorDefault, list, kCFPropertyListBinaryFormat_v1_0, 0, NULL );
+
+            if ( data )
+            {
+                char path[MAXPATHLEN];
+                int  file;
+
+                snprintf( path, sizeof( path ), "%s.new", __kDAProbeCachePath );
+
+                file = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0600 );
+
+                if ( file != -1 )
                 {
-                    if ( ( vs->vs_ops & VSDB_PERM ) )
+                    ssize_t count;
+
+                    count = write( file, CFDataGetBytePtr( data ), CFDataGetLength( data ) );
+
+                    close( file );
+
+                    if ( count == CFDataGetLength( data ) && rename( path, __kDAProbeCachePath ) == 0 )
                     {
-                        CFStringAppend( options, CFSTR( "owners" ) );
-                        CFStringAppend( options, CFSTR( "," ) );
+                        __gDAProbeCacheDirty = FALSE;
                     }
                     else
                     {
-                        CFStringAppend( options, CFSTR( "noowners" ) );
-                        CFStringAppend( options, CFSTR( "," ) );
+                        unlink( path );
                     }
+                }
 
-                    if ( CFStringGetLength( options ) )
+                CFRelease( data );
+            }
+
+            CFRelease( list );
+        }
+    }
+}
+
+void DAProbeCacheSetDigest( DADiskRef disk, CFDataRef digest )
+{
+    /*
+     * Open an entry for the probe in progress.  The entry is completed by DAProbeCacheSetResult(),
+     * unless it is invalidated in the meantime.
+     */
+
+    CFTypeRef key;
+
+    if ( __gDAProbeCacheList == NULL )
+    {
+        __gDAProbeCacheList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDAProbeCacheList );
+    }
+
+    if ( CFDictionaryGetCount( __gDAProbeCacheList ) >= __kDAProbeCacheLimit )
+    {
+        CFDictionaryRemoveAllValues( __gDAProbeCacheList );
+    }
+
+    key = __DAProbeCacheCreateKey( disk );
+
+    if ( key )
+    {
+        CFMutableDictionaryRef entry;
+
+        entry = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( entry )
+        {
+            uint64_t id;
+
+            CFDictionarySetValue( entry, kDAProbeCacheDigestKey, digest );
+
+            /*
+             * Record the media object as well, so that a restart can tell whether it stayed attached.
+             */
+
+            if ( DADiskGetIOMedia( disk ) )
+            {
+                if ( IORegistryEntryGetRegistryEntryID( DADiskGetIOMedia( disk ), &id ) == KERN_SUCCESS )
+                {
+                    CFNumberRef number;
+
+                    number = CFNumberCreate( kCFAllocatorDefault, kCFNumberSInt64Type, &id );
+
+                    if ( number )
                     {
-                        CFStringTrim( options, CFSTR( "," ) );
+                        CFDictionarySetValue( entry, __kDAProbeCacheMediaIDKey, number );
 
-                        CFDictionarySetValue( map, kDAMountMapMountOptionsKey, options );
+                        CFRelease( number );
                     }
+                }
+            }
 
-                    CFRelease( options );
+            CFDictionarySetValue( __gDAProbeCacheList, key, entry );
+
+            CFRelease( entry );
+        }
+
+        CFRelease( key );
+    }
+}
+
+void DAProbeCacheSetResult( DADiskRef disk, DAFileSystemRef filesystem, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid )
+{
+    if ( __gDAProbeCacheList )
+    {
+        CFTypeRef key;
+
+        key = __DAProbeCacheCreateKey( disk );
+
+        if ( key )
+        {
+            CFMutableDictionaryRef entry;
+
+            entry = ( void * ) CFDictionaryGetValue( __gDAProbeCacheList, key );
+
+            if ( entry )
+            {
+                CFDictionarySetValue( entry, kDAFileSystemKey, filesystem );
+
+                /*
+                 * Only the need for a repair is kept, as a clean state must be established afresh.
+                 */
+
+                if ( clean == kCFBooleanFalse )
+                {
+                    CFDictionarySetValue( entry, kDAProbeCacheVolumeCleanKey, clean );
+                }
+                else
+                {
+                    CFDictionaryRemoveValue( entry, kDAProbeCacheVolumeCleanKey );
                 }
 
-                CFDictionarySetValue( map, kDAMountMapProbeIDKey, id );
+                if ( name  )  CFDictionarySetValue( entry, kDAProbeCacheVolumeNameKey,  name  );
+                if ( uuid  )  CFDictionarySetValue( entry, kDAProbeCacheVolumeUUIDKey,  uuid  );
+
+                __gDAProbeCacheDirty = TRUE;
             }
 
-            CFRelease( id );
+            CFRelease( key );
         }
+    }
+}
 
-        CFRelease( idAsString );
+CFUUIDRef DARepairListGetVolumeUUID( DADiskRef disk, CFDataRef digest )
+{
+    /*
+     * Obtain the volume last known to be clean on this media object, provided that the media content
+     * is unchanged since and that the volume has not been mounted writable since.
+     */
+
+    CFUUIDRef uuid = NULL;
+
+    if ( __gDARepairList && digest )
+    {
+        CFTypeRef key;
+
+        key = __DAProbeCacheCreateKey( disk );
+
+        if ( key )
+        {
+            CFDictionaryRef entry;
+
+            entry = CFDictionaryGetValue( __gDARepairList, key );
+
+            if ( entry )
+            {
+                if ( CFEqual( CFDictionaryGetValue( entry, kDAProbeCacheDigestKey ), digest ) )
+                {
+                    uuid = CFDictionaryGetValue( entry, kDAProbeCacheVolumeUUIDKey );
+                }
+            }
+
+            CFRelease( key );
+        }
     }
 
-    return map;
+    return uuid;
 }
 
-void DAMountMapListRefresh2( void )
+void DARepairListRemoveEntry( DADiskRef disk )
 {
-    struct stat status;
+    if ( __gDARepairList )
+    {
+        CFTypeRef key;
+
+        key = __DAProbeCacheCreateKey( disk );
+
+        if ( key )
+        {
+            CFDictionaryRemoveValue( __gDARepairList, key );
+
+            CFRelease( key );
+        }
+    }
+}
 
+void DARepairListSetEntry( DADiskRef disk, CFUUIDRef uuid, CFDataRef digest )
+{
     /*
-     * Determine whether the mount map list is up-to-date.
+     * Record the volume as clean, whether by its "is clean" check or by its repair, along with the
+     * media content at that time.  The entry stands until the volume is mounted writable or until
+     * the media object disappears.
      */
 
-    if ( stat( _PATH_VSDB, &status ) )
+    CFTypeRef key;
+
+    if ( __gDARepairList == NULL )
     {
-        __gDAMountMapListTime2.tv_sec  = 0;
-        __gDAMountMapListTime2.tv_nsec = 0;
+        __gDARepairList = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        assert( __gDARepairList );
     }
 
-    if ( __gDAMountMapListTime2.tv_sec  != status.st_mtimespec.tv_sec  ||
-         __gDAMountMapListTime2.tv_nsec != status.st_mtimespec.tv_nsec )
+    if ( CFDictionaryGetCount( __gDARepairList ) >= __kDAProbeCacheLimit )
     {
-        __gDAMountMapListTime2.tv_sec  = status.st_mtimespec.tv_sec;
-        __gDAMountMapListTime2.tv_nsec = status.st_mtimespec.tv_nsec;
+        CFDictionaryRemoveAllValues( __gDARepairList );
+    }
+
+    key = __DAProbeCacheCreateKey( disk );
+
+    if ( key )
+    {
+        CFMutableDictionaryRef entry;
+
+        entry = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( entry )
+        {
+            CFDictionarySetValue( entry, kDAProbeCacheDigestKey,     digest );
+            CFDictionarySetValue( entry, kDAProbeCacheVolumeUUIDKey, uuid   );
+
+            CFDictionarySetValue( __gDARepairList, key, entry );
+
+            CFRelease( entry );
+        }
+
+        CFRelease( key );
+    }
+}
+
+CFDictionaryRef DAStatisticsCreate( void )
+{
+    /*
+     * Create a snapshot of the daemon's internal statistics, for those who monitor it.  The times
+     * are in milliseconds and the sizes in bytes.
+     */
+
+    CFMutableDictionaryRef statistics;
+
+    statistics = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+    if ( statistics )
+    {
+        CFDictionaryRef        latency;
+        CFMutableDictionaryRef probe;
+        CFMutableArrayRef      sessions;
+
+        ___CFDictionarySetIntegerValue( statistics, CFSTR( "Commands"  ), DACommandGetCount( ) );
+        ___CFDictionarySetIntegerValue( statistics, CFSTR( "Disks"     ), CFArrayGetCount( gDADiskList ) );
+        ___CFDictionarySetIntegerValue( statistics, CFSTR( "Requests"  ), CFArrayGetCount( gDARequestList ) );
+        ___CFDictionarySetIntegerValue( statistics, CFSTR( "Responses" ), CFArrayGetCount( gDAResponseList ) );
+        ___CFDictionarySetIntegerValue( statistics, CFSTR( "Threads"   ), DAThreadGetCount( ) );
 
         /*
-         * Clear the mount map list.
+         * Account for the probe cache.
          */
 
-        CFArrayRemoveAllValues( gDAMountMapList2 );
+        probe = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+        if ( probe )
+        {
+            ___CFDictionarySetIntegerValue( probe, CFSTR( "Count"  ), __gDAProbeCacheList ? CFDictionaryGetCount( __gDAProbeCacheList ) : 0 );
+            ___CFDictionarySetIntegerValue( probe, CFSTR( "Hits"   ), __gDAProbeCacheHitCount );
+            ___CFDictionarySetIntegerValue( probe, CFSTR( "Misses" ), __gDAProbeCacheMissCount );
+
+            CFDictionarySetValue( statistics, CFSTR( "ProbeCache" ), probe );
+
+            CFRelease( probe );
+        }
 
         /*
-         * Build the mount map list.
+         * Account for the sessions, whose callback queues are where a slow client shows first.
          */
 
-        if ( setvsent( ) )
+        sessions = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
+
+        if ( sessions )
         {
-            struct vsdb * item;
+            CFIndex count;
+            CFIndex index;
 
-            while ( ( item = getvsent( ) ) )
+            count = CFArrayGetCount( gDASessionList );
+
+            for ( index = 0; index < count; index++ )
             {
-                CFDictionaryRef map;
+                CFMutableDictionaryRef entry;
+                DASessionRef           session;
 
-                map = __DAMountMapCreate2( kCFAllocatorDefault, item );
+                session = ( void * ) CFArrayGetValueAtIndex( gDASessionList, index );
 
-                if ( map )
+                entry = CFDictionaryCreateMutable( kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks );
+
+                if ( entry )
                 {
-                    CFArrayAppendValue( gDAMountMapList2, map );
+                    CFStringRef name;
 
-                    CFRelease( map );
+                    name = CFStringCreateWithCString( kCFAllocatorDefault, _DASessionGetName( session ), kCFStringEncodingUTF8 );
+
+                    if ( name )
+                    {
+                        CFDictionarySetValue( entry, CFSTR( "Name" ), name );
+
+                        CFRelease( name );
+                    }
+
+                    ___CFDictionarySetIntegerValue( entry, CFSTR( "QueueCount" ), CFArrayGetCount( DASessionGetCallbackQueue( session ) ) );
+                    ___CFDictionarySetIntegerValue( entry, CFSTR( "QueueDrops" ), DASessionGetQueueDrops( session ) );
+                    ___CFDictionarySetIntegerValue( entry, CFSTR( "QueueSize"  ), DASessionGetQueueSize( session ) );
+                    ___CFDictionarySetIntegerValue( entry, CFSTR( "QueueTime"  ), DASessionGetQueueUsage( session ) * 1000 );
+
+                    CFDictionarySetValue( entry, CFSTR( "Timeout" ), DASessionGetState( session, kDASessionStateTimeout ) ? kCFBooleanTrue : kCFBooleanFalse );
+
+                    CFArrayAppendValue( sessions, entry );
+
+                    CFRelease( entry );
                 }
             }
 
-            endvsent( );
+            CFDictionarySetValue( statistics, CFSTR( "Sessions" ), sessions );
+
+            CFRelease( sessions );
+        }
+
+        /*
+         * Account for the stage and request latencies.
+         */
+
+        latency = DALatencyListCreateSummary( );
+
+        if ( latency )
+        {
+            CFDictionarySetValue( statistics, CFSTR( "Latency" ), latency );
+
+            CFRelease( latency );
         }
     }
+
+    return statistics;
 }
 
-static struct timespec __gDAPreferenceListTime1 = { 0, 0 };
-static struct timespec __gDAPreferenceListTime2 = { 0, 0 };
+struct __DAUnit
+{
+    CFMutableArrayRef disks;
+    UInt32            shared;
+    DAUnitState       state;
+};
 
-const CFStringRef kDAPreferenceMountDeferExternalKey  = CFSTR( "DAMountDeferExternal"  );
-const CFStringRef kDAPreferenceMountDeferInternalKey  = CFSTR( "DAMountDeferInternal"  );
-const CFStringRef kDAPreferenceMountDeferRemovableKey = CFSTR( "DAMountDeferRemovable" );
-const CFStringRef kDAPreferenceMountTrustExternalKey  = CFSTR( "DAMountTrustExternal"  );
-const CFStringRef kDAPreferenceMountTrustInternalKey  = CFSTR( "DAMountTrustInternal"  );
-const CFStringRef kDAPreferenceMountTrustRemovableKey = CFSTR( "DAMountTrustRemovable" );
+typedef struct __DAUnit __DAUnit;
 
-void DAPreferenceListRefresh( void )
-{
-    struct stat status1;
-    struct stat status2;
+static __DAUnit * __gDAUnitList      = NULL;
+static CFIndex    __gDAUnitListCount = 0;
 
+static __DAUnit * __DAUnitListGetUnit( DADiskRef disk, Boolean create )
+{
     /*
-     * Determine whether the preference list is up-to-date.
+     * Obtain the entry for the unit of the specified disk object.  The table is indexed by unit
+     * number, past a first entry that is set aside for the disk objects without a unit, such as
+     * those of network volumes, which share a disk list yet carry no unit state.
      */
 
-    if ( stat( ___PREFS_DEFAULT_DIR "/" "autodiskmount.plist", &status1 ) )
-    {
-        __gDAPreferenceListTime1.tv_sec  = 0;
-        __gDAPreferenceListTime1.tv_nsec = 0;
-    }
+    CFIndex index;
 
-    if ( stat( ___PREFS_DEFAULT_DIR "/" _kDADaemonName ".plist", &status2 ) )
-    {
-        __gDAPreferenceListTime2.tv_sec  = 0;
-        __gDAPreferenceListTime2.tv_nsec = 0;
-    }
+    index = ( ( SInt32 ) DADiskGetBSDUnit( disk ) ) + 1;
 
-    if ( __gDAPreferenceListTime1.tv_sec  != status1.st_mtimespec.tv_sec  ||
-         __gDAPreferenceListTime1.tv_nsec != status1.st_mtimespec.tv_nsec ||
-         __gDAPreferenceListTime2.tv_sec  != status2.st_mtimespec.tv_sec  ||
-         __gDAPreferenceListTime2.tv_nsec != status2.st_mtimespec.tv_nsec )
+    if ( index < 0 )  return NULL;
+
+    if ( index >= __gDAUnitListCount )
     {
-        SCPreferencesRef preferences;
+        __DAUnit * list;
+        CFIndex    count;
 
-        __gDAPreferenceListTime1.tv_sec  = status1.st_mtimespec.tv_sec;
-        __gDAPreferenceListTime1.tv_nsec = status1.st_mtimespec.tv_nsec;
-        __gDAPreferenceListTime2.tv_sec  = status2.st_mtimespec.tv_sec;
-        __gDAPreferenceListTime2.tv_nsec = status2.st_mtimespec.tv_nsec;
+        if ( create == FALSE )  return NULL;
 
-        /*
-         * Clear the preference list.
-         */
+        count = MAX( index + 1, __gDAUnitListCount * 2 );
+        count = MAX( count, 16 );
 
-        CFDictionaryRemoveAllValues( gDAPreferenceList );
+        list = realloc( __gDAUnitList, count * sizeof( __DAUnit ) );
 
-        /*
-         * Build the preference list.
-         */
+        assert( list );
 
-        preferences = SCPreferencesCreate( kCFAllocatorDefault, CFSTR( "autodiskmount" ), CFSTR( "autodiskmount.plist" ) );
+        memset( list + __gDAUnitListCount, 0, ( count - __gDAUnitListCount ) * sizeof( __DAUnit ) );
 
-        if ( preferences )
-        {
-            CFTypeRef value;
+        __gDAUnitList      = list;
+        __gDAUnitListCount = count;
+    }
 
-            value = SCPreferencesGetValue( preferences, CFSTR( "AutomountDisksWithoutUserLogin" ) );
+    return __gDAUnitList + index;
+}
 
-            if ( value == kCFBooleanTrue )
-            {
-                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferExternalKey,  kCFBooleanFalse );
-                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferRemovableKey, kCFBooleanFalse );
-                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustExternalKey,  kCFBooleanTrue  );
-            }
-            else if ( value == kCFBooleanFalse )
-            {
-                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferExternalKey,  kCFBooleanFalse );
-                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferRemovableKey, kCFBooleanTrue  );
-                CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustExternalKey,  kCFBooleanTrue  );
-            }
+static __DAUnit * __DAUnitListGetUnitWithState( DADiskRef disk, Boolean create )
+{
+    return ( ( SInt32 ) DADiskGetBSDUnit( disk ) < 0 ) ? NULL : __DAUnitListGetUnit( disk, create );
+}
 
-            CFRelease( preferences );
-        }
+static void __DAUnitListAddDisk( DADiskRef disk )
+{
+    __DAUnit * unit;
 
-        preferences = SCPreferencesCreate( kCFAllocatorDefault, CFSTR( _kDADaemonName ), CFSTR( _kDADaemonName ".plist" ) );
+    unit = __DAUnitListGetUnit( disk, TRUE );
 
-        if ( preferences )
+    if ( unit )
+    {
+        if ( unit->disks )
         {
-            CFTypeRef value;
+            /*
+             * Mirror the order of the disk list, in which the most recent disk object comes first.
+             */
 
-            value = SCPreferencesGetValue( preferences, kDAPreferenceMountDeferExternalKey );
+            CFArrayInsertValueAtIndex( unit->disks, 0, disk );
+        }
+        else
+        {
+            unit->disks = CFArrayCreateMutable( kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks );
 
-            if ( value )
+            if ( unit->disks )
             {
-                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
-                {
-                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferExternalKey, value );
-                }
+                CFArrayAppendValue( unit->disks, disk );
             }
+        }
+    }
+}
 
-            value = SCPreferencesGetValue( preferences, kDAPreferenceMountDeferInternalKey );
+static void __DAUnitListRemoveDisk( DADiskRef disk )
+{
+    __DAUnit * unit;
 
-            if ( value )
-            {
-                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
-                {
-                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferInternalKey, value );
-                }
-            }
+    unit = __DAUnitListGetUnit( disk, FALSE );
 
-            value = SCPreferencesGetValue( preferences, kDAPreferenceMountDeferRemovableKey );
+    if ( unit )
+    {
+        if ( unit->disks )
+        {
+            CFIndex index;
 
-            if ( value )
+            index = CFArrayGetFirstIndexOfValue( unit->disks, CFRangeMake( 0, CFArrayGetCount( unit->disks ) ), disk );
+
+            if ( index != kCFNotFound )
             {
-                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
-                {
-                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountDeferRemovableKey, value );
-                }
+                CFArrayRemoveValueAtIndex( unit->disks, index );
             }
 
-            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTrustExternalKey );
-
-            if ( value )
+            if ( CFArrayGetCount( unit->disks ) == 0 )
             {
-                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
-                {
-                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustExternalKey, value );
-                }
+                CFRelease( unit->disks );
+
+                unit->disks = NULL;
             }
+        }
+    }
+}
 
-            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTrustInternalKey );
+Boolean DAUnitAcquireSharedCommand( DADiskRef disk )
+{
+    /*
+     * Commands that can safely run side by side on a unit, such as the unmounts that make up a
+     * whole-disk unmount, share the active state of the unit.  The unit only becomes available
+     * to other commands once the last of them is released.
+     */
 
-            if ( value )
-            {
-                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
-                {
-                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustInternalKey, value );
-                }
-            }
+    __DAUnit * unit;
 
-            value = SCPreferencesGetValue( preferences, kDAPreferenceMountTrustRemovableKey );
+    unit = __DAUnitListGetUnitWithState( disk, TRUE );
 
-            if ( value )
+    if ( unit )
+    {
+        if ( ( unit->state & kDAUnitStateCommandActive ) )
+        {
+            if ( ( unit->state & kDAUnitStateCommandShared ) == 0 )
             {
-                if ( CFGetTypeID( value ) == CFBooleanGetTypeID( ) )
-                {
-                    CFDictionarySetValue( gDAPreferenceList, kDAPreferenceMountTrustRemovableKey, value );
-                }
+                return FALSE;
             }
-
-            CFRelease( preferences );
         }
+
+        unit->state |= kDAUnitStateCommandActive | kDAUnitStateCommandShared;
+
+        unit->shared++;
+
+        return TRUE;
     }
+
+    return FALSE;
 }
 
-struct __DAUnit
+CFArrayRef DAUnitGetDiskList( DADiskRef disk )
 {
-    DAUnitState state;
-};
+    __DAUnit * unit;
 
-typedef struct __DAUnit __DAUnit;
+    unit = __DAUnitListGetUnit( disk, FALSE );
+
+    return unit ? unit->disks : NULL;
+}
 
 Boolean DAUnitGetState( DADiskRef disk, DAUnitState state )
 {
-    CFNumberRef key;
+    __DAUnit * unit;
 
-    key = DADiskGetDescription( disk, kDADiskDescriptionMediaBSDUnitKey );
+    unit = __DAUnitListGetUnitWithState( disk, FALSE );
 
-    if ( key )
-    {
-        CFMutableDataRef data;
+    return ( unit && ( unit->state & state ) ) ? TRUE : FALSE;
+}
 
-        data = ( CFMutableDataRef ) CFDictionaryGetValue( gDAUnitList, key );
+void DAUnitReleaseSharedCommand( DADiskRef disk )
+{
+    __DAUnit * unit;
 
-        if ( data )
-        {
-            __DAUnit * unit;
+    unit = __DAUnitListGetUnitWithState( disk, FALSE );
 
-            unit = ( void * ) CFDataGetMutableBytePtr( data );
+    if ( unit )
+    {
+        if ( unit->shared )
+        {
+            unit->shared--;
+        }
 
-            return ( unit->state & state ) ? TRUE : FALSE;
+        if ( unit->shared == 0 )
+        {
+            unit->state &= ~( kDAUnitStateCommandActive | kDAUnitStateCommandShared );
         }
     }
-
-    return FALSE;
 }
 
 void DAUnitSetState( DADiskRef disk, DAUnitState state, Boolean value )
 {
-    CFNumberRef key;
+    __DAUnit * unit;
 
-    key = DADiskGetDescription( disk, kDADiskDescriptionMediaBSDUnitKey );
+    unit = __DAUnitListGetUnitWithState( disk, TRUE );
 
-    if ( key )
+    if ( unit )
     {
-        CFMutableDataRef data;
+        unit->state &= ~state;
+        unit->state |= value ? state : 0;
+    }
+}
 
-        data = ( CFMutableDataRef ) CFDictionaryGetValue( gDAUnitList, key );
+static CFFileDescriptorRef __gDAWatchDescriptor = NULL;
+static int                 __gDAWatchQueue      = -1;
 
-        if ( data )
+static void __DAWatchCallback( CFFileDescriptorRef descriptor, CFOptionFlags callBackTypes, void * info )
+{
+    struct kevent   event;
+    struct timespec timeout = { 0, 0 };
+
+    while ( kevent( __gDAWatchQueue, NULL, 0, &event, 1, &timeout ) > 0 )
+    {
+        __DAWatch * watch;
+
+        watch = ( void * ) event.udata;
+
+        watch->changed = TRUE;
+    }
+
+    CFFileDescriptorEnableCallBacks( descriptor, kCFFileDescriptorReadCallBack );
+
+    /*
+     * Reload the tables that changed now, rather than on the way to the next probe.
+     */
+
+    DAFileSystemListRefresh( );
+
+    DAMountMapListRefresh1( );
+
+    DAMountMapListRefresh2( );
+}
+
+static void __DAWatchInitialize( void )
+{
+    if ( __gDAWatchQueue == -1 )
+    {
+        __gDAWatchQueue = kqueue( );
+
+        if ( __gDAWatchQueue != -1 )
         {
-            __DAUnit * unit;
+            __gDAWatchDescriptor = CFFileDescriptorCreate( kCFAllocatorDefault, __gDAWatchQueue, TRUE, __DAWatchCallback, NULL );
+
+            if ( __gDAWatchDescriptor )
+            {
+                CFRunLoopSourceRef source;
+
+                source = CFFileDescriptorCreateRunLoopSource( kCFAllocatorDefault, __gDAWatchDescriptor, 0 );
+
+                if ( source )
+                {
+                    CFRunLoopAddSource( CFRunLoopGetCurrent( ), source, kCFRunLoopDefaultMode );
+
+                    CFRelease( source );
+                }
 
-            unit = ( void * ) CFDataGetMutableBytePtr( data );
+                CFFileDescriptorEnableCallBacks( __gDAWatchDescriptor, kCFFileDescriptorReadCallBack );
+            }
+            else
+            {
+                close( __gDAWatchQueue );
 
-            unit->state &= ~state;
-            unit->state |= value ? state : 0;
+                __gDAWatchQueue = -2;
+            }
         }
         else
         {
-            data = CFDataCreateMutable( kCFAllocatorDefault, sizeof( __DAUnit ) );
+            __gDAWatchQueue = -2;
+        }
+    }
+}
 
-            if ( data )
-            {
-                __DAUnit * unit;
+static Boolean __DAWatchGetChanged( __DAWatch * watch )
+{
+    /*
+     * Determine whether the watched path might have changed since the last call, and re-arm the
+     * watch.  Without a watch in place, as when kqueue is unavailable, we cannot tell, so the
+     * caller falls back to looking at the path itself.  A path that does not exist is watched
+     * through the folder it would appear in.
+     */
 
-                unit = ( void * ) CFDataGetMutableBytePtr( data );
+    __DAWatchInitialize( );
 
-                unit->state = value ? state : 0;
+    if ( watch->fd != -1 && watch->changed == FALSE )
+    {
+        return FALSE;
+    }
 
-                CFDictionarySetValue( gDAUnitList, key, data );
+    watch->changed = FALSE;
 
-                CFRelease( data );
+    if ( watch->fd != -1 )
+    {
+        close( watch->fd );
+
+        watch->fd = -1;
+    }
+
+    if ( __gDAWatchQueue >= 0 )
+    {
+        watch->fd = open( watch->path, O_EVTONLY );
+
+        if ( watch->fd == -1 )
+        {
+            char path[PATH_MAX];
+
+            strlcpy( path, watch->path, sizeof( path ) );
+
+            watch->fd = open( dirname( path ), O_EVTONLY );
+        }
+
+        if ( watch->fd != -1 )
+        {
+            struct kevent event;
+
+            EV_SET( &event, watch->fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_ATTRIB | NOTE_DELETE | NOTE_EXTEND | NOTE_RENAME | NOTE_WRITE, 0, watch );
+
+            if ( kevent( __gDAWatchQueue, &event, 1, NULL, 0, NULL ) == -1 )
+            {
+                close( watch->fd );
+
+                watch->fd = -1;
             }
         }
     }
+
+    return TRUE;
 }
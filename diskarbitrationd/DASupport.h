@@ -51,9 +51,37 @@ extern void DAAuthorizeWithCallback( DASessionRef        session,
                                      void *              callbackContext,
                                      const char *        right );
 
+extern void       DADiskListAddDisk( DADiskRef disk );
+extern CFArrayRef DADiskListCopyDisksWithUserUID( uid_t userUID );
+extern DADiskRef  DADiskListGetDisk( const char * id );
+extern DADiskRef  DADiskListGetDiskWithBSDNode( dev_t node );
+extern DADiskRef  DADiskListGetDiskWithIOMedia( io_service_t media );
+extern void       DADiskListRemoveDisk( DADiskRef disk );
+
 extern const CFStringRef kDAFileSystemKey; /* ( DAFileSystem ) */
 
-extern void DAFileSystemListRefresh( void );
+extern void              DAFileSystemListRefresh( void );
+extern CFMutableArrayRef DAFileSystemProbeListCreateCandidates( DADiskRef disk );
+
+enum
+{
+    kDALatencyPhaseStageProbe,
+    kDALatencyPhaseStagePeek,
+    kDALatencyPhaseStageAppear,
+    kDALatencyPhaseStageApprove,
+    kDALatencyPhaseStageAuthorize,
+    kDALatencyPhaseStageMount,
+    kDALatencyPhaseRequestApprove,
+    kDALatencyPhaseRequestEject,
+    kDALatencyPhaseRequestMount,
+    kDALatencyPhaseRequestUnmount,
+    kDALatencyPhaseCount
+};
+
+typedef UInt32 DALatencyPhase;
+
+extern void            DALatencyListAddSample( DALatencyPhase phase, DADiskRef disk, CFAbsoluteTime start );
+extern CFDictionaryRef DALatencyListCreateSummary( void );
 
 extern const CFStringRef kDAMountMapMountAutomaticKey; /* ( CFBoolean ) */
 extern const CFStringRef kDAMountMapMountOptionsKey;   /* ( CFString  ) */
@@ -61,28 +89,61 @@ extern const CFStringRef kDAMountMapMountPathKey;      /* ( CFURL     ) */
 extern const CFStringRef kDAMountMapProbeIDKey;        /* ( CFUUID    ) */
 extern const CFStringRef kDAMountMapProbeKindKey;      /* ( CFString  ) */
 
-extern void DAMountMapListRefresh1( void );
-extern void DAMountMapListRefresh2( void );
+extern CFDictionaryRef DAMountMapListGetMap1( DADiskRef disk );
+extern CFDictionaryRef DAMountMapListGetMap2( DADiskRef disk );
+extern void            DAMountMapListRefresh1( void );
+extern void            DAMountMapListRefresh2( void );
 
+extern const CFStringRef kDAPreferenceIgnoreKey;              /* ( CFArray   ) */
 extern const CFStringRef kDAPreferenceMountDeferExternalKey;  /* ( CFBoolean ) */
 extern const CFStringRef kDAPreferenceMountDeferInternalKey;  /* ( CFBoolean ) */
 extern const CFStringRef kDAPreferenceMountDeferRemovableKey; /* ( CFBoolean ) */
+extern const CFStringRef kDAPreferenceMountTimeoutKey;        /* ( CFNumber  ) */
 extern const CFStringRef kDAPreferenceMountTrustExternalKey;  /* ( CFBoolean ) */
 extern const CFStringRef kDAPreferenceMountTrustInternalKey;  /* ( CFBoolean ) */
 extern const CFStringRef kDAPreferenceMountTrustRemovableKey; /* ( CFBoolean ) */
-
-extern void DAPreferenceListRefresh( void );
+extern const CFStringRef kDAPreferenceProbeConcurrencyKey;    /* ( CFNumber  ) */
+extern const CFStringRef kDAPreferenceProbeTimeoutKey;        /* ( CFNumber  ) */
+extern const CFStringRef kDAPreferenceRepairTimeoutKey;       /* ( CFNumber  ) */
+
+extern Boolean DAPreferenceListGetIgnore( io_service_t media );
+extern void    DAPreferenceListRefresh( void );
+
+extern const CFStringRef kDAProbeCacheDigestKey;      /* ( CFData    ) */
+extern const CFStringRef kDAProbeCacheVolumeCleanKey; /* ( CFBoolean ) */
+extern const CFStringRef kDAProbeCacheVolumeNameKey;  /* ( CFString  ) */
+extern const CFStringRef kDAProbeCacheVolumeUUIDKey;  /* ( CFUUID    ) */
+
+extern CFDataRef       DAProbeCacheCreateDigest( const char * path, UInt64 size );
+extern CFDataRef       DAProbeCacheGetDigest( DADiskRef disk );
+extern CFDictionaryRef DAProbeCacheGetEntry( DADiskRef disk, CFDataRef digest );
+extern void            DAProbeCacheLoad( void );
+extern void            DAProbeCacheRemoveAllEntries( void );
+extern void            DAProbeCacheRemoveEntry( DADiskRef disk );
+extern void            DAProbeCacheSave( void );
+extern void            DAProbeCacheSetDigest( DADiskRef disk, CFDataRef digest );
+extern void            DAProbeCacheSetResult( DADiskRef disk, DAFileSystemRef filesystem, CFBooleanRef clean, CFStringRef name, CFUUIDRef uuid );
+
+extern CFUUIDRef DARepairListGetVolumeUUID( DADiskRef disk, CFDataRef digest );
+extern void      DARepairListRemoveEntry( DADiskRef disk );
+extern void      DARepairListSetEntry( DADiskRef disk, CFUUIDRef uuid, CFDataRef digest );
+
+extern CFDictionaryRef DAStatisticsCreate( void );
 
 enum
 {
     kDAUnitStateCommandActive    = 0x00000001,
+    kDAUnitStateCommandShared    = 0x00000002,
     kDAUnitStateStagedUnreadable = 0x00010000
 };
 
 typedef UInt32 DAUnitState;
 
-extern Boolean DAUnitGetState( DADiskRef disk, DAUnitState state );
-extern void    DAUnitSetState( DADiskRef disk, DAUnitState state, Boolean value );
+extern Boolean    DAUnitAcquireSharedCommand( DADiskRef disk );
+extern CFArrayRef DAUnitGetDiskList( DADiskRef disk );
+extern Boolean    DAUnitGetState( DADiskRef disk, DAUnitState state );
+extern void       DAUnitReleaseSharedCommand( DADiskRef disk );
+extern void       DAUnitSetState( DADiskRef disk, DAUnitState state, Boolean value );
 
 #ifdef __cplusplus
 }
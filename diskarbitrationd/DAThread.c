@@ -23,6 +23,8 @@
 
 #include "DAThread.h"
 
+#include "DALog.h"
+
 #include <pthread.h>
 #include <sysexits.h>
 #include <mach/mach.h>
@@ -43,9 +45,7 @@ struct __DAThreadRunLoopSourceJob
     {
         struct
         {
-            Boolean                 exited;
             int                     status;
-            pthread_t               thread;
             DAThreadExecuteCallback callback;
             void *                  callbackContext;
             DAThreadFunction        function;
@@ -56,61 +56,173 @@ struct __DAThreadRunLoopSourceJob
 
 typedef struct __DAThreadRunLoopSourceJob __DAThreadRunLoopSourceJob;
 
-static __DAThreadRunLoopSourceJob * __gDAThreadRunLoopSourceJobs = NULL;
-static pthread_mutex_t              __gDAThreadRunLoopSourceLock = PTHREAD_MUTEX_INITIALIZER;
-static CFMachPortRef                __gDAThreadRunLoopSourcePort = NULL;
+/*
+ * Jobs are run by a bounded pool of persistent worker threads.  A job waits on the pending queue
+ * until a worker is idle and moves to the exited queue once its function returns.  Both queues
+ * are FIFO, with O(1) insertion and removal.  A worker stops counting as idle as soon as a job
+ * is handed to it, rather than once it wakes up, so that a burst of jobs grows the pool instead
+ * of piling up behind a single worker.
+ *
+ * Jobs that may block for as long as it takes a user or a device to respond, such as an
+ * authorization prompt or an eject, are instead run on a thread of their own, outside of the pool,
+ * so that they cannot hold up the short jobs that the stages depend on.
+ */
 
-static void * __DAThreadFunction( void * context )
+static const UInt32 __kDAThreadPoolLimit = 16;
+
+static __DAThreadRunLoopSourceJob * __gDAThreadRunLoopSourceJobsExited     = NULL;
+static __DAThreadRunLoopSourceJob * __gDAThreadRunLoopSourceJobsExitedTail = NULL;
+static __DAThreadRunLoopSourceJob * __gDAThreadRunLoopSourceJobs           = NULL;
+static __DAThreadRunLoopSourceJob * __gDAThreadRunLoopSourceJobsTail       = NULL;
+static pthread_mutex_t              __gDAThreadRunLoopSourceLock           = PTHREAD_MUTEX_INITIALIZER;
+static CFMachPortRef                __gDAThreadRunLoopSourcePort           = NULL;
+static UInt32                       __gDAThreadRunLoopSourceJobsCount      = 0;
+static pthread_cond_t               __gDAThreadPoolCondition               = PTHREAD_COND_INITIALIZER;
+static UInt32                       __gDAThreadPoolCount                   = 0;
+static UInt32                       __gDAThreadPoolIdleCount               = 0;
+static UInt32                       __gDAThreadPoolWakeCount               = 0;
+
+static __DAThreadRunLoopSourceJob * __DAThreadCreateJob( DAThreadFunction function, void * functionContext, DAThreadExecuteCallback callback, void * callbackContext )
+{
+    __DAThreadRunLoopSourceJob * job;
+
+    job = malloc( sizeof( __DAThreadRunLoopSourceJob ) );
+
+    if ( job )
+    {
+        job->kind = __kDAThreadRunLoopSourceJobKindExecute;
+        job->next = NULL;
+
+        job->execute.status          = 0;
+        job->execute.callback        = callback;
+        job->execute.callbackContext = callbackContext;
+        job->execute.function        = function;
+        job->execute.functionContext = functionContext;
+    }
+
+    return job;
+}
+
+static void __DAThreadExitJob( __DAThreadRunLoopSourceJob * job )
 {
     /*
-     * Run a thread.
+     * Hand the job off to the run loop.
      */
 
-    __DAThreadRunLoopSourceJob * job;
+    mach_msg_header_t message;
+    kern_return_t     status;
+
+    job->next = NULL;
 
     pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
 
-    for ( job = __gDAThreadRunLoopSourceJobs; job; job = job->next )
+    if ( __gDAThreadRunLoopSourceJobsExitedTail )
     {
-        assert( job->kind == __kDAThreadRunLoopSourceJobKindExecute );
-
-        if ( pthread_equal( job->execute.thread, pthread_self( ) ) )
-        {
-            break;
-        }
+        __gDAThreadRunLoopSourceJobsExitedTail->next = job;
     }
+    else
+    {
+        __gDAThreadRunLoopSourceJobsExited = job;
+    }
+
+    __gDAThreadRunLoopSourceJobsExitedTail = job;
 
     pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
 
-    if ( job )
+    message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
+    message.msgh_id          = 0;
+    message.msgh_local_port  = MACH_PORT_NULL;
+    message.msgh_remote_port = CFMachPortGetPort( __gDAThreadRunLoopSourcePort );
+    message.msgh_reserved    = 0;
+    message.msgh_size        = sizeof( message );
+
+    status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+
+    if ( status == MACH_SEND_TIMED_OUT )
     {
-        mach_msg_header_t message;
-        kern_return_t     status;
+        mach_msg_destroy( &message );
+    }
+}
 
-        job->execute.status = ( ( DAThreadFunction ) job->execute.function )( job->execute.functionContext );
+static void * __DAThreadBlockingFunction( void * context )
+{
+    /*
+     * Run a thread for a single job that may block.
+     */
 
-        pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
+    __DAThreadRunLoopSourceJob * job = context;
 
-        job->execute.exited = TRUE;
+    assert( job->kind == __kDAThreadRunLoopSourceJobKindExecute );
 
-        pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+    job->execute.status = ( ( DAThreadFunction ) job->execute.function )( job->execute.functionContext );
+
+    __DAThreadExitJob( job );
+
+    return NULL;
+}
+
+static void * __DAThreadFunction( void * context )
+{
+    /*
+     * Run a worker thread.  The worker takes jobs off of the pending queue for as long as the
+     * daemon runs.
+     */
 
-        message.msgh_bits        = MACH_MSGH_BITS( MACH_MSG_TYPE_COPY_SEND, 0 );
-        message.msgh_id          = 0;
-        message.msgh_local_port  = MACH_PORT_NULL;
-        message.msgh_remote_port = CFMachPortGetPort( __gDAThreadRunLoopSourcePort );
-        message.msgh_reserved    = 0;
-        message.msgh_size        = sizeof( message );
+    pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
 
-        status = mach_msg( &message, MACH_SEND_MSG | MACH_SEND_TIMEOUT, message.msgh_size, 0, MACH_PORT_NULL, 0, MACH_PORT_NULL );
+    for ( ; ; )
+    {
+        __DAThreadRunLoopSourceJob * job;
 
-        if ( status == MACH_SEND_TIMED_OUT )
+        /*
+         * Obtain the next pending job.
+         */
+
+        while ( __gDAThreadRunLoopSourceJobs == NULL )
         {
-            mach_msg_destroy( &message );
+            __gDAThreadPoolIdleCount++;
+
+            pthread_cond_wait( &__gDAThreadPoolCondition, &__gDAThreadRunLoopSourceLock );
+
+            /*
+             * A hand-off has already taken us off of the idle count.
+             */
+
+            if ( __gDAThreadPoolWakeCount )
+            {
+                __gDAThreadPoolWakeCount--;
+            }
+            else
+            {
+                __gDAThreadPoolIdleCount--;
+            }
         }
+
+        job = __gDAThreadRunLoopSourceJobs;
+
+        __gDAThreadRunLoopSourceJobs = job->next;
+
+        if ( __gDAThreadRunLoopSourceJobs == NULL )
+        {
+            __gDAThreadRunLoopSourceJobsTail = NULL;
+        }
+
+        pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+
+        assert( job->kind == __kDAThreadRunLoopSourceJobKindExecute );
+
+        /*
+         * Run the job.
+         */
+
+        job->execute.status = ( ( DAThreadFunction ) job->execute.function )( job->execute.functionContext );
+
+        __DAThreadExitJob( job );
+
+        pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
     }
 
-    pthread_detach( pthread_self( ) );
+    pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
 
     return NULL;
 }
@@ -118,64 +230,50 @@ static void * __DAThreadFunction( void * context )
 static void __DAThreadRunLoopSourceCallback( CFMachPortRef port, void * message, CFIndex messageSize, void * info )
 {
     /*
-     * Process a DAThread CFRunLoopSource fire.
+     * Process a DAThread CFRunLoopSource fire.  We take the exited queue in whole, since a single
+     * fire may account for several jobs.
      */
 
-    __DAThreadRunLoopSourceJob * job     = NULL;
-    __DAThreadRunLoopSourceJob * jobLast = NULL;
+    __DAThreadRunLoopSourceJob * job;
+    __DAThreadRunLoopSourceJob * jobLast;
 
     pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
 
-    /*
-     * Scan through job list.
-     */
+    job = __gDAThreadRunLoopSourceJobsExited;
 
-    for ( job = __gDAThreadRunLoopSourceJobs; job; jobLast = NULL )
+    for ( jobLast = job; jobLast; jobLast = jobLast->next )
     {
-        for ( job = __gDAThreadRunLoopSourceJobs; job; jobLast = job, job = job->next )
-        {
-            assert( job->kind == __kDAThreadRunLoopSourceJobKindExecute );
+        __gDAThreadRunLoopSourceJobsCount--;
+    }
 
-            if ( job->execute.exited )
-            {
-                /*
-                 * Process the job's callback.
-                 */
+    __gDAThreadRunLoopSourceJobsExited     = NULL;
+    __gDAThreadRunLoopSourceJobsExitedTail = NULL;
 
-                if ( jobLast )
-                {
-                    jobLast->next = job->next;
-                }
-                else
-                {
-                    __gDAThreadRunLoopSourceJobs = job->next;
-                }
+    pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
 
-                pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+    while ( job )
+    {
+        __DAThreadRunLoopSourceJob * jobNext = job->next;
 
-                /*
-                 * Issue the callback.
-                 */
+        assert( job->kind == __kDAThreadRunLoopSourceJobKindExecute );
 
-                if ( job->execute.callback )
-                {
-                    ( job->execute.callback )( job->execute.status, job->execute.callbackContext );
-                }
+        /*
+         * Issue the callback.
+         */
 
-                /*
-                 * Release our resources.
-                 */
+        if ( job->execute.callback )
+        {
+            ( job->execute.callback )( job->execute.status, job->execute.callbackContext );
+        }
 
-                free( job );
+        /*
+         * Release our resources.
+         */
 
-                pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
+        free( job );
 
-                break;
-            }
-        }
+        job = jobNext;
     }
-
-    pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
 }
 
 CFRunLoopSourceRef DAThreadCreateRunLoopSource( CFAllocatorRef allocator, CFIndex order )
@@ -231,11 +329,11 @@ CFRunLoopSourceRef DAThreadCreateRunLoopSource( CFAllocatorRef allocator, CFInde
 void DAThreadExecute( DAThreadFunction function, void * functionContext, DAThreadExecuteCallback callback, void * callbackContext )
 {
     /*
-     * Execute a thread.
+     * Execute a function on a worker thread.
      */
 
-    pthread_t thread;
-    int       status;
+    __DAThreadRunLoopSourceJob * job;
+    int                          status = 0;
 
     /*
      * State our assumptions.
@@ -244,41 +342,162 @@ void DAThreadExecute( DAThreadFunction function, void * functionContext, DAThrea
     assert( __gDAThreadRunLoopSourcePort );
 
     /*
-     * Run the thread.
+     * Create the job.
      */
 
-    pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
-
-    status = pthread_create( &thread, NULL, __DAThreadFunction, NULL );
+    job = __DAThreadCreateJob( function, functionContext, callback, callbackContext );
 
-    if ( status == 0 )
+    if ( job )
     {
+        pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
+
         /*
-         * Register this callback job on our queue.
+         * Grow the worker pool if no worker is idle.
          */
 
-        __DAThreadRunLoopSourceJob * job;
+        if ( __gDAThreadPoolIdleCount == 0 && __gDAThreadPoolCount < __kDAThreadPoolLimit )
+        {
+            pthread_attr_t attributes;
+            pthread_t      thread;
+
+            pthread_attr_init( &attributes );
+
+            pthread_attr_setdetachstate( &attributes, PTHREAD_CREATE_DETACHED );
+
+            status = pthread_create( &thread, &attributes, __DAThreadFunction, NULL );
+
+            pthread_attr_destroy( &attributes );
+
+            if ( status == 0 )
+            {
+                __gDAThreadPoolCount++;
+            }
+            else if ( __gDAThreadPoolCount )
+            {
+                /*
+                 * Make do with the workers we have.
+                 */
+
+                status = 0;
+            }
+        }
+
+        if ( status == 0 )
+        {
+            /*
+             * Register this callback job on our queue.
+             */
+
+            if ( __gDAThreadRunLoopSourceJobsTail )
+            {
+                __gDAThreadRunLoopSourceJobsTail->next = job;
+            }
+            else
+            {
+                __gDAThreadRunLoopSourceJobs = job;
+            }
+
+            __gDAThreadRunLoopSourceJobsTail = job;
+
+            __gDAThreadRunLoopSourceJobsCount++;
+
+            /*
+             * Hand the job off to an idle worker.
+             */
+
+            if ( __gDAThreadPoolIdleCount )
+            {
+                __gDAThreadPoolIdleCount--;
+                __gDAThreadPoolWakeCount++;
+
+                pthread_cond_signal( &__gDAThreadPoolCondition );
+            }
+            else if ( __gDAThreadPoolCount == __kDAThreadPoolLimit )
+            {
+                DALogDebug( "  thread pool is at its limit of %u, job is waiting.", ( unsigned ) __kDAThreadPoolLimit );
+            }
+        }
 
-        job = malloc( sizeof( __DAThreadRunLoopSourceJob ) );
+        pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
 
-        if ( job )
+        if ( status )
         {
-            job->kind = __kDAThreadRunLoopSourceJobKindExecute;
-            job->next = __gDAThreadRunLoopSourceJobs;
-
-            job->execute.exited          = FALSE;
-            job->execute.status          = 0;
-            job->execute.thread          = thread;
-            job->execute.callback        = callback;
-            job->execute.callbackContext = callbackContext;
-            job->execute.function        = function;
-            job->execute.functionContext = functionContext;
-
-            __gDAThreadRunLoopSourceJobs = job;
+            free( job );
         }
     }
+    else
+    {
+        status = ENOMEM;
+    }
 
-    pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+    /*
+     * Complete the call in case we had a local failure.
+     */
+
+    if ( status )
+    {
+        if ( callback )
+        {
+            ( callback )( EX_OSERR, callbackContext );
+        }
+    }
+}
+
+void DAThreadExecuteBlocking( DAThreadFunction function, void * functionContext, DAThreadExecuteCallback callback, void * callbackContext )
+{
+    /*
+     * Execute a function that may block indefinitely on a thread of its own, outside of the pool.
+     */
+
+    __DAThreadRunLoopSourceJob * job;
+    int                          status = 0;
+
+    /*
+     * State our assumptions.
+     */
+
+    assert( __gDAThreadRunLoopSourcePort );
+
+    /*
+     * Create the job.
+     */
+
+    job = __DAThreadCreateJob( function, functionContext, callback, callbackContext );
+
+    if ( job )
+    {
+        pthread_attr_t attributes;
+        pthread_t      thread;
+
+        pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
+
+        __gDAThreadRunLoopSourceJobsCount++;
+
+        pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+
+        pthread_attr_init( &attributes );
+
+        pthread_attr_setdetachstate( &attributes, PTHREAD_CREATE_DETACHED );
+
+        status = pthread_create( &thread, &attributes, __DAThreadBlockingFunction, job );
+
+        pthread_attr_destroy( &attributes );
+
+        if ( status )
+        {
+            pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
+
+            __gDAThreadRunLoopSourceJobsCount--;
+
+            pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+
+            free( job );
+        }
+    }
+    else
+    {
+        status = ENOMEM;
+    }
 
     /*
      * Complete the call in case we had a local failure.
@@ -292,3 +511,20 @@ void DAThreadExecute( DAThreadFunction function, void * functionContext, DAThrea
         }
     }
 }
+
+UInt32 DAThreadGetCount( void )
+{
+    /*
+     * Obtain the number of jobs in flight, whether pending, running or awaiting their callback.
+     */
+
+    UInt32 count;
+
+    pthread_mutex_lock( &__gDAThreadRunLoopSourceLock );
+
+    count = __gDAThreadRunLoopSourceJobsCount;
+
+    pthread_mutex_unlock( &__gDAThreadRunLoopSourceLock );
+
+    return count;
+}
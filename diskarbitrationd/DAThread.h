@@ -38,6 +38,10 @@ extern CFRunLoopSourceRef DAThreadCreateRunLoopSource( CFAllocatorRef allocator,
 
 extern void DAThreadExecute( DAThreadFunction function, void * functionContext, DAThreadExecuteCallback callback, void * callbackContext );
 
+extern void DAThreadExecuteBlocking( DAThreadFunction function, void * functionContext, DAThreadExecuteCallback callback, void * callbackContext );
+
+extern UInt32 DAThreadGetCount( void );
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */